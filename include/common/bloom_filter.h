@@ -0,0 +1,82 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace baikaldb {
+// 简单bloom filter, 用两个32位hash组合出k个hash;
+// 由调用方计算64位hash, 两端hash算法需一致
+class BloomFilter {
+public:
+    // 按预估元素个数和误判率计算位数与hash个数
+    void init(size_t expected_num, double fp_rate) {
+        if (expected_num == 0) {
+            expected_num = 1;
+        }
+        double bits = -1.0 * expected_num * std::log(fp_rate) / (std::log(2) * std::log(2));
+        _num_bits = std::max<uint64_t>(64, ((uint64_t)bits + 63) / 64 * 64);
+        _num_hashes = std::max(1, std::min(30, (int)std::round(bits / expected_num * std::log(2))));
+        _bits.assign(_num_bits / 8, '\0');
+    }
+    int init_from_string(const std::string& bits, int num_hashes) {
+        if (bits.empty() || num_hashes <= 0) {
+            return -1;
+        }
+        _bits = bits;
+        _num_bits = bits.size() * 8;
+        _num_hashes = num_hashes;
+        return 0;
+    }
+    void add(uint64_t hash) {
+        uint32_t h1 = hash;
+        uint32_t h2 = (hash >> 32) | 1;
+        for (int i = 0; i < _num_hashes; ++i) {
+            uint64_t bit = (h1 + (uint64_t)i * h2) % _num_bits;
+            _bits[bit >> 3] |= (1 << (bit & 7));
+        }
+    }
+    bool may_contain(uint64_t hash) const {
+        if (_num_bits == 0) {
+            return true;
+        }
+        uint32_t h1 = hash;
+        uint32_t h2 = (hash >> 32) | 1;
+        for (int i = 0; i < _num_hashes; ++i) {
+            uint64_t bit = (h1 + (uint64_t)i * h2) % _num_bits;
+            if ((_bits[bit >> 3] & (1 << (bit & 7))) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    const std::string& bits() const {
+        return _bits;
+    }
+    int num_hashes() const {
+        return _num_hashes;
+    }
+
+private:
+    std::string _bits;
+    uint64_t _num_bits = 0;
+    int _num_hashes = 0;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,340 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#ifdef BAIDU_INTERNAL
+#include <bthread.h>
+#else
+#include <bthread/bthread.h>
+#endif
+#include <bthread/mutex.h>
+
+namespace baikaldb {
+// 读侧无锁的RCU: 读者按线程分散到多个槽计数, 写者切换phase后等待旧phase的读者退出
+// 读临界区内不能阻塞(不能加bthread锁), 否则写者会一直等待
+class RcuDomain {
+public:
+    struct ReadGuard {
+        uint32_t slot;
+        uint32_t phase;
+    };
+
+    static RcuDomain* get_instance() {
+        static RcuDomain domain;
+        return &domain;
+    }
+
+    ReadGuard read_lock() {
+        ReadGuard guard;
+        guard.slot = slot_idx();
+        Slot& slot = _slots[guard.slot];
+        while (true) {
+            guard.phase = _phase.load() & 1;
+            slot.readers[guard.phase].fetch_add(1);
+            // 计数前phase已切换, 重新计到新phase上, 避免写者等待时间过长
+            if ((_phase.load() & 1) == guard.phase) {
+                return guard;
+            }
+            slot.readers[guard.phase].fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void read_unlock(const ReadGuard& guard) {
+        _slots[guard.slot].readers[guard.phase].fetch_sub(1, std::memory_order_release);
+    }
+
+    // 返回时, 调用前开始的读临界区都已结束
+    void synchronize() {
+        BAIDU_SCOPED_LOCK(_sync_mutex);
+        uint32_t old_phase = _phase.fetch_add(1) & 1;
+        for (auto& slot : _slots) {
+            while (slot.readers[old_phase].load(std::memory_order_acquire) != 0) {
+                bthread_yield();
+            }
+        }
+    }
+
+private:
+    static const uint32_t SLOT_COUNT = 64;
+    struct alignas(64) Slot {
+        std::atomic<int64_t> readers[2];
+        Slot() {
+            readers[0] = 0;
+            readers[1] = 0;
+        }
+    };
+
+    RcuDomain() : _phase(0) {}
+
+    uint32_t slot_idx() {
+        static std::atomic<uint32_t> next_slot(0);
+        static thread_local uint32_t idx = next_slot.fetch_add(1, std::memory_order_relaxed) % SLOT_COUNT;
+        return idx;
+    }
+
+    std::atomic<uint32_t> _phase;
+    Slot _slots[SLOT_COUNT];
+    bthread::Mutex _sync_mutex;
+};
+
+// 接口与ThreadSafeMap一致, 读操作(get/exist/traverse等)不加锁
+// 每个桶是一份只读的unordered_map快照, 写操作在桶锁内复制快照修改后替换, 旧快照经过RCU后释放
+// 覆盖/删除value的写操作返回前旧快照已释放, value的析构(如事务回滚)不会被推迟
+// 回调拿到的是value的拷贝, 适合value为shared_ptr、读远多于写且单桶元素不多的场景
+template <typename KEY, typename VALUE, uint32_t MAP_COUNT = 64>
+class ConcurrentMap {
+    static_assert(MAP_COUNT > 0, "Invalid MAP_COUNT parameters.");
+    typedef std::unordered_map<KEY, VALUE> Map;
+    typedef std::shared_ptr<const Map> SmartMap;
+    // 原子指针只能指向普通对象, 用holder包一层shared_ptr
+    struct MapHolder {
+        SmartMap map;
+    };
+
+public:
+    ConcurrentMap() {
+        for (uint32_t i = 0; i < MAP_COUNT; i++) {
+            _buckets[i].holder.store(new MapHolder{std::make_shared<Map>()});
+        }
+    }
+    ~ConcurrentMap() {
+        RcuDomain::get_instance()->synchronize();
+        for (uint32_t i = 0; i < MAP_COUNT; i++) {
+            delete _buckets[i].holder.load();
+        }
+        for (auto holder : _retired) {
+            delete holder;
+        }
+    }
+
+    uint32_t count(const KEY& key) {
+        return exist(key) ? 1 : 0;
+    }
+    bool exist(const KEY& key) {
+        bool found = false;
+        read(key, [&found](const Map& map, const KEY& key) {
+            found = map.count(key) > 0;
+        });
+        return found;
+    }
+    uint32_t size() {
+        uint32_t size = 0;
+        for (uint32_t i = 0; i < MAP_COUNT; i++) {
+            size += snapshot(i)->size();
+        }
+        return size;
+    }
+    const VALUE get(const KEY& key) {
+        VALUE value = VALUE();
+        read(key, [&value](const Map& map, const KEY& key) {
+            auto iter = map.find(key);
+            if (iter != map.end()) {
+                value = iter->second;
+            }
+        });
+        return value;
+    }
+    // 回调在读临界区外执行, 可以加锁
+    bool call_and_get(const KEY& key, const std::function<void(VALUE& value)>& call) {
+        bool found = false;
+        VALUE value;
+        read(key, [&found, &value](const Map& map, const KEY& key) {
+            auto iter = map.find(key);
+            if (iter != map.end()) {
+                found = true;
+                value = iter->second;
+            }
+        });
+        if (found) {
+            call(value);
+        }
+        return found;
+    }
+
+    void set(const KEY& key, const VALUE& value) {
+        write(key, [&key, &value](Map& map) {
+            map[key] = value;
+            return true;
+        }, true);
+    }
+    // 已存在则不插入，返回false；不存在则init
+    // init函数需要返回0，否则整个insert返回false
+    bool insert_init_if_not_exist(const KEY& key, const std::function<int(VALUE& value)>& call) {
+        bool inserted = false;
+        write(key, [&key, &call, &inserted](Map& map) {
+            if (map.count(key) != 0) {
+                return false;
+            }
+            VALUE value;
+            if (call(value) != 0) {
+                return false;
+            }
+            map[key] = value;
+            inserted = true;
+            return true;
+        }, false);
+        return inserted;
+    }
+    const VALUE get_or_put_call(const KEY& key, const std::function<VALUE(VALUE& value)>& call) {
+        bool found = false;
+        VALUE value;
+        read(key, [&found, &value](const Map& map, const KEY& key) {
+            auto iter = map.find(key);
+            if (iter != map.end()) {
+                found = true;
+                value = iter->second;
+            }
+        });
+        if (found) {
+            return value;
+        }
+        write(key, [&key, &call, &value](Map& map) {
+            auto iter = map.find(key);
+            if (iter != map.end()) {
+                value = iter->second;
+                return false;
+            }
+            value = call(map[key]);
+            return true;
+        }, false);
+        return value;
+    }
+    size_t erase(const KEY& key) {
+        size_t erased = 0;
+        write(key, [&key, &erased](Map& map) {
+            erased = map.erase(key);
+            return erased > 0;
+        }, true);
+        return erased;
+    }
+    bool call_and_erase(const KEY& key, const std::function<void(VALUE& value)>& call) {
+        bool found = false;
+        write(key, [&key, &call, &found](Map& map) {
+            auto iter = map.find(key);
+            if (iter == map.end()) {
+                return false;
+            }
+            found = true;
+            call(iter->second);
+            map.erase(iter);
+            return true;
+        }, true);
+        return found;
+    }
+    void clear() {
+        std::vector<MapHolder*> old_holders;
+        old_holders.reserve(MAP_COUNT);
+        for (uint32_t i = 0; i < MAP_COUNT; i++) {
+            Bucket& bucket = _buckets[i];
+            BAIDU_SCOPED_LOCK(bucket.mutex);
+            old_holders.emplace_back(bucket.holder.exchange(new MapHolder{std::make_shared<Map>()}));
+        }
+        retire(old_holders, true);
+    }
+
+    // 遍历桶快照, 不阻塞读写; 遍历期间的修改可能看不到
+    void traverse(const std::function<void(VALUE& value)>& call) {
+        for (uint32_t i = 0; i < MAP_COUNT; i++) {
+            SmartMap map = snapshot(i);
+            for (auto& pair : *map) {
+                VALUE value = pair.second;
+                call(value);
+            }
+        }
+    }
+    void traverse_with_key_value(const std::function<void(const KEY& key, VALUE& value)>& call) {
+        for (uint32_t i = 0; i < MAP_COUNT; i++) {
+            SmartMap map = snapshot(i);
+            for (auto& pair : *map) {
+                VALUE value = pair.second;
+                call(pair.first, value);
+            }
+        }
+    }
+
+private:
+    struct Bucket {
+        bthread::Mutex mutex;
+        std::atomic<MapHolder*> holder;
+    };
+
+    uint32_t map_idx(const KEY& key) {
+        return std::hash<KEY>{}(key) % MAP_COUNT;
+    }
+
+    void read(const KEY& key, const std::function<void(const Map& map, const KEY& key)>& call) {
+        RcuDomain* rcu = RcuDomain::get_instance();
+        auto guard = rcu->read_lock();
+        call(*_buckets[map_idx(key)].holder.load(std::memory_order_acquire)->map, key);
+        rcu->read_unlock(guard);
+    }
+
+    SmartMap snapshot(uint32_t idx) {
+        RcuDomain* rcu = RcuDomain::get_instance();
+        auto guard = rcu->read_lock();
+        SmartMap map = _buckets[idx].holder.load(std::memory_order_acquire)->map;
+        rcu->read_unlock(guard);
+        return map;
+    }
+
+    // call返回true表示修改了map, 需要替换快照
+    // free_now: 旧快照可能持有被覆盖/删除的value, 需要立即释放
+    void write(const KEY& key, const std::function<bool(Map& map)>& call, bool free_now) {
+        Bucket& bucket = _buckets[map_idx(key)];
+        std::vector<MapHolder*> old_holders;
+        {
+            BAIDU_SCOPED_LOCK(bucket.mutex);
+            std::shared_ptr<Map> map = std::make_shared<Map>(*bucket.holder.load()->map);
+            if (!call(*map)) {
+                return;
+            }
+            old_holders.emplace_back(bucket.holder.exchange(new MapHolder{map}));
+        }
+        retire(old_holders, free_now);
+    }
+
+    // 不能持有桶锁调用, 等待RCU期间不阻塞同桶的写
+    void retire(std::vector<MapHolder*>& old_holders, bool free_now) {
+        std::vector<MapHolder*> need_delete;
+        {
+            BAIDU_SCOPED_LOCK(_retired_mutex);
+            _retired.insert(_retired.end(), old_holders.begin(), old_holders.end());
+            // 只新增value的快照攒够一批再等一次RCU, 摊薄写者的等待
+            if (!free_now && _retired.size() < RETIRE_BATCH) {
+                return;
+            }
+            need_delete.swap(_retired);
+        }
+        RcuDomain::get_instance()->synchronize();
+        for (auto holder : need_delete) {
+            delete holder;
+        }
+    }
+
+    static const size_t RETIRE_BATCH = 32;
+    Bucket _buckets[MAP_COUNT];
+    bthread::Mutex _retired_mutex;
+    std::vector<MapHolder*> _retired;
+    ConcurrentMap(const ConcurrentMap&) = delete;
+    ConcurrentMap& operator=(const ConcurrentMap&) = delete;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
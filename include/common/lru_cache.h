@@ -17,6 +17,11 @@
 #include <string>
 #include <unordered_map>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include <bthread/mutex.h>
+#include <bvar/bvar.h>
 #ifdef BAIDU_INTERNAL
 #include <base/containers/linked_list.h>
 #else
@@ -52,6 +57,115 @@ private:
     int64_t _len_threshold;
 };
 
+template <typename ItemKey, typename ItemType>
+struct ShardedLruNode : public butil::LinkNode<ShardedLruNode<ItemKey, ItemType>> {
+    ItemType value;
+    ItemKey key;
+    int64_t charge = 0;
+};
+
+// 一类ShardedCache共享的字节预算和命中统计, 避免每个cache单独配置容量和bvar
+// 每个cache的字节容量为capacity按注册的cache个数均分, 但不低于min_capacity,
+// cache很多时总占用可能超过capacity, 换来单个cache仍能缓存正常大小的条目
+// cache增减后在下次add时按新容量淘汰
+// 命中统计按分片下标暴露为name_shard_N_hit/miss, 同一下标在所有cache上累加
+struct CacheBudget {
+    CacheBudget(const std::string& name, int shard_bits) :
+            shard_mask((1 << shard_bits) - 1),
+            hit_counts(new bvar::Adder<int64_t>[1 << shard_bits]),
+            miss_counts(new bvar::Adder<int64_t>[1 << shard_bits]) {
+        for (int i = 0; i < (1 << shard_bits); ++i) {
+            std::string prefix = name + "_shard_" + std::to_string(i);
+            hit_counts[i].expose(prefix + "_hit");
+            miss_counts[i].expose(prefix + "_miss");
+        }
+    }
+    int64_t cache_capacity() const {
+        int64_t total = capacity.load(std::memory_order_relaxed);
+        if (total <= 0) {
+            return 0;
+        }
+        int64_t count = cache_count.load(std::memory_order_relaxed);
+        int64_t cache_capacity = count > 1 ? total / count : total;
+        return std::max(cache_capacity, min_capacity.load(std::memory_order_relaxed));
+    }
+    void add_hit(int shard_idx) {
+        hit_counts[shard_idx & shard_mask] << 1;
+    }
+    void add_miss(int shard_idx) {
+        miss_counts[shard_idx & shard_mask] << 1;
+    }
+    // <=0表示不限制
+    std::atomic<int64_t> capacity {0};
+    std::atomic<int64_t> min_capacity {0};
+    std::atomic<int64_t> cache_count {0};
+    const int shard_mask;
+    std::unique_ptr<bvar::Adder<int64_t>[]> hit_counts;
+    std::unique_ptr<bvar::Adder<int64_t>[]> miss_counts;
+};
+
+// 按key哈希分片的LRU, 每个分片独立加锁, 避免并发查询串行在同一把锁上
+// 容量同时按条数和字节数限制, 字节数由调用方在add时给出
+template <typename ItemKey, typename ItemType>
+class ShardedCache {
+public:
+    typedef ShardedLruNode<ItemKey, ItemType> Node;
+    ShardedCache() {}
+    ~ShardedCache();
+    // len_threshold: 总条数上限; byte_capacity: 总字节上限, <=0表示不限制
+    // budget非空时字节容量取budget均分的值, 忽略byte_capacity, 命中统计也汇总到budget
+    // 分片数和budget只在第一次init时确定, 之后再调用init只调整容量
+    int init(int64_t len_threshold, int64_t byte_capacity = 0,
+            int shard_bits = 4, CacheBudget* budget = nullptr);
+    std::string get_info();
+    int check(const ItemKey& key);
+    int find(const ItemKey& key, ItemType* value);
+    int add(const ItemKey& key, const ItemType& value, int64_t charge = 0);
+    int del(const ItemKey& key);
+    int64_t size();
+    int64_t used_bytes();
+
+private:
+    struct Shard {
+        bthread::Mutex mutex;
+        //双链表，从尾部插入数据，超过阈值数据从头部删除
+        butil::LinkedList<Node> lru_list;
+        std::unordered_map<ItemKey, Node*> lru_map;
+        int64_t len_threshold = 0;
+        int64_t byte_capacity = 0;
+        int64_t used_bytes = 0;
+        std::atomic<int64_t> hit_count {0};
+        std::atomic<int64_t> miss_count {0};
+    };
+    Shard* get_shard(const ItemKey& key) {
+        if (_shards == nullptr) {
+            return nullptr;
+        }
+        if (_shard_bits == 0) {
+            return &_shards[0];
+        }
+        // 与unordered_map内部分桶使用的低位错开
+        uint64_t h = std::hash<ItemKey>()(key) * 0x9E3779B97F4A7C15ULL;
+        return &_shards[h >> (64 - _shard_bits)];
+    }
+    int64_t shard_byte_capacity(Shard* shard) {
+        if (_budget == nullptr) {
+            return shard->byte_capacity;
+        }
+        int64_t capacity = _budget->cache_capacity();
+        if (capacity <= 0) {
+            return 0;
+        }
+        return std::max<int64_t>(1, capacity >> _shard_bits);
+    }
+    void evict(Shard* shard);
+
+private:
+    std::unique_ptr<Shard[]> _shards;
+    int _shard_bits = 0;
+    CacheBudget* _budget = nullptr;
+};
+
 }
 #include "lru_cache.hpp"
 
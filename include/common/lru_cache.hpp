@@ -16,6 +16,7 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #include <stdio.h>
+#include <algorithm>
 
 namespace baikaldb  {
 
@@ -91,6 +92,209 @@ int Cache<ItemKey, ItemType>::del(const ItemKey& key) {
     return 0;
 }
 
+template <typename ItemKey, typename ItemType>
+ShardedCache<ItemKey, ItemType>::~ShardedCache() {
+    if (_shards == nullptr) {
+        return;
+    }
+    if (_budget != nullptr) {
+        _budget->cache_count.fetch_sub(1, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < (1 << _shard_bits); ++i) {
+        for (auto& pair : _shards[i].lru_map) {
+            delete pair.second;
+        }
+    }
+}
+
+template <typename ItemKey, typename ItemType>
+int ShardedCache<ItemKey, ItemType>::init(int64_t len_threshold, int64_t byte_capacity,
+        int shard_bits, CacheBudget* budget) {
+    if (_shards == nullptr) {
+        if (shard_bits < 0 || shard_bits > 10) {
+            return -1;
+        }
+        _shard_bits = shard_bits;
+        _shards.reset(new Shard[1 << _shard_bits]);
+        _budget = budget;
+        if (_budget != nullptr) {
+            _budget->cache_count.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    int shard_num = 1 << _shard_bits;
+    int64_t shard_len = std::max<int64_t>(1, (len_threshold + shard_num - 1) / shard_num);
+    int64_t shard_bytes = 0;
+    if (byte_capacity > 0) {
+        shard_bytes = std::max<int64_t>(1, (byte_capacity + shard_num - 1) / shard_num);
+    }
+    for (int i = 0; i < shard_num; ++i) {
+        Shard* shard = &_shards[i];
+        std::lock_guard<bthread::Mutex> lock(shard->mutex);
+        shard->len_threshold = shard_len;
+        shard->byte_capacity = shard_bytes;
+        evict(shard);
+    }
+    return 0;
+}
+
+template <typename ItemKey, typename ItemType>
+std::string ShardedCache<ItemKey, ItemType>::get_info() {
+    int64_t hit = 0;
+    int64_t total = 0;
+    if (_shards != nullptr) {
+        for (int i = 0; i < (1 << _shard_bits); ++i) {
+            int64_t shard_hit = _shards[i].hit_count.load(std::memory_order_relaxed);
+            hit += shard_hit;
+            total += shard_hit + _shards[i].miss_count.load(std::memory_order_relaxed);
+        }
+    }
+    char buf[100];
+    snprintf(buf, sizeof(buf), "hit:%ld, total:%ld,", hit, total);
+    return buf;
+}
+
+template <typename ItemKey, typename ItemType>
+int ShardedCache<ItemKey, ItemType>::check(const ItemKey& key) {
+    Shard* shard = get_shard(key);
+    if (shard == nullptr) {
+        return -1;
+    }
+    std::lock_guard<bthread::Mutex> lock(shard->mutex);
+    if (shard->lru_map.count(key) == 1) {
+        return 0;
+    }
+    return -1;
+}
+
+template <typename ItemKey, typename ItemType>
+int ShardedCache<ItemKey, ItemType>::find(const ItemKey& key, ItemType* value) {
+    Shard* shard = get_shard(key);
+    if (shard == nullptr) {
+        return -1;
+    }
+    bool hit = false;
+    {
+        std::lock_guard<bthread::Mutex> lock(shard->mutex);
+        auto iter = shard->lru_map.find(key);
+        if (iter != shard->lru_map.end()) {
+            Node* node = iter->second;
+            *value = node->value;
+            node->RemoveFromList();
+            shard->lru_list.Append(node);
+            hit = true;
+        }
+    }
+    if (hit) {
+        shard->hit_count.fetch_add(1, std::memory_order_relaxed);
+        if (_budget != nullptr) {
+            _budget->add_hit(shard - _shards.get());
+        }
+        return 0;
+    }
+    shard->miss_count.fetch_add(1, std::memory_order_relaxed);
+    if (_budget != nullptr) {
+        _budget->add_miss(shard - _shards.get());
+    }
+    return -1;
+}
+
+template <typename ItemKey, typename ItemType>
+int ShardedCache<ItemKey, ItemType>::add(const ItemKey& key, const ItemType& value,
+        int64_t charge) {
+    Shard* shard = get_shard(key);
+    if (shard == nullptr) {
+        return -1;
+    }
+    std::lock_guard<bthread::Mutex> lock(shard->mutex);
+    Node* node = NULL;
+    auto iter = shard->lru_map.find(key);
+    if (iter != shard->lru_map.end()) {
+        node = iter->second;
+        node->RemoveFromList();
+        shard->used_bytes -= node->charge;
+    }
+    // 单个条目超过分片容量时不缓存, 避免把整个分片清空
+    int64_t byte_capacity = shard_byte_capacity(shard);
+    if (byte_capacity > 0 && charge > byte_capacity) {
+        if (node != NULL) {
+            shard->lru_map.erase(iter);
+            delete node;
+        }
+        return 0;
+    }
+    if (node == NULL) {
+        node = new Node();
+        node->key = key;
+        shard->lru_map[key] = node;
+    }
+    node->value = value;
+    node->charge = charge;
+    shard->used_bytes += charge;
+    shard->lru_list.Append(node);
+    evict(shard);
+    return 0;
+}
+
+template <typename ItemKey, typename ItemType>
+int ShardedCache<ItemKey, ItemType>::del(const ItemKey& key) {
+    Shard* shard = get_shard(key);
+    if (shard == nullptr) {
+        return 0;
+    }
+    std::lock_guard<bthread::Mutex> lock(shard->mutex);
+    auto iter = shard->lru_map.find(key);
+    if (iter != shard->lru_map.end()) {
+        Node* node = iter->second;
+        node->RemoveFromList();
+        shard->used_bytes -= node->charge;
+        shard->lru_map.erase(iter);
+        delete node;
+    }
+    return 0;
+}
+
+template <typename ItemKey, typename ItemType>
+int64_t ShardedCache<ItemKey, ItemType>::size() {
+    int64_t size = 0;
+    if (_shards != nullptr) {
+        for (int i = 0; i < (1 << _shard_bits); ++i) {
+            std::lock_guard<bthread::Mutex> lock(_shards[i].mutex);
+            size += _shards[i].lru_map.size();
+        }
+    }
+    return size;
+}
+
+template <typename ItemKey, typename ItemType>
+int64_t ShardedCache<ItemKey, ItemType>::used_bytes() {
+    int64_t used = 0;
+    if (_shards != nullptr) {
+        for (int i = 0; i < (1 << _shard_bits); ++i) {
+            std::lock_guard<bthread::Mutex> lock(_shards[i].mutex);
+            used += _shards[i].used_bytes;
+        }
+    }
+    return used;
+}
+
+// 调用方持有shard->mutex, 从头部淘汰直到条数和字节数都不超限
+template <typename ItemKey, typename ItemType>
+void ShardedCache<ItemKey, ItemType>::evict(Shard* shard) {
+    int64_t byte_capacity = shard_byte_capacity(shard);
+    while (!shard->lru_list.empty()) {
+        bool over_len = (int64_t)shard->lru_map.size() > shard->len_threshold;
+        bool over_bytes = byte_capacity > 0 && shard->used_bytes > byte_capacity;
+        if (!over_len && !over_bytes) {
+            break;
+        }
+        Node* head = (Node*)shard->lru_list.head();
+        head->RemoveFromList();
+        shard->used_bytes -= head->charge;
+        shard->lru_map.erase(head->key);
+        delete head;
+    }
+}
+
 }
 
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -15,6 +15,7 @@
 #pragma once
 
 #include "common.h"
+#include "concurrent_map.h"
 
 #include <atomic>
 
@@ -144,7 +145,7 @@ private:
     bool _shutdown = false;
     SmartMemTracker _root_tracker = nullptr;
     Bthread _tracker_gc_bth;
-    ThreadSafeMap<uint64_t, SmartMemTracker> _mem_tracker_pool;
+    ConcurrentMap<uint64_t, SmartMemTracker> _mem_tracker_pool;
 
     DISALLOW_COPY_AND_ASSIGN(MemTrackerPool);
 };
@@ -0,0 +1,73 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/message.h>
+#include "common.h"
+
+namespace baikaldb {
+DECLARE_bool(use_row_codec);
+
+// 按表schema版本编译的行编解码器, 与TableInfo的DynamicMessageFactory同生命周期
+// 字段按字段号排成一张平表, tag和wire type提前算好, 编解码时按类型switch直接读写字节
+// 编码结果与protobuf序列化逐字节一致, 可与SerializeToString/ParseFromString混用
+// 只支持optional标量和string/bytes字段(即schema_factory生成的表pb), 其他返回nullptr
+class RowCodec {
+public:
+    struct Entry {
+        uint32_t field_num = 0;
+        google::protobuf::FieldDescriptor::Type type = google::protobuf::FieldDescriptor::TYPE_INT32;
+        uint32_t wire_type = 0;
+        // tag的varint编码, 最长5字节
+        uint32_t tag_size = 0;
+        char tag[5];
+        const google::protobuf::FieldDescriptor* field = nullptr;
+    };
+
+    static RowCodec* create(const google::protobuf::Descriptor* descriptor);
+
+    // 清空out后写入, message有unknown fields时退化为SerializeToString
+    int encode(const google::protobuf::Message& message, std::string* out) const;
+    // 先清空message, 遇到表里没有的字段时退化为ParseFromArray以保留unknown fields
+    int decode(const char* data, size_t size, google::protobuf::Message* message) const;
+
+    const google::protobuf::Descriptor* descriptor() const {
+        return _descriptor;
+    }
+    const std::vector<Entry>& entries() const {
+        return _entries;
+    }
+
+private:
+    RowCodec() {}
+    const Entry* find_entry(uint64_t field_num) const {
+        if (field_num >= _index.size() || _index[field_num] < 0) {
+            return nullptr;
+        }
+        return &_entries[_index[field_num]];
+    }
+
+    const google::protobuf::Descriptor* _descriptor = nullptr;
+    // 按字段号有序
+    std::vector<Entry> _entries;
+    // 字段号 -> _entries下标, -1表示不存在
+    std::vector<int32_t> _index;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -55,6 +55,7 @@ static const std::string VIRTUAL_DATABASE_NAME = "__virtual_db";              //
 static const std::string TABLE_IN_FAST_IMPORTER= "in_fast_import";
 struct UserInfo;
 class TableRecord;
+class RowCodec;
 typedef std::shared_ptr<TableRecord> SmartRecord;
 typedef std::map<std::string, int64_t> StrInt64Map;
 
@@ -303,6 +304,8 @@ struct TableInfo {
     DynamicMessageFactory*  factory = nullptr;
     DescriptorPool*         pool = nullptr;
     const Message*          msg_proto = nullptr;
+    // 随动态pb一起重建, 延迟删除
+    RowCodec*               row_codec = nullptr;
     uint32_t                timestamp = 0;
     bool                    have_statistics = false;
     bool                    have_backup = false;
@@ -19,6 +19,7 @@
 #include "expr_value.h"
 #include "schema_factory.h"
 #include "message_helper.h"
+#include "row_codec.h"
 #include "proto/meta.interface.pb.h"
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/dynamic_message.h>
@@ -143,7 +144,15 @@ public:
 
     int get_reverse_word(IndexInfo& index_info, std::string& word);
 
+    // 由SchemaFactory::new_record设置, 生命周期与message的descriptor一致
+    void set_codec(const RowCodec* codec) {
+        _codec = codec;
+    }
+
     int encode(std::string& out) {
+        if (_codec != nullptr) {
+            return _codec->encode(*_message, &out);
+        }
         if (_message->SerializeToString(&out)) {
             return 0;
         }
@@ -158,6 +167,13 @@ public:
     }
 
     int decode(const std::string& in) {
+        if (_codec != nullptr) {
+            if (_codec->decode(in.data(), in.size(), _message) != 0) {
+                return -1;
+            }
+            _used_size += in.size();
+            return 0;
+        }
         if (_message->ParseFromString(in)) {
             _used_size += in.size();
             return 0;
@@ -166,6 +182,9 @@ public:
     }
 
     int decode(const char* data, int size) {
+        if (_codec != nullptr) {
+            return _codec->decode(data, size, _message);
+        }
         if (_message->ParseFromArray(data, size)) {
             return 0;
         }
@@ -230,6 +249,7 @@ public:
 
     SmartRecord clone(bool merge_data = true) {
         SmartRecord record(new TableRecord(_message->New()));
+        record->_codec = _codec;
         if (merge_data) {
             record->_message->MergeFrom(*_message);
         }
@@ -267,6 +287,7 @@ public:
 
 private:
     Message* _message = nullptr;
+    const RowCodec* _codec = nullptr;
     int64_t  _used_size = 0;
 };
 }
@@ -21,6 +21,25 @@
 #include "rocksdb/slice.h"
 
 namespace baikaldb {
+// 按投影预编译的解码计划: 字段号有序, 字段描述符和默认值提前解析好
+// 同一次扫描的行共用一个计划, 逐行解码时不再查map和slot
+struct TupleDecodePlan {
+    struct Item {
+        uint64_t field_num;
+        const google::protobuf::FieldDescriptor* field;
+        const ExprValue* default_value;
+    };
+    // 计划对应的message类型, 类型变化(如schema变更)需重新init
+    const google::protobuf::Descriptor* descriptor = nullptr;
+    std::vector<Item> items;
+
+    bool match(const google::protobuf::Message* message) const {
+        return descriptor != nullptr && descriptor == message->GetDescriptor();
+    }
+    int init(const std::map<int32_t, FieldInfo*>& fields, const std::vector<int32_t>* field_slot,
+            SmartRecord* record, int32_t tuple_id, std::unique_ptr<MemRow>* mem_row);
+};
+
 class TupleRecord {
 public:
     TupleRecord(rocksdb::Slice slice) {
@@ -86,8 +105,16 @@ public:
     int decode_fields(const std::map<int32_t, FieldInfo*>& fields, const std::vector<int32_t>* field_slot,
             SmartRecord* record, int32_t tuple_id, std::unique_ptr<MemRow>* mem_row);
 
+    // 按预编译计划解码, 跳过不需要的字段, 最后一个需要的字段之后不再解析
+    // mem_row为nullptr时不统计内存
+    int decode_fields(const TupleDecodePlan& plan, google::protobuf::Message* message, MemRow* mem_row);
+
     int verification_fields(int32_t max_field_id);
 private:
+    int skip_field(int32_t wired_type);
+    int decode_value(const google::protobuf::FieldDescriptor* field,
+            google::protobuf::Message* message, int* used_size);
+
     const char*   _data;
     size_t  _size;
     size_t  _offset = 0;
@@ -101,6 +101,8 @@ public:
         return _txn->Delete(column_family, key);
     }
 
+    rocksdb::WriteBatchWithIndex* GetWriteBatch() { return _txn->GetWriteBatch(); }
+
     rocksdb::Status SetName(const rocksdb::TransactionName& name) { return _txn->SetName(name); }
 
     rocksdb::TransactionName GetName() const { return _txn->GetName(); }
@@ -20,6 +20,7 @@
 #include "mut_table_key.h"
 #include "table_key.h"
 #include "table_record.h"
+#include "tuple_record.h"
 #include "item_batch.hpp"
 #include "my_rocksdb.h"
 
@@ -27,6 +28,7 @@ namespace baikaldb {
 class Transaction;
 class TableIterator;
 class IndexIterator;
+class ColumnVector;
 typedef std::shared_ptr<Transaction> SmartTransaction;
 typedef std::bitset<ROW_BATCH_CAPACITY> FiltBitSet;
 
@@ -216,10 +218,13 @@ public:
     void set_mode(KVMode mode) {
         _mode = mode;
     }
-    int get_column(int32_t tuple_id, const FieldInfo& field, const FiltBitSet* filter, RowBatch* batch);
+    // 列存按列读取一个字段填到batch的行中, column非空时同时按行号写入column(行数与batch一致)
+    int get_column(int32_t tuple_id, const FieldInfo& field, const FiltBitSet* filter, RowBatch* batch,
+            ColumnVector* column = nullptr);
 private:
     int get_next_internal(SmartRecord* record, int32_t tuple_id, std::unique_ptr<MemRow>* mem_row);
     KVMode  _mode;
+    TupleDecodePlan _decode_plan;
 };
 
 class IndexIterator : public Iterator {
@@ -101,6 +101,12 @@ public:
     
     rocksdb::Status rollback();
 
+    // 组提交: 把txns的写入不加锁地追加到本事务, 失败时本事务恢复原状返回-1
+    // 本事务提交后对txns调用finish_merged释放行锁
+    int merge_untracked(const std::vector<std::shared_ptr<Transaction>>& txns);
+
+    void finish_merged(bool committed);
+
     // Set a savepoint for partial rollback in case of some DML execute failed on other store
     int set_save_point();
 
@@ -16,6 +16,7 @@
  
 #include <unordered_map>
 #include "common.h"
+#include "concurrent_map.h"
 #include "transaction.h"
 
 namespace baikaldb {
@@ -122,7 +123,8 @@ private:
     int64_t _online_ttl_base_expire_time_us = 0;
 
     // txn_id => txn handler mapping
-    ThreadSafeMap<uint64_t, SmartTransaction>  _txn_map;
+    // get/traverse远多于增删, 读路径不加锁
+    ConcurrentMap<uint64_t, SmartTransaction>  _txn_map;
     // txn_id => affected_rows use for idempotent
     DoubleBuffer<ThreadSafeMap<uint64_t, int>> _finished_txn_map;
     TimeCost _clean_finished_txn_cost;
@@ -26,8 +26,32 @@
 #include "exec_node.h"
 #include "agg_fn_call.h"
 #include "mut_table_key.h"
+#include "spill_file.h"
 
 namespace baikaldb {
+DECLARE_int32(agg_parallel_partitions);
+DECLARE_int64(agg_spill_memory_quota);
+
+// 分组列全是定长整数时使用的打包key: null_flag(1B) + 各列定长值, 最长16字节
+struct FixedAggKey {
+    uint64_t data[2] = {0, 0};
+    bool operator==(const FixedAggKey& other) const {
+        return data[0] == other.data[0] && data[1] == other.data[1];
+    }
+};
+struct FixedAggKeyHash {
+    size_t operator()(const FixedAggKey& key) const {
+        // murmur3 fmix64
+        uint64_t h = key.data[0] ^ (key.data[1] * 0x9E3779B97F4A7C15ULL);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+};
+
 class AggNode : public ExecNode {
 public:
     AggNode() {
@@ -49,6 +73,13 @@ public:
     virtual void transfer_pb(int64_t region_id, pb::PlanNode* pb_node);
     void encode_agg_key(MemRow* row, MutTableKey& key);
     void process_row_batch(RuntimeState* state, RowBatch& batch, int64_t& used_size, int64_t& release_size);
+    typedef butil::FlatMap<std::string, MemRow*> AggHashMap;
+    void encode_fixed_agg_key(MemRow* row, FixedAggKey& key);
+    void aggregate_fixed_row(const FixedAggKey& key, std::unique_ptr<MemRow>& row,
+            int64_t& used_size, int64_t& release_size);
+    // 将一行聚合进hash_map, 新分组时接管row
+    void aggregate_row(AggHashMap& hash_map, const std::string& key,
+            std::unique_ptr<MemRow>& row, int64_t& used_size, int64_t& release_size);
     std::vector<ExprNode*>* mutable_group_exprs() {
         return &_group_exprs;
     }
@@ -69,6 +100,18 @@ public:
         return &_agg_fn_calls;
     }
 private:
+    // 分区聚合: 按分组key的hash分到多个分区, 每个分区由一个bthread独立聚合,
+    // 分区间key不相交, 输出时依次遍历即可; 超过内存配额时分区整体落盘
+    struct AggPartition {
+        AggHashMap hash_map;
+        std::unique_ptr<SpillFile> spill_file;
+    };
+    bool can_use_partition();
+    bool can_use_fixed_key();
+    int process_pending_rows(RuntimeState* state);
+    int spill_partitions(RuntimeState* state);
+    int load_partition(RuntimeState* state, size_t idx);
+
     //需要推导_agg_tuple_id内部slot的类型
     std::vector<ExprNode*> _group_exprs;
     int32_t _agg_tuple_id;
@@ -81,6 +124,21 @@ private:
     //用于分组和get_next的定位,用map可与mysql保持一致
     butil::FlatMap<std::string, MemRow*> _hash_map;
     butil::FlatMap<std::string, MemRow*>::iterator _iter;
+
+    bool _use_partition = false;
+    std::vector<std::unique_ptr<AggPartition>> _partitions;
+    size_t _partition_idx = 0;
+    std::vector<std::unique_ptr<MemRow>> _pending_rows;
+    // 各分区hash表已计入mem tracker的内存
+    int64_t _partition_bytes = 0;
+
+    // 定长key路径, 只用于行内聚合函数, 字符串key作为兜底
+    typedef butil::FlatMap<FixedAggKey, MemRow*, FixedAggKeyHash> FixedAggHashMap;
+    bool _use_fixed_key = false;
+    std::vector<pb::PrimitiveType> _fixed_key_types;
+    std::vector<int> _fixed_key_widths;
+    FixedAggHashMap _fixed_hash_map;
+    FixedAggHashMap::iterator _fixed_iter;
 };
 }
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,62 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "fetcher_store.h"
+
+namespace baikaldb {
+DECLARE_bool(async_secondary_commit);
+
+// 一个secondary region的commit请求, 已由fetch_store填充完整, 不依赖RuntimeState
+struct AsyncCommitTask {
+    pb::StoreReq request;
+    pb::RegionInfo info;
+    int retry_times = 0;
+};
+typedef std::shared_ptr<AsyncCommitTask> SmartAsyncCommitTask;
+
+// primary region commit成功后, secondary region的commit交给后台bthread执行, 不阻塞客户端
+// 超过重试次数或baikaldb重启时, store上prepared的事务超时后通过
+// exec_txn_query_primary_region查到primary已提交, 自行commit
+class AsyncCommitResolver : public Singleton<AsyncCommitResolver> {
+public:
+    // 积压超过async_commit_max_pending时返回false, 由调用方同步commit
+    bool add_tasks(const std::vector<SmartAsyncCommitTask>& tasks);
+
+    int64_t pending() const {
+        return _pending.load();
+    }
+
+    static bvar::Adder<int64_t> async_commit_region_count;
+    static bvar::Adder<int64_t> async_commit_fail_count;
+    static bvar::LatencyRecorder async_commit_time;
+
+private:
+    void resolve(SmartAsyncCommitTask task);
+    // 返回E_OK表示完成, E_RETRY表示需要重试, 其他表示放弃
+    // region分裂后, 新region的commit任务追加到queue
+    ErrorType commit_region(AsyncCommitTask* task, std::deque<SmartAsyncCommitTask>* queue);
+    ErrorType handle_version_old(AsyncCommitTask* task, const pb::StoreRes& response,
+            std::deque<SmartAsyncCommitTask>* queue);
+
+    std::atomic<int64_t> _pending {0};
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -15,8 +15,12 @@
 #pragma once
 #ifdef BAIDU_INTERNAL
 #include <bthread.h>
+#include <baidu/rpc/channel.h>
+#include <baidu/rpc/selective_channel.h>
 #else
 #include <bthread/bthread.h>
+#include <brpc/channel.h>
+#include <brpc/selective_channel.h>
 #endif
 #include <bthread/condition_variable.h>
 #include <bthread/mutex.h>
@@ -27,6 +31,7 @@
 #include "network_socket.h"
 #include "proto/store.interface.pb.h"
 namespace baikaldb {
+DECLARE_int32(fetcher_multi_query_max_regions);
 enum ErrorType {
     E_OK = 0,
     E_WARNING,
@@ -48,6 +53,15 @@ class FetcherStore;
             _addr.c_str(), _backup.c_str(), ##args);                                                               \
     } while (0);
 
+// 交给上层按页读取的region在store端剩余数据的游标
+struct PageCursor {
+    uint64_t cursor_id = 0;
+    std::string addr;
+    pb::StoreReq request;   // 续读请求, 只带游标id
+    pb::RegionInfo info;
+    int64_t page_bytes = 0; // 上一页占用的内存, 读下一页时释放
+};
+
 class OnRPCDone: public google::protobuf::Closure {
 public:
     OnRPCDone(FetcherStore* fetcher_store, RuntimeState* state, ExecNode* store_request, pb::RegionInfo* info_ptr, 
@@ -71,12 +85,46 @@ public:
     }
 
     ErrorType check_status();
+    // 初始化发往_addr的channel, 有backup时带backup request
+    ErrorType init_channel(brpc::SelectiveChannel& channel, brpc::Controller& cntl);
     ErrorType send_async();
+    // 和合并进来的region一起发multi_query, 返回E_OK时改为单独发query
+    ErrorType send_multi_query();
+    // 被合并的region填充请求, 与multi_query的地址和计划一致时返回true
+    bool prepare_multi_query(const OnRPCDone* leader);
+    // 未发送的合并region退回队列
+    void return_multi_tasks();
     ErrorType fill_request();
     void select_addr();
+    // 目标store已缓存计划模板时只发签名和scan node索引范围
+    void select_plan();
+    void new_cursor_id();
     void send_request();
     ErrorType handle_version_old();
-    ErrorType handle_response(const std::string& remote_side);
+    ErrorType handle_response(const std::string& remote_side, bool has_backup_request);
+    void process_response(const brpc::Controller& cntl);
+    void finish_response(ErrorType err);
+    // 关闭正在续读的游标, 下次从头请求该region
+    void reset_cursor();
+    // 已有页交给上层后不能从头重读, 返回E_FATAL
+    ErrorType restart_paged_select();
+    // 上层读下一页时, 从游标继续请求
+    void set_page_cursor(const PageCursor& cursor);
+    // 非事务select可以和同store的其他region合并成multi_query
+    bool can_multi_query() const;
+    // 由RPCCtrl合并进本task的multi_query, 不占store并发
+    void add_multi_task(OnRPCDone* task) {
+        task->_in_multi_query = true;
+        _multi_tasks.emplace_back(task);
+    }
+    // 返回true表示该task占用了store并发
+    bool release_multi_query() {
+        bool in_multi_query = _in_multi_query;
+        _in_multi_query = false;
+        return !in_multi_query;
+    }
+    // multi_query返回的该region结果, response为nullptr表示rpc失败
+    void multi_query_done(const brpc::Controller& cntl, pb::StoreRes* response);
 
 private:
     FetcherStore* _fetcher_store;
@@ -104,6 +152,21 @@ private:
     brpc::Controller _cntl;
     RPCCtrl* _rpc_ctrl = nullptr;
     std::string _store_addr;
+    // 分页select状态
+    uint64_t _cursor_id = 0;
+    std::string _cursor_addr;
+    int64_t _cursor_bytes = 0;
+    bool _page_delivered = false;
+    std::string _remote_side;
+    // store端计划模板未命中, 重发完整plan
+    bool _plan_cache_miss = false;
+    // 只发签名时暂存的完整plan, 换store重发时恢复
+    bool _plan_stripped = false;
+    pb::Plan _full_plan;
+    google::protobuf::RepeatedPtrField<pb::TupleDescriptor> _full_tuples;
+    // multi_query: 合并进来的其他region, 以及本task是否被合并
+    std::vector<OnRPCDone*> _multi_tasks;
+    bool _in_multi_query = false;
     static bvar::Adder<int64_t>  async_rpc_region_count;
     static bvar::LatencyRecorder total_send_request;
     static bvar::LatencyRecorder add_backup_send_request;
@@ -136,8 +199,12 @@ public:
                             _doing_cnt++;
                             _todo_cnt--;
                             task_group->doing_cnt++;
-                            tasks.emplace_back(task_group->todo_tasks.back());
+                            OnRPCDone* task = task_group->todo_tasks.back();
                             task_group->todo_tasks.pop_back();
+                            if (task->can_multi_query()) {
+                                fetch_multi_tasks(task_group, task);
+                            }
+                            tasks.emplace_back(task);
                         } else {
                             break;
                         }
@@ -176,7 +243,9 @@ public:
         auto task_group = _ip_task_group_map.at(task->key());
         _doing_cnt--;
         _done_cnt++;
-        task_group->doing_cnt--;
+        if (task->release_multi_query()) {
+            task_group->doing_cnt--;
+        }
         task_group->done_tasks.emplace_back(task);
 
         // 唤醒主线程
@@ -189,13 +258,27 @@ public:
         auto task_group = _ip_task_group_map.at(task->key());
         _doing_cnt--;
         _todo_cnt++;
-        task_group->doing_cnt--;
+        if (task->release_multi_query()) {
+            task_group->doing_cnt--;
+        }
         task_group->todo_tasks.emplace_back(task);
 
         // 唤醒主线程
         _cv.notify_one();
     }
-    
+
+    // multi_query未执行的region重新排队, 不计入重试次数
+    void task_continue(OnRPCDone* task) {
+        std::unique_lock<bthread::Mutex> lck(_mutex);
+        auto task_group = _ip_task_group_map.at(task->key());
+        _doing_cnt--;
+        _todo_cnt++;
+        if (task->release_multi_query()) {
+            task_group->doing_cnt--;
+        }
+        task_group->todo_tasks.emplace_back(task);
+        _cv.notify_one();
+    }
 
     void execute() {
         while (true) {
@@ -212,6 +295,24 @@ public:
     }
 
 private:
+    struct TaskGroup;
+    // 同store的其他select合并进task的multi_query, 整批只占一个并发
+    void fetch_multi_tasks(std::shared_ptr<TaskGroup>& task_group, OnRPCDone* task) {
+        auto& todo_tasks = task_group->todo_tasks;
+        int multi_cnt = 1;
+        for (size_t i = todo_tasks.size(); i > 0 && multi_cnt < FLAGS_fetcher_multi_query_max_regions; --i) {
+            OnRPCDone* multi_task = todo_tasks[i - 1];
+            if (!multi_task->can_multi_query()) {
+                continue;
+            }
+            _doing_cnt++;
+            _todo_cnt--;
+            task->add_multi_task(multi_task);
+            todo_tasks.erase(todo_tasks.begin() + (i - 1));
+            ++multi_cnt;
+        }
+    }
+
     struct TaskGroup {
         TaskGroup() { }
 
@@ -276,9 +377,11 @@ public:
     FetcherStore() {
     }
     virtual ~FetcherStore() {
+        close_page_cursors();
     }
     
     void clear() {
+        close_page_cursors();
         region_batch.clear();
         split_region_batch.clear();
         index_records.clear();
@@ -474,7 +577,40 @@ public:
                            const pb::OpType op_type,
                            const uint64_t log_id);
     int64_t get_commit_ts();
+    // commit时优先使用prepare阶段已取到的commit_ts, 省去一次串行的tso rpc
+    int64_t fetch_commit_ts() {
+        int64_t commit_ts = pipelined_commit_ts.exchange(-1);
+        if (commit_ts < 0) {
+            commit_ts = get_commit_ts();
+        }
+        return commit_ts;
+    }
+    // prepare失败或回滚的事务不会commit, 丢弃预取的commit_ts, 避免被之后的commit误用
+    // 需在process_binlog_done之后调用, 此时binlog bthread已结束
+    void discard_commit_ts_if_failed(pb::OpType op_type) {
+        if (op_type == pb::OP_ROLLBACK || (op_type == pb::OP_PREPARE && error != E_OK)) {
+            pipelined_commit_ts = -1;
+        }
+    }
+    // primary region commit成功后, secondary region的commit交给AsyncCommitResolver, 返回false时需同步commit
+    bool async_commit(RuntimeState* state, ExecNode* store_request,
+            std::vector<pb::RegionInfo*>& infos, int start_seq_id, int current_seq_id);
     static int64_t get_dynamic_timeout_ms(ExecNode* store_request, pb::OpType op_type, uint64_t sign);
+    // 异步关闭store端分页游标, 不等待结果
+    static void close_cursor(const std::string& addr, const pb::StoreReq& request, uint64_t cursor_id);
+
+    void add_page_cursor(int64_t region_id, const PageCursor& cursor) {
+        BAIDU_SCOPED_LOCK(region_lock);
+        page_cursors[region_id] = cursor;
+    }
+    bool has_page_cursor(int64_t region_id) {
+        BAIDU_SCOPED_LOCK(region_lock);
+        return page_cursors.count(region_id) != 0;
+    }
+    // 读该region的下一页, 跳过空页; 返回1表示读到数据, 0表示已读完
+    int fetch_next_page(RuntimeState* state, ExecNode* store_request, int64_t region_id,
+            std::shared_ptr<RowBatch>* batch);
+    void close_page_cursors();
 
 public:
     std::map<int64_t, std::vector<SmartRecord>>  index_records; //key: index_id
@@ -503,12 +639,18 @@ public:
     std::set<int64_t> no_copy_cache_plan_set;
     int64_t dynamic_timeout_ms = -1;
     TimeCost binlog_prewrite_time;
+    // prepare阶段binlog prewrite成功后预取的commit_ts, -1表示没有
+    std::atomic<int64_t> pipelined_commit_ts{-1};
     LearnerStatus learner_status;
     MysqlErrCode      error_code = ER_ERROR_FIRST;
     std::ostringstream error_msg;
     int32_t region_count = 0;
     std::set<brpc::CallId> callids;
+    static bvar::Adder<int64_t> multi_query_region_count;
     GlobalBackupType global_backup_type = GBT_INIT;
+    // 分页select的首页即返回, 后续页由上层通过fetch_next_page按需读取
+    bool page_stream = false;
+    std::map<int64_t, PageCursor> page_cursors;
 };
 }
 
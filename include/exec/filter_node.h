@@ -15,6 +15,7 @@
 #pragma once
 
 #include "exec_node.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 class FilterNode : public ExecNode {
@@ -42,6 +43,16 @@ public:
     const std::vector<ExprNode*>& pruned_conjuncts() {
         return _pruned_conjuncts;
     }
+    // 替换成功返回true, 调用方负责释放old_expr, 需要重新做索引选择
+    bool replace_conjunct(ExprNode* old_expr, ExprNode* new_expr) {
+        for (auto& conjunct : _conjuncts) {
+            if (conjunct == old_expr) {
+                conjunct = new_expr;
+                return true;
+            }
+        }
+        return false;
+    }
 
     bool check_satisfy_condition(MemRow* row) override {
         if (!need_copy(row)) {
@@ -100,6 +111,9 @@ public:
     void reset(RuntimeState* state) override {
         _child_eos = false;
         _child_row_idx = 0;
+        _child_columns.clear();
+        _child_sel.clear();
+        _child_sel_pos = 0;
         _raw_filter_node.Clear();
         _filter_node.clear();
         for (auto e : _children) {
@@ -109,6 +123,15 @@ public:
 
 private:
     bool need_copy(MemRow* row);
+    // 对整个_child_row_batch批量计算过滤条件, 结果保存在_child_sel
+    int batch_filter(RuntimeState* state);
+    bool batch_filter_selected() {
+        size_t idx = _child_row_batch.index();
+        while (_child_sel_pos < _child_sel.size() && _child_sel[_child_sel_pos] < idx) {
+            ++_child_sel_pos;
+        }
+        return _child_sel_pos < _child_sel.size() && _child_sel[_child_sel_pos] == idx;
+    }
 private:
     std::vector<ExprNode*> _conjuncts;
     std::vector<ExprNode*> _pruned_conjuncts;
@@ -116,6 +139,11 @@ private:
     RowBatch _child_row_batch;
     size_t  _child_row_idx = 0;
     bool    _child_eos = false;
+    // 批量过滤使用
+    bool    _use_batch_filter = false;
+    ColumnBatch  _child_columns;
+    SelectVector _child_sel;
+    size_t  _child_sel_pos = 0;
     pb::FilterNode _raw_filter_node;
     std::string    _filter_node;
 };
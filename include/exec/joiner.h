@@ -55,6 +55,10 @@ struct ExprValueVec {
     };
 };
 using ExprValueSet = butil::FlatSet<ExprValueVec, ExprValueVec::HashFunction>;
+DECLARE_bool(join_bloom_filter_pushdown);
+DECLARE_int64(join_bloom_filter_threshold);
+DECLARE_int64(join_radix_build_rows);
+
 class Joiner : public ExecNode {
 public:
     Joiner() : _child_eos(false) { 
@@ -127,8 +131,37 @@ public:
     int fetcher_inner_table_data(RuntimeState* state,
                             const std::vector<MemRow*>& outer_tuple_data,
                             std::vector<MemRow*>& inner_tuple_data);
+    // 索引选择之后, 没有用于索引范围的in条件在值过多时换成bloom filter下推, 减少请求大小
+    // 由join_bloom_filter_pushdown控制, in_exprs中被替换的条件同步改为bloom filter
+    int replace_in_with_bloom_filter(RuntimeState* state,
+                                  std::vector<ExecNode*>& scan_nodes,
+                                  std::vector<ExprNode*>& in_exprs);
+    int construct_bloom_filter_condition(std::vector<ExprNode*>& slot_refs,
+                                  const ExprValueSet& in_values,
+                                  std::vector<ExprNode*>& in_exprs);
     void construct_hash_map(const std::vector<MemRow*>& tuple_data,
                              const std::vector<ExprNode*>& slot_refs);
+    // build侧行数较多时按key hash的高位分区, 各分区并行构建且单个分区hash表更小
+    void construct_radix_hash_map(const std::vector<MemRow*>& tuple_data,
+                             const std::vector<ExprNode*>& slot_refs);
+    std::vector<MemRow*>* seek_hash_map(const std::string& key) {
+        if (_radix_bits > 0) {
+            return _radix_maps[make_sign(key) >> (64 - _radix_bits)]->seek(key);
+        }
+        return _hash_map.seek(key);
+    }
+    void erase_hash_map(const std::string& key) {
+        if (_radix_bits > 0) {
+            _radix_maps[make_sign(key) >> (64 - _radix_bits)]->erase(key);
+            return;
+        }
+        _hash_map.erase(key);
+    }
+    void clear_hash_map() {
+        _hash_map.clear();
+        _radix_maps.clear();
+        _radix_bits = 0;
+    }
     void encode_hash_key(MemRow* row,
                           const std::vector<ExprNode*>& slot_ref_exprs,
                           MutTableKey& key);
@@ -169,7 +202,10 @@ protected:
     std::vector<MemRow*> _inner_tuple_data;
 
     //目前只支持等值join（a.id = b.id and a.name = b.name）
-    butil::FlatMap<std::string, std::vector<MemRow*>> _hash_map;
+    typedef butil::FlatMap<std::string, std::vector<MemRow*>> JoinHashMap;
+    JoinHashMap _hash_map;
+    int _radix_bits = 0;
+    std::vector<std::unique_ptr<JoinHashMap>> _radix_maps;
 
     std::vector<MemRow*>::iterator _outer_iter;
     std::vector<MemRow*>::iterator _inner_iter;
@@ -17,6 +17,7 @@
 #include "scan_node.h"
 #include "table_record.h"
 #include "table_iterator.h"
+#include "column_batch.h"
 #include "transaction.h"
 #include "reverse_index.h"
 #include "reverse_interface.h"
@@ -79,6 +80,10 @@ public:
         }
         return true;
     }
+    // 与need_copy语义一致, 对整个batch批量计算conjuncts, 未选中的行记入filter
+    // columns中已有的列(如列存扫描时按列产出的过滤列)直接使用, 其余列按需从行中转置
+    static int batch_need_copy(RowBatch* batch, ColumnBatch* columns,
+            std::vector<ExprNode*>& conjuncts, FiltBitSet* filter);
 
 
     int32_t get_partition_field() {
@@ -133,6 +138,8 @@ private:
     std::map<int32_t, FieldInfo*> _ddl_field_ids;
     std::vector<int32_t> _filt_field_ids;
     std::vector<int32_t> _trivial_field_ids;
+    // 列存扫描的过滤列, 与scan出的row_batch行号一致
+    ColumnBatch _scan_columns;
     std::vector<int32_t> _field_slot;
     MemRowDescriptor* _mem_row_desc;
     ExecNode* _related_manager_node = NULL;
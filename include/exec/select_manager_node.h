@@ -62,6 +62,10 @@ public:
             expr->close();
         }
         _sorter = nullptr;
+        // 关闭未读完的分页游标
+        _page_regions.clear();
+        _main_fetcher.reset();
+        _backup_fetcher.reset();
     }
     int init_sort_info(SortNode* sort_node) {
         _slot_order_exprs = sort_node->slot_order_exprs();
@@ -83,6 +87,7 @@ public:
                           ScanIndexInfo* scan_index_info,
                           RuntimeState* state,
                           ExecNode* exec_node,
+                          ExecNode* store_exec,
                           int64_t main_table_id);
 
     void set_sub_query_runtime_state(RuntimeState* state) {
@@ -111,6 +116,11 @@ private:
     std::vector<bool> _is_null_first;
     std::shared_ptr<MemRowCompare> _mem_row_compare;
     std::shared_ptr<Sorter> _sorter;
+    // get_next时还要按页读取, fetcher在close时才释放
+    std::unique_ptr<FetcherInfo> _main_fetcher;
+    std::unique_ptr<FetcherInfo> _backup_fetcher;
+    // sorter中还有后续页的batch对应的region
+    std::map<RowBatch*, int64_t> _page_regions;
     std::map<int32_t, int32_t> _index_slot_field_map;
     SchemaFactory*  _factory = nullptr;
     RuntimeState*   _sub_query_runtime_state = nullptr;
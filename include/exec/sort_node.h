@@ -20,6 +20,8 @@
 #include "property.h"
 
 namespace baikaldb {
+DECLARE_int64(sort_top_n_max_limit);
+
 class SortNode : public ExecNode {
 public:
     SortNode() : _tuple_id(-1), 
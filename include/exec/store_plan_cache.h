@@ -0,0 +1,80 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "common.h"
+#include "lru_cache.h"
+#include "proto/store.interface.pb.h"
+
+namespace baikaldb {
+DECLARE_bool(enable_store_plan_cache);
+
+// 计划模板: 去掉scan node索引范围后的plan和tuples, 同一条sql不同参数共用
+struct StorePlanTemplate {
+    pb::Plan plan;
+    google::protobuf::RepeatedPtrField<pb::TupleDescriptor> tuples;
+};
+typedef std::shared_ptr<StorePlanTemplate> SmartStorePlanTemplate;
+
+// store端按模板签名缓存plan, baikaldb命中后只发签名和scan node索引范围
+// 节省的是plan的传输和pb解析, store仍需复制模板并create_tree, baikaldb仍需序列化计算签名
+// baikaldb与store都用make_template_sign计算签名, store加入缓存前会校验
+class StorePlanCache : public Singleton<StorePlanCache> {
+public:
+    StorePlanCache();
+    // 把plan中scan node的索引范围移到scan_indexes, plan变为模板, 返回模板签名
+    // 只支持单个scan node的plan, 不支持时返回0且plan不变
+    static uint64_t make_template_sign(pb::Plan* plan,
+            const google::protobuf::RepeatedPtrField<pb::TupleDescriptor>& tuples,
+            google::protobuf::RepeatedPtrField<std::string>* scan_indexes);
+    // make_template_sign的逆操作
+    static void restore_scan_indexes(pb::Plan* plan,
+            google::protobuf::RepeatedPtrField<std::string>* scan_indexes);
+    // 复制plan中scan node的索引范围, plan不变
+    static void copy_scan_indexes(const pb::Plan& plan,
+            google::protobuf::RepeatedPtrField<std::string>* scan_indexes);
+
+    // baikaldb端: 某个签名是否已被addr对应的store确认缓存过
+    // 各store缓存各自的模板, 必须按(store, 签名)记录
+    bool is_template_cached(const std::string& addr, uint64_t sign) {
+        return _cached_signs.check(make_addr_sign(addr, sign)) == 0;
+    }
+    void set_template_cached(const std::string& addr, uint64_t sign) {
+        _cached_signs.add(make_addr_sign(addr, sign), true);
+    }
+
+    // store端: 用缓存的模板补全只带签名的请求, 签名为0或未命中返回-1
+    int fill_request(const pb::StoreReq& request, pb::StoreReq* filled);
+    // store端: 校验带完整plan请求的签名后加入缓存, 成功返回true
+    bool add_template(const pb::StoreReq& request);
+
+    std::string get_info() {
+        return _templates.get_info();
+    }
+
+private:
+    static uint64_t make_addr_sign(const std::string& addr, uint64_t sign) {
+        std::string key = addr;
+        key.append((const char*)&sign, sizeof(sign));
+        return make_sign(key);
+    }
+
+    CacheBudget _budget;
+    ShardedCache<uint64_t, SmartStorePlanTemplate> _templates;
+    ShardedCache<uint64_t, bool> _cached_signs;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -131,6 +131,23 @@ public:
                 return false;
         }
     }
+    // 中间结果只保存在dst行中, 不同分组可在不同线程处理, 且部分结果可再次merge
+    bool is_row_local_agg() const {
+        if (_is_distinct) {
+            return false;
+        }
+        switch (_agg_type) {
+            case COUNT_STAR:
+            case COUNT:
+            case SUM:
+            case AVG:
+            case MIN:
+            case MAX:
+                return true;
+            default:
+                return false;
+        }
+    }
     bool is_hll_agg() const {
         switch(_agg_type) {
             case HLL_ADD_AGG:
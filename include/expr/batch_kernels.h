@@ -0,0 +1,55 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace baikaldb {
+namespace batch {
+// 支持列式计算的二元运算
+enum BinaryOp {
+    OP_NONE = 0,
+    OP_EQ,
+    OP_NE,
+    OP_GT,
+    OP_GE,
+    OP_LT,
+    OP_LE,
+    OP_ADD,
+    OP_MINUS,
+    OP_MULTIPLIES
+};
+
+inline bool is_compare_op(BinaryOp op) {
+    return op >= OP_EQ && op <= OP_LE;
+}
+
+// 以下kernel对[0, n)全部行做无分支计算, 便于编译器生成SIMD指令;
+// null行的结果由调用方通过null bitmap屏蔽
+void compare(BinaryOp op, const int64_t* a, const int64_t* b, uint64_t* out, size_t n);
+void compare(BinaryOp op, const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n);
+void compare(BinaryOp op, const double* a, const double* b, uint64_t* out, size_t n);
+
+void arithmetic(BinaryOp op, const int64_t* a, const int64_t* b, int64_t* out, size_t n);
+void arithmetic(BinaryOp op, const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n);
+void arithmetic(BinaryOp op, const double* a, const double* b, double* out, size_t n);
+
+// out = a | b, 任一侧为null则结果为null
+void merge_null(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t words);
+} // namespace batch
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
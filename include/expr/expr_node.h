@@ -18,9 +18,12 @@
 #include <unordered_set>
 #include "expr_value.h"
 #include "mem_row.h"
+#include "column_vector.h"
 #include "proto/expr.pb.h"
 
 namespace baikaldb {
+class RowBatch;
+class ColumnBatch;
 const int NOT_BOOL_ERRCODE = -100;
 class ExprNode {
 public:
@@ -140,6 +143,16 @@ public:
     virtual ExprValue get_value(MemRow* row) { //对每行计算表达式
         return ExprValue::Null();
     } 
+    // 对batch中sel选中的行批量计算表达式, 返回结果列(行下标与rows一致)
+    // 结果列由节点自身或columns持有, 下次调用前有效; 返回nullptr表示失败
+    // 默认逐行调用get_value, SlotRef/Literal/ScalarFnCall实现了列式计算
+    virtual ColumnVector* eval_batch(RowBatch* rows, ColumnBatch* columns, const SelectVector& sel);
+    // 批量计算谓词, sel中只保留结果为true的行
+    int filter_batch(RowBatch* rows, ColumnBatch* columns, SelectVector* sel);
+    // 是否有列式实现, 没有时filter_batch直接逐行计算
+    virtual bool support_eval_batch() {
+        return false;
+    }
     //释放open创建的资源
     virtual void close() {
         for (auto e : _children) {
@@ -272,6 +285,9 @@ protected:
     int32_t _tuple_id = -1;
     int32_t _slot_id = -1;
     bool is_logical_and_or_not();
+    // eval_batch结果复用的缓冲区, 避免每个batch重新分配
+    ColumnVector* batch_result(size_t num_rows);
+    std::unique_ptr<ColumnVector> _batch_result;
 public:
     static int create_expr_node(const pb::ExprNode& node, ExprNode** expr_node);
 private:
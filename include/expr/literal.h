@@ -14,6 +14,7 @@
 
 #pragma once
 #include "expr_node.h"
+#include "row_batch.h"
 //#include "sql_parser.h"
 
 namespace baikaldb {
@@ -33,6 +34,7 @@ public:
     }
 
     void init(const ExprValue& value) {
+        _batch_result.reset();
         _value = value;
         _is_constant = true;
         _has_null = value.is_null();
@@ -192,6 +194,7 @@ public:
     }
 
     void cast_to_col_type(pb::PrimitiveType type) {
+        _batch_result.reset();
         if (is_datetime_specic(type) && _value.is_numberic()) {
             _value.cast_to(pb::STRING);
         }
@@ -203,6 +206,24 @@ public:
         return _value.cast_to(_col_type);
     }
 
+    // 常量广播成整列, 行数不变时直接复用
+    virtual ColumnVector* eval_batch(RowBatch* rows, ColumnBatch* columns, const SelectVector& sel) {
+        size_t num_rows = rows->size();
+        if (_batch_result != nullptr && _batch_result->type() == _col_type
+                && _batch_result->size() == num_rows) {
+            return _batch_result.get();
+        }
+        ColumnVector* result = batch_result(num_rows);
+        ExprValue value = get_value(nullptr);
+        for (size_t i = 0; i < num_rows; ++i) {
+            result->set_value(i, value);
+        }
+        return result;
+    }
+    virtual bool support_eval_batch() {
+        return true;
+    }
+
 private:
     void value_to_node_type() {
         _col_type = _value.type;
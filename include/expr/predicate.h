@@ -18,6 +18,7 @@
 #include "expr_value.h"
 #include "scalar_fn_call.h"
 #include "re2/re2.h"
+#include "bloom_filter.h"
 #include <boost/optional.hpp>
 
 namespace baikaldb {
@@ -167,6 +168,30 @@ private:
     re2::RE2::Options _option;
 };
 
+// join时由build侧等值列的值构造, 下推到probe侧store过滤, 只会误判不会漏判
+// bloom数据放在derive_node.string_val, hash个数放在derive_node.int_val
+class BloomFilterPredicate : public ScalarFnCall {
+public:
+    virtual int init(const pb::ExprNode& node);
+    virtual int type_inferer() {
+        return ExprNode::type_inferer();
+    }
+    virtual ExprValue get_value(MemRow* row);
+    virtual void transfer_pb(pb::ExprNode* pb_node) {
+        ScalarFnCall::transfer_pb(pb_node);
+        pb_node->mutable_derive_node()->set_string_val(_bloom_filter.bits());
+        pb_node->mutable_derive_node()->set_int_val(_bloom_filter.num_hashes());
+    }
+    BloomFilter* mutable_bloom_filter() {
+        return &_bloom_filter;
+    }
+    // 与Joiner::encode_hash_key的编码一致
+    static uint64_t hash_values(std::vector<ExprValue>& values);
+
+private:
+    BloomFilter _bloom_filter;
+};
+
 class NotPredicate : public ScalarFnCall {
 public:
     virtual ExprValue get_value(MemRow* row) {
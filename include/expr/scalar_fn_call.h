@@ -17,6 +17,7 @@
 #include <functional>
 #include "expr_node.h"
 #include "fn_manager.h"
+#include "batch_kernels.h"
 
 namespace baikaldb {
 class ScalarFnCall : public ExprNode {
@@ -26,6 +27,10 @@ public:
     virtual void children_swap();
     virtual int open();
     virtual ExprValue get_value(MemRow* row);
+    virtual ColumnVector* eval_batch(RowBatch* rows, ColumnBatch* columns, const SelectVector& sel);
+    virtual bool support_eval_batch() {
+        return _batch_op != batch::OP_NONE;
+    }
     pb::Function fn() {
         return _fn;
     }
@@ -40,6 +45,8 @@ public:
         return ExprNode::get_last_insert_id();
     }
 private:
+    void init_batch_op();
+
     ExprValue multi_eq_value(MemRow* row) {
         for (size_t i = 0; i < children(0)->children_size(); i++) {
             auto left = children(0)->children(i)->get_value(row);
@@ -116,6 +123,8 @@ private:
 protected:
     pb::Function _fn;
     bool _is_row_expr = false;
+    // open时确定的列式kernel, OP_NONE表示走逐行计算
+    batch::BinaryOp _batch_op = batch::OP_NONE;
     std::function<ExprValue(const std::vector<ExprValue>&)> _fn_call;
 };
 }
@@ -14,6 +14,7 @@
 
 #pragma once
 #include "expr_node.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 class SlotRef : public ExprNode {
@@ -34,6 +35,24 @@ public:
         }
         return row->get_value(_tuple_id, _slot_id).cast_to(_col_type);
     }
+    // 直接返回ColumnBatch中的列, 列不存在时从rows中按列转置一次
+    virtual ColumnVector* eval_batch(RowBatch* rows, ColumnBatch* columns, const SelectVector& sel) {
+        ColumnVector* column = columns->get_column(_tuple_id, _slot_id);
+        if (column == nullptr) {
+            if (columns->load_column(rows, _tuple_id, _slot_id, _col_type) < 0) {
+                return nullptr;
+            }
+            column = columns->get_column(_tuple_id, _slot_id);
+        }
+        if (column == nullptr || column->type() != _col_type) {
+            // 同一slot被不同类型引用, 走逐行计算
+            return ExprNode::eval_batch(rows, columns, sel);
+        }
+        return column;
+    }
+    virtual bool support_eval_batch() {
+        return true;
+    }
 
     SlotRef* clone() {
         SlotRef* s = new SlotRef;
@@ -0,0 +1,77 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "common.h"
+#include "lru_cache.h"
+#include "query_context.h"
+
+namespace baikaldb {
+DECLARE_bool(enable_plan_cache);
+
+// 缓存的逻辑计划模板, 插入缓存后只读
+struct PlanCacheEntry {
+    struct TableRef {
+        int64_t db_id = -1;
+        int64_t table_id = -1;
+        int64_t version = -1;
+    };
+    std::string normalized_sql;
+    size_t num_params = 0;
+    pb::Plan plan;
+    std::vector<pb::TupleDescriptor> tuple_descs;
+    std::vector<TableRef> tables;
+
+    std::string family;
+    std::string table;
+    std::string resource_tag;
+    int64_t table_id = -1;
+    std::string sample_sql;
+    uint64_t sign = 0;
+    bool is_straight_join = false;
+    std::map<std::string, int32_t> field_column_id_mapping;
+    std::map<int64_t, std::map<std::string, int32_t>> ref_slot_id_mapping;
+    std::map<int64_t, std::map<int32_t, int32_t>> slot_column_mapping;
+    std::set<int64_t> current_tuple_ids;
+    std::set<int64_t> current_table_tuple_ids;
+};
+typedef std::shared_ptr<PlanCacheEntry> SmartPlanCacheEntry;
+
+// 文本协议单表select的逻辑计划缓存, 所有连接共享
+// where中比较运算的常量替换成占位符, 以替换后的sql为key,
+// 命中后跳过逻辑计划, create_plan_tree时重新绑定本次的常量
+// 表的schema version变化后缓存失效
+class PlanCache : public Singleton<PlanCache> {
+public:
+    PlanCache();
+    // 参数化ctx->stmt, 成功时设置ctx->normalized_sql和ctx->plan_cache_params
+    // 返回-1表示该sql不走计划缓存, parse tree未被修改
+    int normalize(QueryContext* ctx, butil::Arena& arena);
+    // 0: 命中, ctx已填充逻辑计划; -1: 未命中或校验不通过(如无权限、schema变化), 需走逻辑计划
+    int fill_from_cache(QueryContext* ctx);
+    // 逻辑计划生成后调用, 满足条件时加入缓存
+    void add_to_cache(QueryContext* ctx);
+    std::string get_info() {
+        return _cache.get_info();
+    }
+
+private:
+    CacheBudget _budget;
+    ShardedCache<uint64_t, SmartPlanCacheEntry> _cache;
+    bvar::Adder<int64_t> _invalid_count;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
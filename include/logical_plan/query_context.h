@@ -234,6 +234,9 @@ public:
     std::map<int, ExprNode*> placeholders;
     std::string         prepare_stmt_name;
     std::vector<pb::ExprNode> param_values;
+    // 计划缓存: 参数化后的sql和被替换出来的常量
+    std::string         normalized_sql;
+    std::vector<pb::ExprNode> plan_cache_params;
 
     SmartState          runtime_state;  // baikaldb side runtime state
     NetworkSocket*      client_conn = nullptr; // used for baikaldb
@@ -0,0 +1,60 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "common.h"
+#include "mem_row.h"
+#include "mem_row_descriptor.h"
+#include "proto/store.interface.pb.h"
+
+namespace baikaldb {
+// 将MemRow按列编码成pb::ColumnBlock, 用于store返回select结果
+// 字符串列低基数时用字典编码, 数值列和字典id重复多时用游程编码
+class ColumnBlockEncoder {
+public:
+    int init(MemRowDescriptor* desc);
+    void add_row(MemRow* row);
+    int64_t num_rows() const {
+        return _num_rows;
+    }
+    // 输出后encoder清空, 可以继续add_row
+    void finish(pb::ColumnBlock* block);
+
+private:
+    struct Column {
+        int32_t tuple_id = 0;
+        const google::protobuf::FieldDescriptor* field = nullptr;
+        std::vector<uint64_t> null_bits;
+        bool has_null = false;
+        std::vector<int64_t> int_values;
+        std::vector<uint64_t> uint_values;
+        std::vector<double> double_values;
+        std::vector<std::string> str_values;
+    };
+    void finish_column(Column& column, pb::ColumnValues* values);
+
+    std::vector<Column> _columns;
+    int64_t _num_rows = 0;
+};
+
+class ColumnBlockDecoder {
+public:
+    // 解码出的行按行序追加到rows, 列数据不合法(如被merge过)返回-1
+    static int decode(MemRowDescriptor* desc, const pb::ColumnBlock& block,
+            google::protobuf::Arena* arena, std::vector<std::unique_ptr<MemRow>>* rows);
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
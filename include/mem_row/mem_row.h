@@ -29,10 +29,15 @@ class MemRowDescriptor;
 class MemRow final {
 friend MemRowDescriptor;
 public:
-    explicit MemRow(int size) : _tuples(size), _tuples_assignd(size), _used_size(0) {
+    explicit MemRow(int size, bool arena_owned = false) : _tuples(size), _tuples_assignd(size),
+        _used_size(0), _arena_owned(arena_owned) {
     }
 
     ~MemRow() {
+        // arena上分配的tuple随RuntimeState一起释放
+        if (_arena_owned) {
+            return;
+        }
         for (auto& t : _tuples) {
             delete t;
             t = nullptr;
@@ -67,6 +72,10 @@ public:
 
     void to_string(int32_t tuple_id, std::string* out);
     std::string debug_string(int32_t tuple_id);
+    // 落盘用的紧凑格式, 逐个非空tuple追加: tuple_id(4B) + len(4B) + pb
+    void serialize(std::string* out);
+    // 需要由同一个MemRowDescriptor fetch出的空行调用
+    int deserialize(const char* data, size_t size);
 
     void clear() {
         for (auto& t : _tuples) {
@@ -158,6 +167,7 @@ private:
     std::vector<google::protobuf::Message*> _tuples;
     std::vector<bool> _tuples_assignd;
     int64_t _used_size;
+    bool _arena_owned;
 };
 }
 
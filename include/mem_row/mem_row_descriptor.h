@@ -21,6 +21,7 @@
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/dynamic_message.h>
 #include <google/protobuf/descriptor.pb.h>
+#include <google/protobuf/arena.h>
 
 using google::protobuf::FieldDescriptorProto;
 
@@ -42,7 +43,8 @@ public:
 
     google::protobuf::Message* new_tuple_message(int32_t tuple_id);
 
-    std::unique_ptr<MemRow> fetch_mem_row();
+    // arena不为空时tuple在arena上分配, MemRow析构时不再逐个释放
+    std::unique_ptr<MemRow> fetch_mem_row(google::protobuf::Arena* arena = nullptr);
 
     int tuple_size() {
         return _id_tuple_mapping.size();
@@ -0,0 +1,86 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <bthread/mutex.h>
+#include "proto/meta.interface.pb.h"
+#include "common.h"
+
+namespace baikaldb {
+DECLARE_bool(hot_spot_balance);
+
+// 按store心跳上报的region负载做热点调度
+// leader/peer数量均衡由RegionManager/ClusterManager按个数做, 这里只处理个数均衡但负载不均的store:
+// leader负载超过同resource_tag平均值hot_spot_load_ratio%的store, 把负载最高的leader转给低负载的peer;
+// store总负载(leader+follower)超过平均值hot_spot_load_ratio%的store, 把负载最高的follower迁到低负载的store
+class HotSpotScheduler {
+public:
+    static HotSpotScheduler* get_instance() {
+        static HotSpotScheduler instance;
+        return &instance;
+    }
+
+    // region负载按权重折算成一个值
+    static int64_t weighted_load(const pb::RegionLoad& load);
+
+    // 每次心跳更新store的leader负载, 心跳带全量peer_infos时同时更新store总负载
+    void update_instance_load(const pb::StoreHeartBeatRequest* request);
+
+    // leader热点调度, 返回发起的transfer leader个数
+    int leader_balance(const pb::StoreHeartBeatRequest* request,
+                       std::set<int64_t>& trans_leader_region_ids,
+                       pb::StoreHeartBeatResponse* response);
+
+    // peer热点调度, 在低负载的store上add peer, 多出的peer由check_peer_count从本store删除
+    void peer_balance(const pb::StoreHeartBeatRequest* request);
+
+    // leader负载是否高于同resource_tag的平均值, 按个数均衡时不再往这些store转leader
+    bool above_average_leader_load(const std::string& instance);
+
+    // 在candidates中选负载最低且加上region_load后不超过threshold的store, 没有返回空
+    // 选中后把region_load从instance挪到目标store上, 后续心跳到来前的调度也能看到
+    // is_leader为false时比较的是store总负载
+    std::string move_load(const std::string& instance, const std::vector<std::string>& candidates,
+                          int64_t region_load, int64_t threshold, bool is_leader);
+
+private:
+    HotSpotScheduler() {}
+
+    struct InstanceLoad {
+        std::string resource_tag;
+        int64_t leader_load = 0;
+        // leader和follower的负载之和, follower的负载主要是apply和follower读
+        int64_t total_load = 0;
+        int64_t leader_timestamp = 0;
+        int64_t total_timestamp = 0;
+    };
+    struct AverageLoad {
+        int64_t leader_load = 0;
+        int64_t total_load = 0;
+    };
+
+    // 调用方持有_mutex, 只统计心跳未过期的store
+    AverageLoad average_load(const std::string& resource_tag, int64_t now);
+
+    bthread::Mutex _mutex;
+    std::unordered_map<std::string, InstanceLoad> _instance_loads;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
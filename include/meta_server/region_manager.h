@@ -172,6 +172,7 @@ public:
         _instance_leader_count.clear();
         _instance_pk_prefix_leader_count.clear();
         _remove_region_peer_on_pk_prefix.clear();
+        _remove_region_peer_on_hot_spot.clear();
         _incremental_region_info.clear();
         _region_learner_peer_state_map.clear();
     }
@@ -420,6 +421,20 @@ public:
         BAIDU_SCOPED_LOCK(_count_mutex);
         _remove_region_peer_on_pk_prefix.erase(region_id);
     }
+    void add_remove_peer_on_hot_spot(const int64_t region_id, const std::string& instance) {
+        BAIDU_SCOPED_LOCK(_count_mutex);
+        _remove_region_peer_on_hot_spot[region_id] = instance;
+    }
+    bool need_remove_peer_on_hot_spot(const int64_t region_id, std::string& instance) {
+        BAIDU_SCOPED_LOCK(_count_mutex);
+        auto iter = _remove_region_peer_on_hot_spot.find(region_id);
+        if (iter == _remove_region_peer_on_hot_spot.end()) {
+            return false;
+        }
+        instance = iter->second;
+        _remove_region_peer_on_hot_spot.erase(iter);
+        return true;
+    }
     int64_t get_leader_count(const std::string& instance, int64_t table_id) {
         BAIDU_SCOPED_LOCK(_count_mutex);
         if (_instance_leader_count.find(instance) == _instance_leader_count.end()
@@ -529,6 +544,8 @@ private:
     // region_id -> logical_room，处理store心跳发现大户不均，标记需要迁移的region_id及其候选store需要在的logical room
     // check_peer_count发现region_id在map里，直接按照大户的维度删除peer数最多的candidate，否则按照table维度删除peer
     std::unordered_map<int64_t, std::string>            _remove_region_peer_on_pk_prefix;
+    // region_id -> instance，热点调度add peer后, check_peer_count优先删除热点store上的peer
+    std::unordered_map<int64_t, std::string>            _remove_region_peer_on_hot_spot;
 
     bthread_mutex_t                                     _doing_mutex;
     std::set<std::string>                               _doing_migrate; 
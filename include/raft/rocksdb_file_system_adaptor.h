@@ -14,21 +14,27 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
 #ifdef BAIDU_INTERNAL
 #include <raft/file_system_adaptor.h>
 #else
 #include <braft/file_system_adaptor.h>
 #endif
+#include <bthread/condition_variable.h>
 #include "rocks_wrapper.h"
 #include "sst_file_writer.h"
 
 namespace baikaldb {
+DECLARE_bool(snapshot_ship_sst);
 
 const std::string SNAPSHOT_DATA_FILE = "region_data_snapshot.sst";
 const std::string SNAPSHOT_META_FILE = "region_meta_snapshot.sst";
+// 直接传输leader上生成的sst文件, 接收端仍落成SNAPSHOT_DATA_FILE0...N, ingest流程不变
+const std::string SNAPSHOT_SST_FILES = "region_data_sst_files";
 const std::string SNAPSHOT_DATA_FILE_WITH_SLASH = "/" + SNAPSHOT_DATA_FILE;
 const std::string SNAPSHOT_META_FILE_WITH_SLASH = "/" + SNAPSHOT_META_FILE;
+const std::string SNAPSHOT_SST_FILES_WITH_SLASH = "/" + SNAPSHOT_SST_FILES;
 const size_t SST_FILE_LENGTH = 128 * 1024 * 1024;
 
 class RocksdbFileSystemAdaptor;
@@ -51,6 +57,92 @@ struct IteratorContext {
 
 typedef std::shared_ptr<IteratorContext> IteratorContextPtr;
 
+// leader按index并发把region数据生成sst文件, 按key序拼成一个流发送:
+// 每个文件为 8字节文件长度 + 文件内容, 文件生成完即可读, 不必等全部生成
+struct SstFilesContext {
+    struct SstFile {
+        std::string path;
+        int64_t size = 0;
+        // 在流中的起始位置(含长度头)
+        int64_t offset = 0;
+    };
+    // 一个index的key范围
+    struct Partition {
+        std::string lower_bound;
+        std::string upper_bound;
+        std::vector<SstFile> files;
+        bool done = false;
+    };
+
+    ~SstFilesContext();
+    // 调用方持有mutex, 把已生成完的文件按key序追加到files, 全部生成完时置done
+    void publish();
+
+    bthread::Mutex mutex;
+    bthread::ConditionVariable cv;
+    std::vector<Partition> partitions;
+    size_t next_partition = 0;
+    size_t next_file = 0;
+    std::vector<SstFile> files;
+    // files在流中的总长度
+    int64_t total_size = 0;
+    bool done = false;
+    bool failed = false;
+    // 快照关闭时取消生成, reader关闭不取消, braft重试时可以继续读已生成的文件
+    std::atomic<bool> cancel {false};
+    bool reading = false;
+    bool need_copy_data = true;
+    // 最近一次读到的位置, 判断快照是否长时间无人读取
+    std::atomic<int64_t> read_offset {0};
+};
+
+typedef std::shared_ptr<SstFilesContext> SstFilesContextPtr;
+
+// 从已生成的文件拼成的流中读取, 缓存当前读的文件fd
+class SstFilesStreamReader {
+public:
+    ~SstFilesStreamReader();
+    // 读[offset, offset + size)中files已覆盖的部分, 返回读到的字节数, 失败返回-1
+    ssize_t read(const std::vector<SstFilesContext::SstFile>& files, butil::IOPortal* portal,
+                 int64_t offset, size_t size);
+
+private:
+    int _fd = -1;
+    int64_t _fd_file_idx = -1;
+};
+
+// 按长度头把流切分成文件 path0...N, 每个文件写完即sync
+class SstFilesStreamWriter {
+public:
+    SstFilesStreamWriter(int64_t region_id, const std::string& path)
+        : _region_id(region_id), _path(path) {}
+    ~SstFilesStreamWriter() {
+        close();
+    }
+    // 按顺序追加流数据, 失败返回-1
+    int write(const butil::IOBuf& data);
+    // 最后一个文件不完整时删除该文件并返回false
+    bool close();
+    int file_num() const {
+        return _sst_idx;
+    }
+
+private:
+    int finish_file();
+
+    int64_t _region_id;
+    std::string _path;
+    int _sst_idx = 0;
+    int _fd = -1;
+    int64_t _file_offset = 0;
+    int64_t _file_remain = 0;
+    char _header[sizeof(uint64_t)];
+    size_t _header_len = 0;
+};
+
+// 删除db_path下进程退出前未清理的快照sst文件, store启动时调用
+void clear_snapshot_sst_files();
+
 struct SnapshotContext {
     SnapshotContext()
         : snapshot(RocksWrapper::get_instance()->get_snapshot()) {}
@@ -62,11 +154,19 @@ struct SnapshotContext {
     const rocksdb::Snapshot* snapshot = nullptr;
     IteratorContextPtr data_context = nullptr;
     IteratorContextPtr meta_context = nullptr;
+    SstFilesContextPtr sst_files_context = nullptr;
     int64_t data_index = 0;
 };
 
 typedef std::shared_ptr<SnapshotContext> SnapshotContextPtr;
 
+// 按index切分region在snapshot中的key范围, 每个index一个分区, 失败返回-1
+int init_sst_partitions(const rocksdb::Snapshot* snapshot, int64_t region_id,
+                        SstFilesContext* context);
+// 生成一个分区的sst文件并发布到context, 失败时置context->failed
+void build_sst_files(SnapshotContextPtr sc, SstFilesContextPtr context, size_t partition_idx,
+                     int64_t region_id, int64_t build_id);
+
 class PosixDirReader : public braft::DirReader {
 friend class RocksdbFileSystemAdaptor;
 public:
@@ -171,6 +271,77 @@ private:
     std::unique_ptr<SstFileWriter> _writer;
 };
 
+//读取leader上生成的sst文件流, 文件内容通过pread直接读入IOPortal
+class SstFilesReaderAdaptor : public braft::FileAdaptor {
+friend class RocksdbFileSystemAdaptor;
+public:
+    virtual ~SstFilesReaderAdaptor();
+
+    virtual ssize_t read(butil::IOPortal* portal, off_t offset, size_t size) override;
+
+    virtual ssize_t size() override;
+
+    virtual bool close() override;
+    void open() {
+        _closed = false;
+    }
+    virtual ssize_t write(const butil::IOBuf& data, off_t offset) override;
+
+    virtual bool sync() override;
+
+protected:
+    SstFilesReaderAdaptor(int64_t region_id,
+                        const std::string& path,
+                        RocksdbFileSystemAdaptor* rs,
+                        SstFilesContextPtr context);
+
+private:
+    bool region_shutdown();
+    // 等待[0, end)可读或全部生成完, 最多等snapshot_sst_read_wait_ms, 失败或超时返回-1
+    int wait_readable(int64_t end);
+
+    int64_t _region_id;
+    SmartRegion _region_ptr;
+    std::string _path;
+    RocksdbFileSystemAdaptor* _rs = nullptr;
+    SstFilesContextPtr _context = nullptr;
+    bool _closed = true;
+    SstFilesStreamReader _stream;
+};
+
+//接收sst文件流, 按长度头切分后直接写成SNAPSHOT_DATA_FILE0...N
+class SstFilesWriterAdaptor : public braft::FileAdaptor {
+friend class RocksdbFileSystemAdaptor;
+public:
+    virtual ~SstFilesWriterAdaptor();
+
+    int open();
+
+    virtual ssize_t write(const butil::IOBuf& data, off_t offset) override;
+
+    virtual bool close() override;
+
+    virtual ssize_t read(butil::IOPortal* portal, off_t offset, size_t size) override;
+
+    virtual ssize_t size() override;
+
+    virtual bool sync() override;
+
+protected:
+    SstFilesWriterAdaptor(int64_t region_id, const std::string& path);
+
+private:
+    bool region_shutdown();
+
+    int64_t _region_id;
+    SmartRegion _region_ptr;
+    // 接收端文件前缀: 快照目录/SNAPSHOT_DATA_FILE
+    std::string _path;
+    bool _closed = true;
+    SstFilesStreamWriter _stream;
+    int64_t _data_size = 0;
+};
+
 class PosixFileAdaptor : public braft::FileAdaptor {
 friend class RocksdbFileSystemAdaptor;
 public:
@@ -219,8 +390,12 @@ private:
     braft::FileAdaptor* open_writer_adaptor(const std::string& path, int oflag,
                               const ::google::protobuf::Message* file_meta,
                               butil::File::Error* e);
+    braft::FileAdaptor* open_sst_files_reader_adaptor(const std::string& path,
+                              butil::File::Error* e);
 
     SnapshotContextPtr get_snapshot(const std::string& path);
+    // 通过peer状态和data_index判断是否需要复制数据
+    bool need_copy_data(int64_t data_index);
 
 private:
     struct ContextEnv {
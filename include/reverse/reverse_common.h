@@ -36,10 +36,15 @@
 
 namespace baikaldb {
 DECLARE_bool(reverse_print_log);
+DECLARE_int64(reverse_cache_max_bytes);
+DECLARE_int64(reverse_cache_min_bytes);
+DECLARE_int32(reverse_cache_shard_bits);
 typedef std::shared_ptr<google::protobuf::Message> MessageSP;
 typedef std::pair<std::string, std::string> KeyRange;
 extern std::atomic_long g_statistic_insert_key_num;
 extern std::atomic_long g_statistic_delete_key_num;
+// 所有倒排索引的list/seg cache共享的字节预算, 命中统计汇总到reverse_cache_shard_N_hit/miss
+CacheBudget* reverse_cache_budget();
 
 #ifdef BAIDU_INTERNAL
 extern drpc::NLPCClient* wordrank_client;
@@ -198,10 +198,10 @@ public:
                         _is_seg_cache(is_seg_cache),
                         _cached_list_length(cached_list_length) {
         if (is_over_cache) {
-            _cache.init(cache_size);
+            _cache.init(cache_size, 0, FLAGS_reverse_cache_shard_bits, reverse_cache_budget());
         }
         if (is_seg_cache) {
-            _seg_cache.init(cache_size);
+            _seg_cache.init(cache_size, 0, FLAGS_reverse_cache_shard_bits, reverse_cache_budget());
         }
     }
     ~ReverseIndex(){}
@@ -407,8 +407,8 @@ private:
     RocksWrapper*       _rocksdb;
     KeyRange            _key_range;
     int64_t             _level_1_scan_count = 0;
-    Cache<std::string, ReverseListSptr> _cache;
-    Cache<std::string, std::shared_ptr<std::map<std::string, ReverseNode>>> _seg_cache;
+    ShardedCache<std::string, ReverseListSptr> _cache;
+    ShardedCache<std::string, std::shared_ptr<std::map<std::string, ReverseNode>>> _seg_cache;
     pb::SegmentType _segment_type;
     bool _is_over_cache;
     bool _is_seg_cache;
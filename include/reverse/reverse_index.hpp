@@ -116,7 +116,11 @@ int ReverseIndex<Schema>::handle_reverse(
     if (_is_seg_cache) {
         if (_seg_cache.find(word, &cache_seg_res) != 0) {
             Schema::segment(word, pk, record, _segment_type, _name_field_id_map, flag, *seg_res);
-            _seg_cache.add(word, seg_res);
+            int64_t charge = word.size();
+            for (auto& pair : *seg_res) {
+                charge += pair.first.size() + sizeof(ReverseNode);
+            }
+            _seg_cache.add(word, seg_res, charge);
         } else {
             *seg_res = *cache_seg_res;
             // 填充pk，flag信息
@@ -596,7 +600,7 @@ int ReverseIndex<Schema>::_get_level_reverse_list(
         if (_is_over_cache) {
             if (is_over_cache) {
                 if (((ReverseList*)tmp_ptr.get())->reverse_nodes_size() >= _cached_list_length) {
-                    _cache.add(key, tmp_ptr);
+                    _cache.add(key, tmp_ptr, key.size() + value.size());
                 }
             }
         }
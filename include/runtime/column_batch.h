@@ -0,0 +1,97 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "column_vector.h"
+#include "row_batch.h"
+
+namespace baikaldb {
+// RowBatch的列存视图, 按(tuple_id, slot_id)组织列, 用于批量过滤, 过滤结果仍是RowBatch的行
+// 列存表扫描时过滤列由TableIterator按列产出; 其余列在表达式求值时按需从RowBatch转置
+class ColumnBatch {
+public:
+    ColumnBatch() {}
+    size_t size() const {
+        return _num_rows;
+    }
+    void clear() {
+        _columns.clear();
+        _loaded.clear();
+        _num_rows = 0;
+    }
+    // 换batch时调用, 列的内存保留下来复用
+    void reset() {
+        _loaded.clear();
+        _num_rows = 0;
+    }
+    ColumnVector* get_column(int32_t tuple_id, int32_t slot_id) {
+        uint64_t key = column_key(tuple_id, slot_id);
+        if (_loaded.count(key) == 0) {
+            return nullptr;
+        }
+        return _columns[key].get();
+    }
+    ColumnVector* add_column(int32_t tuple_id, int32_t slot_id, pb::PrimitiveType type) {
+        uint64_t key = column_key(tuple_id, slot_id);
+        auto& column = _columns[key];
+        if (column == nullptr || column->type() != type) {
+            column.reset(new ColumnVector(type));
+        } else if (_loaded.count(key) == 1) {
+            return column.get();
+        }
+        column->clear();
+        column->resize(_num_rows);
+        _loaded.insert(key);
+        return column.get();
+    }
+    void set_num_rows(size_t num_rows) {
+        _num_rows = num_rows;
+        for (auto& pair : _columns) {
+            pair.second->resize(num_rows);
+        }
+    }
+
+    // 从RowBatch中按列转置单个slot, 每列只做一次字段反射查找
+    int load_column(RowBatch* batch, int32_t tuple_id, int32_t slot_id, pb::PrimitiveType type);
+    // 转置RowBatch中tuple_descs描述的所有slot
+    int from_row_batch(RowBatch* batch, const std::vector<pb::TupleDescriptor>& tuple_descs);
+
+    int64_t used_size() const {
+        int64_t used = sizeof(*this);
+        for (auto& pair : _columns) {
+            used += pair.second->used_size();
+        }
+        return used;
+    }
+
+private:
+    static uint64_t column_key(int32_t tuple_id, int32_t slot_id) {
+        return ((uint64_t)(uint32_t)tuple_id << 32) | (uint32_t)slot_id;
+    }
+
+private:
+    std::unordered_map<uint64_t, std::unique_ptr<ColumnVector>> _columns;
+    // 当前batch已经填充的列
+    std::unordered_set<uint64_t> _loaded;
+    size_t _num_rows = 0;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -0,0 +1,151 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include "expr_value.h"
+
+namespace baikaldb {
+// 列存batch中行下标的选择向量，只保存通过过滤的行
+typedef std::vector<uint32_t> SelectVector;
+
+// 单列数据, 按物理类型存放到连续数组中, 以便批量计算
+// INT8~INT64,TIME => int64; UINT8~UINT64,BOOL,DATE,DATETIME,TIMESTAMP => uint64;
+// FLOAT,DOUBLE => double; 其余 => string
+class ColumnVector {
+public:
+    enum PhysicalType {
+        PT_INT64,
+        PT_UINT64,
+        PT_DOUBLE,
+        PT_STRING
+    };
+    explicit ColumnVector(pb::PrimitiveType type) : _type(type) {
+        _physical_type = physical_type(type);
+    }
+    static PhysicalType physical_type(pb::PrimitiveType type) {
+        switch (type) {
+            case pb::INT8:
+            case pb::INT16:
+            case pb::INT32:
+            case pb::INT64:
+            case pb::TIME:
+                return PT_INT64;
+            case pb::BOOL:
+            case pb::UINT8:
+            case pb::UINT16:
+            case pb::UINT32:
+            case pb::UINT64:
+            case pb::DATE:
+            case pb::DATETIME:
+            case pb::TIMESTAMP:
+                return PT_UINT64;
+            case pb::FLOAT:
+            case pb::DOUBLE:
+                return PT_DOUBLE;
+            default:
+                return PT_STRING;
+        }
+    }
+    pb::PrimitiveType type() const {
+        return _type;
+    }
+    PhysicalType physical_type() const {
+        return _physical_type;
+    }
+    size_t size() const {
+        return _size;
+    }
+    // 预分配n行, 所有行初始为null
+    void resize(size_t n);
+    void reserve(size_t n);
+    void clear() {
+        _int_vals.clear();
+        _uint_vals.clear();
+        _double_vals.clear();
+        _str_vals.clear();
+        _null_bitmap.clear();
+        _size = 0;
+    }
+
+    bool is_null(size_t idx) const {
+        return (_null_bitmap[idx >> 6] >> (idx & 63)) & 1;
+    }
+    void set_null(size_t idx) {
+        _null_bitmap[idx >> 6] |= (1ULL << (idx & 63));
+    }
+    void set_not_null(size_t idx) {
+        _null_bitmap[idx >> 6] &= ~(1ULL << (idx & 63));
+    }
+    bool has_null() const {
+        for (auto word : _null_bitmap) {
+            if (word != 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void append(const ExprValue& value) {
+        resize(_size + 1);
+        set_value(_size - 1, value);
+    }
+    void append_null() {
+        resize(_size + 1);
+    }
+    void set_value(size_t idx, const ExprValue& value);
+    ExprValue get_value(size_t idx) const;
+
+    int64_t* int_data() {
+        return _int_vals.data();
+    }
+    uint64_t* uint_data() {
+        return _uint_vals.data();
+    }
+    double* double_data() {
+        return _double_vals.data();
+    }
+    std::vector<std::string>& str_data() {
+        return _str_vals;
+    }
+    std::vector<uint64_t>& null_bitmap() {
+        return _null_bitmap;
+    }
+    int64_t used_size() const {
+        int64_t used = sizeof(*this) + _null_bitmap.size() * sizeof(uint64_t)
+            + _int_vals.size() * sizeof(int64_t) + _uint_vals.size() * sizeof(uint64_t)
+            + _double_vals.size() * sizeof(double);
+        for (auto& str : _str_vals) {
+            used += str.size() + sizeof(std::string);
+        }
+        return used;
+    }
+
+private:
+    pb::PrimitiveType _type;
+    PhysicalType _physical_type;
+    size_t _size = 0;
+    std::vector<int64_t> _int_vals;
+    std::vector<uint64_t> _uint_vals;
+    std::vector<double> _double_vals;
+    std::vector<std::string> _str_vals;
+    // bit为1表示null
+    std::vector<uint64_t> _null_bitmap;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
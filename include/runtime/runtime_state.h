@@ -39,6 +39,10 @@ using google::protobuf::RepeatedPtrField;
 namespace baikaldb {
 DECLARE_int32(single_store_concurrency);
 DECLARE_int32(per_txn_max_num_locks);
+DECLARE_int64(sort_spill_budget);
+DECLARE_int64(store_sort_spill_budget);
+DECLARE_bool(mem_row_use_arena);
+DECLARE_int64(mem_row_arena_max_bytes);
 struct TxnLimitMap {
     static TxnLimitMap* get_instance() {
         static TxnLimitMap _instance;
@@ -135,6 +139,10 @@ public:
     MemRowDescriptor* mem_row_desc() {
         return _mem_row_desc.get();
     }
+    // 本次请求MemRow使用的arena, 请求结束时整体释放
+    // 未开启或者超过FLAGS_mem_row_arena_max_bytes时返回nullptr, 退回到堆上分配
+    // arena上的行不能比RuntimeState活得久, 需要跨请求保留的行要拷贝到堆上
+    google::protobuf::Arena* mem_row_arena();
     int64_t region_id() {
         return _region_id;
     }
@@ -229,6 +237,13 @@ public:
     bool sort_use_index() {
         return _sort_use_index;
     }
+    // 排序超过该内存后有序run落盘, <=0表示不落盘
+    int64_t sort_spill_budget() const {
+        return _sort_spill_budget;
+    }
+    void set_sort_spill_budget(int64_t budget) {
+        _sort_spill_budget = budget;
+    }
 
     uint64_t log_id() {
         return _log_id;
@@ -415,6 +430,8 @@ private:
     bool _is_expr_subquery = false;
     std::vector<pb::TupleDescriptor> _tuple_descs;
     SmartDescriptor _mem_row_desc;
+    // 需要在所有MemRow之后析构, 由持有RuntimeState的一方保证exec tree先销毁
+    std::unique_ptr<google::protobuf::Arena> _mem_row_arena;
     // MemRowDescriptor _mem_row_desc;
     int64_t          _region_id = 0;
     int64_t          _region_version = 0;
@@ -435,6 +452,7 @@ private:
     bool              _optimize_1pc = false;  // 2pc de-generates to 1pc when autocommit=true and
     // 如果用了排序列做索引，就不需要排序了
     bool              _sort_use_index = false;
+    int64_t           _sort_spill_budget = FLAGS_sort_spill_budget;
     bool              _use_backup = false;
     bool              _need_learner_backup = false;
                                               // there is only 1 region.
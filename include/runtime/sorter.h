@@ -15,37 +15,96 @@
 #pragma once
 
 #include <algorithm> 
+#include <functional>
 #include <vector>
 #include "common.h"
 #include "row_batch.h"
 #include "mem_row_compare.h"
+#include "spill_file.h"
 
 namespace baikaldb {
+class RuntimeState;
 //对每个batch并行的做sort后，再用heap做归并
+//开启落盘后, 内存中的batch排序后写成有序run, 最终用败者树多路归并
 class Sorter {
 public:
     Sorter(MemRowCompare* comp) : _comp(comp), _idx(0) {
     }
     void add_batch(std::shared_ptr<RowBatch>& batch) {
         batch->reset();
+        _added_rows += batch->size();
         _min_heap.push_back(batch);
     }
     void sort();
     void merge_sort();
     int get_next(RowBatch* batch, bool* eos);
 
+    void set_spill_row_desc(MemRowDescriptor* desc) {
+        _spill_row_desc = desc;
+    }
+    // 设置后, 落盘和Top-N丢弃的行所占内存从state的内存统计中扣除
+    void set_runtime_state(RuntimeState* state) {
+        _state = state;
+    }
+    // 已加入的batch排序后写成一个有序run
+    int spill();
+    bool is_spilled() const {
+        return !_runs.empty();
+    }
+    // 落盘后代替sort()调用, 剩余batch也落盘并构建败者树
+    int prepare_merge_runs();
+
+    // Top-N模式, 只保留排序后的前n行
+    void set_top_n(int64_t top_n) {
+        _top_n = top_n;
+    }
+    // Top-N模式下代替add_batch, 不小于当前第n行的行直接丢弃
+    void add_top_n_batch(RowBatch& batch);
+
     size_t batch_size() {
         return _min_heap.size();
     }
+    // batch读完时用下一页替换, 返回1表示已替换, 0表示没有下一页
+    // 用于分页读取的region, 每个batch的后续页都接在它后面输出
+    typedef std::function<int(std::shared_ptr<RowBatch>& batch)> RefillFunc;
+    void set_refill(const RefillFunc& refill) {
+        _refill = refill;
+    }
 private:
+    int refill(std::shared_ptr<RowBatch>& batch) {
+        if (_refill == nullptr) {
+            return 0;
+        }
+        return _refill(batch);
+    }
     void multi_sort();
     void make_heap();
     void shiftdown(size_t index);
+    int get_next_in_memory(RowBatch* batch, bool* eos);
+    int get_next_from_runs(RowBatch* batch, bool* eos);
+    int read_run(int idx);
+    bool run_less(int left, int right);
+    void adjust_loser_tree(int idx);
 
 private:
     MemRowCompare* _comp;
     std::vector<std::shared_ptr<RowBatch>> _min_heap;
     size_t _idx;
+
+    MemRowDescriptor* _spill_row_desc = nullptr;
+    RuntimeState* _state = nullptr;
+    int64_t _added_rows = 0;
+    std::vector<std::unique_ptr<SpillFile>> _runs;
+    // 各run当前行, nullptr表示已读完
+    std::vector<std::unique_ptr<MemRow>> _run_rows;
+    // _loser_tree[0]为胜者, 其余节点记录败者run下标
+    std::vector<int> _loser_tree;
+
+    RefillFunc _refill;
+
+    int64_t _top_n = -1;
+    // 大顶堆, 堆顶为当前第n行
+    std::vector<std::unique_ptr<MemRow>> _top_n_heap;
 };
 }
 
@@ -0,0 +1,59 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <memory>
+#include "common.h"
+#include "mem_row.h"
+#include "mem_row_descriptor.h"
+
+namespace baikaldb {
+DECLARE_string(spill_dir);
+
+// 算子内存超限时用于落盘的临时文件, 顺序写完后再顺序读
+// 文件创建后立即unlink, 关闭或进程退出时由系统回收
+class SpillFile {
+public:
+    SpillFile() {}
+    ~SpillFile() {
+        if (_fp != nullptr) {
+            fclose(_fp);
+            _fp = nullptr;
+        }
+    }
+    int open();
+    int write_row(MemRow* row);
+    // 刷盘并切换到读模式
+    int finish_write();
+    // 读到文件尾时*eof置为true
+    int read_row(MemRowDescriptor* desc, std::unique_ptr<MemRow>* row, bool* eof);
+
+    int64_t row_count() const {
+        return _row_count;
+    }
+    int64_t byte_size() const {
+        return _byte_size;
+    }
+private:
+    FILE* _fp = nullptr;
+    std::string _buf;
+    int64_t _row_count = 0;
+    int64_t _byte_size = 0;
+};
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -39,6 +39,8 @@ DECLARE_string(meta_server_bns);
 class TsoFetcher {
 public:
     static int64_t get_tso();
+    // 直接从meta取count个连续tso, 返回第一个
+    static int64_t gen_tso(int64_t count);
 };
 
 class BinlogContext {
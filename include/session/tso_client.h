@@ -0,0 +1,64 @@
+// Copyright (c) 2020-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#ifdef BAIDU_INTERNAL
+#include <bthread.h>
+#else
+#include <bthread/bthread.h>
+#endif
+#include <bthread/condition_variable.h>
+#include <bthread/mutex.h>
+#include <bvar/bvar.h>
+#include "common.h"
+
+namespace baikaldb {
+DECLARE_bool(tso_client_batch);
+
+// baikaldb端tso请求合并, 只做合并不做预取
+// 并发的取tso请求合并成一次rpc, meta一次分配一段连续的timestamp按到达顺序分给各请求
+// 只合并到请求到达之后才发出的rpc, 保证取到的tso大于请求开始前meta已分配的所有tso
+// 预取的窗口即使只发meta已返回的timestamp, 也可能早于其他实例在本请求开始前提交的commit_ts,
+// 破坏跨实例的顺序, 所以每个请求至少等一次在它到达之后发出的rpc
+class TsoClient : public Singleton<TsoClient> {
+public:
+    int64_t get_tso();
+
+    static bvar::LatencyRecorder tso_rpc_time;
+    static bvar::IntRecorder tso_batch_count;
+
+private:
+    // 一次rpc合并的请求
+    struct TsoBatch {
+        int64_t count = 0;
+        int64_t start = -1;
+        bool done = false;
+    };
+    typedef std::shared_ptr<TsoBatch> SmartTsoBatch;
+
+    // 调用方持有lock, rpc期间释放
+    void fetch(std::unique_lock<bthread::Mutex>& lock);
+
+    bthread::Mutex _mutex;
+    bthread::ConditionVariable _cv;
+    // 以下受_mutex保护
+    // 等待下一次rpc的请求, rpc发出后新到的请求进入新的batch
+    SmartTsoBatch _pending_batch;
+    bool _fetching = false;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -100,6 +100,15 @@ struct ConvertToSyncClosure : public braft::Closure {
     int64_t region_id = 0;
 };
 
+// multi_query中单个region的query结束后通知
+struct MultiQueryClosure : public google::protobuf::Closure {
+    explicit MultiQueryClosure(BthreadCond& cond) : cond(cond) {}
+    virtual void Run() {
+        cond.decrease_signal();
+    }
+    BthreadCond& cond;
+};
+
 struct SnapshotClosure : public braft::Closure {
     virtual void Run() {
         if (!status().ok()) {
@@ -0,0 +1,76 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <bthread/mutex.h>
+#include "common.h"
+
+namespace baikaldb {
+DECLARE_bool(load_split);
+DECLARE_int32(load_split_write_weight);
+
+// 按负载分裂的访问采样
+// 配置表、计数器等region数据量很小, 按行数/大小永远不会分裂, 但访问集中时会限制整张表的吞吐
+// 每次访问累加负载, 按load_split_sample_rate抽样记录访问的key(与region start_key/end_key同编码),
+// 负载连续load_split_sustain_times个检查周期超过阈值后, 按采样key的负载分布选分裂点
+class LoadSplitSampler {
+public:
+    // 每次访问都调用, weight为本次访问折算的负载
+    void add_load(int64_t weight) {
+        _load.fetch_add(weight, std::memory_order_relaxed);
+    }
+    // 是否对本次访问采样key
+    bool need_sample() const;
+    // 蓄水池采样, 最多保留load_split_sample_num个key
+    void sample(const std::string& key, int64_t weight);
+
+    // 分裂检查线程每个周期调用一次, 负载连续load_split_sustain_times个周期超过阈值返回true
+    bool check_hot();
+
+    // 选分裂点使两边采样负载最接近, 分裂点在(start_key, end_key)内,
+    // 两边负载都不低于load_split_min_ratio%, 单key热点等无法拆分时返回-1
+    int get_split_key(const std::string& start_key, const std::string& end_key,
+                      std::string& split_key);
+
+    // 分裂发起后重新累计
+    void reset();
+
+    size_t sample_size() {
+        BAIDU_SCOPED_LOCK(_mutex);
+        return _samples.size();
+    }
+
+private:
+    struct Sample {
+        std::string key;
+        int64_t weight;
+    };
+
+    std::atomic<int64_t> _load {0};
+    // 以下两个只在分裂检查线程访问
+    TimeCost _last_check;
+    int32_t _hot_times = 0;
+
+    bthread::Mutex _mutex;
+    std::vector<Sample> _samples;
+    // 蓄水池采样已见过的key个数
+    int64_t _sample_count = 0;
+};
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
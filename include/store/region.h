@@ -55,8 +55,10 @@
 #include "meta_writer.h"
 #include "rpc_sender.h"
 #include "exec_node.h"
+#include "select_cursor.h"
 #include "concurrency.h"
 #include "backup.h"
+#include "load_split_sampler.h"
 
 #ifdef BAIDU_INTERNAL
 #else
@@ -89,6 +91,10 @@ namespace baikaldb {
 DECLARE_int64(disable_write_wait_timeout_us);
 DECLARE_int32(prepare_slow_down_wait);
 DECLARE_int64(binlog_warn_timeout_minute);
+DECLARE_bool(enable_apply_group_commit);
+DECLARE_int32(apply_group_commit_max_entries);
+DECLARE_int32(apply_lanes);
+DECLARE_int32(apply_lane_max_entries);
 
 static const int32_t RECV_QUEUE_SIZE = 128;
 struct StatisticsInfo {
@@ -133,6 +139,24 @@ struct ApproximateInfo {
     TimeCost last_version_time_cost;
 };
 
+// region的读写负载, 心跳时换算成上次心跳以来的每秒平均值上报meta
+struct RegionLoadStat {
+    std::atomic<int64_t> read_count {0};
+    std::atomic<int64_t> write_count {0};
+    std::atomic<int64_t> scan_rows {0};
+    std::atomic<int64_t> read_bytes {0};
+    TimeCost last_collect;
+
+    void collect(pb::RegionLoad* load) {
+        double seconds = std::max(last_collect.get_time(), (int64_t)1) / 1000000.0;
+        last_collect.reset();
+        load->set_read_qps(read_count.exchange(0) / seconds);
+        load->set_write_qps(write_count.exchange(0) / seconds);
+        load->set_scan_rows(scan_rows.exchange(0) / seconds);
+        load->set_read_bytes(read_bytes.exchange(0) / seconds);
+    }
+};
+
 class region;
 class ScopeProcStatus {
 public:
@@ -234,6 +258,7 @@ private:
 };
 
 class TransactionPool;
+struct DMLClosure;
 typedef std::shared_ptr<Region> SmartRegion;
 class Region : public braft::StateMachine, public std::enable_shared_from_this<Region> {
 friend class RegionControl;
@@ -245,6 +270,7 @@ public:
     virtual ~Region() {
         shutdown();
         join();
+        clear_select_cursors(false);
         for (auto& pair : _reverse_index_map) {
             delete pair.second;
         }
@@ -329,6 +355,8 @@ public:
     }
 
     int init(bool new_region, int32_t snapshot_times);
+    // 不依赖raft的初始化(key范围, 索引, 事务池), 单测可以只做这部分后直接apply
+    int init_resource(bool new_region);
     void wait_table_info() {
         while (!_factory->exist_tableid(get_table_id())) {
             DB_WARNING("region_id: %ld wait for table_info: %ld", _region_id, get_table_id());
@@ -387,8 +415,31 @@ public:
             const RepeatedPtrField<pb::TupleDescriptor>& tuples,
             pb::StoreRes& response);
     int select_normal(RuntimeState& state, ExecNode* root, pb::StoreRes& response);
+    // max_rows > 0时读够max_rows行(按batch取整)即返回, eos表示是否读完
+    // column_block为true时结果按列编码到response.column_block
+    int select_normal(RuntimeState& state, ExecNode* root, pb::StoreRes& response,
+            int64_t max_rows, bool column_block, bool* eos);
+    int select_cursor_next(const pb::StoreReq& request, pb::StoreRes& response);
+    // baikaldb不再需要的游标(查询结束, backup request另一端先返回)
+    void close_select_cursor(const pb::StoreReq& request, pb::StoreRes& response);
+    void close_select_cursor(SmartSelectCursor cursor);
+    void clear_select_cursors(bool only_expired);
     int select_sample(RuntimeState& state, ExecNode* root, const pb::AnalyzeInfo& analyze_info, pb::StoreRes& response);
     void do_apply(int64_t term, int64_t index, const pb::StoreReq& request, braft::Closure* done);
+    // leader端已执行完的1pc dml在状态机内提交
+    void commit_leader_1pc(DMLClosure* done, int64_t applied_index);
+    // on_apply中连续的leader端1pc dml攒批后合并成一次rocksdb提交
+    bool can_group_commit(const pb::StoreReq& request, braft::Closure* done, int64_t index);
+    void group_commit_1pc();
+    // follower上单行1pc dml按主键分到多个lane并行apply, 同主键保持日志顺序
+    bool can_apply_in_lane(const pb::StoreReq& request, braft::Closure* done, int64_t index, std::string* key);
+    bool get_apply_lane_key(const pb::StoreReq& request, std::string* key);
+    void apply_in_lanes();
+    int dml_1pc_in_lane(const pb::StoreReq& request, int64_t applied_index, SmartTransaction txn);
+    // on_apply的单条日志, 接管done; 攒批的日志在finish_apply_entries中提交
+    void apply_entry(int64_t term, int64_t index, std::shared_ptr<pb::StoreReq> request,
+            braft::Closure* done);
+    void finish_apply_entries();
     virtual void on_apply(braft::Iterator& iter);
    
     virtual void on_shutdown();
@@ -545,6 +596,14 @@ public:
             int64_t& split_end_index);
     
     int get_split_key(std::string& split_key, int64_t& split_key_term);
+    // 按负载分裂, 分裂检查线程每周期调用, 负载持续超过阈值时返回true
+    bool check_load_hot() {
+        return _load_split_sampler.check_hot();
+    }
+    // 按采样的访问key选分裂点, 尾region也走非尾分裂流程
+    int get_load_split_key(std::string& split_key, int64_t& split_key_term);
+    // 采样本次访问的主键(或全局索引key)范围
+    void sample_access_key(const pb::PossibleIndex& pos_index, int64_t weight);
     
     int64_t get_region_id() const {
         return _region_id;
@@ -819,6 +878,7 @@ public:
         }
         _multi_thread_cond.increase();
         _txn_pool.clear_transactions(this);
+        clear_select_cursors(true);
         _multi_thread_cond.decrease_signal();
     }
     void update_ttl_info() {
@@ -1241,6 +1301,8 @@ private:
 
     TimeCost                        _time_cost; //上次收到请求的时间，每次收到请求都重置一次
     LatencyOnly                     _dml_time_cost;
+    RegionLoadStat                  _load_stat;
+    LoadSplitSampler                _load_split_sampler;
     bool                                _restart = false;
     //计算存储分离开关，在store定时任务中更新，避免每次dml都访问schema factory
     bool                                _storage_compute_separate = false;
@@ -1283,6 +1345,15 @@ private:
     TimeCost                            _removed_time_cost;
     TransactionPool                     _txn_pool;
     RuntimeStatePool                    _state_pool;
+    SelectCursorMap                     _select_cursors;
+    std::vector<DMLClosure*>            _group_commit_dones; //只在状态机线程访问
+    struct ApplyLaneEntry {
+        std::shared_ptr<pb::StoreReq> request;
+        int64_t index = 0;
+        int64_t term = 0;
+        std::string key; //主键编码
+    };
+    std::vector<ApplyLaneEntry>         _apply_lane_entries; //只在状态机线程访问
 
     // shared_ptr is not thread safe when assign
     std::mutex  _ptr_mutex;
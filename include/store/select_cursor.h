@@ -0,0 +1,68 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <bthread/mutex.h>
+#include "common.h"
+#include "runtime_state.h"
+
+namespace baikaldb {
+DECLARE_int64(select_cursor_timeout_s);
+DECLARE_int32(select_cursor_max_per_region);
+
+class ExecNode;
+// 分页select在store端保留的执行状态, 下一页请求带cursor_id继续get_next
+struct SelectCursor {
+    SmartState state;
+    ExecNode* root = nullptr;
+    uint64_t db_conn_id = 0; // 校验续读请求与创建游标的请求来自同一连接
+    bool column_block = false;
+    int64_t scan_rows = 0;   // 已返回给baikaldb的扫描行数
+    int64_t filter_rows = 0;
+    int64_t rows = 0;
+    TimeCost last_access;
+};
+typedef std::shared_ptr<SelectCursor> SmartSelectCursor;
+
+// region上的游标表, 只管登记和查找, 取出的游标由调用方执行或关闭
+class SelectCursorMap {
+public:
+    // 未超过select_cursor_max_per_region时才分页
+    bool can_add();
+    // 登记新游标, cursor_id为0时随机生成; 返回0表示baikaldb已先关闭了该id(backup request落败)
+    uint64_t add(uint64_t cursor_id, SmartSelectCursor cursor);
+    // 续读时独占取出, 不存在或不是同一连接返回nullptr
+    SmartSelectCursor take(uint64_t cursor_id, uint64_t db_conn_id);
+    // 本页读完后放回
+    void put_back(uint64_t cursor_id, SmartSelectCursor cursor);
+    // 返回要关闭的游标; 游标还未建立时记下id, 建立时直接关闭
+    SmartSelectCursor close(uint64_t cursor_id, uint64_t db_conn_id);
+    // 取出全部或空闲超时的游标, 同时清理过期的已关闭id
+    void clear(bool only_expired, std::vector<SmartSelectCursor>* cursors);
+    size_t size() {
+        BAIDU_SCOPED_LOCK(_lock);
+        return _cursors.size();
+    }
+
+private:
+    bthread::Mutex _lock;
+    std::map<uint64_t, SmartSelectCursor> _cursors;
+    // 关闭时还未建立的游标id
+    std::map<uint64_t, TimeCost> _closed_ids;
+};
+}  // namespace baikaldb
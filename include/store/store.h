@@ -83,6 +83,11 @@ public:
                        pb::StoreRes* response,
                        google::protobuf::Closure* done);
 
+    virtual void multi_query(google::protobuf::RpcController* controller,
+                       const pb::MultiStoreReq* request,
+                       pb::MultiStoreRes* response,
+                       google::protobuf::Closure* done);
+
     void async_apply_log_entry(google::protobuf::RpcController* controller,
                               const pb::BatchStoreReq* request,
                               pb::BatchStoreRes* response,
@@ -0,0 +1,355 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "row_codec.h"
+#include <algorithm>
+#include <cstring>
+
+namespace baikaldb {
+DEFINE_bool(use_row_codec, true, "encode/decode table record by schema-compiled codec, default: true");
+
+using google::protobuf::Descriptor;
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+namespace {
+// 字段号过大时索引表太稀疏, 直接不用codec
+const uint32_t MAX_FIELD_NUM = 65536;
+
+inline size_t write_varint(uint64_t value, char* buf) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        buf[size++] = static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    buf[size++] = static_cast<char>(value);
+    return size;
+}
+
+inline bool read_varint(const char* data, size_t size, size_t* offset, uint64_t* value) {
+    uint64_t raw = 0;
+    for (int shift = 0; shift < 64 && *offset < size; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(data[(*offset)++]);
+        raw |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            *value = raw;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+inline bool read_fixed(const char* data, size_t size, size_t* offset, T* value) {
+    if (*offset + sizeof(T) > size) {
+        return false;
+    }
+    memcpy(value, data + *offset, sizeof(T));
+    *offset += sizeof(T);
+    return true;
+}
+
+inline uint32_t wire_type_of(FieldDescriptor::Type type) {
+    switch (type) {
+    case FieldDescriptor::TYPE_FIXED64:
+    case FieldDescriptor::TYPE_SFIXED64:
+    case FieldDescriptor::TYPE_DOUBLE:
+        return 1;
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES:
+        return 2;
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_SFIXED32:
+    case FieldDescriptor::TYPE_FLOAT:
+        return 5;
+    default:
+        return 0;
+    }
+}
+} // namespace
+
+RowCodec* RowCodec::create(const Descriptor* descriptor) {
+    if (descriptor == nullptr) {
+        return nullptr;
+    }
+    RowCodec* codec = new (std::nothrow) RowCodec;
+    if (codec == nullptr) {
+        return nullptr;
+    }
+    codec->_descriptor = descriptor;
+    uint32_t max_field_num = 0;
+    for (int i = 0; i < descriptor->field_count(); ++i) {
+        const FieldDescriptor* field = descriptor->field(i);
+        if (field->is_repeated() || field->containing_oneof() != nullptr
+                || field->number() > (int)MAX_FIELD_NUM) {
+            delete codec;
+            return nullptr;
+        }
+        switch (field->type()) {
+        case FieldDescriptor::TYPE_ENUM:
+        case FieldDescriptor::TYPE_MESSAGE:
+        case FieldDescriptor::TYPE_GROUP:
+            delete codec;
+            return nullptr;
+        default:
+            break;
+        }
+        Entry entry;
+        entry.field_num = field->number();
+        entry.type = field->type();
+        entry.wire_type = wire_type_of(field->type());
+        entry.tag_size = write_varint((entry.field_num << 3) | entry.wire_type, entry.tag);
+        entry.field = field;
+        codec->_entries.emplace_back(entry);
+        max_field_num = std::max(max_field_num, entry.field_num);
+    }
+    // protobuf按字段号顺序序列化, 保持一致
+    std::sort(codec->_entries.begin(), codec->_entries.end(),
+            [](const Entry& l, const Entry& r) { return l.field_num < r.field_num; });
+    codec->_index.assign(max_field_num + 1, -1);
+    for (size_t i = 0; i < codec->_entries.size(); ++i) {
+        codec->_index[codec->_entries[i].field_num] = i;
+    }
+    return codec;
+}
+
+int RowCodec::encode(const Message& message, std::string* out) const {
+    const Reflection* reflection = message.GetReflection();
+    if (message.GetDescriptor() != _descriptor
+            || reflection->GetUnknownFields(message).field_count() != 0) {
+        return message.SerializeToString(out) ? 0 : -1;
+    }
+    out->clear();
+    // tag(5) + varint(10)
+    char buf[16];
+    std::string scratch;
+    for (auto& entry : _entries) {
+        const FieldDescriptor* field = entry.field;
+        if (!reflection->HasField(message, field)) {
+            continue;
+        }
+        memcpy(buf, entry.tag, entry.tag_size);
+        size_t size = entry.tag_size;
+        switch (entry.type) {
+        case FieldDescriptor::TYPE_SINT32: {
+            int32_t value = reflection->GetInt32(message, field);
+            size += write_varint((static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31),
+                    buf + size);
+            break;
+        }
+        case FieldDescriptor::TYPE_SINT64: {
+            int64_t value = reflection->GetInt64(message, field);
+            size += write_varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63),
+                    buf + size);
+            break;
+        }
+        case FieldDescriptor::TYPE_INT32:
+            // 负数按64位符号扩展, 与protobuf一致
+            size += write_varint(static_cast<int64_t>(reflection->GetInt32(message, field)), buf + size);
+            break;
+        case FieldDescriptor::TYPE_INT64:
+            size += write_varint(reflection->GetInt64(message, field), buf + size);
+            break;
+        case FieldDescriptor::TYPE_UINT32:
+            size += write_varint(reflection->GetUInt32(message, field), buf + size);
+            break;
+        case FieldDescriptor::TYPE_UINT64:
+            size += write_varint(reflection->GetUInt64(message, field), buf + size);
+            break;
+        case FieldDescriptor::TYPE_BOOL:
+            buf[size++] = reflection->GetBool(message, field) ? 1 : 0;
+            break;
+        case FieldDescriptor::TYPE_FIXED32: {
+            uint32_t value = reflection->GetUInt32(message, field);
+            memcpy(buf + size, &value, sizeof(value));
+            size += sizeof(value);
+            break;
+        }
+        case FieldDescriptor::TYPE_SFIXED32: {
+            int32_t value = reflection->GetInt32(message, field);
+            memcpy(buf + size, &value, sizeof(value));
+            size += sizeof(value);
+            break;
+        }
+        case FieldDescriptor::TYPE_FLOAT: {
+            float value = reflection->GetFloat(message, field);
+            memcpy(buf + size, &value, sizeof(value));
+            size += sizeof(value);
+            break;
+        }
+        case FieldDescriptor::TYPE_FIXED64: {
+            uint64_t value = reflection->GetUInt64(message, field);
+            memcpy(buf + size, &value, sizeof(value));
+            size += sizeof(value);
+            break;
+        }
+        case FieldDescriptor::TYPE_SFIXED64: {
+            int64_t value = reflection->GetInt64(message, field);
+            memcpy(buf + size, &value, sizeof(value));
+            size += sizeof(value);
+            break;
+        }
+        case FieldDescriptor::TYPE_DOUBLE: {
+            double value = reflection->GetDouble(message, field);
+            memcpy(buf + size, &value, sizeof(value));
+            size += sizeof(value);
+            break;
+        }
+        case FieldDescriptor::TYPE_STRING:
+        case FieldDescriptor::TYPE_BYTES: {
+            const std::string& value = reflection->GetStringReference(message, field, &scratch);
+            size += write_varint(value.size(), buf + size);
+            out->append(buf, size);
+            out->append(value);
+            continue;
+        }
+        default:
+            DB_FATAL("invalid type: %d, field_num: %u", entry.type, entry.field_num);
+            return -1;
+        }
+        out->append(buf, size);
+    }
+    return 0;
+}
+
+int RowCodec::decode(const char* data, size_t size, Message* message) const {
+    if (message->GetDescriptor() != _descriptor) {
+        return message->ParseFromArray(data, size) ? 0 : -1;
+    }
+    const Reflection* reflection = message->GetReflection();
+    message->Clear();
+    size_t offset = 0;
+    while (offset < size) {
+        uint64_t tag = 0;
+        if (!read_varint(data, size, &offset, &tag)) {
+            return -1;
+        }
+        const Entry* entry = find_entry(tag >> 3);
+        if (entry == nullptr || entry->wire_type != (tag & 0x07)) {
+            // 已删除的字段等, 交给protobuf保留到unknown fields
+            return message->ParseFromArray(data, size) ? 0 : -1;
+        }
+        const FieldDescriptor* field = entry->field;
+        uint64_t raw = 0;
+        switch (entry->type) {
+        case FieldDescriptor::TYPE_SINT32:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetInt32(message, field,
+                    static_cast<int32_t>((static_cast<uint32_t>(raw) >> 1) ^ -(static_cast<uint32_t>(raw) & 1)));
+            break;
+        case FieldDescriptor::TYPE_SINT64:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetInt64(message, field, static_cast<int64_t>((raw >> 1) ^ -(raw & 1)));
+            break;
+        case FieldDescriptor::TYPE_INT32:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetInt32(message, field, static_cast<int32_t>(raw));
+            break;
+        case FieldDescriptor::TYPE_INT64:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetInt64(message, field, static_cast<int64_t>(raw));
+            break;
+        case FieldDescriptor::TYPE_UINT32:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetUInt32(message, field, static_cast<uint32_t>(raw));
+            break;
+        case FieldDescriptor::TYPE_UINT64:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetUInt64(message, field, raw);
+            break;
+        case FieldDescriptor::TYPE_BOOL:
+            if (!read_varint(data, size, &offset, &raw)) {
+                return -1;
+            }
+            reflection->SetBool(message, field, raw != 0);
+            break;
+        case FieldDescriptor::TYPE_FIXED32: {
+            uint32_t value = 0;
+            if (!read_fixed(data, size, &offset, &value)) {
+                return -1;
+            }
+            reflection->SetUInt32(message, field, value);
+            break;
+        }
+        case FieldDescriptor::TYPE_SFIXED32: {
+            int32_t value = 0;
+            if (!read_fixed(data, size, &offset, &value)) {
+                return -1;
+            }
+            reflection->SetInt32(message, field, value);
+            break;
+        }
+        case FieldDescriptor::TYPE_FLOAT: {
+            float value = 0;
+            if (!read_fixed(data, size, &offset, &value)) {
+                return -1;
+            }
+            reflection->SetFloat(message, field, value);
+            break;
+        }
+        case FieldDescriptor::TYPE_FIXED64: {
+            uint64_t value = 0;
+            if (!read_fixed(data, size, &offset, &value)) {
+                return -1;
+            }
+            reflection->SetUInt64(message, field, value);
+            break;
+        }
+        case FieldDescriptor::TYPE_SFIXED64: {
+            int64_t value = 0;
+            if (!read_fixed(data, size, &offset, &value)) {
+                return -1;
+            }
+            reflection->SetInt64(message, field, value);
+            break;
+        }
+        case FieldDescriptor::TYPE_DOUBLE: {
+            double value = 0;
+            if (!read_fixed(data, size, &offset, &value)) {
+                return -1;
+            }
+            reflection->SetDouble(message, field, value);
+            break;
+        }
+        case FieldDescriptor::TYPE_STRING:
+        case FieldDescriptor::TYPE_BYTES:
+            if (!read_varint(data, size, &offset, &raw) || raw > size - offset) {
+                return -1;
+            }
+            reflection->SetString(message, field, std::string(data + offset, raw));
+            offset += raw;
+            break;
+        default:
+            DB_FATAL("invalid type: %d, field_num: %u", entry->type, entry->field_num);
+            return -1;
+        }
+    }
+    return 0;
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
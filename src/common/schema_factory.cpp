@@ -219,9 +219,11 @@ void SchemaFactory::delete_table(const pb::SchemaInfo& table, SchemaMapping& bac
     delete tbl_info.file_proto;
     auto _pool = tbl_info.pool;
     auto _factory = tbl_info.factory;
+    auto _codec = tbl_info.row_codec;
     Bthread bth;
-    bth.run([table_id, _pool, _factory]() {
+    bth.run([table_id, _pool, _factory, _codec]() {
             bthread_usleep(3600 * 1000 * 1000LL);
+            delete _codec;
             delete _factory;
             delete _pool; 
             });
@@ -570,15 +572,19 @@ int SchemaFactory::update_table_internal(SchemaMapping& background, const pb::Sc
         }
         auto del_pool = tbl_info.pool;
         auto del_factory = tbl_info.factory;
+        auto del_codec = tbl_info.row_codec;
         tbl_info.pool = tmp_pool.release();
         tbl_info.factory = tmp_factory.release();
         tbl_info.tbl_desc = descriptor;
         tbl_info.msg_proto = tbl_info.factory->GetPrototype(tbl_info.tbl_desc);
+        // 不支持的schema返回nullptr, 走protobuf序列化
+        tbl_info.row_codec = RowCodec::create(tbl_info.tbl_desc);
 
         Bthread bth;
-        bth.run([table_id, del_pool, del_factory]() {
+        bth.run([table_id, del_pool, del_factory, del_codec]() {
                 // 延迟删除
                 bthread_usleep(3600 * 1000 * 1000LL); 
+                delete del_codec;
                 delete del_factory;
                 delete del_pool; 
                 });
@@ -1411,7 +1417,11 @@ void SchemaFactory::table_with_statistics_info(std::vector<std::string>& databas
 SmartRecord SchemaFactory::new_record(TableInfo& info) {
     Message* message = info.msg_proto->New();
     if (message) {
-        return SmartRecord(new (std::nothrow)TableRecord(message));
+        SmartRecord record(new (std::nothrow)TableRecord(message));
+        if (record != nullptr && FLAGS_use_row_codec) {
+            record->set_codec(info.row_codec);
+        }
+        return record;
     } else {
         DB_FATAL("new fail, table_id: %ld", info.id);
         return SmartRecord(nullptr);
@@ -122,146 +122,21 @@ int TupleRecord::decode_fields(const std::map<int32_t, FieldInfo*>& fields,
             //DB_WARNING("tag1: %d");
             return 0;
         }
-        int str_size = 0;
         if (field_num < static_cast<uint64_t>(iter->first)) {
             // skip current field in proto
-            switch (wired_type) {
-                case 0:
-                    skip_varint();
-                    break;
-                case 1:
-                    skip_fixed<double>();
-                    break;
-                case 2:
-                    skip_string();
-                    break;
-                case 5:
-                    skip_fixed<float>();
-                    break;
-                default:
-                    DB_FATAL("invalid wired_type: %d, offset: %lu,%lu", wired_type, _offset, _size);
-                    return -1;
+            if (skip_field(wired_type) != 0) {
+                return -1;
             }
         } else if (field_num == static_cast<uint64_t>(iter->first)) {
             auto field = get_field(iter->second, field_slot, record, tuple_id, mem_row);
-            switch (field->type()) {
-            case FieldDescriptor::TYPE_SINT32: {
-                //zigzag
-                int32_t value = 0;
-                uint32_t raw_val = get_varint<uint32_t>();
-                if (raw_val & 0x1) {
-                    value = (raw_val << 31) | ~(raw_val >> 1);
-                } else {
-                    value = (raw_val >> 1);
-                }
-                MessageHelper::set_int32(field, message, value);
-                break;
-            }
-            case FieldDescriptor::TYPE_SINT64: {
-                //zigzag
-                int64_t value = 0;
-                uint64_t raw_val = get_varint<uint64_t>();
-                if (raw_val & 0x1) {
-                    value = (raw_val << 63) | ~(raw_val >> 1);
-                } else {
-                    value = (raw_val >> 1);
-                }
-                MessageHelper::set_int64(field, message, value);
-                break;
-            }
-            case FieldDescriptor::TYPE_INT32: {
-                MessageHelper::set_int32(field, message, get_varint<int32_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_INT64: {
-                MessageHelper::set_int64(field, message, get_varint<int64_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_SFIXED32: {
-                MessageHelper::set_int32(field, message, get_fixed<int32_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_SFIXED64: {
-                MessageHelper::set_int64(field, message, get_fixed<int64_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_UINT32: {
-                MessageHelper::set_uint32(field, message, get_varint<uint32_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_UINT64: {
-                MessageHelper::set_uint64(field, message, get_varint<uint64_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_FIXED32: {
-                MessageHelper::set_uint32(field, message, get_fixed<uint32_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_FIXED64: {
-                MessageHelper::set_uint64(field, message, get_fixed<uint64_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_FLOAT: {
-                MessageHelper::set_float(field, message, get_fixed<float>());
-                break;
-            }
-            case FieldDescriptor::TYPE_DOUBLE: {
-                MessageHelper::set_double(field, message, get_fixed<double>());
-                break;
-            }
-            case FieldDescriptor::TYPE_BOOL: {
-                MessageHelper::set_boolean(field, message, get_varint<uint32_t>());
-                break;
-            }
-            case FieldDescriptor::TYPE_STRING: 
-            case FieldDescriptor::TYPE_BYTES: {
-                std::string tmp = get_string();
-                str_size = tmp.size();
-                MessageHelper::set_string(field, message, tmp);
-                break;
-            }
-            default: {
+            int used_size = 0;
+            if (decode_value(field, message, &used_size) != 0) {
                 DB_FATAL("invalid TYPE: %d, field_id:%d, offset: %lu,%lu",
                         field->type(), iter->first, _offset, _size);
                 return -1;
             }
-            }
             if (record == nullptr) {
-                switch (field->type()) {
-                case FieldDescriptor::TYPE_SINT32:
-                case FieldDescriptor::TYPE_INT32:
-                case FieldDescriptor::TYPE_SFIXED32:
-                case FieldDescriptor::TYPE_UINT32:
-                case FieldDescriptor::TYPE_FIXED32: {
-                    (*mem_row)->update_used_size(4);
-                    break;
-                }
-                case FieldDescriptor::TYPE_SINT64:
-                case FieldDescriptor::TYPE_INT64:
-                case FieldDescriptor::TYPE_SFIXED64:
-                case FieldDescriptor::TYPE_UINT64:
-                case FieldDescriptor::TYPE_FIXED64:
-                case FieldDescriptor::TYPE_FLOAT: {
-                    (*mem_row)->update_used_size(8);
-                    break;
-                }
-                case FieldDescriptor::TYPE_DOUBLE: {
-                    (*mem_row)->update_used_size(16);
-                    break;
-                }
-                case FieldDescriptor::TYPE_STRING: 
-                case FieldDescriptor::TYPE_BYTES: {
-                    (*mem_row)->update_used_size(str_size);
-                    break;
-                }
-                case FieldDescriptor::TYPE_BOOL: {
-                    (*mem_row)->update_used_size(1);
-                    break;
-                }
-                default: {
-                    break;
-                }
-                }
+                (*mem_row)->update_used_size(used_size);
             }
             iter++;
         }
@@ -278,4 +153,201 @@ int TupleRecord::decode_fields(const std::map<int32_t, FieldInfo*>& fields,
     return 0;
 }
 
+int TupleRecord::skip_field(int32_t wired_type) {
+    switch (wired_type) {
+        case 0:
+            skip_varint();
+            break;
+        case 1:
+            skip_fixed<double>();
+            break;
+        case 2:
+            skip_string();
+            break;
+        case 5:
+            skip_fixed<float>();
+            break;
+        default:
+            DB_FATAL("invalid wired_type: %d, offset: %lu,%lu", wired_type, _offset, _size);
+            return -1;
+    }
+    return 0;
+}
+
+// 解码一个字段的值写入message, used_size为MemRow的内存统计
+int TupleRecord::decode_value(const google::protobuf::FieldDescriptor* field,
+        google::protobuf::Message* message, int* used_size) {
+    switch (field->type()) {
+    case FieldDescriptor::TYPE_SINT32: {
+        //zigzag
+        int32_t value = 0;
+        uint32_t raw_val = get_varint<uint32_t>();
+        if (raw_val & 0x1) {
+            value = (raw_val << 31) | ~(raw_val >> 1);
+        } else {
+            value = (raw_val >> 1);
+        }
+        MessageHelper::set_int32(field, message, value);
+        *used_size = 4;
+        break;
+    }
+    case FieldDescriptor::TYPE_SINT64: {
+        //zigzag
+        int64_t value = 0;
+        uint64_t raw_val = get_varint<uint64_t>();
+        if (raw_val & 0x1) {
+            value = (raw_val << 63) | ~(raw_val >> 1);
+        } else {
+            value = (raw_val >> 1);
+        }
+        MessageHelper::set_int64(field, message, value);
+        *used_size = 8;
+        break;
+    }
+    case FieldDescriptor::TYPE_INT32: {
+        MessageHelper::set_int32(field, message, get_varint<int32_t>());
+        *used_size = 4;
+        break;
+    }
+    case FieldDescriptor::TYPE_INT64: {
+        MessageHelper::set_int64(field, message, get_varint<int64_t>());
+        *used_size = 8;
+        break;
+    }
+    case FieldDescriptor::TYPE_SFIXED32: {
+        MessageHelper::set_int32(field, message, get_fixed<int32_t>());
+        *used_size = 4;
+        break;
+    }
+    case FieldDescriptor::TYPE_SFIXED64: {
+        MessageHelper::set_int64(field, message, get_fixed<int64_t>());
+        *used_size = 8;
+        break;
+    }
+    case FieldDescriptor::TYPE_UINT32: {
+        MessageHelper::set_uint32(field, message, get_varint<uint32_t>());
+        *used_size = 4;
+        break;
+    }
+    case FieldDescriptor::TYPE_UINT64: {
+        MessageHelper::set_uint64(field, message, get_varint<uint64_t>());
+        *used_size = 8;
+        break;
+    }
+    case FieldDescriptor::TYPE_FIXED32: {
+        MessageHelper::set_uint32(field, message, get_fixed<uint32_t>());
+        *used_size = 4;
+        break;
+    }
+    case FieldDescriptor::TYPE_FIXED64: {
+        MessageHelper::set_uint64(field, message, get_fixed<uint64_t>());
+        *used_size = 8;
+        break;
+    }
+    case FieldDescriptor::TYPE_FLOAT: {
+        MessageHelper::set_float(field, message, get_fixed<float>());
+        *used_size = 8;
+        break;
+    }
+    case FieldDescriptor::TYPE_DOUBLE: {
+        MessageHelper::set_double(field, message, get_fixed<double>());
+        *used_size = 16;
+        break;
+    }
+    case FieldDescriptor::TYPE_BOOL: {
+        MessageHelper::set_boolean(field, message, get_varint<uint32_t>());
+        *used_size = 1;
+        break;
+    }
+    case FieldDescriptor::TYPE_STRING: 
+    case FieldDescriptor::TYPE_BYTES: {
+        uint64_t length = get_varint<uint64_t>();
+        // 直接构造临时string交给reflection, 少一次拷贝
+        message->GetReflection()->SetString(message, field, std::string(_data + _offset, length));
+        _offset += length;
+        *used_size = length;
+        break;
+    }
+    default: {
+        return -1;
+    }
+    }
+    return 0;
+}
+
+int TupleDecodePlan::init(const std::map<int32_t, FieldInfo*>& fields,
+        const std::vector<int32_t>* field_slot,
+        SmartRecord* record, int32_t tuple_id,
+        std::unique_ptr<MemRow>* mem_row) {
+    items.clear();
+    items.reserve(fields.size());
+    for (auto& pair : fields) {
+        Item item;
+        item.field_num = pair.first;
+        item.field = get_field(pair.second, field_slot, record, tuple_id, mem_row);
+        if (item.field == nullptr) {
+            descriptor = nullptr;
+            return -1;
+        }
+        item.default_value = &pair.second->default_expr_value;
+        items.emplace_back(item);
+    }
+    if (record != nullptr) {
+        descriptor = (*record)->get_raw_message()->GetDescriptor();
+    } else {
+        descriptor = (*mem_row)->get_tuple(tuple_id)->GetDescriptor();
+    }
+    return 0;
+}
+
+int TupleRecord::decode_fields(const TupleDecodePlan& plan,
+        google::protobuf::Message* message, MemRow* mem_row) {
+    auto iter = plan.items.begin();
+    auto end = plan.items.end();
+    while (_offset < _size && iter != end) {
+        uint64_t field_key = get_varint<uint64_t>();
+        uint64_t field_num = field_key >> 3;
+        int32_t wired_type = field_key & 0x07;
+        if (_offset >= _size) {
+            DB_WARNING("error: %lu, %lu", _offset, _size);
+            return -1;
+        }
+        // 行里没有的字段填默认值
+        while (iter != end && field_num > iter->field_num) {
+            MessageHelper::set_value(iter->field, message, *iter->default_value);
+            if (mem_row != nullptr) {
+                mem_row->update_used_size(iter->default_value->size());
+            }
+            ++iter;
+        }
+        if (iter == end) {
+            // 需要的字段都已解码, 剩余字节不再解析
+            return 0;
+        }
+        if (field_num < iter->field_num) {
+            if (skip_field(wired_type) != 0) {
+                return -1;
+            }
+            continue;
+        }
+        int used_size = 0;
+        if (decode_value(iter->field, message, &used_size) != 0) {
+            DB_FATAL("invalid TYPE: %d, field_id:%lu, offset: %lu,%lu",
+                    iter->field->type(), iter->field_num, _offset, _size);
+            return -1;
+        }
+        if (mem_row != nullptr) {
+            mem_row->update_used_size(used_size);
+        }
+        ++iter;
+    }
+    for (; iter != end; ++iter) {
+        MessageHelper::set_value(iter->field, message, *iter->default_value);
+        if (mem_row != nullptr) {
+            mem_row->update_used_size(iter->default_value->size());
+        }
+    }
+    return 0;
+}
+
 } //namespace baikaldb
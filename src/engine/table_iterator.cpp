@@ -15,6 +15,7 @@
 #include "table_iterator.h"
 #include "transaction.h"
 #include "tuple_record.h"
+#include "column_vector.h"
 
 namespace baikaldb {
 DEFINE_bool(cstore_scan_fill_cache, true, "cstore_scan_fill_cache");
@@ -467,8 +468,21 @@ int TableIterator::get_next_internal(SmartRecord* record, int32_t tuple_id, std:
     if (VAL_ONLY == _mode || KEY_VAL == _mode) {
         if (!_is_cstore) {
             TupleRecord tuple_record(value_slice);
+            google::protobuf::Message* message = nullptr;
+            if (record != nullptr) {
+                message = (*record)->get_raw_message();
+            } else {
+                message = (*mem_row)->get_tuple(tuple_id);
+            }
+            if (!_decode_plan.match(message)
+                    && 0 != _decode_plan.init(_fields, &_field_slot, record, tuple_id, mem_row)) {
+                DB_WARNING("init decode plan failed: %ld", _index_info->id);
+                _valid = false;
+                return -1;
+            }
             // only decode the required field (field_ids stored in fields)
-            if (0 != tuple_record.decode_fields(_fields, &_field_slot, record, tuple_id, mem_row)) {
+            if (0 != tuple_record.decode_fields(_decode_plan, message,
+                    record != nullptr ? nullptr : mem_row->get())) {
                 DB_WARNING("decode value failed: %ld, _use_ttl:%d", _index_info->id, _use_ttl);
                 _valid = false;
                 return -1;
@@ -506,7 +520,8 @@ int TableIterator::get_next_internal(SmartRecord* record, int32_t tuple_id, std:
     return 0;
 }
 
-int TableIterator::get_column(int32_t tuple_id, const FieldInfo& field, const FiltBitSet* filter, RowBatch* batch) {
+int TableIterator::get_column(int32_t tuple_id, const FieldInfo& field, const FiltBitSet* filter, RowBatch* batch,
+        ColumnVector* column) {
 
     int32_t field_id = field.id;
     int32_t slot_id = _field_slot[field_id];
@@ -576,6 +591,10 @@ int TableIterator::get_column(int32_t tuple_id, const FieldInfo& field, const Fi
                 }
             }
         }
+        if (column != nullptr) {
+            // 刚解码的字段直接按列写出, 过滤时不用再从行中转置
+            column->set_value(i, mem_row->get_value(tuple_id, slot_id));
+        }
         filter_num = 0;
     }
     return 0;
@@ -991,6 +991,115 @@ rocksdb::Status Transaction::rollback() {
     return res;
 }
 
+namespace {
+// 按column family把WriteBatch中的写入直接追加到目标事务的WriteBatch
+// PutUntracked在悲观事务上仍会加锁, 而这些行锁由被合并的事务持有, 会等到锁超时
+class UntrackedWriteHandler : public rocksdb::WriteBatch::Handler {
+public:
+    explicit UntrackedWriteHandler(myrocksdb::Transaction* txn) : _txn(txn) {
+        RocksWrapper* db = RocksWrapper::get_instance();
+        for (auto handle : {db->get_data_handle(), db->get_meta_info_handle(),
+                db->get_raft_log_handle(), db->get_bin_log_handle()}) {
+            if (handle != nullptr) {
+                _handles[handle->GetID()] = handle;
+            }
+        }
+    }
+    virtual rocksdb::Status PutCF(uint32_t cf_id, const rocksdb::Slice& key,
+            const rocksdb::Slice& value) override {
+        auto handle = get_handle(cf_id);
+        if (handle == nullptr) {
+            return rocksdb::Status::NotSupported("unknown column family");
+        }
+        return _txn->GetWriteBatch()->Put(handle, key, value);
+    }
+    virtual rocksdb::Status DeleteCF(uint32_t cf_id, const rocksdb::Slice& key) override {
+        auto handle = get_handle(cf_id);
+        if (handle == nullptr) {
+            return rocksdb::Status::NotSupported("unknown column family");
+        }
+        return _txn->GetWriteBatch()->Delete(handle, key);
+    }
+    virtual rocksdb::Status SingleDeleteCF(uint32_t cf_id, const rocksdb::Slice& key) override {
+        auto handle = get_handle(cf_id);
+        if (handle == nullptr) {
+            return rocksdb::Status::NotSupported("unknown column family");
+        }
+        return _txn->GetWriteBatch()->SingleDelete(handle, key);
+    }
+    virtual rocksdb::Status MergeCF(uint32_t cf_id, const rocksdb::Slice& key,
+            const rocksdb::Slice& value) override {
+        auto handle = get_handle(cf_id);
+        if (handle == nullptr) {
+            return rocksdb::Status::NotSupported("unknown column family");
+        }
+        return _txn->GetWriteBatch()->Merge(handle, key, value);
+    }
+    virtual rocksdb::Status DeleteRangeCF(uint32_t cf_id, const rocksdb::Slice& begin_key,
+            const rocksdb::Slice& end_key) override {
+        return rocksdb::Status::NotSupported("delete range");
+    }
+
+private:
+    rocksdb::ColumnFamilyHandle* get_handle(uint32_t cf_id) {
+        auto iter = _handles.find(cf_id);
+        if (iter == _handles.end()) {
+            return nullptr;
+        }
+        return iter->second;
+    }
+    myrocksdb::Transaction* _txn;
+    std::map<uint32_t, rocksdb::ColumnFamilyHandle*> _handles;
+};
+}
+
+int Transaction::merge_untracked(const std::vector<std::shared_ptr<Transaction>>& txns) {
+    BAIDU_SCOPED_LOCK(_txn_mutex);
+    last_active_time = butil::gettimeofday_us();
+    if (_is_finished) {
+        DB_WARNING("TransactionWarn: merge into a finished txn: %lu", _txn_id);
+        return -1;
+    }
+    _txn->SetSavePoint();
+    UntrackedWriteHandler handler(_txn);
+    for (auto& txn : txns) {
+        BAIDU_SCOPED_LOCK(txn->_txn_mutex);
+        if (txn->_is_finished || txn->_txn->GetName().size() != 0) {
+            DB_WARNING("TransactionWarn: txn: %lu can not be merged", txn->_txn_id);
+            _txn->RollbackToSavePoint();
+            return -1;
+        }
+        auto res = txn->_txn->GetWriteBatch()->GetWriteBatch()->Iterate(&handler);
+        if (!res.ok()) {
+            DB_WARNING("TransactionWarn: merge txn: %lu fail, msg: %s", txn->_txn_id, res.ToString().c_str());
+            _txn->RollbackToSavePoint();
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void Transaction::finish_merged(bool committed) {
+    if (!committed) {
+        rollback();
+        return;
+    }
+    BAIDU_SCOPED_LOCK(_txn_mutex);
+    last_active_time = butil::gettimeofday_us();
+    if (_is_finished) {
+        return;
+    }
+    // 写入已随合并事务提交, 这里只丢弃本地WriteBatch并释放行锁
+    auto res = _txn->Rollback();
+    if (!res.ok()) {
+        DB_WARNING("TransactionWarn: release merged txn: %lu fail, msg: %s", _txn_id, res.ToString().c_str());
+    }
+    _is_finished = true;
+    for (auto& base : _reverse_set) {
+        base->add_write_count();
+    }
+}
+
 int Transaction::set_save_point() {
     BAIDU_SCOPED_LOCK(_txn_mutex);
     last_active_time = butil::gettimeofday_us();
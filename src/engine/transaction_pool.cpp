@@ -678,15 +678,16 @@ void TransactionPool::get_prepared_txn_info(std::unordered_map<uint64_t, pb::Tra
 void TransactionPool::update_txn_num_rows_after_split(const std::vector<pb::TransactionInfo>& txn_infos) {
     for (auto& txn_info : txn_infos) {
         uint64_t txn_id = txn_info.txn_id();
-        if (!_txn_map.exist(txn_id)) {
+        SmartTransaction txn = _txn_map.get(txn_id);
+        if (txn == nullptr) {
             continue;
         }
         DB_WARNING("TransactionNote: region_id: %ld, txn_id: %lu, old_lines: %ld, dec_lines: %ld",
             _region_id, 
             txn_id, 
-            _txn_map[txn_id]->num_increase_rows, 
+            txn->num_increase_rows, 
             txn_info.num_rows());
-        _txn_map[txn_id]->num_increase_rows -= txn_info.num_rows();
+        txn->num_increase_rows -= txn_info.num_rows();
     }
 }
 void TransactionPool::clear() {
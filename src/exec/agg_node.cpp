@@ -17,6 +17,38 @@
 #include "query_context.h"
 
 namespace baikaldb {
+DEFINE_int32(agg_parallel_partitions, 8, "partition num of merge agg on baikaldb, <=1 means disable, default: 8");
+DEFINE_int32(agg_parallel_round_rows, 16384, "rows buffered before one round of partitioned agg, default: 16384");
+DEFINE_int32(agg_parallel_min_rows, 2048, "partitioned agg runs in current bthread when rows less than #, default: 2048");
+DEFINE_int64(agg_spill_memory_quota, 0, "spill partitioned agg hash table to disk when exceeds # bytes, 0 means disable");
+DEFINE_bool(agg_use_fixed_key, true, "use packed fixed-width key when all group exprs are integers, default: true");
+
+// 行内聚合函数不使用分组key
+static const std::string EMPTY_AGG_KEY;
+
+static int fixed_key_width(pb::PrimitiveType type) {
+    switch (type) {
+        case pb::BOOL:
+        case pb::INT8:
+        case pb::UINT8:
+            return 1;
+        case pb::INT16:
+        case pb::UINT16:
+            return 2;
+        case pb::INT32:
+        case pb::UINT32:
+        case pb::TIME:
+        case pb::DATE:
+        case pb::TIMESTAMP:
+            return 4;
+        case pb::INT64:
+        case pb::UINT64:
+        case pb::DATETIME:
+            return 8;
+        default:
+            return -1;
+    }
+}
 
 int AggNode::init(const pb::PlanNode& node) {
     int ret = 0;
@@ -121,6 +153,18 @@ int AggNode::open(RuntimeState* state) {
         }
     }
     _mem_row_desc = state->mem_row_desc();
+    _use_partition = can_use_partition();
+    if (_use_partition && _partitions.empty()) {
+        for (int i = 0; i < FLAGS_agg_parallel_partitions; ++i) {
+            _partitions.emplace_back(new AggPartition);
+            _partitions.back()->hash_map.init(4096);
+        }
+    }
+    _use_fixed_key = can_use_fixed_key();
+    if (_use_fixed_key && !_fixed_hash_map.initialized()) {
+        _fixed_hash_map.init(12301);
+    }
+    _fixed_iter = _fixed_hash_map.begin();
 
     TimeCost cost;
     int64_t agg_time = 0;
@@ -143,6 +187,21 @@ int AggNode::open(RuntimeState* state) {
             }
             scan_time += cost.get_time();
             cost.reset();
+            if (_use_partition) {
+                _row_cnt += batch.size();
+                for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                    _pending_rows.emplace_back(std::move(batch.get_row()));
+                }
+                if (_pending_rows.size() >= (size_t)FLAGS_agg_parallel_round_rows) {
+                    ret = process_pending_rows(state);
+                    if (ret < 0) {
+                        _iter = _hash_map.begin();
+                        return ret;
+                    }
+                }
+                agg_time += cost.get_time();
+                continue;
+            }
             int64_t used_size = 0;
             int64_t release_size = 0;
             process_row_batch(state, batch, used_size, release_size);
@@ -160,6 +219,18 @@ int AggNode::open(RuntimeState* state) {
             //}
         } while (!eos);
     }
+    if (_use_partition) {
+        TimeCost cost;
+        ret = process_pending_rows(state);
+        if (ret == 0) {
+            ret = load_partition(state, 0);
+        }
+        agg_time += cost.get_time();
+        if (ret < 0) {
+            _iter = _hash_map.begin();
+            return ret;
+        }
+    }
     LOCAL_TRACE_DESC << "agg time cost:" << agg_time << 
         " scan time cost:" << scan_time << " rows:" << _row_cnt;
 
@@ -179,9 +250,80 @@ int AggNode::open(RuntimeState* state) {
         }
     }
     _iter = _hash_map.begin();
+    if (_use_fixed_key) {
+        _fixed_iter = _fixed_hash_map.begin();
+    }
     return 0;
 }
 
+bool AggNode::can_use_fixed_key() {
+    if (!FLAGS_agg_use_fixed_key || _use_partition) {
+        return false;
+    }
+    // null_flag只有8位
+    if (_group_exprs.empty() || _group_exprs.size() > 8) {
+        return false;
+    }
+    for (auto agg : _agg_fn_calls) {
+        if (!agg->is_row_local_agg()) {
+            return false;
+        }
+    }
+    _fixed_key_types.clear();
+    _fixed_key_widths.clear();
+    size_t width = sizeof(uint8_t);
+    for (auto expr : _group_exprs) {
+        int w = fixed_key_width(expr->col_type());
+        if (w < 0) {
+            return false;
+        }
+        _fixed_key_types.emplace_back(expr->col_type());
+        _fixed_key_widths.emplace_back(w);
+        width += w;
+    }
+    return width <= sizeof(FixedAggKey);
+}
+
+void AggNode::encode_fixed_agg_key(MemRow* row, FixedAggKey& key) {
+    uint8_t* buf = (uint8_t*)key.data;
+    uint8_t null_flag = 0;
+    size_t pos = sizeof(uint8_t);
+    for (uint32_t i = 0; i < _group_exprs.size(); i++) {
+        ExprValue value = _group_exprs[i]->get_value(row);
+        if (value.is_null()) {
+            null_flag |= (0x01 << (7 - i));
+        } else {
+            if (value.type != _fixed_key_types[i]) {
+                value.cast_to(_fixed_key_types[i]);
+            }
+            // 小端序, 取union的低位字节
+            memcpy(buf + pos, &value._u, _fixed_key_widths[i]);
+        }
+        pos += _fixed_key_widths[i];
+    }
+    buf[0] = null_flag;
+}
+
+void AggNode::aggregate_fixed_row(const FixedAggKey& key, std::unique_ptr<MemRow>& row,
+        int64_t& used_size, int64_t& release_size) {
+    MemRow* cur_row = row.get();
+    MemRow** agg_row = _fixed_hash_map.seek(key);
+    if (agg_row == nullptr) {
+        cur_row = row.release();
+        agg_row = &cur_row;
+        used_size += cur_row->used_size();
+        AggFnCall::initialize_all(_agg_fn_calls, EMPTY_AGG_KEY, *agg_row, used_size, false);
+        _fixed_hash_map.insert(key, *agg_row);
+    } else {
+        release_size += cur_row->used_size();
+    }
+    if (_is_merger) {
+        AggFnCall::merge_all(_agg_fn_calls, EMPTY_AGG_KEY, cur_row, *agg_row, used_size);
+    } else {
+        AggFnCall::update_all(_agg_fn_calls, EMPTY_AGG_KEY, cur_row, *agg_row, used_size);
+    }
+}
+
 void AggNode::encode_agg_key(MemRow* row, MutTableKey& key) {
     uint8_t null_flag = 0;
     key.append_u8(null_flag);
@@ -197,38 +339,207 @@ void AggNode::encode_agg_key(MemRow* row, MutTableKey& key) {
 }
 
 void AggNode::process_row_batch(RuntimeState* state, RowBatch& batch, int64_t& used_size, int64_t& release_size) {
+    if (_use_fixed_key) {
+        for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+            FixedAggKey key;
+            encode_fixed_agg_key(batch.get_row().get(), key);
+            aggregate_fixed_row(key, batch.get_row(), used_size, release_size);
+        }
+        return;
+    }
     for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
-        std::unique_ptr<MemRow>& row = batch.get_row();
         MutTableKey key;
-        MemRow* cur_row = row.get();
-        encode_agg_key(cur_row, key);
-        MemRow** agg_row = _hash_map.seek(key.data());
-        
-        if (agg_row == nullptr) { //不存在则新建
-            cur_row = row.release();
-            agg_row = &cur_row;
-            // fix bug: 多个store agg，有无数据会造条空数据(L157)
-            // merge多个store时，去除这种造的数据
-            // 以便于 select id,count(*) from t where id>1;这种sql时id不会时造出来的null
-            if (_is_merger && _group_exprs.size() == 0) {
-                if (AggFnCall::all_is_initialize(_agg_fn_calls, key.data(), *agg_row)) {
-                    delete cur_row;
-                    continue;
-                }
+        encode_agg_key(batch.get_row().get(), key);
+        aggregate_row(_hash_map, key.data(), batch.get_row(), used_size, release_size);
+    }
+}
+
+void AggNode::aggregate_row(AggHashMap& hash_map, const std::string& key,
+        std::unique_ptr<MemRow>& row, int64_t& used_size, int64_t& release_size) {
+    MemRow* cur_row = row.get();
+    MemRow** agg_row = hash_map.seek(key);
+
+    if (agg_row == nullptr) { //不存在则新建
+        cur_row = row.release();
+        agg_row = &cur_row;
+        // fix bug: 多个store agg，有无数据会造条空数据(L157)
+        // merge多个store时，去除这种造的数据
+        // 以便于 select id,count(*) from t where id>1;这种sql时id不会时造出来的null
+        if (_is_merger && _group_exprs.size() == 0) {
+            if (AggFnCall::all_is_initialize(_agg_fn_calls, key, *agg_row)) {
+                delete cur_row;
+                return;
             }
-            used_size += cur_row->used_size();
-            AggFnCall::initialize_all(_agg_fn_calls, key.data(), *agg_row, used_size, false);
-            // 可能会rehash
-            _hash_map.insert(key.data(), *agg_row);
-        } else {
-            release_size += cur_row->used_size();
         }
-        if (_is_merger) {
-            AggFnCall::merge_all(_agg_fn_calls, key.data(), cur_row, *agg_row, used_size);
-        } else {
-            AggFnCall::update_all(_agg_fn_calls, key.data(), cur_row, *agg_row, used_size);
+        used_size += cur_row->used_size();
+        AggFnCall::initialize_all(_agg_fn_calls, key, *agg_row, used_size, false);
+        // 可能会rehash
+        hash_map.insert(key, *agg_row);
+    } else {
+        release_size += cur_row->used_size();
+    }
+    if (_is_merger) {
+        AggFnCall::merge_all(_agg_fn_calls, key, cur_row, *agg_row, used_size);
+    } else {
+        AggFnCall::update_all(_agg_fn_calls, key, cur_row, *agg_row, used_size);
+    }
+}
+
+bool AggNode::can_use_partition() {
+    // 只在baikaldb上merge多个store的结果时使用
+    if (!_is_merger || _group_exprs.empty() || FLAGS_agg_parallel_partitions <= 1) {
+        return false;
+    }
+    for (auto agg : _agg_fn_calls) {
+        if (!agg->is_row_local_agg()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int AggNode::process_pending_rows(RuntimeState* state) {
+    size_t row_count = _pending_rows.size();
+    if (row_count == 0) {
+        return 0;
+    }
+    size_t part_count = _partitions.size();
+    std::vector<std::string> keys(row_count);
+    // buckets[chunk * part_count + part]: 第chunk段输入中属于part分区的行, 保持输入顺序
+    std::vector<std::vector<uint32_t>> buckets(part_count * part_count);
+    size_t step = (row_count + part_count - 1) / part_count;
+    auto encode_fn = [this, &keys, &buckets, step, row_count, part_count](size_t chunk) {
+        size_t end = std::min(row_count, (chunk + 1) * step);
+        for (size_t i = chunk * step; i < end; ++i) {
+            MutTableKey key;
+            encode_agg_key(_pending_rows[i].get(), key);
+            keys[i].swap(key.data());
+            size_t part = make_sign(keys[i]) % part_count;
+            buckets[chunk * part_count + part].push_back(i);
+        }
+    };
+    std::vector<int64_t> used_sizes(part_count, 0);
+    std::vector<int64_t> release_sizes(part_count, 0);
+    auto agg_fn = [this, &keys, &buckets, &used_sizes, &release_sizes, part_count](size_t part) {
+        auto& hash_map = _partitions[part]->hash_map;
+        for (size_t chunk = 0; chunk < part_count; ++chunk) {
+            for (auto i : buckets[chunk * part_count + part]) {
+                aggregate_row(hash_map, keys[i], _pending_rows[i], used_sizes[part], release_sizes[part]);
+            }
+        }
+    };
+    if (row_count < (size_t)FLAGS_agg_parallel_min_rows) {
+        for (size_t i = 0; i < part_count; ++i) {
+            encode_fn(i);
+        }
+        for (size_t i = 0; i < part_count; ++i) {
+            agg_fn(i);
+        }
+    } else {
+        ConcurrencyBthread encode_bth(part_count);
+        for (size_t i = 0; i < part_count; ++i) {
+            encode_bth.run([&encode_fn, i]() {
+                encode_fn(i);
+            });
+        }
+        encode_bth.join();
+        ConcurrencyBthread agg_bth(part_count);
+        for (size_t i = 0; i < part_count; ++i) {
+            agg_bth.run([&agg_fn, i]() {
+                agg_fn(i);
+            });
+        }
+        agg_bth.join();
+    }
+    _pending_rows.clear();
+
+    int64_t used_size = 0;
+    int64_t release_size = 0;
+    for (size_t i = 0; i < part_count; ++i) {
+        used_size += used_sizes[i];
+        release_size += release_sizes[i];
+    }
+    state->memory_limit_release(_row_cnt, release_size);
+    _partition_bytes += used_size;
+    if (FLAGS_agg_spill_memory_quota > 0 && _partition_bytes > FLAGS_agg_spill_memory_quota) {
+        // 本轮新增的内存还未计入mem tracker
+        int64_t tracked_size = _partition_bytes - used_size;
+        if (spill_partitions(state) != 0) {
+            return -1;
         }
+        state->memory_limit_release(_row_cnt, tracked_size);
+        used_size = 0;
+    }
+    if (state->memory_limit_exceeded(_row_cnt, used_size) != 0) {
+        DB_WARNING_STATE(state, "memory limit exceeded");
+        return -1;
     }
+    return 0;
+}
+
+int AggNode::spill_partitions(RuntimeState* state) {
+    TimeCost cost;
+    int64_t rows = 0;
+    for (auto& part : _partitions) {
+        if (part->spill_file == nullptr) {
+            part->spill_file.reset(new SpillFile);
+            if (part->spill_file->open() != 0) {
+                DB_WARNING_STATE(state, "open spill file fail");
+                return -1;
+            }
+        }
+        for (auto& pair : part->hash_map) {
+            if (part->spill_file->write_row(pair.second) != 0) {
+                DB_WARNING_STATE(state, "write spill file fail");
+                return -1;
+            }
+            delete pair.second;
+            pair.second = nullptr;
+            ++rows;
+        }
+        part->hash_map.clear();
+    }
+    DB_WARNING_STATE(state, "agg spill rows:%ld bytes:%ld cost:%ld",
+            rows, _partition_bytes, cost.get_time());
+    _partition_bytes = 0;
+    return 0;
+}
+
+int AggNode::load_partition(RuntimeState* state, size_t idx) {
+    auto& part = _partitions[idx];
+    if (part->spill_file != nullptr) {
+        if (part->spill_file->finish_write() != 0) {
+            DB_WARNING_STATE(state, "rewind spill file fail");
+            return -1;
+        }
+        // 落盘的是部分聚合结果, 与store返回的中间结果一样merge即可
+        int64_t used_size = 0;
+        int64_t release_size = 0;
+        while (true) {
+            std::unique_ptr<MemRow> row;
+            bool eof = false;
+            if (part->spill_file->read_row(_mem_row_desc, &row, &eof) != 0) {
+                DB_WARNING_STATE(state, "read spill file fail");
+                return -1;
+            }
+            if (eof) {
+                break;
+            }
+            MutTableKey key;
+            encode_agg_key(row.get(), key);
+            aggregate_row(part->hash_map, key.data(), row, used_size, release_size);
+        }
+        part->spill_file.reset();
+        if (state->memory_limit_exceeded(_row_cnt, used_size) != 0) {
+            DB_WARNING_STATE(state, "memory limit exceeded");
+            return -1;
+        }
+    }
+    _hash_map.clear();
+    _hash_map.swap(part->hash_map);
+    _partition_idx = idx;
+    _iter = _hash_map.begin();
+    return 0;
 }
 
 int AggNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
@@ -242,7 +553,33 @@ int AggNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
             *eos = true;
             return 0;
         }
-        if (reached_limit() || _iter == _hash_map.end()) {
+        if (reached_limit()) {
+            *eos = true;
+            return 0;
+        }
+        if (_use_fixed_key) {
+            if (_fixed_iter == _fixed_hash_map.end()) {
+                *eos = true;
+                return 0;
+            }
+            if (batch->is_full()) {
+                return 0;
+            }
+            AggFnCall::finalize_all(_agg_fn_calls, EMPTY_AGG_KEY, _fixed_iter->second);
+            batch->move_row(std::move(std::unique_ptr<MemRow>(_fixed_iter->second)));
+            _num_rows_returned++;
+            _fixed_iter->second = nullptr;
+            _fixed_iter++;
+            continue;
+        }
+        if (_iter == _hash_map.end()) {
+            if (_use_partition && _partition_idx + 1 < _partitions.size()) {
+                int ret = load_partition(state, _partition_idx + 1);
+                if (ret < 0) {
+                    return ret;
+                }
+                continue;
+            }
             *eos = true;
             return 0;
         }
@@ -269,6 +606,21 @@ void AggNode::close(RuntimeState* state) {
         delete _iter->second;
     }
     _hash_map.clear();
+    // 已输出的行置为了nullptr
+    for (auto& pair : _fixed_hash_map) {
+        delete pair.second;
+    }
+    _fixed_hash_map.clear();
+    for (auto& part : _partitions) {
+        for (auto& pair : part->hash_map) {
+            delete pair.second;
+        }
+        part->hash_map.clear();
+        part->spill_file.reset();
+    }
+    _pending_rows.clear();
+    _partition_bytes = 0;
+    _partition_idx = 0;
 }
 void AggNode::transfer_pb(int64_t region_id, pb::PlanNode* pb_node) {
     ExecNode::transfer_pb(region_id, pb_node);
@@ -328,6 +328,7 @@ int ApplyNode::hash_apply(RuntimeState* state) {
         DB_WARNING("ExecNode::create in condition for right table fail");
         return ret;
     }
+    std::vector<ExprNode*> in_exprs_back = in_exprs;
     //表达式下推，下推的那个节点重新做索引选择，路由选择
     _inner_node->predicate_pushdown(in_exprs);
     if (in_exprs.size() > 0) {
@@ -337,6 +338,10 @@ int ApplyNode::hash_apply(RuntimeState* state) {
     std::vector<ExecNode*> scan_nodes;
     _inner_node->get_node(pb::SCAN_NODE, scan_nodes);
     do_plan_router(state, scan_nodes);
+    ret = replace_in_with_bloom_filter(state, scan_nodes, in_exprs_back);
+    if (ret < 0) {
+        return ret;
+    }
     //谓词下推后可能生成新的plannode重新生成tracenode
     _inner_node->create_trace();
     ret = _inner_node->open(state);
@@ -383,7 +388,7 @@ int ApplyNode::loop_hash_apply(RuntimeState* state) {
         _outer_table_is_null = true;
         return 0;
     }
-    _hash_map.clear();
+    clear_hash_map();
     construct_hash_map(outer_tuple_data, _outer_equal_slot);
 
     if (_is_explain) {
@@ -552,7 +557,7 @@ int ApplyNode::get_next_via_inner_hash_map(RuntimeState* state, RowBatch* batch,
         }
         MutTableKey outer_key;
         encode_hash_key(*_outer_iter, _outer_equal_slot, outer_key);
-        auto inner_mem_rows = _hash_map.seek(outer_key.data());
+        auto inner_mem_rows = seek_hash_map(outer_key.data());
         if (inner_mem_rows != NULL) {
             if (_join_type == pb::ANTI_SEMI_JOIN) {
                 ++_outer_iter;
@@ -636,7 +641,7 @@ int ApplyNode::get_next_via_outer_hash_map(RuntimeState* state, RowBatch* batch,
         std::unique_ptr<MemRow>& inner_mem_row = _inner_row_batch.get_row();
         MutTableKey inner_key;
         encode_hash_key(inner_mem_row.get(), _inner_equal_slot, inner_key);
-        auto outer_mem_rows = _hash_map.seek(inner_key.data());
+        auto outer_mem_rows = seek_hash_map(inner_key.data());
         if (outer_mem_rows != NULL) {
             for (; _result_row_index < outer_mem_rows->size(); ++_result_row_index) {
                 if (reached_limit()) {
@@ -664,7 +669,7 @@ int ApplyNode::get_next_via_outer_hash_map(RuntimeState* state, RowBatch* batch,
                         return ret;
                     }
                 }
-                _hash_map.erase(inner_key.data());
+                erase_hash_map(inner_key.data());
             }
         }
         _result_row_index = 0;
@@ -695,7 +700,7 @@ int ApplyNode::get_next_via_loop_outer_hash_map(RuntimeState* state, RowBatch* b
             outer_tuple_data.emplace_back(*_outer_iter);
             _outer_iter++;
         }
-        _hash_map.clear();
+        clear_hash_map();
         construct_hash_map(outer_tuple_data, _outer_equal_slot);
 
         // fetcher inner
@@ -710,7 +715,7 @@ int ApplyNode::get_next_via_loop_outer_hash_map(RuntimeState* state, RowBatch* b
         MemRow* inner_mem_row = *_inner_iter;
         MutTableKey inner_key;
         encode_hash_key(inner_mem_row, _inner_equal_slot, inner_key);
-        auto outer_mem_rows = _hash_map.seek(inner_key.data());
+        auto outer_mem_rows = seek_hash_map(inner_key.data());
         if (outer_mem_rows != NULL) {
             for (; _result_row_index < outer_mem_rows->size(); ++_result_row_index) {
                 if (reached_limit()) {
@@ -738,7 +743,7 @@ int ApplyNode::get_next_via_loop_outer_hash_map(RuntimeState* state, RowBatch* b
                         return ret;
                     }
                 }
-                _hash_map.erase(inner_key.data());
+                erase_hash_map(inner_key.data());
             }
         }
         _result_row_index = 0;
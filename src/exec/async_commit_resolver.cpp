@@ -0,0 +1,196 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "async_commit_resolver.h"
+#ifdef BAIDU_INTERNAL
+#include <baidu/rpc/channel.h>
+#else
+#include <brpc/channel.h>
+#endif
+
+namespace baikaldb {
+DEFINE_bool(async_secondary_commit, false, "reply client after primary region commit, "
+        "commit secondary regions in background");
+DEFINE_int64(async_commit_max_pending, 10000, "max pending async commit regions, "
+        "commit synchronously when exceeded, default: 10000");
+DEFINE_int32(async_commit_max_retry, 20, "max retry of async commit per region, default: 20");
+DECLARE_int64(retry_interval_us);
+DECLARE_int32(fetcher_request_timeout);
+DECLARE_int32(fetcher_connect_timeout);
+
+bvar::Adder<int64_t> AsyncCommitResolver::async_commit_region_count {"async_commit_region_count"};
+bvar::Adder<int64_t> AsyncCommitResolver::async_commit_fail_count {"async_commit_fail_count"};
+bvar::LatencyRecorder AsyncCommitResolver::async_commit_time {"async_commit_time"};
+
+bool AsyncCommitResolver::add_tasks(const std::vector<SmartAsyncCommitTask>& tasks) {
+    int64_t count = tasks.size();
+    if (_pending.fetch_add(count) + count > FLAGS_async_commit_max_pending) {
+        _pending.fetch_sub(count);
+        DB_WARNING("too many pending async commit: %ld, commit synchronously", _pending.load());
+        return false;
+    }
+    async_commit_region_count << count;
+    for (auto& task : tasks) {
+        Bthread bth(&BTHREAD_ATTR_SMALL);
+        bth.run([this, task]() {
+            resolve(task);
+        });
+    }
+    return true;
+}
+
+void AsyncCommitResolver::resolve(SmartAsyncCommitTask task) {
+    TimeCost cost;
+    std::deque<SmartAsyncCommitTask> queue;
+    queue.emplace_back(task);
+    while (!queue.empty()) {
+        SmartAsyncCommitTask current = queue.front();
+        queue.pop_front();
+        while (true) {
+            ErrorType ret = commit_region(current.get(), &queue);
+            if (ret == E_OK) {
+                break;
+            }
+            if (ret != E_RETRY || ++current->retry_times >= FLAGS_async_commit_max_retry) {
+                async_commit_fail_count << 1;
+                DB_FATAL("async commit fail, region_id: %ld, txn_id: %lu, retry_times: %d, "
+                        "store will resolve by primary region",
+                        current->info.region_id(), current->request.txn_infos(0).txn_id(),
+                        current->retry_times);
+                break;
+            }
+            bthread_usleep(std::min(current->retry_times, 5) * FLAGS_retry_interval_us);
+        }
+    }
+    async_commit_time << cost.get_time();
+    _pending.fetch_sub(1);
+}
+
+ErrorType AsyncCommitResolver::commit_region(AsyncCommitTask* task,
+        std::deque<SmartAsyncCommitTask>* queue) {
+    pb::RegionInfo& info = task->info;
+    int64_t region_id = info.region_id();
+    uint64_t txn_id = task->request.txn_infos(0).txn_id();
+    if (info.leader() == "0.0.0.0:0" || info.leader() == "") {
+        info.set_leader(rand_peer(info));
+    }
+    std::string addr = info.leader();
+    FetcherStore::choose_other_if_dead(info, addr);
+    brpc::ChannelOptions option;
+    option.max_retry = 1;
+    option.connect_timeout_ms = FLAGS_fetcher_connect_timeout;
+    option.timeout_ms = FLAGS_fetcher_request_timeout;
+    brpc::Channel channel;
+    if (channel.Init(addr.c_str(), &option) != 0) {
+        DB_WARNING("channel init failed, addr: %s, region_id: %ld", addr.c_str(), region_id);
+        FetcherStore::other_normal_peer_to_leader(info, addr);
+        return E_RETRY;
+    }
+    brpc::Controller cntl;
+    cntl.set_log_id(task->request.log_id());
+    pb::StoreRes response;
+    pb::StoreService_Stub(&channel).query(&cntl, &task->request, &response, nullptr);
+    SchemaFactory* schema_factory = SchemaFactory::get_instance();
+    if (cntl.Failed()) {
+        DB_WARNING("async commit call failed, region_id: %ld, txn_id: %lu, addr: %s, errcode: %d, error: %s",
+                region_id, txn_id, addr.c_str(), cntl.ErrorCode(), cntl.ErrorText().c_str());
+        schema_factory->update_instance(addr, pb::FAULTY, false, false);
+        FetcherStore::other_normal_peer_to_leader(info, addr);
+        return E_RETRY;
+    }
+    switch (response.errcode()) {
+    case pb::SUCCESS:
+        return E_OK;
+    case pb::NOT_LEADER:
+        DB_WARNING("async commit NOT_LEADER, region_id: %ld, txn_id: %lu, new_leader: %s",
+                region_id, txn_id, response.leader().c_str());
+        if (response.leader() != "0.0.0.0:0") {
+            info.set_leader(response.leader());
+            schema_factory->update_leader(info);
+        } else {
+            FetcherStore::other_normal_peer_to_leader(info, addr);
+        }
+        return E_RETRY;
+    case pb::DISABLE_WRITE_TIMEOUT:
+    case pb::RETRY_LATER:
+    case pb::IN_PROCESS:
+        return E_RETRY;
+    case pb::VERSION_OLD:
+        return handle_version_old(task, response, queue);
+    case pb::REGION_NOT_EXIST: {
+        pb::RegionInfo tmp_info;
+        // 已经被merge了并且store已经删掉了，按正常处理
+        if (schema_factory->get_region_info(info.table_id(), region_id, tmp_info) != 0) {
+            return E_OK;
+        }
+        schema_factory->update_instance(addr, pb::FAULTY, false, false);
+        FetcherStore::other_normal_peer_to_leader(info, addr);
+        return E_RETRY;
+    }
+    case pb::INTERNAL_ERROR:
+        schema_factory->update_instance(addr, pb::FAULTY, false, false);
+        FetcherStore::other_normal_peer_to_leader(info, addr);
+        return E_RETRY;
+    default:
+        DB_FATAL("async commit fail, region_id: %ld, txn_id: %lu, errcode: %s, msg: %s",
+                region_id, txn_id, pb::ErrCode_Name(response.errcode()).c_str(),
+                response.errmsg().c_str());
+        return E_FATAL;
+    }
+}
+
+// 与OnRPCDone::handle_version_old一致: 分裂出的新region也要commit
+ErrorType AsyncCommitResolver::handle_version_old(AsyncCommitTask* task,
+        const pb::StoreRes& response, std::deque<SmartAsyncCommitTask>* queue) {
+    pb::RegionInfo& info = task->info;
+    int64_t region_id = info.region_id();
+    DB_WARNING("async commit VERSION_OLD, region_id: %ld, txn_id: %lu, now: %s",
+            region_id, task->request.txn_infos(0).txn_id(), info.ShortDebugString().c_str());
+    if (response.regions_size() == 0) {
+        return E_FATAL;
+    }
+    RegionVec regions;
+    for (auto& r : response.regions()) {
+        if (response.is_merge() && r.region_id() == region_id) {
+            continue;
+        }
+        if (!response.is_merge() && end_key_compare(r.end_key(), info.end_key()) > 0) {
+            continue;
+        }
+        *regions.Add() = r;
+    }
+    SchemaFactory::get_instance()->update_regions(regions);
+    bool retry_self = false;
+    for (auto& r : regions) {
+        if (r.region_id() == region_id) {
+            info = r;
+            if (response.leader() != "0.0.0.0:0") {
+                info.set_leader(response.leader());
+            }
+            task->request.set_region_version(info.version());
+            retry_self = true;
+            continue;
+        }
+        SmartAsyncCommitTask new_task = std::make_shared<AsyncCommitTask>();
+        new_task->request = task->request;
+        new_task->request.set_region_id(r.region_id());
+        new_task->request.set_region_version(r.version());
+        new_task->info = r;
+        queue->emplace_back(new_task);
+    }
+    return retry_self ? E_RETRY : E_OK;
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
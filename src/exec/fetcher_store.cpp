@@ -13,19 +13,15 @@
 // limitations under the License.
 
 #include "fetcher_store.h"
-#ifdef BAIDU_INTERNAL
-#include <baidu/rpc/channel.h>
-#include <baidu/rpc/selective_channel.h>
-#else
-#include <brpc/channel.h>
-#include <brpc/selective_channel.h>
-#endif
 #include <gflags/gflags.h>
 #include "binlog_context.h"
 #include "query_context.h"
 #include "dml_node.h"
 #include "scan_node.h"
 #include "trace_state.h"
+#include "column_block.h"
+#include "store_plan_cache.h"
+#include "async_commit_resolver.h"
 namespace baikaldb {
 
 DEFINE_int64(retry_interval_us, 500 * 1000, "retry interval ");
@@ -41,6 +37,12 @@ DEFINE_int32(fetcher_connect_timeout, 1000,
                     "store as server connect timeout, default:1000ms");
 DEFINE_bool(fetcher_follower_read, true, "where allow follower read for fether");
 DEFINE_bool(fetcher_learner_read, false, "where allow learner read for fether");
+DEFINE_bool(fetcher_use_column_block, true, "store return select rows as column block");
+DEFINE_int64(fetcher_select_page_rows, 100000, "paged select rows per rpc, 0 means return all rows at once");
+DEFINE_bool(fetcher_multi_query, false, "merge select of regions on the same store into one multi_query rpc");
+DEFINE_int32(fetcher_multi_query_max_regions, 64, "max regions of one multi_query rpc, default: 64");
+DEFINE_int64(fetcher_multi_query_max_rows, 100000, "max rows of one multi_query response, default: 100000");
+DEFINE_bool(pipeline_commit_ts, false, "get commit ts right after binlog prewrite, in parallel with region prepare");
 DECLARE_int32(transaction_clear_delay_ms);
 DEFINE_bool(use_dynamic_timeout, false, "whether use dynamic_timeout");
 BRPC_VALIDATE_GFLAG(use_dynamic_timeout, brpc::PassValidate);
@@ -48,6 +50,7 @@ bvar::Adder<int64_t> OnRPCDone::async_rpc_region_count {"async_rpc_region_count"
 bvar::LatencyRecorder OnRPCDone::total_send_request {"total_send_request"};
 bvar::LatencyRecorder OnRPCDone::add_backup_send_request {"add_backup_send_request"};
 bvar::LatencyRecorder OnRPCDone::has_backup_send_request {"has_backup_send_request"};
+bvar::Adder<int64_t> FetcherStore::multi_query_region_count {"multi_query_region_count"};
 
 OnRPCDone::OnRPCDone(FetcherStore* fetcher_store, RuntimeState* state, ExecNode* store_request, pb::RegionInfo* info_ptr, 
     int64_t old_region_id, int64_t region_id, int start_seq_id, int current_seq_id, pb::OpType op_type) : 
@@ -67,6 +70,10 @@ OnRPCDone::OnRPCDone(FetcherStore* fetcher_store, RuntimeState* state, ExecNode*
     DB_DONE(DEBUG, "OnRPCDone");
 }
 OnRPCDone::~OnRPCDone() {
+    // 查询结束时还没读完的游标
+    if (_cursor_id != 0) {
+        FetcherStore::close_cursor(_cursor_addr, _request, _cursor_id);
+    }
     async_rpc_region_count << -1;
 }
 // 检查状态，判断是否需要继续执行
@@ -129,6 +136,16 @@ ErrorType OnRPCDone::fill_request() {
     _request.set_region_version(_info.version());
     _request.set_log_id(_state->log_id());
     _request.set_sql_sign(_state->sign);
+    if ((_op_type == pb::OP_SELECT || _op_type == pb::OP_SELECT_FOR_UPDATE) && FLAGS_fetcher_use_column_block) {
+        _request.set_use_column_block(true);
+    }
+    // 大结果分页返回, store端保留游标, 避免单个response占用过多内存
+    // 只有按页交给上层的fetcher才分页, 否则baikaldb仍要攒下整个region
+    if (_op_type == pb::OP_SELECT && _state->txn_id == 0 && _trace_node == nullptr
+            && _state->explain_type != ANALYZE_STATISTICS && FLAGS_fetcher_select_page_rows > 0
+            && _fetcher_store->page_stream) {
+        _request.set_page_rows(FLAGS_fetcher_select_page_rows);
+    }
     for (auto& desc : _state->tuple_descs()) {
         if (desc.has_tuple_id()){
             _request.add_tuples()->CopyFrom(desc);
@@ -236,10 +253,28 @@ ErrorType OnRPCDone::fill_request() {
         scan_node->current_index_unlock();
     }
 
+    // 计算计划模板签名, 是否只发签名在选定store后由select_plan决定
+    _plan_stripped = false;
+    if (_op_type == pb::OP_SELECT && _state->txn_id == 0 && FLAGS_enable_store_plan_cache) {
+        google::protobuf::RepeatedPtrField<std::string> scan_indexes;
+        uint64_t plan_sign = StorePlanCache::make_template_sign(_request.mutable_plan(),
+                _request.tuples(), &scan_indexes);
+        if (plan_sign != 0) {
+            _request.set_plan_sign(plan_sign);
+            StorePlanCache::restore_scan_indexes(_request.mutable_plan(), &scan_indexes);
+        }
+    }
+
     return E_OK;
 }   
 
 void OnRPCDone::select_addr() {
+    // 游标只存在于返回第一页的实例上
+    if (_cursor_id != 0) {
+        _addr = _cursor_addr;
+        _backup.clear();
+        return;
+    }
     _addr = _info.leader();
     _access_learner = false;
     // 事务读也读leader
@@ -317,14 +352,50 @@ void OnRPCDone::select_addr() {
     }
 }
 
-ErrorType OnRPCDone::send_async() {
-    _cntl.Reset();
-    _cntl.set_log_id(_state->log_id());
-    _response.Clear();
-    if (_region_id == 0) {
-        DB_DONE(FATAL, "region_id == 0");
-        return E_FATAL;
+void OnRPCDone::new_cursor_id() {
+    // 首页游标id由baikaldb指定, 每次发送都重新生成, 失败或backup落败时按id关闭
+    if (_request.page_rows() > 0 && _cursor_id == 0) {
+        uint64_t cursor_id = 0;
+        while (cursor_id == 0) {
+            cursor_id = butil::fast_rand();
+        }
+        _request.set_new_cursor_id(cursor_id);
+    }
+}
+
+void OnRPCDone::select_plan() {
+    if (_request.plan_sign() == 0) {
+        return;
+    }
+    // 上次只发了签名, 先恢复完整plan再按本次的store判断
+    if (_plan_stripped) {
+        _request.mutable_plan()->Swap(&_full_plan);
+        _request.mutable_tuples()->Swap(&_full_tuples);
+        _request.clear_scan_indexes();
+        _full_plan.Clear();
+        _full_tuples.Clear();
+        _plan_stripped = false;
+    }
+    if (_plan_cache_miss) {
+        return;
+    }
+    // 模板缓存在各store上, 要发往的store(包括backup)都确认缓存过才只发签名
+    StorePlanCache* plan_cache = StorePlanCache::get_instance();
+    if (!plan_cache->is_template_cached(_addr, _request.plan_sign())) {
+        return;
     }
+    if (!_backup.empty() && _backup != _addr
+            && !plan_cache->is_template_cached(_backup, _request.plan_sign())) {
+        return;
+    }
+    StorePlanCache::copy_scan_indexes(_request.plan(), _request.mutable_scan_indexes());
+    _full_plan.Swap(_request.mutable_plan());
+    _full_tuples.Swap(_request.mutable_tuples());
+    _request.clear_plan();
+    _plan_stripped = true;
+}
+
+ErrorType OnRPCDone::init_channel(brpc::SelectiveChannel& channel, brpc::Controller& cntl) {
     brpc::ChannelOptions option;
     option.max_retry = 1;
     option.connect_timeout_ms = FLAGS_fetcher_connect_timeout;
@@ -332,7 +403,6 @@ ErrorType OnRPCDone::send_async() {
     if (_fetcher_store->dynamic_timeout_ms > 0 && !_backup.empty() && _backup != _addr) {
         option.backup_request_ms = _fetcher_store->dynamic_timeout_ms;
     }
-    brpc::SelectiveChannel channel;
     int ret = channel.Init("rr", &option);
     if (ret != 0) {
         DB_DONE(WARNING, "SelectiveChannel init failed, ret:%d", ret);
@@ -365,22 +435,43 @@ ErrorType OnRPCDone::send_async() {
         // 保证第一次请求必定走addr，并且这个ExcludedServers不影响backup_request
         brpc::ExcludedServers* exclude = brpc::ExcludedServers::Create(1);
         exclude->Add(sub_id2);
-        _cntl.set_excluded_servers(exclude);
+        cntl.set_excluded_servers(exclude);
 #endif
     } else {
         //命中backup可以不cancel
-        _client_conn->insert_callid(_addr, _region_id, _cntl.call_id());
+        _client_conn->insert_callid(_addr, _region_id, cntl.call_id());
+    }
+    _fetcher_store->insert_callid(cntl.call_id());
+    return E_OK;
+}
+
+ErrorType OnRPCDone::send_async() {
+    _cntl.Reset();
+    _cntl.set_log_id(_state->log_id());
+    _response.Clear();
+    if (_region_id == 0) {
+        DB_DONE(FATAL, "region_id == 0");
+        return E_FATAL;
+    }
+    brpc::SelectiveChannel channel;
+    ErrorType err = init_channel(channel, _cntl);
+    if (err != E_OK) {
+        return err;
     }
-    _fetcher_store->insert_callid(_cntl.call_id());
     _query_time.reset();
     pb::StoreService_Stub(&channel).query(&_cntl, &_request, &_response, this);
     return E_ASYNC;
 }
 
 void OnRPCDone::Run() {
+    process_response(_cntl);
+}
+
+void OnRPCDone::process_response(const brpc::Controller& cntl) {
     DB_DONE(DEBUG, "fetch store req: %s", _request.ShortDebugString().c_str());
     DB_DONE(DEBUG, "fetch store res: %s", _response.ShortDebugString().c_str());
-    std::string remote_side = butil::endpoint2str(_cntl.remote_side()).c_str();
+    std::string remote_side = butil::endpoint2str(cntl.remote_side()).c_str();
+    _remote_side = remote_side;
     int64_t query_cost = _query_time.get_time();
     if (query_cost > FLAGS_print_time_us || _retry_times > 0) {
         DB_DONE(WARNING, "version:%ld time:%ld rpc_time:%ld ip:%s",
@@ -391,20 +482,27 @@ void OnRPCDone::Run() {
         add_backup_send_request << query_cost;
     }
     SchemaFactory* schema_factory = SchemaFactory::get_instance();
-    if (_cntl.Failed()) {
-        DB_DONE(WARNING, "call failed, errcode:%d, error:%s", _cntl.ErrorCode(), _cntl.ErrorText().c_str());
+    if (cntl.Failed()) {
+        DB_DONE(WARNING, "call failed, errcode:%d, error:%s", cntl.ErrorCode(), cntl.ErrorText().c_str());
         schema_factory->update_instance(remote_side, pb::FAULTY, false, false);
+        // 首页请求可能已在store端建立了游标
+        if (_request.new_cursor_id() != 0) {
+            FetcherStore::close_cursor(_addr, _request, _request.new_cursor_id());
+            if (!_backup.empty() && _backup != _addr) {
+                FetcherStore::close_cursor(_backup, _request, _request.new_cursor_id());
+            }
+        }
         // 只有网络相关错误码才重试
-        if (_cntl.ErrorCode() != ETIMEDOUT &&
-                _cntl.ErrorCode() != ECONNREFUSED &&
-                _cntl.ErrorCode() != EHOSTDOWN &&
-                _cntl.ErrorCode() != ECANCELED &&
-                _cntl.ErrorCode() != EHOSTUNREACH) {
+        if (cntl.ErrorCode() != ETIMEDOUT &&
+                cntl.ErrorCode() != ECONNREFUSED &&
+                cntl.ErrorCode() != EHOSTDOWN &&
+                cntl.ErrorCode() != ECANCELED &&
+                cntl.ErrorCode() != EHOSTUNREACH) {
             _fetcher_store->error = E_FATAL;
             _rpc_ctrl->task_finish(this);
             return;
         }
-        if (_op_type != pb::OP_SELECT && _cntl.ErrorCode() == ECANCELED) {
+        if (_op_type != pb::OP_SELECT && cntl.ErrorCode() == ECANCELED) {
             _fetcher_store->error = E_FATAL;
             _rpc_ctrl->task_finish(this);
             return;
@@ -412,6 +510,11 @@ void OnRPCDone::Run() {
 
         _fetcher_store->learner_status.set_learner_cannot_access(_info.region_id(), remote_side);
         FetcherStore::other_normal_peer_to_leader(_info, _addr);
+        if (restart_paged_select() != E_RETRY) {
+            _fetcher_store->error = E_FATAL;
+            _rpc_ctrl->task_finish(this);
+            return;
+        }
         bthread_usleep(_retry_times * FLAGS_retry_interval_us);
         _rpc_ctrl->task_retry(this);
         return;
@@ -431,7 +534,15 @@ void OnRPCDone::Run() {
         return;
     }
 
-    auto err = handle_response(remote_side);
+    finish_response(handle_response(remote_side, cntl.has_backup_request()));
+}
+
+void OnRPCDone::finish_response(ErrorType err) {
+    // 失败的response里新建的游标不会再被续读
+    if (err != E_OK && _response.has_more() && _response.cursor_id() != 0
+            && _response.cursor_id() != _cursor_id) {
+        FetcherStore::close_cursor(_remote_side, _request, _response.cursor_id());
+    }
     if (err == E_RETRY) {
         _rpc_ctrl->task_retry(this);
     } else {
@@ -440,7 +551,6 @@ void OnRPCDone::Run() {
         }
         _rpc_ctrl->task_finish(this);
     }
-    return;
 }
 
 ErrorType OnRPCDone::handle_version_old() {
@@ -546,12 +656,19 @@ ErrorType OnRPCDone::handle_version_old() {
     return E_FATAL;
 }
 
-ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
+ErrorType OnRPCDone::handle_response(const std::string& remote_side, bool has_backup_request) {
     SchemaFactory* schema_factory = SchemaFactory::get_instance();
-    if (_cntl.has_backup_request()) {
+    if (has_backup_request) {
         DB_DONE(WARNING, "has_backup_request");
         has_backup_send_request << _query_time.get_time();
         // backup先回，整体时延包含dynamic_timeout_ms，不做统计
+        // 首页请求另一端也可能建立了游标
+        if (_request.new_cursor_id() != 0) {
+            const std::string& other_side = (remote_side != _addr) ? _addr : _backup;
+            if (!other_side.empty() && other_side != remote_side) {
+                FetcherStore::close_cursor(other_side, _request, _request.new_cursor_id());
+            }
+        }
         // remote_side != _addr 说明backup先回
         if (remote_side != _addr) {
             //业务快速置状态
@@ -581,6 +698,23 @@ ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
             }
         }
     }
+    if (_cursor_id != 0 && _response.errcode() != pb::SUCCESS && _response.errcode() != pb::EXEC_FAIL) {
+        // 游标失效(超时/切主/实例重启), 整个region重新查询
+        DB_DONE(WARNING, "continue paged select fail, errcode: %s, cursor_id: %lu",
+                pb::ErrCode_Name(_response.errcode()).c_str(), _cursor_id);
+        return restart_paged_select();
+    }
+    if (_response.errcode() == pb::PLAN_NOT_CACHED) {
+        // 模板被淘汰或换了store, 立即带完整plan重发
+        DB_DONE(DEBUG, "plan template not cached, sign: %lu", _request.plan_sign());
+        _plan_cache_miss = true;
+        _request.Clear();
+        _has_fill_request = false;
+        return E_RETRY;
+    }
+    if (_response.plan_cached()) {
+        StorePlanCache::get_instance()->set_template_cached(remote_side, _request.plan_sign());
+    }
     if (_access_learner && (_response.errcode() == pb::REGION_NOT_EXIST || _response.errcode() == pb::LEARNER_NOT_READY)) {
         DB_DONE(WARNING, "learner not ready, errcode: %s", pb::ErrCode_Name(_response.errcode()).c_str());
         _fetcher_store->learner_status.set_learner_cannot_access(_info.region_id(), _addr);
@@ -718,8 +852,10 @@ ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
         }
     }
     TimeCost cost;
-    if (_response.row_values_size() > 0) {
-        _fetcher_store->row_cnt += _response.row_values_size();
+    int64_t response_rows = _response.has_column_block() ?
+        _response.column_block().num_rows() : _response.row_values_size();
+    if (response_rows > 0) {
+        _fetcher_store->row_cnt += response_rows;
     }
     // TODO reduce mem used by streaming
     if ((!_state->is_full_export) && (_fetcher_store->row_cnt > FLAGS_max_select_rows)) {
@@ -729,8 +865,19 @@ ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
     std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
     std::vector<int64_t> ttl_batch;
     ttl_batch.reserve(100);
-    bool global_ddl_with_ttl = (_response.row_values_size() > 0 && _response.row_values_size() == _response.ttl_timestamp_size()) ? true : false;
+    bool global_ddl_with_ttl = (response_rows > 0 && response_rows == _response.ttl_timestamp_size()) ? true : false;
     int ttl_idx = 0;
+    std::vector<std::unique_ptr<MemRow>> rows;
+    if (_response.has_column_block()) {
+        if (ColumnBlockDecoder::decode(_state->mem_row_desc(), _response.column_block(),
+                    _state->mem_row_arena(), &rows) != 0) {
+            // 同样可能是backup_request把两个response merge到了一起
+            DB_DONE(WARNING, "decode column block fail, rows:%ld", response_rows);
+            return restart_paged_select();
+        }
+    } else {
+        rows.reserve(_response.row_values_size());
+    }
     for (auto& pb_row : _response.row_values()) {
         if (pb_row.tuple_values_size() != _response.tuple_ids_size()) {
             // brpc SelectiveChannel+backup_request有bug，pb的repeated字段merge到一起了
@@ -739,19 +886,23 @@ ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
             for (auto id : _response.tuple_ids()) {
                 SQL_TRACE("tuple_id:%d  ", id);
             }
-            return E_RETRY;
+            return restart_paged_select();
         }
-        std::unique_ptr<MemRow> row = _state->mem_row_desc()->fetch_mem_row();
+        std::unique_ptr<MemRow> row = _state->mem_row_desc()->fetch_mem_row(_state->mem_row_arena());
         for (int i = 0; i < _response.tuple_ids_size(); i++) {
             int32_t tuple_id = _response.tuple_ids(i);
             row->from_string(tuple_id, pb_row.tuple_values(i));
         }
+        rows.emplace_back(std::move(row));
+    }
+    for (auto& row : rows) {
         if (0 != _state->memory_limit_exceeded(_fetcher_store->row_cnt, row->used_size())) {
             BAIDU_SCOPED_LOCK(_fetcher_store->region_lock);
             _state->error_code = ER_TOO_BIG_SELECT;
             _state->error_msg.str("select reach memory limit");
             return E_FATAL;
         }
+        _cursor_bytes += row->used_size();
         batch->move_row(std::move(row));
         if (global_ddl_with_ttl) {
             int64_t time_us = _response.ttl_timestamp(ttl_idx++);
@@ -759,6 +910,30 @@ ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
             DB_DEBUG("region_id: %ld, ttl_timestamp: %ld", _region_id, time_us);
         }
     }
+    if (_response.has_more() && _response.cursor_id() != 0) {
+        // 当前页直接交给上层, 游标由上层按需续读
+        PageCursor cursor;
+        cursor.cursor_id = _response.cursor_id();
+        cursor.addr = remote_side;
+        cursor.request = _request;
+        // 续读只需要游标id
+        cursor.request.set_cursor_id(cursor.cursor_id);
+        cursor.request.clear_new_cursor_id();
+        cursor.request.clear_plan();
+        cursor.request.clear_tuples();
+        cursor.request.clear_plan_sign();
+        cursor.request.clear_scan_indexes();
+        cursor.info = _info;
+        cursor.page_bytes = _cursor_bytes;
+        _fetcher_store->add_page_cursor(_region_id, cursor);
+    }
+    // 游标已转交给fetcher_store
+    _cursor_id = 0;
+    _cursor_addr.clear();
+    _cursor_bytes = 0;
+    if (!ttl_batch.empty()) {
+        global_ddl_with_ttl = true;
+    }
     if (global_ddl_with_ttl) {
         BAIDU_SCOPED_LOCK(_fetcher_store->region_lock);
         _fetcher_store->region_id_ttl_timestamp_batch[_region_id] = ttl_batch;
@@ -800,10 +975,193 @@ ErrorType OnRPCDone::handle_response(const std::string& remote_side) {
     return E_OK;
 }
 
+void OnRPCDone::reset_cursor() {
+    if (_cursor_id == 0) {
+        return;
+    }
+    FetcherStore::close_cursor(_cursor_addr, _request, _cursor_id);
+    DB_DONE(WARNING, "reset paged select, cursor_id: %lu", _cursor_id);
+    _cursor_id = 0;
+    _cursor_addr.clear();
+    _cursor_bytes = 0;
+    // plan已在续读时清掉, 重新填充
+    _request.Clear();
+    _has_fill_request = false;
+}
+
+ErrorType OnRPCDone::restart_paged_select() {
+    if (_page_delivered) {
+        DB_DONE(WARNING, "paged select fail after pages delivered, cursor_id: %lu", _cursor_id);
+        return E_FATAL;
+    }
+    reset_cursor();
+    return E_RETRY;
+}
+
+void OnRPCDone::set_page_cursor(const PageCursor& cursor) {
+    _cursor_id = cursor.cursor_id;
+    _cursor_addr = cursor.addr;
+    _request = cursor.request;
+    _has_fill_request = true;
+    _page_delivered = true;
+}
+
+bool OnRPCDone::can_multi_query() const {
+    return FLAGS_fetcher_multi_query && _op_type == pb::OP_SELECT && _state->txn_id == 0
+        && _trace_node == nullptr && _state->explain_type != ANALYZE_STATISTICS && _cursor_id == 0;
+}
+
+bool OnRPCDone::prepare_multi_query(const OnRPCDone* leader) {
+    auto err = check_status();
+    if (err == E_OK && !_has_fill_request) {
+        err = fill_request();
+        if (err == E_OK) {
+            _has_fill_request = true;
+        }
+    }
+    if (err != E_OK) {
+        _fetcher_store->error = err;
+        _rpc_ctrl->task_finish(this);
+        return false;
+    }
+    select_addr();
+    select_plan();
+    new_cursor_id();
+    // 地址和计划模板都相同才能共用一个multi_query, 否则退回队列单独发送
+    if (_addr != leader->_addr || _backup != leader->_backup
+            || _request.plan_sign() != leader->_request.plan_sign()
+            || _request.has_plan() != leader->_request.has_plan()) {
+        _rpc_ctrl->task_continue(this);
+        return false;
+    }
+    return true;
+}
+
+// multi_query的rpc回调, 各region按自己的结果处理重试
+class OnMultiRPCDone : public google::protobuf::Closure {
+public:
+    virtual void Run() {
+        std::unique_ptr<OnMultiRPCDone> self_guard(this);
+        if (!cntl.Failed() && response.responses_size() != (int)tasks.size()) {
+            cntl.SetFailed(brpc::ERESPONSE, "response size diff, region_cnt: %lu, response_cnt: %d",
+                    tasks.size(), response.responses_size());
+        }
+        FetcherStore::multi_query_region_count << tasks.size();
+        if (cntl.Failed()) {
+            // 失败重试前会sleep, 并发处理避免各region的等待累加
+            ConcurrencyBthread retry_bth(tasks.size());
+            for (auto task : tasks) {
+                retry_bth.run([this, task]() {
+                    task->multi_query_done(cntl, nullptr);
+                });
+            }
+            retry_bth.join();
+            return;
+        }
+        for (size_t i = 0; i < tasks.size(); ++i) {
+            tasks[i]->multi_query_done(cntl, response.mutable_responses(i));
+        }
+    }
+
+    std::vector<OnRPCDone*> tasks;
+    pb::MultiStoreReq request;
+    pb::MultiStoreRes response;
+    brpc::Controller cntl;
+};
+
+void OnRPCDone::return_multi_tasks() {
+    std::vector<OnRPCDone*> multi_tasks;
+    multi_tasks.swap(_multi_tasks);
+    for (auto task : multi_tasks) {
+        _rpc_ctrl->task_continue(task);
+    }
+}
+
+ErrorType OnRPCDone::send_multi_query() {
+    // 只有计划模板相同的region才能共用plan
+    if (_request.plan_sign() == 0 || _region_id == 0) {
+        return_multi_tasks();
+        return E_OK;
+    }
+    std::vector<OnRPCDone*> multi_tasks;
+    multi_tasks.swap(_multi_tasks);
+    std::unique_ptr<OnMultiRPCDone> done(new OnMultiRPCDone);
+    done->tasks.emplace_back(this);
+    for (auto task : multi_tasks) {
+        if (task->prepare_multi_query(this)) {
+            done->tasks.emplace_back(task);
+        }
+    }
+    // 单个region直接走query
+    if (done->tasks.size() < 2) {
+        return E_OK;
+    }
+    pb::MultiStoreReq& request = done->request;
+    // region_id和region_version由store按regions覆盖
+    pb::StoreReq* common = request.mutable_common();
+    common->CopyFrom(_request);
+    common->clear_scan_indexes();
+    if (common->has_plan()) {
+        google::protobuf::RepeatedPtrField<std::string> scan_indexes;
+        StorePlanCache::restore_scan_indexes(common->mutable_plan(), &scan_indexes);
+    }
+    for (auto task : done->tasks) {
+        // 各region共用common中的首页游标id
+        if (_request.new_cursor_id() != 0) {
+            task->_request.set_new_cursor_id(_request.new_cursor_id());
+        }
+        const pb::StoreReq& task_request = task->_request;
+        pb::MultiRegionReq* region_req = request.add_regions();
+        region_req->set_region_id(task_request.region_id());
+        region_req->set_region_version(task_request.region_version());
+        if (task_request.has_plan()) {
+            StorePlanCache::copy_scan_indexes(task_request.plan(), region_req->mutable_scan_indexes());
+        } else {
+            region_req->mutable_scan_indexes()->CopyFrom(task_request.scan_indexes());
+        }
+    }
+    request.set_max_rows(FLAGS_fetcher_multi_query_max_rows);
+    done->cntl.set_log_id(_state->log_id());
+    brpc::SelectiveChannel channel;
+    if (init_channel(channel, done->cntl) != E_OK) {
+        for (size_t i = 1; i < done->tasks.size(); ++i) {
+            _rpc_ctrl->task_continue(done->tasks[i]);
+        }
+        return E_OK;
+    }
+    // 与send_async一致, 带backup request时不注册到连接上
+    if (!(_fetcher_store->dynamic_timeout_ms > 0 && !_backup.empty() && _backup != _addr)) {
+        for (size_t i = 1; i < done->tasks.size(); ++i) {
+            _client_conn->insert_callid(_addr, done->tasks[i]->_region_id, done->cntl.call_id());
+        }
+    }
+    for (auto task : done->tasks) {
+        task->_response.Clear();
+        task->_query_time.reset();
+    }
+    OnMultiRPCDone* multi_done = done.release();
+    pb::StoreService_Stub(&channel).multi_query(&multi_done->cntl, &multi_done->request,
+            &multi_done->response, multi_done);
+    return E_ASYNC;
+}
+
+void OnRPCDone::multi_query_done(const brpc::Controller& cntl, pb::StoreRes* response) {
+    if (response != nullptr) {
+        _response.Swap(response);
+        // 整批行数已达上限, store未执行该region, 重新排队不计重试
+        if (_response.errcode() == pb::REGION_SKIPPED) {
+            _rpc_ctrl->task_continue(this);
+            return;
+        }
+    }
+    process_response(cntl);
+}
+
 void OnRPCDone::send_request() {
     auto err = check_status();
     if (err != E_OK) {
         _fetcher_store->error = err;
+        return_multi_tasks();
         _rpc_ctrl->task_finish(this);
         return;
     }
@@ -813,6 +1171,7 @@ void OnRPCDone::send_request() {
         err = fill_request();
         if (err != E_OK) {
             _fetcher_store->error = err;
+            return_multi_tasks();
             _rpc_ctrl->task_finish(this);
             return;
         }
@@ -821,7 +1180,15 @@ void OnRPCDone::send_request() {
 
     // 选择请求的store地址
     select_addr();
+    select_plan();
+    new_cursor_id();
 
+    if (!_multi_tasks.empty()) {
+        err = send_multi_query();
+        if (err == E_ASYNC) {
+            return;
+        }
+    }
     err = send_async();
     if (err == E_RETRY) {
         _rpc_ctrl->task_retry(this);
@@ -833,6 +1200,139 @@ void OnRPCDone::send_request() {
     }
 }
 
+// 关闭游标的rpc回调, 只打日志
+class CloseCursorDone : public google::protobuf::Closure {
+public:
+    virtual void Run() {
+        if (cntl.Failed() || response.errcode() != pb::SUCCESS) {
+            DB_WARNING("close select cursor fail, region_id: %ld, cursor_id: %lu, errcode: %d, error: %s, log_id: %lu",
+                    request.region_id(), request.cursor_id(), cntl.ErrorCode(), cntl.ErrorText().c_str(),
+                    request.log_id());
+        }
+        delete this;
+    }
+
+    pb::StoreReq request;
+    pb::StoreRes response;
+    brpc::Controller cntl;
+};
+
+void FetcherStore::close_cursor(const std::string& addr, const pb::StoreReq& request, uint64_t cursor_id) {
+    if (cursor_id == 0 || addr.empty()) {
+        return;
+    }
+    brpc::ChannelOptions option;
+    option.max_retry = 1;
+    option.connect_timeout_ms = FLAGS_fetcher_connect_timeout;
+    option.timeout_ms = FLAGS_fetcher_request_timeout;
+    brpc::Channel channel;
+    if (channel.Init(addr.c_str(), &option) != 0) {
+        DB_WARNING("channel init failed, addr: %s", addr.c_str());
+        return;
+    }
+    CloseCursorDone* done = new CloseCursorDone;
+    done->request.set_op_type(pb::OP_SELECT);
+    done->request.set_region_id(request.region_id());
+    done->request.set_region_version(request.region_version());
+    done->request.set_db_conn_id(request.db_conn_id());
+    done->request.set_log_id(request.log_id());
+    done->request.set_select_without_leader(true);
+    done->request.set_cursor_id(cursor_id);
+    done->request.set_close_cursor(true);
+    done->cntl.set_log_id(request.log_id());
+    pb::StoreService_Stub(&channel).query(&done->cntl, &done->request, &done->response, done);
+}
+
+int FetcherStore::fetch_next_page(RuntimeState* state, ExecNode* store_request, int64_t region_id,
+        std::shared_ptr<RowBatch>* batch) {
+    while (true) {
+        PageCursor cursor;
+        {
+            BAIDU_SCOPED_LOCK(region_lock);
+            auto iter = page_cursors.find(region_id);
+            if (iter == page_cursors.end()) {
+                return 0;
+            }
+            cursor = iter->second;
+            page_cursors.erase(iter);
+        }
+        // 上一页已交给上层
+        state->memory_limit_release(row_cnt.load(), cursor.page_bytes);
+        int64_t old_scan_rows = scan_rows.load();
+        int64_t old_filter_rows = filter_rows.load();
+        region_batch[region_id] = nullptr;
+        {
+            RPCCtrl rpc_ctrl(1);
+            auto task = new OnRPCDone(this, state, store_request, &cursor.info,
+                    region_id, region_id, 0, 0, pb::OP_SELECT);
+            task->set_page_cursor(cursor);
+            rpc_ctrl.add_new_task(task);
+            rpc_ctrl.execute();
+        }
+        state->set_num_scan_rows(state->num_scan_rows() + scan_rows.load() - old_scan_rows);
+        state->set_num_filter_rows(state->num_filter_rows() + filter_rows.load() - old_filter_rows);
+        std::shared_ptr<RowBatch> page;
+        auto iter = region_batch.find(region_id);
+        if (iter != region_batch.end()) {
+            page = iter->second;
+            region_batch.erase(iter);
+        }
+        if (error != E_OK) {
+            DB_WARNING("fetch next page fail, region_id: %ld, cursor_id: %lu, log_id: %lu",
+                    region_id, cursor.cursor_id, state->log_id());
+            if (error == E_BIG_SQL) {
+                error_code = ER_SQL_TOO_BIG;
+                error_msg.str("sql too big");
+            }
+            return -1;
+        }
+        if (page != nullptr && page->size() > 0) {
+            *batch = page;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void FetcherStore::close_page_cursors() {
+    std::map<int64_t, PageCursor> cursors;
+    {
+        BAIDU_SCOPED_LOCK(region_lock);
+        cursors.swap(page_cursors);
+    }
+    for (auto& pair : cursors) {
+        close_cursor(pair.second.addr, pair.second.request, pair.second.cursor_id);
+    }
+}
+
+bool FetcherStore::async_commit(RuntimeState* state, ExecNode* store_request,
+        std::vector<pb::RegionInfo*>& infos, int start_seq_id, int current_seq_id) {
+    // primary region已经commit成功后才会走到这里
+    if (!FLAGS_async_secondary_commit || state->txn_id == 0 || infos.empty()
+            || skip_region_set.count(client_conn->primary_region_id) == 0) {
+        return false;
+    }
+    std::vector<SmartAsyncCommitTask> tasks;
+    tasks.reserve(infos.size());
+    for (auto info : infos) {
+        OnRPCDone done(this, state, store_request, info,
+                info->region_id(), info->region_id(), start_seq_id, current_seq_id, pb::OP_COMMIT);
+        if (done.fill_request() != E_OK) {
+            return false;
+        }
+        SmartAsyncCommitTask task = std::make_shared<AsyncCommitTask>();
+        task->request = done.request();
+        task->info = *info;
+        tasks.emplace_back(task);
+    }
+    if (!AsyncCommitResolver::get_instance()->add_tasks(tasks)) {
+        return false;
+    }
+    DB_DEBUG("async commit secondary regions: %lu, txn_id: %lu, log_id: %lu",
+            tasks.size(), state->txn_id, state->log_id());
+    return true;
+}
+
 void FetcherStore::choose_other_if_dead(pb::RegionInfo& info, std::string& addr) {
     SchemaFactory* schema_factory = SchemaFactory::get_instance();
     auto status = schema_factory->get_instance_status(addr);
@@ -891,6 +1391,9 @@ ErrorType FetcherStore::process_binlog_start(RuntimeState* state, pb::OpType op_
     if (need_process_binlog(state, op_type)) {
         auto binlog_ctx = client_conn->get_binlog_ctx();
         uint64_t log_id = state->log_id();
+        if (op_type == pb::OP_PREPARE) {
+            pipelined_commit_ts = -1;
+        }
         if (need_get_binlog_region) {
             need_get_binlog_region = false;
             int ret = binlog_ctx->get_binlog_regions(log_id);
@@ -918,6 +1421,11 @@ ErrorType FetcherStore::process_binlog_start(RuntimeState* state, pb::OpType op_
                 auto ret = write_binlog(state, op_type, log_id);
                 if (ret != E_OK) {
                     error = ret;
+                    return;
+                }
+                // prewrite binlog写入后即可取commit_ts, 与各region的prepare rpc并行
+                if (op_type == pb::OP_PREPARE && FLAGS_pipeline_commit_ts) {
+                    pipelined_commit_ts = get_commit_ts();
                 }
             };
             Bthread bth(&BTHREAD_ATTR_SMALL);
@@ -1103,6 +1611,7 @@ int FetcherStore::run_not_set_state(RuntimeState* state,
                     int current_seq_id,
                     pb::OpType op_type, 
                     GlobalBackupType backup_type) {
+    close_page_cursors();
     region_batch.clear();
     split_region_batch.clear();
     index_records.clear();
@@ -1176,7 +1685,7 @@ int FetcherStore::run_not_set_state(RuntimeState* state,
         }
         // commit命令获取commit_ts需要发送给store
         if (op_type == pb::OP_COMMIT && need_process_binlog(state, op_type)) {
-            int64_t commit_ts = get_commit_ts();
+            int64_t commit_ts = fetch_commit_ts();
             if (commit_ts < 0) {
                 DB_WARNING("get commit_ts fail");
                 return -1;
@@ -1232,9 +1741,13 @@ int FetcherStore::run_not_set_state(RuntimeState* state,
         infos.emplace_back(info);
     }
 
-    send_request(state, store_request, infos, start_seq_id, current_seq_id, op_type);
+    if (op_type != pb::OP_COMMIT
+            || !async_commit(state, store_request, infos, start_seq_id, current_seq_id)) {
+        send_request(state, store_request, infos, start_seq_id, current_seq_id, op_type);
+    }
 
     process_binlog_done(state, op_type);
+    discard_commit_ts_if_failed(op_type);
 
     if (op_type == pb::OP_COMMIT || op_type == pb::OP_ROLLBACK) {
         // 清除primary region信息
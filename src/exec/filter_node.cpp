@@ -32,6 +32,7 @@ namespace baikaldb {
 
 DECLARE_bool(open_nonboolean_sql_forbid);
 DECLARE_bool(open_nonboolean_sql_statistics);
+DEFINE_bool(enable_batch_filter, true, "evaluate filter conjuncts on whole row batch, default: true");
 
 int FilterNode::init(const pb::PlanNode& node) {
     int ret = ExecNode::init(node);
@@ -604,6 +605,27 @@ void FilterNode::transfer_pb(int64_t region_id, pb::PlanNode* pb_node) {
     }
 }
 
+int FilterNode::batch_filter(RuntimeState* state) {
+    size_t num_rows = _child_row_batch.size();
+    _child_sel_pos = 0;
+    _child_sel.resize(num_rows);
+    for (size_t i = 0; i < num_rows; ++i) {
+        _child_sel[i] = i;
+    }
+    _child_columns.reset();
+    for (auto conjunct : _pruned_conjuncts) {
+        if (_child_sel.empty()) {
+            break;
+        }
+        int ret = conjunct->filter_batch(&_child_row_batch, &_child_columns, &_child_sel);
+        if (ret < 0) {
+            DB_WARNING_STATE(state, "filter_batch fail, ret:%d", ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
 inline bool FilterNode::need_copy(MemRow* row) {
     for (auto conjunct : _pruned_conjuncts) {
         ExprValue value = conjunct->get_value(row);
@@ -646,13 +668,23 @@ int FilterNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
                     DB_WARNING_STATE(state, "_children get_next fail");
                     return ret;
                 }
+                _use_batch_filter = FLAGS_enable_batch_filter && !_is_explain
+                    && _child_row_batch.size() > 1;
+                if (_use_batch_filter) {
+                    ret = batch_filter(state);
+                    if (ret < 0) {
+                        return ret;
+                    }
+                }
                 //DB_WARNING_STATE(state, "_child_row_batch:%u %u", _child_row_batch.capacity(), _child_row_batch.size());
                 //DB_NOTICE("scan cost:%ld", cost.get_time());
                 continue;
             }
         }
         std::unique_ptr<MemRow>& row = _child_row_batch.get_row();
-        if (_is_explain || need_copy(row.get())) {
+        bool selected = _is_explain || 
+            (_use_batch_filter ? batch_filter_selected() : need_copy(row.get()));
+        if (selected) {
             batch->move_row(std::move(row));
             ++_num_rows_returned;
         } else {
@@ -692,6 +724,10 @@ void FilterNode::remove_additional_predicate(std::vector<ExprNode*>& input_exprs
     }
     _pruned_conjuncts.clear();
     _child_row_batch.clear();
+    _child_columns.clear();
+    _child_sel.clear();
+    _child_sel_pos = 0;
+    _use_batch_filter = false;
     _raw_filter_node.Clear();
     _filter_node.clear();
     _child_row_idx = 0;
@@ -705,6 +741,10 @@ void FilterNode::close(RuntimeState* state) {
     }
     _pruned_conjuncts.clear();
     _child_row_batch.clear();
+    _child_columns.clear();
+    _child_sel.clear();
+    _child_sel_pos = 0;
+    _use_batch_filter = false;
     _child_row_idx = 0;
     _child_eos = false;
 }
@@ -221,6 +221,7 @@ int JoinNode::hash_join(RuntimeState* state) {
         return ret;
     }
 
+    std::vector<ExprNode*> in_exprs_back = in_exprs;
     //表达式下推，下推的那个节点重新做索引选择，路由选择
     _inner_node->predicate_pushdown(in_exprs);
     if (in_exprs.size() > 0) {
@@ -231,6 +232,10 @@ int JoinNode::hash_join(RuntimeState* state) {
     std::vector<ExecNode*> scan_nodes;
     _inner_node->get_node(pb::SCAN_NODE, scan_nodes);
     do_plan_router(state, scan_nodes);
+    ret = replace_in_with_bloom_filter(state, scan_nodes, in_exprs_back);
+    if (ret < 0) {
+        return ret;
+    }
     //谓词下推后可能生成新的plannode重新生成tracenode
     _inner_node->create_trace();
     ret = _inner_node->open(state);
@@ -297,6 +302,7 @@ int JoinNode::nested_loop_join(RuntimeState* state) {
         DB_WARNING("ExecNode::create in condition for right table fail");
         return ret;
     }
+    std::vector<ExprNode*> in_exprs_back = in_exprs;
     //表达式下推，下推的那个节点重新做索引选择，路由选择
     _inner_node->predicate_pushdown(in_exprs);
     if (in_exprs.size() > 0) {
@@ -306,6 +312,10 @@ int JoinNode::nested_loop_join(RuntimeState* state) {
     std::vector<ExecNode*> scan_nodes;
     _inner_node->get_node(pb::SCAN_NODE, scan_nodes);
     do_plan_router(state, scan_nodes);
+    ret = replace_in_with_bloom_filter(state, scan_nodes, in_exprs_back);
+    if (ret < 0) {
+        return ret;
+    }
     //谓词下推后可能生成新的plannode重新生成tracenode
     _inner_node->create_trace();
     ret = _inner_node->open(state);
@@ -429,7 +439,7 @@ int JoinNode::get_next_for_hash_outer_join(RuntimeState* state, RowBatch* batch,
         }
         MutTableKey outer_key;
         encode_hash_key(*_outer_iter, _outer_equal_slot, outer_key);
-        auto inner_mem_rows = _hash_map.seek(outer_key.data());
+        auto inner_mem_rows = seek_hash_map(outer_key.data());
         if (inner_mem_rows != NULL) {
             for (; _result_row_index < inner_mem_rows->size(); ++_result_row_index) {
                 if (reached_limit()) {
@@ -497,7 +507,7 @@ int JoinNode::get_next_for_hash_inner_join(RuntimeState* state, RowBatch* batch,
         std::unique_ptr<MemRow>& inner_mem_row = _inner_row_batch.get_row();
         MutTableKey inner_key;
         encode_hash_key(inner_mem_row.get(), _inner_equal_slot, inner_key);
-        auto outer_mem_rows = _hash_map.seek(inner_key.data());
+        auto outer_mem_rows = seek_hash_map(inner_key.data());
         if (outer_mem_rows != NULL) {
             for (; _result_row_index < outer_mem_rows->size(); ++_result_row_index) {
                 if (reached_limit()) {
@@ -537,7 +547,7 @@ int JoinNode::get_next_for_loop_hash_inner_join(RuntimeState* state, RowBatch* b
             delete mem_row;
         }
         _inner_tuple_data.clear();
-        _hash_map.clear();
+        clear_hash_map();
 
         FullExportNode* full_export = static_cast<FullExportNode*>(_outer_node->get_node(pb::FULL_EXPORT_NODE));
         if (full_export == nullptr) {
@@ -575,7 +585,7 @@ int JoinNode::get_next_for_loop_hash_inner_join(RuntimeState* state, RowBatch* b
         }
         MutTableKey outer_key;
         encode_hash_key(*_outer_iter, _outer_equal_slot, outer_key);
-        auto inner_mem_rows = _hash_map.seek(outer_key.data());
+        auto inner_mem_rows = seek_hash_map(outer_key.data());
         if (inner_mem_rows != NULL) {
             for (; _result_row_index < inner_mem_rows->size(); ++_result_row_index) {
                 if (reached_limit()) {
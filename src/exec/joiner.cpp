@@ -21,8 +21,16 @@
 #include "plan_router.h"
 #include "logical_planner.h"
 #include "literal.h"
+#include "predicate.h"
 
 namespace baikaldb {
+DEFINE_bool(join_bloom_filter_pushdown, false, "push down BLOOM_FILTER_PREDICATE to store, "
+        "enable after all stores are upgraded, default: false");
+DEFINE_int64(join_bloom_filter_threshold, 100000, "replace in condition not used by index ranges "
+        "with bloom filter when join values more than #, 0 means disable, default: 100000");
+DEFINE_double(join_bloom_filter_fp_rate, 0.01, "false positive rate of join bloom filter, default: 0.01");
+DEFINE_int64(join_radix_build_rows, 1000000, "build radix partitioned hash map when rows more than #, default: 100w");
+DEFINE_int32(join_radix_bits, 6, "radix partition bits of join hash map, default: 6");
 int Joiner::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -243,6 +251,10 @@ int Joiner::fetcher_inner_table_data(RuntimeState* state,
     std::vector<ExecNode*> scan_nodes;
     _inner_node->get_node(pb::SCAN_NODE, scan_nodes);
     do_plan_router(state, scan_nodes);
+    ret = replace_in_with_bloom_filter(state, scan_nodes, in_exprs_back);
+    if (ret < 0) {
+        return ret;
+    }
     _inner_node->create_trace();
     ret = _inner_node->open(state);
     if (ret < 0) {
@@ -270,7 +282,8 @@ int Joiner::construct_in_condition(std::vector<ExprNode*>& slot_refs,
     //手工构造pb格式的表达式，再转为内存结构的表达式
     if (slot_refs.size() == 0) {
         return 0;
-    } else if (slot_refs.size() == 1) {
+    }
+    if (slot_refs.size() == 1) {
         pb::Expr expr;
         ExprNode* conjunct = nullptr;
         //增加一个in
@@ -341,6 +354,92 @@ int Joiner::construct_in_condition(std::vector<ExprNode*>& slot_refs,
     return 0;
 }
 
+int Joiner::replace_in_with_bloom_filter(RuntimeState* state,
+                             std::vector<ExecNode*>& scan_nodes,
+                             std::vector<ExprNode*>& in_exprs) {
+    if (!FLAGS_join_bloom_filter_pushdown || FLAGS_join_bloom_filter_threshold <= 0
+            || (int64_t)_outer_join_values.size() <= FLAGS_join_bloom_filter_threshold) {
+        return 0;
+    }
+    for (auto& in_expr : in_exprs) {
+        for (auto& exec_node : scan_nodes) {
+            ExecNode* parent_node_ptr = exec_node->get_parent();
+            if (parent_node_ptr == nullptr
+                    || (parent_node_ptr->node_type() != pb::WHERE_FILTER_NODE
+                        && parent_node_ptr->node_type() != pb::TABLE_FILTER_NODE)) {
+                continue;
+            }
+            FilterNode* filter_node = static_cast<FilterNode*>(parent_node_ptr);
+            // 不在剩余过滤条件里说明in已经用于索引范围
+            const std::vector<ExprNode*>& pruned_conjuncts = filter_node->pruned_conjuncts();
+            if (std::find(pruned_conjuncts.begin(), pruned_conjuncts.end(), in_expr)
+                    == pruned_conjuncts.end()) {
+                continue;
+            }
+            std::vector<ExprNode*> bloom_exprs;
+            int ret = construct_bloom_filter_condition(_inner_equal_slot, _outer_join_values, bloom_exprs);
+            if (ret < 0) {
+                return ret;
+            }
+            if (!filter_node->replace_conjunct(in_expr, bloom_exprs[0])) {
+                bloom_exprs[0]->close();
+                delete bloom_exprs[0];
+                continue;
+            }
+            in_expr->close();
+            delete in_expr;
+            in_expr = bloom_exprs[0];
+            // 过滤条件变了, 重新生成下推给store的filter
+            std::vector<ExecNode*> replaced_scan_nodes = {exec_node};
+            do_plan_router(state, replaced_scan_nodes);
+            break;
+        }
+    }
+    return 0;
+}
+
+int Joiner::construct_bloom_filter_condition(std::vector<ExprNode*>& slot_refs,
+                             const ExprValueSet& in_values,
+                             std::vector<ExprNode*>& in_exprs) {
+    TimeCost cost;
+    BloomFilter bloom_filter;
+    bloom_filter.init(in_values.size(), FLAGS_join_bloom_filter_fp_rate);
+    for (auto& in_value : in_values) {
+        std::vector<ExprValue> values = in_value.vec;
+        bloom_filter.add(BloomFilterPredicate::hash_values(values));
+    }
+    pb::Expr expr;
+    pb::ExprNode* bloom_node = expr.add_nodes();
+    bloom_node->set_node_type(pb::BLOOM_FILTER_PREDICATE);
+    bloom_node->set_col_type(pb::BOOL);
+    pb::Function* func = bloom_node->mutable_fn();
+    func->set_name("bloom_filter");
+    func->set_fn_op(parser::FT_IN);
+    bloom_node->set_num_children(slot_refs.size());
+    bloom_node->mutable_derive_node()->set_string_val(bloom_filter.bits());
+    bloom_node->mutable_derive_node()->set_int_val(bloom_filter.num_hashes());
+    for (auto& slot : slot_refs) {
+        pb::ExprNode* slot_node = expr.add_nodes();
+        slot_node->set_node_type(pb::SLOT_REF);
+        slot_node->set_col_type(slot->col_type());
+        slot_node->set_num_children(0);
+        slot_node->mutable_derive_node()->set_tuple_id(static_cast<SlotRef*>(slot)->tuple_id());
+        slot_node->mutable_derive_node()->set_slot_id(static_cast<SlotRef*>(slot)->slot_id());
+        slot_node->mutable_derive_node()->set_field_id(static_cast<SlotRef*>(slot)->field_id());
+    }
+    ExprNode* conjunct = nullptr;
+    int ret = ExprNode::create_tree(expr, &conjunct);
+    if (ret < 0) {
+        DB_WARNING("create bloom filter condition fail");
+        return ret;
+    }
+    conjunct->type_inferer();
+    in_exprs.emplace_back(conjunct);
+    DB_WARNING("construct bloom filter, values:%lu bytes:%lu num_hashes:%d time_cost:%ld",
+            in_values.size(), bloom_filter.bits().size(), bloom_filter.num_hashes(), cost.get_time());
+    return 0;
+}
+
 void Joiner::construct_equal_values(const std::vector<MemRow*>& tuple_data,
                                 const std::vector<ExprNode*>& slot_refs) {
     for (auto& mem_row : tuple_data) {
@@ -377,6 +476,11 @@ void Joiner::encode_hash_key(MemRow* row,
 
 void Joiner::construct_hash_map(const std::vector<MemRow*>& tuple_data, 
                                   const std::vector<ExprNode*>& slot_refs) {
+    if (FLAGS_join_radix_build_rows > 0 && FLAGS_join_radix_bits > 0 &&
+            (int64_t)tuple_data.size() > FLAGS_join_radix_build_rows) {
+        construct_radix_hash_map(tuple_data, slot_refs);
+        return;
+    }
     for (auto& mem_row : tuple_data) {
         MutTableKey key;
         encode_hash_key(mem_row, slot_refs, key);
@@ -384,6 +488,55 @@ void Joiner::construct_hash_map(const std::vector<MemRow*>& tuple_data,
     } 
 }
 
+void Joiner::construct_radix_hash_map(const std::vector<MemRow*>& tuple_data,
+                                  const std::vector<ExprNode*>& slot_refs) {
+    TimeCost cost;
+    _hash_map.clear();
+    _radix_bits = std::min(FLAGS_join_radix_bits, 16);
+    size_t part_count = 1 << _radix_bits;
+    _radix_maps.clear();
+    size_t bucket_count = tuple_data.size() / part_count + 1;
+    for (size_t i = 0; i < part_count; ++i) {
+        _radix_maps.emplace_back(new JoinHashMap);
+        _radix_maps.back()->init(bucket_count);
+    }
+    // 第一遍并行计算key和分区, 第二遍每个分区按输入顺序插入, 保持同key行的顺序
+    size_t row_count = tuple_data.size();
+    size_t chunk_count = std::min<size_t>(part_count, 16);
+    size_t step = (row_count + chunk_count - 1) / chunk_count;
+    std::vector<std::string> keys(row_count);
+    std::vector<uint16_t> part_ids(row_count);
+    ConcurrencyBthread encode_bth(chunk_count);
+    for (size_t chunk = 0; chunk < chunk_count; ++chunk) {
+        encode_bth.run([this, &tuple_data, &slot_refs, &keys, &part_ids, chunk, step, row_count]() {
+            size_t end = std::min(row_count, (chunk + 1) * step);
+            for (size_t i = chunk * step; i < end; ++i) {
+                MutTableKey key;
+                encode_hash_key(tuple_data[i], slot_refs, key);
+                keys[i].swap(key.data());
+                part_ids[i] = make_sign(keys[i]) >> (64 - _radix_bits);
+            }
+        });
+    }
+    encode_bth.join();
+    std::vector<std::vector<uint32_t>> part_rows(part_count);
+    for (size_t i = 0; i < row_count; ++i) {
+        part_rows[part_ids[i]].emplace_back(i);
+    }
+    ConcurrencyBthread build_bth(chunk_count);
+    for (size_t part = 0; part < part_count; ++part) {
+        build_bth.run([this, &tuple_data, &keys, &part_rows, part]() {
+            JoinHashMap& hash_map = *_radix_maps[part];
+            for (auto i : part_rows[part]) {
+                hash_map[keys[i]].emplace_back(tuple_data[i]);
+            }
+        });
+    }
+    build_bth.join();
+    DB_WARNING("construct radix hash map, rows:%lu partitions:%lu time_cost:%ld",
+            row_count, part_count, cost.get_time());
+}
+
 int Joiner::construct_result_batch(RowBatch* batch, 
                                       MemRow* outer_mem_row, 
                                       MemRow* inner_mem_row,
@@ -470,7 +623,7 @@ void Joiner::close(RuntimeState* state) {
     }
     _inner_tuple_data.clear();
     _result_row_index = 0;
-    _hash_map.clear();
+    clear_hash_map();
     _outer_table_is_null = false;
     _inner_row_batch.clear();
     _child_eos = false;
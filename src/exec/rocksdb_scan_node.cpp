@@ -27,6 +27,7 @@ namespace baikaldb {
 
 DEFINE_bool(reverse_seek_first_level, false, "reverse index seek first level, default(false)");
 DEFINE_int32(in_predicate_check_threshold, 4096, "in predicate threshold to check memory, default(4096)");
+DECLARE_bool(enable_batch_filter);
 
 int RocksdbScanNode::choose_index(RuntimeState* state) {
     // 做完logical plan还没有索引
@@ -549,7 +550,7 @@ int RocksdbScanNode::open(RuntimeState* state) {
 int RocksdbScanNode::get_next(RuntimeState* state, RowBatch* batch, bool* eos) {  
     if (_is_explain) {
         // 生成一条临时数据跑通所有流程
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row(state->mem_row_arena());
         for (auto slot : _tuple_desc->slots()) {
             ExprValue tmp(pb::INT64);
             row->set_value(slot.tuple_id(), slot.slot_id(), tmp);
@@ -646,7 +647,7 @@ int RocksdbScanNode::get_next_by_table_get(RuntimeState* state, RowBatch* batch,
                 continue;
             }
         }
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row(state->mem_row_arena());
         for (auto slot : _tuple_desc->slots()) {
             auto field = record->get_field_by_tag(slot.field_id());
             row->set_value(slot.tuple_id(), slot.slot_id(),
@@ -724,7 +725,7 @@ int RocksdbScanNode::get_next_by_index_get(RuntimeState* state, RowBatch* batch,
                 continue;
             }
         }
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row(state->mem_row_arena());
         for (auto slot : _tuple_desc->slots()) {
             auto field = record->get_field_by_tag(slot.field_id());
             row->set_value(slot.tuple_id(), slot.slot_id(),
@@ -1011,7 +1012,7 @@ int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch
         }
         if (!_table_iter->is_cstore()) {
             ++_scan_rows;
-            std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+            std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row(state->mem_row_arena());
             int ret = _table_iter->get_next(_tuple_id, row);
             if (ret < 0) {
                 continue;
@@ -1064,7 +1065,7 @@ int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch
                 if (row_batch.size() + num >= row_batch.capacity()) {
                     break;
                 }
-                std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+                std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row(state->mem_row_arena());
                 std::string key;
                 int ret = _table_iter->get_next(_tuple_id, row);
                 if (ret < 0) {
@@ -1073,13 +1074,27 @@ int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch
                 row_batch.move_row(std::move(row));
                 ++num;
             }
-            // scan filt column
+            // scan filt column, 批量过滤时同时按列产出到_scan_columns
+            bool use_batch_filter = filter != nullptr && FLAGS_enable_batch_filter && row_batch.size() > 1;
+            if (use_batch_filter) {
+                _scan_columns.reset();
+                _scan_columns.set_num_rows(row_batch.size());
+            }
             for (auto& field_id : _filt_field_ids) {
                 FieldInfo* field_info = _field_ids[field_id];
-                _table_iter->get_column(_tuple_id, *field_info, nullptr, &row_batch);
+                ColumnVector* column = nullptr;
+                if (use_batch_filter && _field_slot[field_id] != 0) {
+                    column = _scan_columns.add_column(_tuple_id, _field_slot[field_id], field_info->type);
+                }
+                _table_iter->get_column(_tuple_id, *field_info, nullptr, &row_batch, column);
             }
             // filt
-            if (filter != nullptr) {
+            if (use_batch_filter) {
+                if (batch_need_copy(&row_batch, &_scan_columns, _scan_conjuncts, filter.get()) < 0) {
+                    DB_WARNING_STATE(state, "batch filter fail");
+                    return -1;
+                }
+            } else if (filter != nullptr) {
                 for (row_batch.reset(); !row_batch.is_traverse_over(); row_batch.next()) {
                     std::unique_ptr<MemRow>& row = row_batch.get_row();
                     if (!need_copy(row.get(), _scan_conjuncts)) {
@@ -1134,6 +1149,33 @@ int RocksdbScanNode::get_next_by_table_seek(RuntimeState* state, RowBatch* batch
     }
 }
 
+int RocksdbScanNode::batch_need_copy(RowBatch* batch, ColumnBatch* columns,
+        std::vector<ExprNode*>& conjuncts, FiltBitSet* filter) {
+    size_t num_rows = batch->size();
+    SelectVector sel(num_rows);
+    for (size_t i = 0; i < num_rows; ++i) {
+        sel[i] = i;
+    }
+    for (auto conjunct : conjuncts) {
+        if (sel.empty()) {
+            break;
+        }
+        int ret = conjunct->filter_batch(batch, columns, &sel);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    size_t pos = 0;
+    for (size_t i = 0; i < num_rows; ++i) {
+        if (pos < sel.size() && sel[pos] == i) {
+            ++pos;
+            continue;
+        }
+        filter->set(i);
+    }
+    return 0;
+}
+
 int RocksdbScanNode::get_next_by_index_seek(RuntimeState* state, RowBatch* batch, bool* eos) {
     int64_t index_filter_cnt = 0;
     int64_t get_primary_cnt = 0;
@@ -1227,7 +1269,7 @@ int RocksdbScanNode::get_next_by_index_seek(RuntimeState* state, RowBatch* batch
         if (use_record) {
             record->clear();
         }
-        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row();
+        std::unique_ptr<MemRow> row = _mem_row_desc->fetch_mem_row(state->mem_row_arena());
         if (_reverse_indexes.size() > 0) {
             ret = multi_get_next(_storage_type, record);
             if (ret < 0) {
@@ -144,6 +144,8 @@ int SelectManagerNode::single_fetcher_store_open(FetcherInfo* fetcher, RuntimeSt
     int ret = 0;
     // 如果命中的不是全局二级索引，或者全局二级索引是covering_index, 则直接在主表或者索引表上做scan即可
     if (router_index_id == main_table_id || scan_index_info->covering_index) {
+        // 直接返回给上层的结果可以按页读取
+        fetcher->fetcher_store.page_stream = true;
         ret = fetcher->fetcher_store.run_not_set_state(state, fetcher->scan_index->region_infos, _children[0], 
                 client_conn->seq_id, client_conn->seq_id, pb::OP_SELECT, fetcher->global_backup_type);
     } else {
@@ -202,8 +204,11 @@ void SelectManagerNode::multi_fetcher_store_open(FetcherInfo* self_fetcher, Fetc
 int SelectManagerNode::fetcher_store_run(RuntimeState* state, ExecNode* exec_node) {
     RocksdbScanNode* scan_node = static_cast<RocksdbScanNode*>(exec_node);
     FetcherStore* fetcher_store = nullptr;
-    FetcherInfo main_fetcher;
-    FetcherInfo backup_fetcher;
+    _main_fetcher.reset(new FetcherInfo);
+    _backup_fetcher.reset(new FetcherInfo);
+    _page_regions.clear();
+    FetcherInfo& main_fetcher = *_main_fetcher;
+    FetcherInfo& backup_fetcher = *_backup_fetcher;
     ScanIndexInfo* main_scan_index = scan_node->main_scan_index();
     ScanIndexInfo* backup_scan_index = scan_node->backup_scan_index();
     int64_t dynamic_timeout_ms = FetcherStore::get_dynamic_timeout_ms(exec_node, pb::OP_SELECT, state->sign);
@@ -239,10 +244,13 @@ int SelectManagerNode::fetcher_store_run(RuntimeState* state, ExecNode* exec_nod
         main_bth.join();
         backup_bth.join();
 
+        // 关闭落败一方的游标
         if (main_fetcher.status == FetcherInfo::S_SUCC) {
             fetcher_store = &main_fetcher.fetcher_store;
+            _backup_fetcher.reset();
         } else if (backup_fetcher.status == FetcherInfo::S_SUCC) {
             fetcher_store = &backup_fetcher.fetcher_store;
+            _main_fetcher.reset();
         } else {
             state->error_code = main_fetcher.fetcher_store.error_code;
             state->error_msg.str("");
@@ -268,15 +276,57 @@ int SelectManagerNode::fetcher_store_run(RuntimeState* state, ExecNode* exec_nod
     } 
 
     for (auto& pair : fetcher_store->start_key_sort) {
-        auto iter = fetcher_store->region_batch.find(pair.second);
+        int64_t region_id = pair.second;
+        auto iter = fetcher_store->region_batch.find(region_id);
         if (iter != fetcher_store->region_batch.end()) {
-            auto& batch = iter->second;
+            std::shared_ptr<RowBatch> batch = iter->second;
+            fetcher_store->region_batch.erase(iter);
+            // 首页被过滤为空时先读到有数据的页
+            if ((batch == nullptr || batch->size() == 0) && fetcher_store->has_page_cursor(region_id)) {
+                ret = fetcher_store->fetch_next_page(state, _children[0], region_id, &batch);
+                if (ret < 0) {
+                    state->error_code = fetcher_store->error_code;
+                    state->error_msg.str("");
+                    state->error_msg << fetcher_store->error_msg.str();
+                    return -1;
+                }
+            }
             if (batch != nullptr && batch->size() != 0) {
+                if (fetcher_store->has_page_cursor(region_id)) {
+                    _page_regions[batch.get()] = region_id;
+                }
                 _sorter->add_batch(batch);
             }
-            fetcher_store->region_batch.erase(iter);
         }
     }
+    // 分页的region在当前页读完后再读下一页, 不在内存中攒整个region
+    if (!_page_regions.empty()) {
+        _sorter->set_refill([this, state, fetcher_store](std::shared_ptr<RowBatch>& batch) -> int {
+            auto iter = _page_regions.find(batch.get());
+            if (iter == _page_regions.end()) {
+                return 0;
+            }
+            int64_t region_id = iter->second;
+            _page_regions.erase(iter);
+            std::shared_ptr<RowBatch> page;
+            int ret = fetcher_store->fetch_next_page(state, _children[0], region_id, &page);
+            if (ret < 0) {
+                state->error_code = fetcher_store->error_code;
+                state->error_msg.str("");
+                state->error_msg << fetcher_store->error_msg.str();
+                return -1;
+            }
+            if (ret == 0) {
+                return 0;
+            }
+            page->reset();
+            batch = page;
+            if (fetcher_store->has_page_cursor(region_id)) {
+                _page_regions[batch.get()] = region_id;
+            }
+            return 1;
+        });
+    }
     // 无sort节点时不会排序，按顺序输出
     _sorter->merge_sort();
     return fetcher_store->affected_rows.load();
@@ -334,6 +384,8 @@ int SelectManagerNode::open_global_index(FetcherInfo* fetcher, RuntimeState* sta
         && _children[0]->node_type() != pb::WHERE_FILTER_NODE) {
         store_exec = _children[0]->children(0);
     }*/
+    // 索引表和主表的结果都按页读取
+    fetcher->fetcher_store.page_stream = true;
     auto ret = fetcher->fetcher_store.run_not_set_state(state, fetcher->scan_index->region_infos, store_exec, 
             client_conn->seq_id, client_conn->seq_id, pb::OP_SELECT, fetcher->global_backup_type);
     if (ret < 0) {
@@ -341,7 +393,8 @@ int SelectManagerNode::open_global_index(FetcherInfo* fetcher, RuntimeState* sta
                 state->txn_id, state->log_id());
         return ret;
     }
-    ret = construct_primary_possible_index(fetcher->fetcher_store, fetcher->scan_index, state, scan_node, main_table_id);
+    ret = construct_primary_possible_index(fetcher->fetcher_store, fetcher->scan_index, state, scan_node,
+            store_exec, main_table_id);
     if (ret < 0) {
         DB_WARNING("construct primary possible index failed");
         return ret;
@@ -362,6 +415,7 @@ int SelectManagerNode::construct_primary_possible_index(
                       ScanIndexInfo* scan_index_info, 
                       RuntimeState* state,
                       ExecNode* exec_node,
+                      ExecNode* store_exec,
                       int64_t main_table_id) {
     RocksdbScanNode* scan_node = static_cast<RocksdbScanNode*>(exec_node);
     int32_t tuple_id = scan_node->tuple_id();
@@ -384,43 +438,57 @@ int SelectManagerNode::construct_primary_possible_index(
     pos_index.set_index_id(main_table_id);
     SmartRecord record_template = _factory->new_record(main_table_id);
     for (auto& pair : fetcher_store.start_key_sort) {
-        auto iter = fetcher_store.region_batch.find(pair.second);
+        int64_t region_id = pair.second;
+        auto iter = fetcher_store.region_batch.find(region_id);
         if (iter == fetcher_store.region_batch.end()) {
             continue;
         }
-        auto& batch = iter->second;
-        if (batch == nullptr || batch->size() == 0) {
-            fetcher_store.region_batch.erase(iter);
-            continue;
-        }
-        for (batch->reset(); !batch->is_traverse_over(); batch->next()) {
-            std::unique_ptr<MemRow>& mem_row = batch->get_row();
-            SmartRecord record = record_template->clone(false);
-            for (auto& pri_field : pri_info->fields) {
-                int32_t field_id = pri_field.id;
-                int32_t slot_id = state->get_slot_id(tuple_id, field_id);
-                if (slot_id == -1) {
-                    DB_WARNING("field_id:%d tuple_id:%d, slot_id:%d", field_id, tuple_id, slot_id);
-                    return -1;
+        std::shared_ptr<RowBatch> batch = iter->second;
+        fetcher_store.region_batch.erase(iter);
+        // 索引表的结果逐页转成主键范围, 不在内存中攒整个region
+        while (true) {
+            if (batch != nullptr) {
+                for (batch->reset(); !batch->is_traverse_over(); batch->next()) {
+                    std::unique_ptr<MemRow>& mem_row = batch->get_row();
+                    SmartRecord record = record_template->clone(false);
+                    for (auto& pri_field : pri_info->fields) {
+                        int32_t field_id = pri_field.id;
+                        int32_t slot_id = state->get_slot_id(tuple_id, field_id);
+                        if (slot_id == -1) {
+                            DB_WARNING("field_id:%d tuple_id:%d, slot_id:%d", field_id, tuple_id, slot_id);
+                            return -1;
+                        }
+                        record->set_value(record->get_field_by_tag(field_id), mem_row->get_value(tuple_id, slot_id));
+                    }
+                    auto range = pos_index.add_ranges();
+                    MutTableKey  key;
+                    if (record->encode_key(*pri_info.get(), key, pri_info->fields.size(), false, false) != 0) {
+                        DB_FATAL("Fail to encode_key left, table:%ld", pri_info->id);
+                        return -1;
+                    }
+                    range->set_left_key(key.data());
+                    range->set_left_full(key.get_full());
+                    range->set_right_key(key.data());
+                    range->set_right_full(key.get_full());
+                    range->set_left_field_cnt(pri_info->fields.size());
+                    range->set_right_field_cnt(pri_info->fields.size());
+                    range->set_left_open(false);
+                    range->set_right_open(false);
                 }
-                record->set_value(record->get_field_by_tag(field_id), mem_row->get_value(tuple_id, slot_id));
             }
-            auto range = pos_index.add_ranges();
-            MutTableKey  key;
-            if (record->encode_key(*pri_info.get(), key, pri_info->fields.size(), false, false) != 0) {
-                DB_FATAL("Fail to encode_key left, table:%ld", pri_info->id);
+            if (!fetcher_store.has_page_cursor(region_id)) {
+                break;
+            }
+            int ret = fetcher_store.fetch_next_page(state, store_exec, region_id, &batch);
+            if (ret < 0) {
+                DB_WARNING("fetch global index page fail, region_id: %ld, log_id: %lu",
+                        region_id, state->log_id());
                 return -1;
             }
-            range->set_left_key(key.data());
-            range->set_left_full(key.get_full());
-            range->set_right_key(key.data());
-            range->set_right_full(key.get_full());
-            range->set_left_field_cnt(pri_info->fields.size());
-            range->set_right_field_cnt(pri_info->fields.size());
-            range->set_left_open(false);
-            range->set_right_open(false);
+            if (ret == 0) {
+                break;
+            }
         }
-        fetcher_store.region_batch.erase(iter);
     }
 
     pos_index.SerializeToString(&scan_index_info->raw_index);
@@ -17,6 +17,8 @@
 #include "query_context.h"
 
 namespace baikaldb {
+DEFINE_int64(sort_top_n_max_limit, 100000, "sort node keeps a top-n heap when limit less than #, default: 100000");
+
 int SortNode::init(const pb::PlanNode& node) {
     int ret = 0;
     ret = ExecNode::init(node);
@@ -158,6 +160,16 @@ int SortNode::open(RuntimeState* state) {
     _mem_row_compare = std::make_shared<MemRowCompare>(
             _slot_order_exprs, _is_asc, _is_null_first);
     _sorter = std::make_shared<Sorter>(_mem_row_compare.get());
+    _sorter->set_spill_row_desc(_mem_row_desc);
+    _sorter->set_runtime_state(state);
+    int64_t spill_budget = state->sort_spill_budget();
+    // order by ... limit k时只保留前k行
+    bool use_top_n = _limit > 0 && _limit <= FLAGS_sort_top_n_max_limit &&
+        !_mem_row_compare->need_not_compare();
+    if (use_top_n) {
+        _sorter->set_top_n(_limit);
+    }
+    int64_t in_memory_bytes = 0;
 
     bool eos = false;
     int count = 0;
@@ -178,11 +190,34 @@ int SortNode::open(RuntimeState* state) {
         }
         count += batch->size();
         fill_tuple(batch.get());
+        if (use_top_n) {
+            _sorter->add_top_n_batch(*batch);
+            continue;
+        }
+        if (spill_budget > 0) {
+            in_memory_bytes += batch->used_bytes_size();
+        }
         _sorter->add_batch(batch);
+        if (spill_budget > 0 && in_memory_bytes > spill_budget) {
+            ret = _sorter->spill();
+            if (ret < 0) {
+                DB_WARNING_STATE(state, "sorter spill fail, ret:%d", ret);
+                return ret;
+            }
+            in_memory_bytes = 0;
+        }
     } while (!eos);
     //DB_WARNING_STATE(state, "sort_size:%d", count);
     TimeCost sort_time;
-    _sorter->sort();
+    if (_sorter->is_spilled()) {
+        ret = _sorter->prepare_merge_runs();
+        if (ret < 0) {
+            DB_WARNING_STATE(state, "sorter merge runs fail, ret:%d", ret);
+            return ret;
+        }
+    } else {
+        _sorter->sort();
+    }
     LOCAL_TRACE_DESC <<  "sort time cost:" << sort_time.get_time() << " rows:" << count;  
     return 0;
 }
@@ -0,0 +1,120 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "store_plan_cache.h"
+
+namespace baikaldb {
+DEFINE_bool(enable_store_plan_cache, false, "send plan template sign instead of full plan for select");
+DEFINE_int64(store_plan_cache_capacity, 10000, "max plan templates cached in store, default: 10000");
+DEFINE_int64(store_plan_cache_max_bytes, 128 * 1024 * 1024LL, "max bytes of store plan cache, default: 128M");
+
+StorePlanCache::StorePlanCache() : _budget("store_plan_cache", 4) {
+    _budget.capacity = FLAGS_store_plan_cache_max_bytes;
+    _templates.init(FLAGS_store_plan_cache_capacity, 0, 4, &_budget);
+    _cached_signs.init(FLAGS_store_plan_cache_capacity, 0, 4);
+}
+
+namespace {
+pb::PlanNode* single_scan_node(pb::Plan* plan) {
+    pb::PlanNode* scan_node = nullptr;
+    for (auto& node : *plan->mutable_nodes()) {
+        if (node.node_type() == pb::SCAN_NODE) {
+            if (scan_node != nullptr) {
+                return nullptr;
+            }
+            scan_node = &node;
+        }
+    }
+    return scan_node;
+}
+}
+
+uint64_t StorePlanCache::make_template_sign(pb::Plan* plan,
+        const google::protobuf::RepeatedPtrField<pb::TupleDescriptor>& tuples,
+        google::protobuf::RepeatedPtrField<std::string>* scan_indexes) {
+    pb::PlanNode* scan_node = single_scan_node(plan);
+    if (scan_node == nullptr) {
+        return 0;
+    }
+    scan_indexes->Swap(scan_node->mutable_derive_node()->mutable_scan_node()->mutable_indexes());
+    std::string key;
+    if (!plan->AppendToString(&key)) {
+        restore_scan_indexes(plan, scan_indexes);
+        return 0;
+    }
+    for (auto& tuple : tuples) {
+        tuple.AppendToString(&key);
+    }
+    return make_sign(key);
+}
+
+void StorePlanCache::restore_scan_indexes(pb::Plan* plan,
+        google::protobuf::RepeatedPtrField<std::string>* scan_indexes) {
+    pb::PlanNode* scan_node = single_scan_node(plan);
+    if (scan_node == nullptr) {
+        return;
+    }
+    scan_indexes->Swap(scan_node->mutable_derive_node()->mutable_scan_node()->mutable_indexes());
+}
+
+void StorePlanCache::copy_scan_indexes(const pb::Plan& plan,
+        google::protobuf::RepeatedPtrField<std::string>* scan_indexes) {
+    for (auto& node : plan.nodes()) {
+        if (node.node_type() == pb::SCAN_NODE) {
+            scan_indexes->CopyFrom(node.derive_node().scan_node().indexes());
+            return;
+        }
+    }
+}
+
+int StorePlanCache::fill_request(const pb::StoreReq& request, pb::StoreReq* filled) {
+    SmartStorePlanTemplate plan_template;
+    if (request.plan_sign() == 0 || _templates.find(request.plan_sign(), &plan_template) != 0) {
+        return -1;
+    }
+    filled->CopyFrom(request);
+    filled->mutable_plan()->CopyFrom(plan_template->plan);
+    filled->mutable_tuples()->CopyFrom(plan_template->tuples);
+    for (auto& node : *filled->mutable_plan()->mutable_nodes()) {
+        if (node.node_type() == pb::SCAN_NODE) {
+            node.mutable_derive_node()->mutable_scan_node()->mutable_indexes()->CopyFrom(
+                    request.scan_indexes());
+            break;
+        }
+    }
+    filled->clear_scan_indexes();
+    return 0;
+}
+
+bool StorePlanCache::add_template(const pb::StoreReq& request) {
+    SmartStorePlanTemplate plan_template = std::make_shared<StorePlanTemplate>();
+    google::protobuf::RepeatedPtrField<std::string> scan_indexes;
+    plan_template->plan.CopyFrom(request.plan());
+    uint64_t sign = make_template_sign(&plan_template->plan, request.tuples(), &scan_indexes);
+    // 两端pb序列化结果不一致(如版本不同)时不缓存, baikaldb会继续发完整plan
+    if (sign == 0 || sign != request.plan_sign()) {
+        DB_WARNING("plan template sign diff, request sign: %lu, sign: %lu", request.plan_sign(), sign);
+        return false;
+    }
+    plan_template->tuples.CopyFrom(request.tuples());
+    int64_t charge = plan_template->plan.SpaceUsedLong();
+    for (auto& tuple : plan_template->tuples) {
+        charge += tuple.SpaceUsedLong();
+    }
+    _templates.add(sign, plan_template, charge);
+    return true;
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
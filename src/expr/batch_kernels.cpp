@@ -0,0 +1,105 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "batch_kernels.h"
+
+namespace baikaldb {
+namespace batch {
+namespace {
+template <typename T, typename R, typename Op>
+inline void binary_loop(const T* __restrict a, const T* __restrict b, R* __restrict out,
+        size_t n, Op op) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = op(a[i], b[i]);
+    }
+}
+
+template <typename T>
+void compare_impl(BinaryOp op, const T* a, const T* b, uint64_t* out, size_t n) {
+    switch (op) {
+        case OP_EQ:
+            binary_loop(a, b, out, n, [](T x, T y) -> uint64_t { return x == y; });
+            break;
+        case OP_NE:
+            binary_loop(a, b, out, n, [](T x, T y) -> uint64_t { return x != y; });
+            break;
+        case OP_GT:
+            binary_loop(a, b, out, n, [](T x, T y) -> uint64_t { return x > y; });
+            break;
+        case OP_GE:
+            binary_loop(a, b, out, n, [](T x, T y) -> uint64_t { return x >= y; });
+            break;
+        case OP_LT:
+            binary_loop(a, b, out, n, [](T x, T y) -> uint64_t { return x < y; });
+            break;
+        case OP_LE:
+            binary_loop(a, b, out, n, [](T x, T y) -> uint64_t { return x <= y; });
+            break;
+        default:
+            break;
+    }
+}
+
+// 整数运算按uint64做回绕, 避免垃圾数据(null行)上的有符号溢出
+template <typename T, typename U>
+void arithmetic_impl(BinaryOp op, const T* a, const T* b, T* out, size_t n) {
+    switch (op) {
+        case OP_ADD:
+            binary_loop(a, b, out, n, [](T x, T y) -> T { return (T)((U)x + (U)y); });
+            break;
+        case OP_MINUS:
+            binary_loop(a, b, out, n, [](T x, T y) -> T { return (T)((U)x - (U)y); });
+            break;
+        case OP_MULTIPLIES:
+            binary_loop(a, b, out, n, [](T x, T y) -> T { return (T)((U)x * (U)y); });
+            break;
+        default:
+            break;
+    }
+}
+}
+
+void compare(BinaryOp op, const int64_t* a, const int64_t* b, uint64_t* out, size_t n) {
+    compare_impl(op, a, b, out, n);
+}
+
+void compare(BinaryOp op, const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+    compare_impl(op, a, b, out, n);
+}
+
+void compare(BinaryOp op, const double* a, const double* b, uint64_t* out, size_t n) {
+    compare_impl(op, a, b, out, n);
+}
+
+void arithmetic(BinaryOp op, const int64_t* a, const int64_t* b, int64_t* out, size_t n) {
+    arithmetic_impl<int64_t, uint64_t>(op, a, b, out, n);
+}
+
+void arithmetic(BinaryOp op, const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+    arithmetic_impl<uint64_t, uint64_t>(op, a, b, out, n);
+}
+
+void arithmetic(BinaryOp op, const double* a, const double* b, double* out, size_t n) {
+    arithmetic_impl<double, double>(op, a, b, out, n);
+}
+
+void merge_null(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t words) {
+    for (size_t i = 0; i < words; ++i) {
+        out[i] = a[i] | b[i];
+    }
+}
+} // namespace batch
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
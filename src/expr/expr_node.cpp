@@ -19,6 +19,7 @@
 #include "agg_fn_call.h"
 #include "slot_ref.h"
 #include "row_expr.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 bvar::Adder<int64_t> ExprNode::_s_non_boolean_sql_cnts{"non_boolean_sql_cnts"};
@@ -329,6 +330,14 @@ int ExprNode::create_expr_node(const pb::ExprNode& node, ExprNode** expr_node) {
             *expr_node = new RegexpPredicate;
             (*expr_node)->init(node);
             return 0;
+        case pb::BLOOM_FILTER_PREDICATE:
+            *expr_node = new BloomFilterPredicate;
+            if ((*expr_node)->init(node) < 0) {
+                delete *expr_node;
+                *expr_node = nullptr;
+                return -1;
+            }
+            return 0;
         case pb::FUNCTION_CALL:
             *expr_node = new ScalarFnCall;
             (*expr_node)->init(node);
@@ -361,6 +370,81 @@ void ExprNode::print_expr_info() {
     }
 }
 
+ColumnVector* ExprNode::batch_result(size_t num_rows) {
+    if (_batch_result == nullptr || _batch_result->type() != _col_type) {
+        _batch_result.reset(new ColumnVector(_col_type));
+    }
+    _batch_result->clear();
+    _batch_result->resize(num_rows);
+    return _batch_result.get();
+}
+
+ColumnVector* ExprNode::eval_batch(RowBatch* rows, ColumnBatch* columns, const SelectVector& sel) {
+    ColumnVector* result = batch_result(rows->size());
+    for (auto idx : sel) {
+        result->set_value(idx, get_value(rows->get_row(idx).get()));
+    }
+    return result;
+}
+
+int ExprNode::filter_batch(RowBatch* rows, ColumnBatch* columns, SelectVector* sel) {
+    size_t keep = 0;
+    if (!support_eval_batch()) {
+        // 不支持列式计算的表达式直接逐行判断, 保持与get_value完全一致的语义
+        for (auto idx : *sel) {
+            ExprValue value = get_value(rows->get_row(idx).get());
+            if (!value.is_null() && value.get_numberic<bool>()) {
+                (*sel)[keep++] = idx;
+            }
+        }
+        sel->resize(keep);
+        return 0;
+    }
+    ColumnVector* result = eval_batch(rows, columns, *sel);
+    if (result == nullptr) {
+        return -1;
+    }
+    switch (result->physical_type()) {
+        case ColumnVector::PT_INT64: {
+            const int64_t* data = result->int_data();
+            for (auto idx : *sel) {
+                if (!result->is_null(idx) && data[idx] != 0) {
+                    (*sel)[keep++] = idx;
+                }
+            }
+            break;
+        }
+        case ColumnVector::PT_UINT64: {
+            const uint64_t* data = result->uint_data();
+            for (auto idx : *sel) {
+                if (!result->is_null(idx) && data[idx] != 0) {
+                    (*sel)[keep++] = idx;
+                }
+            }
+            break;
+        }
+        case ColumnVector::PT_DOUBLE: {
+            const double* data = result->double_data();
+            for (auto idx : *sel) {
+                if (!result->is_null(idx) && data[idx] != 0) {
+                    (*sel)[keep++] = idx;
+                }
+            }
+            break;
+        }
+        default: {
+            for (auto idx : *sel) {
+                if (!result->is_null(idx) && result->get_value(idx).get_numberic<bool>()) {
+                    (*sel)[keep++] = idx;
+                }
+            }
+            break;
+        }
+    }
+    sel->resize(keep);
+    return 0;
+}
+
 bool ExprNode::is_logical_and_or_not() {
     if (_node_type == pb::NOT_PREDICATE || _node_type == pb::AND_PREDICATE || _node_type == pb::OR_PREDICATE) {
         return true;
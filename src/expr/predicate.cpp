@@ -14,6 +14,7 @@
 
 #include "predicate.h"
 #include "parser.h"
+#include "mut_table_key.h"
 #include <boost/algorithm/string.hpp>
 
 namespace baikaldb {
@@ -410,6 +411,40 @@ rocksdb::Slice LikePredicate::GBKCharset::next_code_point(size_t idx) {
     }
     return rocksdb::Slice();
 }
+
+int BloomFilterPredicate::init(const pb::ExprNode& node) {
+    int ret = ScalarFnCall::init(node);
+    if (ret < 0) {
+        return ret;
+    }
+    _is_constant = false;
+    if (_bloom_filter.init_from_string(node.derive_node().string_val(),
+            node.derive_node().int_val()) != 0) {
+        DB_WARNING("invalid bloom filter, num_hashes:%ld", node.derive_node().int_val());
+        return -1;
+    }
+    return 0;
+}
+
+uint64_t BloomFilterPredicate::hash_values(std::vector<ExprValue>& values) {
+    MutTableKey key;
+    for (auto& value : values) {
+        key.append_value(value.cast_to(pb::STRING));
+    }
+    return make_sign(key.data());
+}
+
+ExprValue BloomFilterPredicate::get_value(MemRow* row) {
+    std::vector<ExprValue> values;
+    values.reserve(_children.size());
+    for (auto child : _children) {
+        values.emplace_back(child->get_value(row));
+    }
+    if (_bloom_filter.may_contain(hash_values(values))) {
+        return ExprValue::True();
+    }
+    return ExprValue::False();
+}
 }
 
 /* vim: set ts=4 sw=4 sts=4 tw=100 */
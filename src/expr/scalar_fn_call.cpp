@@ -17,6 +17,7 @@
 #include "row_expr.h"
 #include "literal.h"
 #include "parser.h"
+#include "column_batch.h"
 
 namespace baikaldb {
 DEFINE_bool(open_nonboolean_sql_forbid, false, "open nonboolean sqls forbid default:false");
@@ -183,9 +184,145 @@ int ScalarFnCall::open() {
     if (node_type() == pb::FUNCTION_CALL && _fn_call == NULL) {
         DB_WARNING("fn call is null, name:%s", _fn.name().c_str());
     }
+    init_batch_op();
     return 0;
 }
 
+// 子节点类型转换到参数类型后数值不变, 且物理存储一致时才能走列式kernel
+static bool batch_type_compatible(pb::PrimitiveType child_type, pb::PrimitiveType arg_type) {
+    if (child_type == arg_type) {
+        return true;
+    }
+    switch (arg_type) {
+        case pb::INT64:
+            return child_type == pb::INT8 || child_type == pb::INT16 || child_type == pb::INT32;
+        case pb::UINT64:
+            return child_type == pb::UINT8 || child_type == pb::UINT16 || child_type == pb::UINT32;
+        case pb::DOUBLE:
+            return child_type == pb::FLOAT;
+        default:
+            return false;
+    }
+}
+
+void ScalarFnCall::init_batch_op() {
+    _batch_op = batch::OP_NONE;
+    if (_is_row_expr || _fn_call == NULL || _children.size() != 2 || _fn.arg_types_size() != 2) {
+        return;
+    }
+    batch::BinaryOp op = batch::OP_NONE;
+    switch (_fn.fn_op()) {
+        case parser::FT_EQ:
+            op = batch::OP_EQ;
+            break;
+        case parser::FT_NE:
+            op = batch::OP_NE;
+            break;
+        case parser::FT_GT:
+            op = batch::OP_GT;
+            break;
+        case parser::FT_GE:
+            op = batch::OP_GE;
+            break;
+        case parser::FT_LT:
+            op = batch::OP_LT;
+            break;
+        case parser::FT_LE:
+            op = batch::OP_LE;
+            break;
+        case parser::FT_ADD:
+            op = batch::OP_ADD;
+            break;
+        case parser::FT_MINUS:
+            op = batch::OP_MINUS;
+            break;
+        case parser::FT_MULTIPLIES:
+            op = batch::OP_MULTIPLIES;
+            break;
+        default:
+            return;
+    }
+    pb::PrimitiveType arg_type = _fn.arg_types(0);
+    if (arg_type != _fn.arg_types(1)) {
+        return;
+    }
+    ColumnVector::PhysicalType pt = ColumnVector::physical_type(arg_type);
+    if (pt == ColumnVector::PT_STRING) {
+        return;
+    }
+    if (batch::is_compare_op(op)) {
+        if (_col_type != pb::BOOL) {
+            return;
+        }
+    } else if (_col_type != arg_type ||
+            (arg_type != pb::INT64 && arg_type != pb::UINT64 && arg_type != pb::DOUBLE)) {
+        return;
+    }
+    for (auto c : _children) {
+        if (!batch_type_compatible(c->col_type(), arg_type)) {
+            return;
+        }
+    }
+    _batch_op = op;
+}
+
+ColumnVector* ScalarFnCall::eval_batch(RowBatch* rows, ColumnBatch* columns, const SelectVector& sel) {
+    if (_batch_op == batch::OP_NONE) {
+        return ExprNode::eval_batch(rows, columns, sel);
+    }
+    ColumnVector* left = _children[0]->eval_batch(rows, columns, sel);
+    if (left == nullptr) {
+        return nullptr;
+    }
+    ColumnVector* right = _children[1]->eval_batch(rows, columns, sel);
+    if (right == nullptr) {
+        return nullptr;
+    }
+    size_t num_rows = rows->size();
+    if (left->size() != num_rows || right->size() != num_rows
+            || left->physical_type() != right->physical_type()) {
+        DB_WARNING("batch column mismatch, rows:%lu left:%lu right:%lu", 
+                num_rows, left->size(), right->size());
+        return ExprNode::eval_batch(rows, columns, sel);
+    }
+    ColumnVector* result = batch_result(num_rows);
+    batch::merge_null(left->null_bitmap().data(), right->null_bitmap().data(),
+            result->null_bitmap().data(), result->null_bitmap().size());
+    bool is_compare = batch::is_compare_op(_batch_op);
+    switch (left->physical_type()) {
+        case ColumnVector::PT_INT64:
+            if (is_compare) {
+                batch::compare(_batch_op, left->int_data(), right->int_data(),
+                        result->uint_data(), num_rows);
+            } else {
+                batch::arithmetic(_batch_op, left->int_data(), right->int_data(),
+                        result->int_data(), num_rows);
+            }
+            break;
+        case ColumnVector::PT_UINT64:
+            if (is_compare) {
+                batch::compare(_batch_op, left->uint_data(), right->uint_data(),
+                        result->uint_data(), num_rows);
+            } else {
+                batch::arithmetic(_batch_op, left->uint_data(), right->uint_data(),
+                        result->uint_data(), num_rows);
+            }
+            break;
+        case ColumnVector::PT_DOUBLE:
+            if (is_compare) {
+                batch::compare(_batch_op, left->double_data(), right->double_data(),
+                        result->uint_data(), num_rows);
+            } else {
+                batch::arithmetic(_batch_op, left->double_data(), right->double_data(),
+                        result->double_data(), num_rows);
+            }
+            break;
+        default:
+            return ExprNode::eval_batch(rows, columns, sel);
+    }
+    return result;
+}
+
 ExprValue ScalarFnCall::get_value(MemRow* row) {
     if (_is_row_expr) {
         switch (_fn.fn_op()) {
@@ -29,6 +29,7 @@
 #include "transaction_planner.h"
 #include "kill_planner.h"
 #include "prepare_planner.h"
+#include "plan_cache.h"
 #include "predicate.h"
 #include "network_socket.h"
 #include "parser.h"
@@ -358,6 +359,11 @@ int LogicalPlanner::analyze(QueryContext* ctx) {
         DB_WARNING("dml only support normal explain");
         return -1;
     }
+    // 命中计划缓存时跳过逻辑计划
+    if (PlanCache::get_instance()->normalize(ctx, parser.arena) == 0 &&
+            PlanCache::get_instance()->fill_from_cache(ctx) == 0) {
+        return 0;
+    }
 
     std::unique_ptr<LogicalPlanner> planner;
     switch (ctx->stmt_type) {
@@ -418,6 +424,9 @@ int LogicalPlanner::analyze(QueryContext* ctx) {
     if (ret < 0) {
         return -1;
     }
+    if (!ctx->normalized_sql.empty()) {
+        PlanCache::get_instance()->add_to_cache(ctx);
+    }
     return 0;
 }
 
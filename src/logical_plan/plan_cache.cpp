@@ -0,0 +1,381 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "plan_cache.h"
+#include "network_socket.h"
+#include "schema_factory.h"
+#include "meta_server_interact.hpp"
+#include "mysql_err_code.h"
+#include "dml.h"
+
+namespace baikaldb {
+DEFINE_bool(enable_plan_cache, false, "cache logical plan of text protocol select, default: false");
+DEFINE_int64(plan_cache_capacity, 10000, "max plan count in plan cache, default: 10000");
+DEFINE_int64(plan_cache_max_bytes, 256 * 1024 * 1024LL, "max bytes of plan cache, default: 256M");
+
+namespace {
+bool is_session_func(const parser::FuncExpr* func) {
+    if (func->func_type != parser::FT_COMMON) {
+        return false;
+    }
+    std::string name = func->fn_name.to_lower();
+    // 这些函数在逻辑计划阶段按连接状态求值, 计划不能跨连接复用
+    return name == "last_insert_id" || name == "database" || name == "schema"
+        || name == "user" || name == "session_user" || name == "system_user";
+}
+
+// @user_var和@@session_var在逻辑计划阶段被替换成变量值, 但在key中仍是变量名
+bool is_session_var(const parser::ColumnName* column) {
+    std::ostringstream os;
+    column->to_stream(os);
+    return os.str().compare(0, 1, "@") == 0;
+}
+
+bool has_session_state(const parser::Node* node) {
+    if (node == nullptr) {
+        return false;
+    }
+    if (node->node_type == parser::NT_EXPR) {
+        auto expr = static_cast<const parser::ExprNode*>(node);
+        if (expr->expr_type == parser::ET_FUNC &&
+                is_session_func(static_cast<const parser::FuncExpr*>(expr))) {
+            return true;
+        }
+        if (expr->expr_type == parser::ET_COLUMN &&
+                is_session_var(static_cast<const parser::ColumnName*>(expr))) {
+            return true;
+        }
+    }
+    for (int i = 0; i < node->children.size(); ++i) {
+        if (has_session_state(node->children[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 引用了会话相关函数或变量的sql, 计划不能跨连接或跨变量值复用
+bool has_session_state(const parser::SelectStmt* select) {
+    for (int i = 0; i < select->fields.size(); ++i) {
+        if (has_session_state(select->fields[i]->expr)) {
+            return true;
+        }
+    }
+    if (has_session_state(select->where) || has_session_state(select->having)) {
+        return true;
+    }
+    if (select->group != nullptr) {
+        for (int i = 0; i < select->group->items.size(); ++i) {
+            if (has_session_state(select->group->items[i]->expr)) {
+                return true;
+            }
+        }
+    }
+    if (select->order != nullptr) {
+        for (int i = 0; i < select->order->items.size(); ++i) {
+            if (has_session_state(select->order->items[i]->expr)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool is_param_literal(const parser::Node* node) {
+    if (node == nullptr || node->node_type != parser::NT_EXPR) {
+        return false;
+    }
+    auto expr = static_cast<const parser::ExprNode*>(node);
+    if (expr->expr_type != parser::ET_LITETAL) {
+        return false;
+    }
+    auto literal = static_cast<const parser::LiteralExpr*>(expr);
+    return literal->literal_type == parser::LT_INT
+        || literal->literal_type == parser::LT_DOUBLE
+        || literal->literal_type == parser::LT_STRING;
+}
+
+void replace_literal(parser::Node* parent, int idx, butil::Arena& arena,
+        std::vector<parser::LiteralExpr*>* params) {
+    if (!is_param_literal(parent->children[idx])) {
+        return;
+    }
+    params->push_back(static_cast<parser::LiteralExpr*>(parent->children[idx]));
+    parent->children[idx] = parser::LiteralExpr::make_place_holder(params->size() - 1, arena);
+}
+
+// 只参数化where中比较/IN/BETWEEN的常量操作数, 其余常量留在key里
+void parameterize(parser::Node* node, butil::Arena& arena,
+        std::vector<parser::LiteralExpr*>* params) {
+    if (node == nullptr || node->node_type != parser::NT_EXPR) {
+        return;
+    }
+    auto expr = static_cast<parser::ExprNode*>(node);
+    if (expr->expr_type != parser::ET_FUNC) {
+        return;
+    }
+    auto func = static_cast<parser::FuncExpr*>(expr);
+    switch (func->func_type) {
+        case parser::FT_LOGIC_AND:
+        case parser::FT_LOGIC_OR:
+        case parser::FT_LOGIC_XOR:
+        case parser::FT_LOGIC_NOT:
+            for (int i = 0; i < func->children.size(); ++i) {
+                parameterize(func->children[i], arena, params);
+            }
+            break;
+        case parser::FT_EQ:
+        case parser::FT_NE:
+        case parser::FT_GT:
+        case parser::FT_GE:
+        case parser::FT_LT:
+        case parser::FT_LE:
+        case parser::FT_BETWEEN:
+            for (int i = 0; i < func->children.size(); ++i) {
+                replace_literal(func, i, arena, params);
+            }
+            break;
+        case parser::FT_IN: {
+            if (func->has_subquery() || func->children.size() != 2) {
+                break;
+            }
+            parser::Node* list = func->children[1];
+            for (int i = 0; i < list->children.size(); ++i) {
+                replace_literal(list, i, arena, params);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void literal_to_pb(const parser::LiteralExpr* literal, pb::ExprNode* node) {
+    node->set_num_children(0);
+    switch (literal->literal_type) {
+        case parser::LT_INT:
+            node->set_node_type(pb::INT_LITERAL);
+            node->set_col_type(pb::INT64);
+            node->mutable_derive_node()->set_int_val(literal->_u.int64_val);
+            break;
+        case parser::LT_DOUBLE:
+            node->set_node_type(pb::DOUBLE_LITERAL);
+            node->set_col_type(pb::DOUBLE);
+            node->mutable_derive_node()->set_double_val(literal->_u.double_val);
+            break;
+        default:
+            node->set_node_type(pb::STRING_LITERAL);
+            node->set_col_type(pb::STRING);
+            node->mutable_derive_node()->set_string_val(literal->_u.str_val.to_string());
+            break;
+    }
+}
+
+int count_place_holders(const google::protobuf::Message& message) {
+    int count = 0;
+    const pb::ExprNode* expr_node = dynamic_cast<const pb::ExprNode*>(&message);
+    if (expr_node != nullptr && expr_node->node_type() == pb::PLACE_HOLDER_LITERAL) {
+        ++count;
+    }
+    const google::protobuf::Reflection* reflection = message.GetReflection();
+    std::vector<const google::protobuf::FieldDescriptor*> fields;
+    reflection->ListFields(message, &fields);
+    for (auto field : fields) {
+        if (field->cpp_type() != google::protobuf::FieldDescriptor::CPPTYPE_MESSAGE) {
+            continue;
+        }
+        if (field->is_repeated()) {
+            for (int i = 0; i < reflection->FieldSize(message, field); ++i) {
+                count += count_place_holders(reflection->GetRepeatedMessage(message, field, i));
+            }
+        } else {
+            count += count_place_holders(reflection->GetMessage(message, field));
+        }
+    }
+    return count;
+}
+
+uint64_t plan_cache_key(const std::string& normalized_sql) {
+    uint64_t out[2];
+    butil::MurmurHash3_x64_128(normalized_sql.c_str(), normalized_sql.size(), 0x1234, out);
+    return out[0];
+}
+}
+
+PlanCache::PlanCache() : _budget("plan_cache", 4), _invalid_count("plan_cache_invalid_count") {
+    _budget.capacity = FLAGS_plan_cache_max_bytes;
+    _cache.init(FLAGS_plan_cache_capacity, 0, 4, &_budget);
+}
+
+int PlanCache::normalize(QueryContext* ctx, butil::Arena& arena) {
+    if (!FLAGS_enable_plan_cache) {
+        return -1;
+    }
+    if (ctx->mysql_cmd != COM_QUERY || ctx->stmt_type != parser::NT_SELECT
+            || ctx->explain_type != EXPLAIN_NULL || ctx->is_explain || ctx->is_complex
+            || ctx->user_info == nullptr || ctx->client_conn == nullptr) {
+        return -1;
+    }
+    // 未参数化的字符串常量原样出现在key中, 含转义时打印结果可能有歧义
+    if (ctx->sql.find('\\') != std::string::npos || ctx->sql.find("''") != std::string::npos) {
+        return -1;
+    }
+    parser::SelectStmt* select = static_cast<parser::SelectStmt*>(ctx->stmt);
+    // 只缓存单表select, join的计划依赖join重排和各表统计信息
+    if (select->table_refs == nullptr || select->table_refs->node_type == parser::NT_JOIN
+            || has_session_state(select)) {
+        return -1;
+    }
+    std::vector<parser::LiteralExpr*> params;
+    parameterize(select->where, arena, &params);
+
+    std::ostringstream os;
+    os << ctx->user_info->namespace_ << "\n" << ctx->cur_db << "\n" << ctx->charset << "\n"
+       << select->to_string();
+    // 列头取自原始sql, 也要区分
+    for (int i = 0; i < select->fields.size(); ++i) {
+        parser::SelectField* field = select->fields[i];
+        os << "\n";
+        if (!field->org_name.empty()) {
+            os << field->org_name.c_str();
+        }
+        os << "\t";
+        if (!field->as_name.empty()) {
+            os << field->as_name.c_str();
+        }
+    }
+    // 常量类型影响类型推导和索引范围, id = 1和id = '1'不能共用计划
+    os << "\n";
+    for (auto param : params) {
+        os << param->literal_type << ",";
+    }
+    ctx->normalized_sql = os.str();
+    ctx->plan_cache_params.clear();
+    ctx->plan_cache_params.resize(params.size());
+    for (size_t i = 0; i < params.size(); ++i) {
+        literal_to_pb(params[i], &ctx->plan_cache_params[i]);
+    }
+    return 0;
+}
+
+int PlanCache::fill_from_cache(QueryContext* ctx) {
+    uint64_t key = plan_cache_key(ctx->normalized_sql);
+    SmartPlanCacheEntry entry;
+    if (_cache.find(key, &entry) != 0) {
+        return -1;
+    }
+    if (entry->normalized_sql != ctx->normalized_sql
+            || entry->num_params != ctx->plan_cache_params.size()) {
+        return -1;
+    }
+    // 任何校验不通过都按未命中处理, 重新走逻辑计划得到准确的报错
+    SchemaFactory* factory = SchemaFactory::get_instance();
+    bool backup_inited = MetaServerInteract::get_backup_instance()->is_inited();
+    bool need_learner_backup = false;
+    for (auto& ref : entry->tables) {
+        SmartTable tbl = factory->get_table_info_ptr(ref.table_id);
+        if (tbl == nullptr || tbl->version != ref.version || tbl->db_id != ref.db_id) {
+            _cache.del(key);
+            _invalid_count << 1;
+            return -1;
+        }
+        if (backup_inited && tbl->have_backup
+                && (tbl->need_write_backup || tbl->need_read_backup)) {
+            return -1;
+        }
+        if (!ctx->user_info->allow_op(pb::OP_SELECT, ref.db_id, ref.table_id)) {
+            return -1;
+        }
+        if (tbl->sign_blacklist.count(entry->sign) > 0) {
+            return -1;
+        }
+        if (tbl->need_learner_backup || tbl->sign_forcelearner.count(entry->sign) > 0) {
+            need_learner_backup = true;
+        }
+    }
+    ctx->is_select = true;
+    ctx->need_learner_backup = ctx->need_learner_backup || need_learner_backup;
+    ctx->is_straight_join = entry->is_straight_join;
+    ctx->plan.CopyFrom(entry->plan);
+    ctx->mutable_tuple_descs()->assign(entry->tuple_descs.begin(), entry->tuple_descs.end());
+    ctx->field_column_id_mapping = entry->field_column_id_mapping;
+    ctx->ref_slot_id_mapping = entry->ref_slot_id_mapping;
+    ctx->slot_column_mapping = entry->slot_column_mapping;
+    ctx->current_tuple_ids = entry->current_tuple_ids;
+    ctx->current_table_tuple_ids = entry->current_table_tuple_ids;
+    ctx->stat_info.family = entry->family;
+    ctx->stat_info.table = entry->table;
+    ctx->stat_info.resource_tag = entry->resource_tag;
+    ctx->stat_info.table_id = entry->table_id;
+    ctx->stat_info.sample_sql << entry->sample_sql;
+    ctx->stat_info.sign = entry->sign;
+    ctx->get_runtime_state()->set_single_sql_autocommit(ctx->client_conn->txn_id == 0);
+    return 0;
+}
+
+void PlanCache::add_to_cache(QueryContext* ctx) {
+    if (ctx->normalized_sql.empty() || ctx->stat_info.sign == 0) {
+        return;
+    }
+    if (ctx->has_derived_table || ctx->has_information_schema || ctx->is_full_export
+            || ctx->use_backup || ctx->return_empty || !ctx->sub_query_plans.empty()
+            || !ctx->derived_table_ctx_mapping.empty()) {
+        return;
+    }
+    if (count_place_holders(ctx->plan) != (int)ctx->plan_cache_params.size()) {
+        DB_WARNING("place holder count not match, sql: %s", ctx->sql.c_str());
+        return;
+    }
+    SmartPlanCacheEntry entry = std::make_shared<PlanCacheEntry>();
+    SchemaFactory* factory = SchemaFactory::get_instance();
+    for (auto& tuple_desc : ctx->tuple_descs()) {
+        if (!tuple_desc.has_table_id()) {
+            continue;
+        }
+        SmartTable tbl = factory->get_table_info_ptr(tuple_desc.table_id());
+        if (tbl == nullptr) {
+            return;
+        }
+        PlanCacheEntry::TableRef ref;
+        ref.db_id = tbl->db_id;
+        ref.table_id = tbl->id;
+        ref.version = tbl->version;
+        entry->tables.push_back(ref);
+    }
+    if (entry->tables.empty()) {
+        return;
+    }
+    entry->normalized_sql = ctx->normalized_sql;
+    entry->num_params = ctx->plan_cache_params.size();
+    entry->plan.CopyFrom(ctx->plan);
+    entry->tuple_descs = ctx->tuple_descs();
+    entry->family = ctx->stat_info.family;
+    entry->table = ctx->stat_info.table;
+    entry->resource_tag = ctx->stat_info.resource_tag;
+    entry->table_id = ctx->stat_info.table_id;
+    entry->sample_sql = ctx->stat_info.sample_sql.str();
+    entry->sign = ctx->stat_info.sign;
+    entry->is_straight_join = ctx->is_straight_join;
+    entry->field_column_id_mapping = ctx->field_column_id_mapping;
+    entry->ref_slot_id_mapping = ctx->ref_slot_id_mapping;
+    entry->slot_column_mapping = ctx->slot_column_mapping;
+    entry->current_tuple_ids = ctx->current_tuple_ids;
+    entry->current_table_tuple_ids = ctx->current_table_tuple_ids;
+    int64_t charge = entry->normalized_sql.size() + entry->plan.ByteSizeLong()
+        + entry->sample_sql.size();
+    _cache.add(plan_cache_key(entry->normalized_sql), entry, charge);
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -14,6 +14,7 @@
 
 #include "query_context.h"
 #include "exec_node.h"
+#include "literal.h"
 
 namespace baikaldb {
 DEFINE_bool(default_2pc, false, "default enable/disable 2pc for autocommit queries");
@@ -26,7 +27,24 @@ QueryContext::~QueryContext() {
 
 int QueryContext::create_plan_tree() {
     need_destroy_tree = true;
-    return ExecNode::create_tree(plan, &root);
+    int ret = ExecNode::create_tree(plan, &root);
+    if (ret < 0 || plan_cache_params.empty()) {
+        return ret;
+    }
+    // 计划缓存参数化后的常量在这里绑定
+    std::map<int, ExprNode*> place_holders;
+    root->find_place_holder(place_holders);
+    for (size_t idx = 0; idx < plan_cache_params.size(); ++idx) {
+        auto iter = place_holders.find(idx);
+        if (iter == place_holders.end() || iter->second == nullptr) {
+            continue;
+        }
+        ret = static_cast<Literal*>(iter->second)->init(plan_cache_params[idx]);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
 }
 
 void QueryContext::update_ctx_stat_info(RuntimeState* state, int64_t query_total_time) {
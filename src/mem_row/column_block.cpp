@@ -0,0 +1,375 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "column_block.h"
+#include <unordered_map>
+
+namespace baikaldb {
+namespace {
+using google::protobuf::FieldDescriptor;
+using google::protobuf::RepeatedField;
+
+// 少于该行数不做游程/字典编码
+const size_t MIN_ENCODE_ROWS = 4;
+
+template <typename T>
+size_t count_runs(const std::vector<T>& values) {
+    size_t runs = 0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (i == 0 || values[i] != values[i - 1]) {
+            ++runs;
+        }
+    }
+    return runs;
+}
+
+// 段数不超过一半时用游程编码, 否则原样输出
+template <typename T, typename F>
+void encode_values(const std::vector<T>& values, RepeatedField<F>* out,
+        RepeatedField<uint32_t>* run_lengths) {
+    if (values.size() >= MIN_ENCODE_ROWS && count_runs(values) * 2 <= values.size()) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i == 0 || values[i] != values[i - 1]) {
+                out->Add(values[i]);
+                run_lengths->Add(1);
+            } else {
+                run_lengths->Set(run_lengths->size() - 1, run_lengths->Get(run_lengths->size() - 1) + 1);
+            }
+        }
+        return;
+    }
+    out->Reserve(values.size());
+    for (auto& v : values) {
+        out->Add(v);
+    }
+}
+
+// 按行序给出每个非null值在值数组中的下标
+class ValueCursor {
+public:
+    ValueCursor(const pb::ColumnValues& column) : _run_lengths(column.run_lengths()) {}
+    // values_size: 值数组长度, non_null: 非null行数
+    bool check(int64_t values_size, int64_t non_null) const {
+        if (_run_lengths.size() == 0) {
+            return values_size == non_null;
+        }
+        if (values_size != _run_lengths.size()) {
+            return false;
+        }
+        int64_t total = 0;
+        for (auto len : _run_lengths) {
+            total += len;
+        }
+        return total == non_null;
+    }
+    int next() {
+        if (_run_lengths.size() == 0) {
+            return _idx++;
+        }
+        while (_remain == 0) {
+            _remain = _run_lengths.Get(_idx++);
+        }
+        --_remain;
+        return _idx - 1;
+    }
+
+private:
+    const RepeatedField<uint32_t>& _run_lengths;
+    int _idx = 0;
+    uint32_t _remain = 0;
+};
+
+int decode_column(const pb::ColumnValues& column, int64_t num_rows, const FieldDescriptor* field,
+        std::unique_ptr<MemRow>* rows) {
+    const std::string& null_bitmap = column.null_bitmap();
+    if (column.has_null_bitmap() && (int64_t)null_bitmap.size() != (num_rows + 7) / 8) {
+        DB_WARNING("null bitmap size wrong, %lu vs %ld", null_bitmap.size(), num_rows);
+        return -1;
+    }
+    auto is_null = [&null_bitmap](int64_t i) -> bool {
+        if (null_bitmap.empty()) {
+            return false;
+        }
+        return (null_bitmap[i / 8] >> (i % 8)) & 1;
+    };
+    int64_t non_null = 0;
+    for (int64_t i = 0; i < num_rows; ++i) {
+        if (!is_null(i)) {
+            ++non_null;
+        }
+    }
+    ValueCursor cursor(column);
+    int64_t values_size = 0;
+    bool use_dict = column.dict_size() > 0;
+    switch (field->cpp_type()) {
+        case FieldDescriptor::CPPTYPE_INT32:
+        case FieldDescriptor::CPPTYPE_INT64:
+            values_size = column.int_values_size();
+            break;
+        case FieldDescriptor::CPPTYPE_UINT32:
+        case FieldDescriptor::CPPTYPE_UINT64:
+        case FieldDescriptor::CPPTYPE_BOOL:
+            values_size = column.uint_values_size();
+            break;
+        case FieldDescriptor::CPPTYPE_FLOAT:
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+            values_size = column.double_values_size();
+            break;
+        case FieldDescriptor::CPPTYPE_STRING:
+            values_size = use_dict ? column.dict_ids_size() : column.str_values_size();
+            break;
+        default:
+            DB_WARNING("unsupported cpp type: %d", field->cpp_type());
+            return -1;
+    }
+    if (!cursor.check(values_size, non_null)) {
+        DB_WARNING("column values size wrong, tuple_id: %d, slot_id: %d, values: %ld, rows: %ld",
+                column.tuple_id(), column.slot_id(), values_size, non_null);
+        return -1;
+    }
+    for (int64_t i = 0; i < num_rows; ++i) {
+        if (is_null(i)) {
+            continue;
+        }
+        MemRow* row = rows[i].get();
+        google::protobuf::Message* tuple = row->get_tuple(column.tuple_id());
+        if (tuple == nullptr) {
+            return -1;
+        }
+        const google::protobuf::Reflection* reflection = tuple->GetReflection();
+        int idx = cursor.next();
+        switch (field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+                reflection->SetInt32(tuple, field, column.int_values(idx));
+                row->update_used_size(4);
+                break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                reflection->SetInt64(tuple, field, column.int_values(idx));
+                row->update_used_size(8);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                reflection->SetUInt32(tuple, field, column.uint_values(idx));
+                row->update_used_size(4);
+                break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                reflection->SetUInt64(tuple, field, column.uint_values(idx));
+                row->update_used_size(8);
+                break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                reflection->SetBool(tuple, field, column.uint_values(idx) != 0);
+                row->update_used_size(1);
+                break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                reflection->SetFloat(tuple, field, column.double_values(idx));
+                row->update_used_size(4);
+                break;
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                reflection->SetDouble(tuple, field, column.double_values(idx));
+                row->update_used_size(8);
+                break;
+            case FieldDescriptor::CPPTYPE_STRING: {
+                if (use_dict) {
+                    uint32_t id = column.dict_ids(idx);
+                    if ((int)id >= column.dict_size()) {
+                        DB_WARNING("dict id out of range: %u, dict size: %d", id, column.dict_size());
+                        return -1;
+                    }
+                    reflection->SetString(tuple, field, column.dict(id));
+                    row->update_used_size(column.dict(id).size());
+                } else {
+                    reflection->SetString(tuple, field, column.str_values(idx));
+                    row->update_used_size(column.str_values(idx).size());
+                }
+                break;
+            }
+            default:
+                return -1;
+        }
+    }
+    return 0;
+}
+}
+
+int ColumnBlockEncoder::init(MemRowDescriptor* desc) {
+    _columns.clear();
+    _num_rows = 0;
+    for (auto& pair : desc->id_tuple_mapping()) {
+        const google::protobuf::Descriptor* descriptor = pair.second->GetDescriptor();
+        for (int i = 0; i < descriptor->field_count(); ++i) {
+            Column column;
+            column.tuple_id = pair.first;
+            column.field = descriptor->field(i);
+            _columns.emplace_back(std::move(column));
+        }
+    }
+    return 0;
+}
+
+void ColumnBlockEncoder::add_row(MemRow* row) {
+    if (_num_rows % 64 == 0) {
+        for (auto& column : _columns) {
+            column.null_bits.push_back(0);
+        }
+    }
+    for (auto& column : _columns) {
+        const google::protobuf::Message* tuple = row->get_tuple(column.tuple_id);
+        const google::protobuf::Reflection* reflection = nullptr;
+        if (tuple != nullptr) {
+            reflection = tuple->GetReflection();
+        }
+        if (tuple == nullptr || !reflection->HasField(*tuple, column.field)) {
+            column.null_bits.back() |= 1ULL << (_num_rows % 64);
+            column.has_null = true;
+            continue;
+        }
+        switch (column.field->cpp_type()) {
+            case FieldDescriptor::CPPTYPE_INT32:
+                column.int_values.push_back(reflection->GetInt32(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_INT64:
+                column.int_values.push_back(reflection->GetInt64(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_UINT32:
+                column.uint_values.push_back(reflection->GetUInt32(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_UINT64:
+                column.uint_values.push_back(reflection->GetUInt64(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_BOOL:
+                column.uint_values.push_back(reflection->GetBool(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_FLOAT:
+                column.double_values.push_back(reflection->GetFloat(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_DOUBLE:
+                column.double_values.push_back(reflection->GetDouble(*tuple, column.field));
+                break;
+            case FieldDescriptor::CPPTYPE_STRING:
+                column.str_values.emplace_back(reflection->GetString(*tuple, column.field));
+                break;
+            default:
+                break;
+        }
+    }
+    ++_num_rows;
+}
+
+void ColumnBlockEncoder::finish_column(Column& column, pb::ColumnValues* values) {
+    values->set_tuple_id(column.tuple_id);
+    values->set_slot_id(column.field->number());
+    if (column.has_null) {
+        std::string* bitmap = values->mutable_null_bitmap();
+        bitmap->resize((_num_rows + 7) / 8);
+        for (int64_t i = 0; i < _num_rows; ++i) {
+            if ((column.null_bits[i / 64] >> (i % 64)) & 1) {
+                (*bitmap)[i / 8] |= (char)(1 << (i % 8));
+            }
+        }
+    }
+    auto run_lengths = values->mutable_run_lengths();
+    if (!column.int_values.empty()) {
+        encode_values(column.int_values, values->mutable_int_values(), run_lengths);
+    } else if (!column.uint_values.empty()) {
+        encode_values(column.uint_values, values->mutable_uint_values(), run_lengths);
+    } else if (!column.double_values.empty()) {
+        encode_values(column.double_values, values->mutable_double_values(), run_lengths);
+    } else if (!column.str_values.empty()) {
+        auto& strs = column.str_values;
+        // 不同值不超过一半时用字典编码
+        std::unordered_map<std::string, uint32_t> dict;
+        std::vector<uint32_t> ids;
+        bool use_dict = strs.size() >= MIN_ENCODE_ROWS;
+        if (use_dict) {
+            ids.reserve(strs.size());
+            for (auto& str : strs) {
+                auto iter = dict.find(str);
+                if (iter == dict.end()) {
+                    if ((dict.size() + 1) * 2 > strs.size()) {
+                        use_dict = false;
+                        break;
+                    }
+                    iter = dict.emplace(str, dict.size()).first;
+                    values->add_dict(str);
+                }
+                ids.push_back(iter->second);
+            }
+        }
+        if (use_dict) {
+            encode_values(ids, values->mutable_dict_ids(), run_lengths);
+        } else {
+            values->clear_dict();
+            values->mutable_str_values()->Reserve(strs.size());
+            for (auto& str : strs) {
+                values->add_str_values()->swap(str);
+            }
+        }
+    }
+}
+
+void ColumnBlockEncoder::finish(pb::ColumnBlock* block) {
+    block->set_num_rows(_num_rows);
+    for (auto& column : _columns) {
+        finish_column(column, block->add_columns());
+        column.null_bits.clear();
+        column.has_null = false;
+        column.int_values.clear();
+        column.uint_values.clear();
+        column.double_values.clear();
+        column.str_values.clear();
+    }
+    _num_rows = 0;
+}
+
+int ColumnBlockDecoder::decode(MemRowDescriptor* desc, const pb::ColumnBlock& block,
+        google::protobuf::Arena* arena, std::vector<std::unique_ptr<MemRow>>* rows) {
+    int64_t num_rows = block.num_rows();
+    if (num_rows < 0) {
+        return -1;
+    }
+    size_t base = rows->size();
+    rows->reserve(base + num_rows);
+    for (int64_t i = 0; i < num_rows; ++i) {
+        rows->emplace_back(desc->fetch_mem_row(arena));
+    }
+    std::set<std::pair<int32_t, int32_t>> decoded;
+    for (auto& column : block.columns()) {
+        // brpc backup_request可能把两个response merge到一起, 出现重复列
+        if (!decoded.emplace(column.tuple_id(), column.slot_id()).second) {
+            DB_WARNING("duplicate column, tuple_id: %d, slot_id: %d", column.tuple_id(), column.slot_id());
+            rows->resize(base);
+            return -1;
+        }
+        auto iter = desc->id_tuple_mapping().find(column.tuple_id());
+        if (iter == desc->id_tuple_mapping().end()) {
+            DB_WARNING("no tuple found: %d", column.tuple_id());
+            rows->resize(base);
+            return -1;
+        }
+        const FieldDescriptor* field =
+            iter->second->GetDescriptor()->FindFieldByNumber(column.slot_id());
+        if (field == nullptr) {
+            DB_WARNING("no slot found, tuple_id: %d, slot_id: %d", column.tuple_id(), column.slot_id());
+            rows->resize(base);
+            return -1;
+        }
+        if (decode_column(column, num_rows, field, rows->data() + base) != 0) {
+            rows->resize(base);
+            return -1;
+        }
+    }
+    return 0;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -32,6 +32,51 @@ void MemRow::to_string(int32_t tuple_id, std::string* out) {
         tuple->SerializeToString(out);
 }
 
+void MemRow::serialize(std::string* out) {
+    for (uint32_t tuple_id = 0; tuple_id < _tuples.size(); ++tuple_id) {
+        auto tuple = _tuples[tuple_id];
+        if (tuple == nullptr) {
+            continue;
+        }
+        uint32_t len = tuple->ByteSizeLong();
+        if (len == 0) {
+            continue;
+        }
+        out->append((char*)&tuple_id, sizeof(tuple_id));
+        out->append((char*)&len, sizeof(len));
+        size_t pos = out->size();
+        out->resize(pos + len);
+        tuple->SerializeWithCachedSizesToArray((uint8_t*)&(*out)[pos]);
+    }
+}
+
+int MemRow::deserialize(const char* data, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+        if (pos + 2 * sizeof(uint32_t) > size) {
+            DB_WARNING("invalid row data, pos:%lu size:%lu", pos, size);
+            return -1;
+        }
+        uint32_t tuple_id = 0;
+        uint32_t len = 0;
+        memcpy(&tuple_id, data + pos, sizeof(tuple_id));
+        memcpy(&len, data + pos + sizeof(tuple_id), sizeof(len));
+        pos += 2 * sizeof(uint32_t);
+        auto tuple = get_tuple(tuple_id);
+        if (tuple == nullptr || pos + len > size) {
+            DB_WARNING("invalid row data, tuple_id:%u len:%u", tuple_id, len);
+            return -1;
+        }
+        if (!tuple->ParseFromArray(data + pos, len)) {
+            DB_WARNING("parse tuple fail, tuple_id:%u", tuple_id);
+            return -1;
+        }
+        _used_size += len;
+        pos += len;
+    }
+    return 0;
+}
+
 std::string MemRow::debug_string(int32_t tuple_id) {
     auto tuple = get_tuple(tuple_id);
     if (tuple == nullptr) {
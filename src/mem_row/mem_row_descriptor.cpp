@@ -92,15 +92,15 @@ google::protobuf::Message* MemRowDescriptor::new_tuple_message(int32_t tuple_id)
     return iter->second->New();
 }
 
-std::unique_ptr<MemRow> MemRowDescriptor::fetch_mem_row() {
+std::unique_ptr<MemRow> MemRowDescriptor::fetch_mem_row(google::protobuf::Arena* arena) {
     int32_t size = _id_tuple_mapping.size();
     int32_t largest = 1;
     if (size > 0) {
         largest = _id_tuple_mapping.rbegin()->first;
     }
-    std::unique_ptr<MemRow> tmp(new MemRow(largest + 1));
+    std::unique_ptr<MemRow> tmp(new MemRow(largest + 1, arena != nullptr));
     for (auto& pair : _id_tuple_mapping) {
-        tmp->_tuples[pair.first] = pair.second->New();
+        tmp->_tuples[pair.first] = pair.second->New(arena);
     }
     return tmp;
 }
@@ -20,6 +20,7 @@
 #include "region_manager.h"
 #include "meta_util.h"
 #include "meta_rocksdb.h"
+#include "hot_spot_scheduler.h"
 
 namespace baikaldb {
 DEFINE_int32(migrate_percent, 60, "migrate percent. default:60%");
@@ -1031,6 +1032,8 @@ void ClusterManager::process_peer_heartbeat_for_store(const pb::StoreHeartBeatRe
     } else {
         DB_WARNING("instance: %s has been peer_load_balance, no need migrate", instance.c_str());
     }
+    // 个数均衡之外, 按负载迁走热点store上的follower
+    HotSpotScheduler::get_instance()->peer_balance(request);
 
     for (auto& add_learner_count : add_learner_counts) {
         DB_WARNING("instance: %s should add learner count for learner_load_balance, "
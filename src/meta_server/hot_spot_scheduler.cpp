@@ -0,0 +1,369 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "hot_spot_scheduler.h"
+#include <algorithm>
+#include <functional>
+#include "cluster_manager.h"
+#include "region_manager.h"
+#include "table_manager.h"
+#include "store_interact.hpp"
+
+namespace baikaldb {
+DEFINE_bool(hot_spot_balance, false, "balance leader and peer by region load reported in heartbeat");
+DEFINE_int32(hot_spot_load_ratio, 130, "store is hot when load above average * ratio / 100, default: 130");
+DEFINE_int64(hot_spot_min_load, 1000, "no hot spot balance when average load below this, default: 1000");
+DEFINE_int32(hot_spot_max_transfer_leader, 5, "max transfer leader per heartbeat for hot spot, default: 5");
+DEFINE_int32(hot_spot_max_add_peer, 2, "max add peer per heartbeat for hot spot, default: 2");
+DEFINE_int32(region_load_read_weight, 1, "load weight of one read qps, default: 1");
+DEFINE_int32(region_load_write_weight, 4, "load weight of one write qps, default: 4");
+DEFINE_int64(region_load_scan_rows_unit, 1000, "scan rows per second counted as one load, default: 1000");
+DEFINE_int64(region_load_read_bytes_unit, 64 * 1024LL, "read bytes per second counted as one load, default: 64K");
+DECLARE_int64(store_heart_beat_interval_us);
+DECLARE_int32(store_dead_interval_times);
+
+int64_t HotSpotScheduler::weighted_load(const pb::RegionLoad& load) {
+    int64_t value = load.read_qps() * FLAGS_region_load_read_weight
+            + load.write_qps() * FLAGS_region_load_write_weight;
+    if (FLAGS_region_load_scan_rows_unit > 0) {
+        value += load.scan_rows() / FLAGS_region_load_scan_rows_unit;
+    }
+    if (FLAGS_region_load_read_bytes_unit > 0) {
+        value += load.read_bytes() / FLAGS_region_load_read_bytes_unit;
+    }
+    return value;
+}
+
+void HotSpotScheduler::update_instance_load(const pb::StoreHeartBeatRequest* request) {
+    const std::string& instance = request->instance_info().address();
+    if (instance.empty()) {
+        return;
+    }
+    int64_t leader_load = 0;
+    std::set<int64_t> leader_region_ids;
+    for (auto& leader_region : request->leader_regions()) {
+        leader_load += weighted_load(leader_region.load());
+        leader_region_ids.insert(leader_region.region().region_id());
+    }
+    // peer_infos里也有leader region, 只累加follower的负载
+    int64_t total_load = leader_load;
+    for (auto& peer_info : request->peer_infos()) {
+        if (leader_region_ids.count(peer_info.region_id()) == 0) {
+            total_load += weighted_load(peer_info.load());
+        }
+    }
+    int64_t now = butil::gettimeofday_us();
+    BAIDU_SCOPED_LOCK(_mutex);
+    InstanceLoad& instance_load = _instance_loads[instance];
+    instance_load.resource_tag = request->instance_info().resource_tag();
+    instance_load.leader_load = leader_load;
+    instance_load.leader_timestamp = now;
+    // 全量peer_infos只在need_peer_balance时上报
+    if (request->need_peer_balance()) {
+        instance_load.total_load = total_load;
+        instance_load.total_timestamp = now;
+    }
+}
+
+HotSpotScheduler::AverageLoad HotSpotScheduler::average_load(const std::string& resource_tag, int64_t now) {
+    AverageLoad average;
+    int64_t leader_count = 0;
+    int64_t total_count = 0;
+    int64_t expire_us = FLAGS_store_heart_beat_interval_us * FLAGS_store_dead_interval_times;
+    for (auto iter = _instance_loads.begin(); iter != _instance_loads.end();) {
+        const InstanceLoad& load = iter->second;
+        if (now - load.leader_timestamp > expire_us) {
+            // 已下线的store
+            iter = _instance_loads.erase(iter);
+            continue;
+        }
+        if (load.resource_tag == resource_tag) {
+            average.leader_load += load.leader_load;
+            ++leader_count;
+            if (now - load.total_timestamp <= expire_us) {
+                average.total_load += load.total_load;
+                ++total_count;
+            }
+        }
+        ++iter;
+    }
+    if (leader_count > 0) {
+        average.leader_load /= leader_count;
+    }
+    if (total_count > 0) {
+        average.total_load /= total_count;
+    }
+    return average;
+}
+
+bool HotSpotScheduler::above_average_leader_load(const std::string& instance) {
+    if (!FLAGS_hot_spot_balance) {
+        return false;
+    }
+    BAIDU_SCOPED_LOCK(_mutex);
+    auto iter = _instance_loads.find(instance);
+    if (iter == _instance_loads.end()) {
+        return false;
+    }
+    // average_load可能删除过期的store, 先拷出来
+    InstanceLoad instance_load = iter->second;
+    AverageLoad average = average_load(instance_load.resource_tag, butil::gettimeofday_us());
+    if (average.leader_load < FLAGS_hot_spot_min_load) {
+        return false;
+    }
+    return instance_load.leader_load > average.leader_load;
+}
+
+std::string HotSpotScheduler::move_load(const std::string& instance,
+        const std::vector<std::string>& candidates,
+        int64_t region_load, int64_t threshold, bool is_leader) {
+    BAIDU_SCOPED_LOCK(_mutex);
+    std::string target;
+    int64_t min_load = INT64_MAX;
+    for (auto& candidate : candidates) {
+        auto iter = _instance_loads.find(candidate);
+        if (iter == _instance_loads.end()) {
+            continue;
+        }
+        int64_t load = is_leader ? iter->second.leader_load : iter->second.total_load;
+        // 迁过去之后不能成为新的热点
+        if (load + region_load > threshold) {
+            continue;
+        }
+        if (load < min_load) {
+            min_load = load;
+            target = candidate;
+        }
+    }
+    if (target.empty()) {
+        return target;
+    }
+    if (is_leader) {
+        _instance_loads[target].leader_load += region_load;
+        _instance_loads[instance].leader_load -= region_load;
+    } else {
+        _instance_loads[target].total_load += region_load;
+        _instance_loads[instance].total_load -= region_load;
+    }
+    return target;
+}
+
+int HotSpotScheduler::leader_balance(const pb::StoreHeartBeatRequest* request,
+        std::set<int64_t>& trans_leader_region_ids,
+        pb::StoreHeartBeatResponse* response) {
+    if (!FLAGS_hot_spot_balance) {
+        return 0;
+    }
+    std::string instance = request->instance_info().address();
+    std::string resource_tag = request->instance_info().resource_tag();
+    int64_t instance_load = 0;
+    int64_t average = 0;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        auto iter = _instance_loads.find(instance);
+        if (iter == _instance_loads.end()) {
+            return 0;
+        }
+        instance_load = iter->second.leader_load;
+        average = average_load(resource_tag, butil::gettimeofday_us()).leader_load;
+    }
+    int64_t threshold = average * FLAGS_hot_spot_load_ratio / 100;
+    if (average < FLAGS_hot_spot_min_load || instance_load <= threshold) {
+        return 0;
+    }
+    DB_WARNING("hot spot leader balance, instance: %s, resource_tag: %s, load: %ld, average: %ld",
+               instance.c_str(), resource_tag.c_str(), instance_load, average);
+    // 负载高的region先迁
+    std::vector<std::pair<int64_t, const pb::LeaderHeartBeat*>> hot_regions;
+    for (auto& leader_region : request->leader_regions()) {
+        int64_t region_load = weighted_load(leader_region.load());
+        if (region_load <= 0 || leader_region.status() != pb::IDLE
+                || trans_leader_region_ids.count(leader_region.region().region_id()) > 0) {
+            continue;
+        }
+        hot_regions.emplace_back(region_load, &leader_region);
+    }
+    std::sort(hot_regions.begin(), hot_regions.end(),
+            [](const std::pair<int64_t, const pb::LeaderHeartBeat*>& l,
+               const std::pair<int64_t, const pb::LeaderHeartBeat*>& r) {
+                return l.first > r.first;
+            });
+    int64_t excess = instance_load - average;
+    int transfer_count = 0;
+    for (auto& hot_region : hot_regions) {
+        if (excess <= 0 || transfer_count >= FLAGS_hot_spot_max_transfer_leader) {
+            break;
+        }
+        int64_t region_load = hot_region.first;
+        const pb::RegionInfo& region = hot_region.second->region();
+        int64_t table_id = region.table_id();
+        int64_t replica_num = 0;
+        if (TableManager::get_instance()->get_replica_num(table_id, replica_num) < 0
+                || region.peers_size() < replica_num) {
+            continue;
+        }
+        std::string main_logical_room;
+        TableManager::get_instance()->get_main_logical_room(table_id, main_logical_room);
+        std::vector<std::string> candidates;
+        for (auto& peer : region.peers()) {
+            if (peer == instance || ClusterManager::get_instance()->get_instance_status(peer) != pb::NORMAL) {
+                continue;
+            }
+            if (!main_logical_room.empty()
+                    && ClusterManager::get_instance()->get_logical_room(peer) != main_logical_room) {
+                continue;
+            }
+            candidates.emplace_back(peer);
+        }
+        std::string new_leader = move_load(instance, candidates, region_load, threshold, true);
+        if (new_leader.empty()) {
+            continue;
+        }
+        pb::TransLeaderRequest* transfer_request = response->add_trans_leader();
+        transfer_request->set_table_id(table_id);
+        transfer_request->set_region_id(region.region_id());
+        transfer_request->set_old_leader(instance);
+        transfer_request->set_new_leader(new_leader);
+        trans_leader_region_ids.insert(region.region_id());
+        RegionManager::get_instance()->add_leader_count(new_leader, table_id);
+        excess -= region_load;
+        ++transfer_count;
+        DB_WARNING("hot spot transfer leader, region_id: %ld, load: %ld, %s -> %s",
+                   region.region_id(), region_load, instance.c_str(), new_leader.c_str());
+    }
+    return transfer_count;
+}
+
+void HotSpotScheduler::peer_balance(const pb::StoreHeartBeatRequest* request) {
+    if (!FLAGS_hot_spot_balance || !request->need_peer_balance()) {
+        return;
+    }
+    std::string instance = request->instance_info().address();
+    std::string resource_tag = request->instance_info().resource_tag();
+    int64_t instance_load = 0;
+    int64_t average = 0;
+    std::vector<std::string> instances;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        auto iter = _instance_loads.find(instance);
+        if (iter == _instance_loads.end()) {
+            return;
+        }
+        instance_load = iter->second.total_load;
+        average = average_load(resource_tag, butil::gettimeofday_us()).total_load;
+        for (auto& pair : _instance_loads) {
+            if (pair.second.resource_tag == resource_tag && pair.first != instance) {
+                instances.emplace_back(pair.first);
+            }
+        }
+    }
+    int64_t threshold = average * FLAGS_hot_spot_load_ratio / 100;
+    if (average < FLAGS_hot_spot_min_load || instance_load <= threshold) {
+        return;
+    }
+    DB_WARNING("hot spot peer balance, instance: %s, resource_tag: %s, load: %ld, average: %ld",
+               instance.c_str(), resource_tag.c_str(), instance_load, average);
+    std::vector<std::pair<int64_t, int64_t>> hot_regions;
+    for (auto& peer_info : request->peer_infos()) {
+        int64_t region_load = weighted_load(peer_info.load());
+        if (region_load <= 0 || peer_info.is_learner()) {
+            continue;
+        }
+        hot_regions.emplace_back(region_load, peer_info.region_id());
+    }
+    std::sort(hot_regions.begin(), hot_regions.end(), std::greater<std::pair<int64_t, int64_t>>());
+    std::string logical_room = ClusterManager::get_instance()->get_logical_room(instance);
+    std::vector<std::pair<std::string, pb::AddPeer>> add_peer_requests;
+    int64_t excess = instance_load - average;
+    for (auto& hot_region : hot_regions) {
+        if (excess <= 0 || (int)add_peer_requests.size() >= FLAGS_hot_spot_max_add_peer) {
+            break;
+        }
+        int64_t region_load = hot_region.first;
+        int64_t region_id = hot_region.second;
+        auto region_info = RegionManager::get_instance()->get_region_info(region_id);
+        // leader的负载由leader_balance先转走
+        if (region_info == nullptr || region_info->leader() == instance) {
+            continue;
+        }
+        int64_t table_id = region_info->table_id();
+        int64_t replica_num = 0;
+        std::string table_resource_tag;
+        if (TableManager::get_instance()->get_replica_num(table_id, replica_num) < 0
+                || region_info->peers_size() != replica_num
+                || TableManager::get_instance()->get_resource_tag(table_id, table_resource_tag) < 0
+                || table_resource_tag != resource_tag) {
+            continue;
+        }
+        pb::Status status = pb::NORMAL;
+        if (RegionManager::get_instance()->get_region_status(region_id, status) < 0
+                || status != pb::NORMAL) {
+            continue;
+        }
+        std::set<std::string> peers(region_info->peers().begin(), region_info->peers().end());
+        bool replica_dists = TableManager::get_instance()->whether_replica_dists(table_id);
+        std::vector<std::string> candidates;
+        for (auto& candidate : instances) {
+            if (peers.count(candidate) > 0
+                    || ClusterManager::get_instance()->get_instance_status(candidate) != pb::NORMAL) {
+                continue;
+            }
+            // 指定了副本分布的表只在同机房内迁移
+            if (replica_dists && ClusterManager::get_instance()->get_logical_room(candidate) != logical_room) {
+                continue;
+            }
+            candidates.emplace_back(candidate);
+        }
+        std::string new_instance = move_load(instance, candidates, region_load, threshold, false);
+        if (new_instance.empty()) {
+            continue;
+        }
+        pb::AddPeer add_peer;
+        add_peer.set_region_id(region_id);
+        for (auto& peer : region_info->peers()) {
+            add_peer.add_old_peers(peer);
+            add_peer.add_new_peers(peer);
+        }
+        add_peer.add_new_peers(new_instance);
+        add_peer_requests.emplace_back(region_info->leader(), add_peer);
+        excess -= region_load;
+        DB_WARNING("hot spot add peer, region_id: %ld, load: %ld, %s -> %s",
+                   region_id, region_load, instance.c_str(), new_instance.c_str());
+    }
+    if (add_peer_requests.empty()) {
+        return;
+    }
+    Bthread bth(&BTHREAD_ATTR_SMALL);
+    auto add_peer_fun = [add_peer_requests, instance]() {
+        for (auto& request : add_peer_requests) {
+            StoreInteract store_interact(request.first.c_str());
+            pb::StoreRes response;
+            auto ret = store_interact.send_request("add_peer", request.second, response);
+            DB_WARNING("instance: %s hot spot peer balance, send add peer leader: %s, "
+                       "request:%s, response:%s, ret: %d",
+                       instance.c_str(),
+                       request.first.c_str(),
+                       request.second.ShortDebugString().c_str(),
+                       response.ShortDebugString().c_str(), ret);
+            if (ret == 0) {
+                RegionManager::get_instance()->add_remove_peer_on_hot_spot(
+                        request.second.region_id(), instance);
+            }
+        }
+    };
+    bth.run(add_peer_fun);
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
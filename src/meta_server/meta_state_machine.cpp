@@ -35,6 +35,7 @@
 #include "query_table_manager.h"
 #include "query_region_manager.h"
 #include "ddl_manager.h"
+#include "hot_spot_scheduler.h"
 #include "sst_file_writer.h"
 
 namespace baikaldb {
@@ -68,6 +69,7 @@ void MetaStateMachine::store_heartbeat(google::protobuf::RpcController* controll
     DB_WARNING("Huzx=> receive heartbeat request:%s", request->DebugString().c_str());
     ClusterManager::get_instance()->process_instance_heartbeat_for_store(request->instance_info());
     ClusterManager::get_instance()->process_instance_param_heartbeat_for_store(request, response);
+    HotSpotScheduler::get_instance()->update_instance_load(request);
     int64_t instance_time = step_time_cost.get_time();
     step_time_cost.reset();
 
@@ -21,6 +21,7 @@
 #include "meta_util.h"
 #include "table_manager.h"
 #include "meta_rocksdb.h"
+#include "hot_spot_scheduler.h"
 
 namespace baikaldb {
 DECLARE_int32(concurrency_num);
@@ -1016,6 +1017,11 @@ void RegionManager::leader_load_balance(bool whether_can_decide,
     }
     DB_WARNING("leader load balance, resource_tag: %s, instance: %s", 
                 resource_tag.c_str(), instance.c_str());
+    // 按负载迁走热点store的leader, 本轮不再按个数均衡, 避免两者相互抵消
+    if (instance_status == pb::NORMAL
+            && HotSpotScheduler::get_instance()->leader_balance(request, trans_leader_region_ids, response) > 0) {
+        return;
+    }
     std::unordered_map<int64_t, std::set<int64_t>> table_region_ids;
     get_region_ids(instance, table_region_ids);
     //记录以表的维度出发，每个表应该transfer leader的数量
@@ -1136,6 +1142,11 @@ void RegionManager::leader_load_balance(bool whether_can_decide,
             if (!main_logical_room.empty() && logical_room != main_logical_room) {
                 continue;
             }
+            // 不往负载高于平均的store转leader
+            if (instance_status == pb::NORMAL
+                    && HotSpotScheduler::get_instance()->above_average_leader_load(peer)) {
+                continue;
+            }
             int64_t peer_leader_count_on_table = get_leader_count(peer, table_id);
             // 选leader少的peer
             if (peer_leader_count_on_table < leader_count_for_transfer_peer) {
@@ -2204,9 +2215,19 @@ void RegionManager::check_peer_count(int64_t region_id,
                     }
                 } 
             }
+            // 热点调度发起的迁移, 删除热点store上的peer
+            std::string hot_spot_instance;
+            if (need_remove_peer_on_hot_spot(region_id, hot_spot_instance)
+                    && candicate_remove_peers.count(hot_spot_instance) > 0) {
+                remove_peer = hot_spot_instance;
+                clear_remove_peer_on_pk_prefix(region_id);
+                DB_WARNING("remove peer on hot spot instance: %s, region_id: %ld",
+                           hot_spot_instance.c_str(), region_id);
+            }
             // 如果表开启了pk_prefix balance，判断是否是pk_prefix发起的迁移，有就从pk_prefix维度remove peer数最多的，否则走table的维度
             std::string pk_prefix_logical_room;
-            if (table_pk_prefix_dimension > 0 && need_remove_peer_on_pk_prefix(region_id, pk_prefix_logical_room)) {
+            if (remove_peer.empty() && table_pk_prefix_dimension > 0
+                    && need_remove_peer_on_pk_prefix(region_id, pk_prefix_logical_room)) {
                 bool get_pk_prefix_success = TableManager::get_instance()->get_pk_prefix_key(table_id,
                                              table_pk_prefix_dimension,
                                              leader_region_info.start_key(),
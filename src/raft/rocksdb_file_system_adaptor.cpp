@@ -13,6 +13,11 @@
 // limitations under the License.
 
 #include "rocksdb_file_system_adaptor.h"
+#ifdef BAIDU_INTERNAL
+#include <base/files/file_enumerator.h>
+#else
+#include <butil/files/file_enumerator.h>
+#endif
 #include "mut_table_key.h"
 #include "sst_file_writer.h"
 #include "meta_writer.h"
@@ -20,7 +25,24 @@
 #include "log_entry_reader.h"
 
 namespace baikaldb {
+DEFINE_bool(snapshot_ship_sst, false, "install snapshot by sending sst files built on leader, "
+        "enable after all stores are upgraded");
+DEFINE_int32(snapshot_sst_build_concurrency, 4, "concurrency of building snapshot sst files per region");
+// 小于braft拷贝快照rpc的超时, 超时后返回失败由braft重试
+DEFINE_int32(snapshot_sst_read_wait_ms, 3000, "max wait ms for snapshot sst files to be built in one read");
+DECLARE_string(db_path);
 
+const std::string SNAPSHOT_SST_FILE_PREFIX = "region_snapshot_sst.";
+
+static std::atomic<int64_t> g_snapshot_sst_build_id {0};
+
+bool inline is_snapshot_sst_files(const std::string& path) {
+    butil::StringPiece sp(path);
+    if (sp.ends_with(SNAPSHOT_SST_FILES_WITH_SLASH)) {
+        return true;
+    }
+    return false;
+}
 bool inline is_snapshot_data_file(const std::string& path) {
     butil::StringPiece sp(path);
     if (sp.ends_with(SNAPSHOT_DATA_FILE_WITH_SLASH)) {
@@ -472,6 +494,338 @@ ssize_t SstWriterAdaptor::read(butil::IOPortal* portal, off_t offset, size_t siz
     return -1;
 }
 
+SstFilesContext::~SstFilesContext() {
+    for (auto& partition : partitions) {
+        for (auto& file : partition.files) {
+            butil::DeleteFile(butil::FilePath(file.path), false);
+        }
+    }
+}
+
+void SstFilesContext::publish() {
+    while (next_partition < partitions.size()) {
+        auto& partition = partitions[next_partition];
+        for (; next_file < partition.files.size(); ++next_file) {
+            SstFile file = partition.files[next_file];
+            file.offset = total_size;
+            total_size += sizeof(uint64_t) + file.size;
+            files.push_back(file);
+        }
+        if (!partition.done) {
+            return;
+        }
+        ++next_partition;
+        next_file = 0;
+    }
+    done = true;
+}
+
+SstFilesStreamReader::~SstFilesStreamReader() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+ssize_t SstFilesStreamReader::read(const std::vector<SstFilesContext::SstFile>& files,
+                                   butil::IOPortal* portal, int64_t offset, size_t size) {
+    int64_t pos = offset;
+    size_t count = 0;
+    size_t idx = 0;
+    while (idx < files.size() && files[idx].offset + (int64_t)sizeof(uint64_t) + files[idx].size <= pos) {
+        ++idx;
+    }
+    for (; idx < files.size() && count < size; ++idx) {
+        auto& file = files[idx];
+        int64_t file_end = file.offset + sizeof(uint64_t) + file.size;
+        while (pos < file_end && count < size) {
+            int64_t rel = pos - file.offset;
+            size_t n = 0;
+            if (rel < (int64_t)sizeof(uint64_t)) {
+                uint64_t file_size = file.size;
+                n = std::min(sizeof(uint64_t) - rel, size - count);
+                portal->append((char*)&file_size + rel, n);
+            } else {
+                int64_t file_offset = rel - sizeof(uint64_t);
+                n = std::min((size_t)(file.size - file_offset), size - count);
+                if (_fd_file_idx != (int64_t)idx) {
+                    if (_fd >= 0) {
+                        ::close(_fd);
+                    }
+                    _fd = ::open(file.path.c_str(), O_RDONLY);
+                    if (_fd < 0) {
+                        DB_FATAL("open sst file: %s fail", file.path.c_str());
+                        _fd_file_idx = -1;
+                        return -1;
+                    }
+                    _fd_file_idx = idx;
+                }
+                ssize_t nread = braft::file_pread(portal, _fd, file_offset, n);
+                if (nread != (ssize_t)n) {
+                    DB_FATAL("read sst file: %s fail, file_offset: %ld, size: %lu, nread: %ld",
+                            file.path.c_str(), file_offset, n, nread);
+                    return -1;
+                }
+            }
+            pos += n;
+            count += n;
+        }
+    }
+    return count;
+}
+
+int SstFilesStreamWriter::write(const butil::IOBuf& data) {
+    butil::IOBuf buf = data;
+    while (!buf.empty()) {
+        if (_fd < 0) {
+            // 长度头可能跨包
+            _header_len += buf.cutn(_header + _header_len, sizeof(uint64_t) - _header_len);
+            if (_header_len < sizeof(uint64_t)) {
+                break;
+            }
+            _header_len = 0;
+            uint64_t file_size = 0;
+            memcpy(&file_size, _header, sizeof(uint64_t));
+            std::string path = _path + std::to_string(_sst_idx);
+            _fd = ::open(path.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0644);
+            if (_fd < 0) {
+                DB_FATAL("open sst file path: %s failed, region_id: %ld", path.c_str(), _region_id);
+                return -1;
+            }
+            _file_offset = 0;
+            _file_remain = file_size;
+        }
+        if (_file_remain > 0) {
+            butil::IOBuf piece;
+            buf.cutn(&piece, std::min((size_t)_file_remain, buf.size()));
+            ssize_t nwrite = braft::file_pwrite(piece, _fd, _file_offset);
+            if (nwrite != (ssize_t)piece.size()) {
+                DB_FATAL("write sst file path: %s%d failed, region_id: %ld",
+                        _path.c_str(), _sst_idx, _region_id);
+                return -1;
+            }
+            _file_offset += nwrite;
+            _file_remain -= nwrite;
+        }
+        if (_file_remain == 0 && finish_file() != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int SstFilesStreamWriter::finish_file() {
+    if (braft::raft_fsync(_fd) != 0) {
+        DB_FATAL("sync sst file path: %s%d failed, region_id: %ld",
+                _path.c_str(), _sst_idx, _region_id);
+        return -1;
+    }
+    ::close(_fd);
+    _fd = -1;
+    DB_WARNING("receive sst file done, path: %s%d, file_size: %ld, region_id: %ld",
+            _path.c_str(), _sst_idx, _file_offset, _region_id);
+    ++_sst_idx;
+    return 0;
+}
+
+bool SstFilesStreamWriter::close() {
+    if (_fd < 0 && _header_len == 0) {
+        return true;
+    }
+    DB_FATAL("sst files incomplete, path: %s%d, file_remain: %ld, region_id: %ld",
+            _path.c_str(), _sst_idx, _file_remain, _region_id);
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+        butil::DeleteFile(butil::FilePath(_path + std::to_string(_sst_idx)), false);
+    }
+    _header_len = 0;
+    return false;
+}
+
+SstFilesReaderAdaptor::SstFilesReaderAdaptor(int64_t region_id,
+                                            const std::string& path,
+                                            RocksdbFileSystemAdaptor* rs,
+                                            SstFilesContextPtr context) :
+            _region_id(region_id),
+            _path(path),
+            _rs(rs),
+            _context(context) {
+                _region_ptr = Store::get_instance()->get_region(_region_id);
+            }
+
+SstFilesReaderAdaptor::~SstFilesReaderAdaptor() {
+    close();
+}
+
+bool SstFilesReaderAdaptor::region_shutdown() {
+    return _region_ptr == nullptr || _region_ptr->is_shutdown();
+}
+
+int SstFilesReaderAdaptor::wait_readable(int64_t end) {
+    TimeCost cost;
+    int64_t wait_us = FLAGS_snapshot_sst_read_wait_ms * 1000LL;
+    std::unique_lock<bthread::Mutex> lock(_context->mutex);
+    while (!_context->done && !_context->failed && _context->total_size < end) {
+        if (region_shutdown()) {
+            return -1;
+        }
+        // 单个文件生成可能比braft拷贝rpc的超时还长, 不能一直等
+        int64_t left_us = wait_us - cost.get_time();
+        if (left_us <= 0) {
+            DB_WARNING("region_id: %ld wait sst files timeout, end: %ld, total_size: %ld",
+                    _region_id, end, _context->total_size);
+            return -1;
+        }
+        _context->cv.wait_for(lock, std::min(left_us, (int64_t)1000 * 1000));
+    }
+    if (_context->failed) {
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t SstFilesReaderAdaptor::read(butil::IOPortal* portal, off_t offset, size_t size) {
+    if (_closed) {
+        DB_FATAL("sst files reader has been closed, region_id: %ld, offset: %ld",
+                    _region_id, offset);
+        return -1;
+    }
+    if (offset < 0) {
+        DB_FATAL("region_id: %ld read error. offset: %ld", _region_id, offset);
+        return -1;
+    }
+    if (region_shutdown()) {
+        DB_FATAL("region_id: %ld shutdown, off:%lu, size:%lu", _region_id, offset, size);
+        return -1;
+    }
+    TimeCost time_cost;
+    // 文件按生成顺序可读, 等待本次要读的范围生成完
+    if (wait_readable(offset + size) != 0) {
+        DB_FATAL("region_id: %ld sst files not readable, off:%lu, size:%lu", _region_id, offset, size);
+        return -1;
+    }
+    std::vector<SstFilesContext::SstFile> files;
+    {
+        BAIDU_SCOPED_LOCK(_context->mutex);
+        files = _context->files;
+    }
+    // 大region addpeer中重置time_cost，防止version=0超时删除
+    _region_ptr->reset_timecost();
+    ssize_t count = _stream.read(files, portal, offset, size);
+    if (count < 0) {
+        DB_FATAL("region_id: %ld read sst files fail, off:%lu, size:%lu", _region_id, offset, size);
+        return -1;
+    }
+    _context->read_offset = offset + count;
+    DB_WARNING("region_id: %ld read sst files done. count: %lu, time_cost: %ld, off:%lu, size:%lu",
+                _region_id, count, time_cost.get_time(), offset, size);
+    return count;
+}
+
+ssize_t SstFilesReaderAdaptor::size() {
+    BAIDU_SCOPED_LOCK(_context->mutex);
+    if (_context->done) {
+        return _context->total_size;
+    }
+    return std::numeric_limits<ssize_t>::max();
+}
+
+bool SstFilesReaderAdaptor::close() {
+    if (_closed) {
+        return true;
+    }
+    _rs->close(_path);
+    _closed = true;
+    return true;
+}
+
+ssize_t SstFilesReaderAdaptor::write(const butil::IOBuf& data, off_t offset) {
+    DB_FATAL("SstFilesReaderAdaptor::write not implemented");
+    return -1;
+}
+
+bool SstFilesReaderAdaptor::sync() {
+    return true;
+}
+
+SstFilesWriterAdaptor::SstFilesWriterAdaptor(int64_t region_id, const std::string& path)
+        : _region_id(region_id)
+        , _path(path)
+        , _stream(region_id, path) {}
+
+SstFilesWriterAdaptor::~SstFilesWriterAdaptor() {
+    close();
+}
+
+bool SstFilesWriterAdaptor::region_shutdown() {
+    return _region_ptr == nullptr || _region_ptr->is_shutdown();
+}
+
+int SstFilesWriterAdaptor::open() {
+    _region_ptr = Store::get_instance()->get_region(_region_id);
+    if (_region_ptr == nullptr) {
+        DB_FATAL("open sst files path: %s failed, region_id: %ld not exist",
+                _path.c_str(), _region_id);
+        return -1;
+    }
+    _closed = false;
+    DB_WARNING("sst files writer open, path: %s, region_id: %ld", _path.c_str(), _region_id);
+    return 0;
+}
+
+ssize_t SstFilesWriterAdaptor::write(const butil::IOBuf& data, off_t offset) {
+    if (region_shutdown()) {
+        DB_FATAL("write sst files path: %s failed, region shutdown, region_id: %ld",
+                _path.c_str(), _region_id);
+        return -1;
+    }
+    if (_closed) {
+        DB_FATAL("write sst files path: %s failed, file closed, region_id: %ld",
+                _path.c_str(), _region_id);
+        return -1;
+    }
+    if (offset != _data_size) {
+        DB_FATAL("write sst files path: %s failed, offset: %ld, expect: %ld, region_id: %ld",
+                _path.c_str(), offset, _data_size, _region_id);
+        return -1;
+    }
+    if (_stream.write(data) != 0) {
+        return -1;
+    }
+    // 大region addpeer中重置time_cost，防止version=0超时删除
+    _region_ptr->reset_timecost();
+    _data_size += data.size();
+    return data.size();
+}
+
+bool SstFilesWriterAdaptor::close() {
+    if (_closed) {
+        return true;
+    }
+    _closed = true;
+    bool ret = _stream.close();
+    _region_ptr->set_snapshot_data_size(_data_size);
+    DB_WARNING("sst files writer close, path: %s, file_num: %d, all_size: %ld, region_id: %ld",
+            _path.c_str(), _stream.file_num(), _data_size, _region_id);
+    return ret;
+}
+
+ssize_t SstFilesWriterAdaptor::read(butil::IOPortal* portal, off_t offset, size_t size) {
+    DB_FATAL("SstFilesWriterAdaptor::read not implemented, region_id: %ld", _region_id);
+    return -1;
+}
+
+ssize_t SstFilesWriterAdaptor::size() {
+    DB_FATAL("SstFilesWriterAdaptor::size not implemented, region_id: %ld", _region_id);
+    return -1;
+}
+
+bool SstFilesWriterAdaptor::sync() {
+    //每个文件写完时已经sync
+    return true;
+}
+
 PosixFileAdaptor::~PosixFileAdaptor() {
     close();
 }
@@ -523,7 +877,8 @@ RocksdbFileSystemAdaptor::~RocksdbFileSystemAdaptor() {
 braft::FileAdaptor* RocksdbFileSystemAdaptor::open(const std::string& path, int oflag,
                                      const ::google::protobuf::Message* file_meta,
                                      butil::File::Error* e) {
-    if (!is_snapshot_data_file(path) && !is_snapshot_meta_file(path)) {
+    if (!is_snapshot_data_file(path) && !is_snapshot_meta_file(path)
+            && !is_snapshot_sst_files(path)) {
         PosixFileAdaptor* adaptor = new PosixFileAdaptor(path);
         int ret = adaptor->open(oflag);
         if (ret != 0) {
@@ -549,6 +904,21 @@ braft::FileAdaptor* RocksdbFileSystemAdaptor::open_writer_adaptor(const std::str
                                      butil::File::Error* e) {
     (void) file_meta;
 
+    if (is_snapshot_sst_files(path)) {
+        std::string data_path = path.substr(0, path.size() - SNAPSHOT_SST_FILES_WITH_SLASH.size())
+                                + SNAPSHOT_DATA_FILE_WITH_SLASH;
+        SstFilesWriterAdaptor* writer = new SstFilesWriterAdaptor(_region_id, data_path);
+        if (writer->open() != 0) {
+            if (e) {
+                *e = butil::File::FILE_ERROR_FAILED;
+            }
+            delete writer;
+            return nullptr;
+        }
+        DB_WARNING("open for write sst files, path: %s, region_id: %ld", path.c_str(), _region_id);
+        return writer;
+    }
+
     RocksWrapper* db = RocksWrapper::get_instance();
     rocksdb::Options options;
     if (is_snapshot_data_file(path)) {
@@ -577,6 +947,9 @@ braft::FileAdaptor* RocksdbFileSystemAdaptor::open_reader_adaptor(const std::str
                                      butil::File::Error* e) {
     TimeCost time_cost;
     (void) file_meta;
+    if (is_snapshot_sst_files(path)) {
+        return open_sst_files_reader_adaptor(path, e);
+    }
     std::string prefix;
     std::string upper_bound;
     size_t len = path.size();
@@ -625,28 +998,10 @@ braft::FileAdaptor* RocksdbFileSystemAdaptor::open_reader_adaptor(const std::str
             rocksdb::ColumnFamilyHandle* column_family = RocksWrapper::get_instance()->get_data_handle();
             iter_context->iter.reset(RocksWrapper::get_instance()->new_iterator(read_options, column_family));
             iter_context->iter->Seek(prefix);
-            braft::NodeStatus status;
-
-            auto region = Store::get_instance()->get_region(_region_id);
-            region->get_node_status(&status);
-            int64_t peer_next_index = 0;
-            // 通过peer状态和data_index判断是否需要复制数据
-            // addpeer在unstable里，peer_next_index=0就会走复制流程
-            for (auto iter : status.stable_followers) {
-                auto& peer = iter.second;
-                DB_WARNING("region_id: %ld %s %d %ld", _region_id, iter.first.to_string().c_str(),
-                peer.installing_snapshot, peer.next_index);
-                if (peer.installing_snapshot) {
-                    peer_next_index = peer.next_index;
-                    break;
-                }
-            }
-            if (sc->data_index < peer_next_index) {
-                iter_context->need_copy_data = false;
-            }
+            iter_context->need_copy_data = need_copy_data(sc->data_index);
             sc->data_context = iter_context;
-            DB_WARNING("region_id: %ld open reader, data_index:%ld,peer_next_index:%ld, path: %s, time_cost: %ld", 
-                    _region_id, sc->data_index, peer_next_index, path.c_str(), time_cost.get_time());
+            DB_WARNING("region_id: %ld open reader, data_index:%ld, need_copy_data:%d, path: %s, time_cost: %ld", 
+                    _region_id, sc->data_index, iter_context->need_copy_data, path.c_str(), time_cost.get_time());
         }
     }
     int64_t applied_index = 0;
@@ -689,6 +1044,255 @@ braft::FileAdaptor* RocksdbFileSystemAdaptor::open_reader_adaptor(const std::str
     return reader;
 }
 
+bool RocksdbFileSystemAdaptor::need_copy_data(int64_t data_index) {
+    braft::NodeStatus status;
+    auto region = Store::get_instance()->get_region(_region_id);
+    region->get_node_status(&status);
+    int64_t peer_next_index = 0;
+    // 通过peer状态和data_index判断是否需要复制数据
+    // addpeer在unstable里，peer_next_index=0就会走复制流程
+    for (auto iter : status.stable_followers) {
+        auto& peer = iter.second;
+        DB_WARNING("region_id: %ld %s %d %ld", _region_id, iter.first.to_string().c_str(),
+        peer.installing_snapshot, peer.next_index);
+        if (peer.installing_snapshot) {
+            peer_next_index = peer.next_index;
+            break;
+        }
+    }
+    DB_WARNING("region_id: %ld data_index:%ld, peer_next_index:%ld",
+            _region_id, data_index, peer_next_index);
+    return data_index >= peer_next_index;
+}
+
+// 调用方持有context->mutex
+// 全部生成完时先设置快照大小再置done, 读到流结尾时check_follower_snapshot已能拿到大小
+static void publish_sst_files(SstFilesContext* context, int64_t region_id) {
+    context->publish();
+    if (context->done) {
+        auto region = Store::get_instance()->get_region(region_id);
+        if (region != nullptr) {
+            region->set_snapshot_data_size(context->total_size);
+        }
+    }
+}
+
+// 分区间可以并发生成sst
+int init_sst_partitions(const rocksdb::Snapshot* snapshot, int64_t region_id,
+                        SstFilesContext* context) {
+    MutTableKey region_upper_key;
+    region_upper_key.append_i64(region_id).append_u64(UINT64_MAX);
+    std::string region_upper = region_upper_key.data();
+    rocksdb::Slice upper_bound_slice = region_upper;
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    read_options.total_order_seek = true;
+    read_options.fill_cache = false;
+    read_options.iterate_upper_bound = &upper_bound_slice;
+    RocksWrapper* db = RocksWrapper::get_instance();
+    std::unique_ptr<rocksdb::Iterator> iter(db->new_iterator(read_options, db->get_data_handle()));
+    MutTableKey region_prefix;
+    region_prefix.append_i64(region_id);
+    std::string lower_bound = region_prefix.data();
+    for (iter->Seek(lower_bound); iter->Valid(); iter->Seek(lower_bound)) {
+        SstFilesContext::Partition partition;
+        partition.lower_bound = lower_bound;
+        partition.upper_bound = region_upper;
+        if (iter->key().size() >= 2 * sizeof(int64_t)) {
+            int64_t index_id = TableKey(iter->key()).extract_i64(sizeof(int64_t));
+            if (index_id != INT64_MAX) {
+                MutTableKey upper_key;
+                upper_key.append_i64(region_id).append_i64(index_id + 1);
+                partition.upper_bound = upper_key.data();
+            }
+        }
+        context->partitions.push_back(partition);
+        if (partition.upper_bound == region_upper) {
+            break;
+        }
+        lower_bound = partition.upper_bound;
+    }
+    if (!iter->status().ok()) {
+        DB_FATAL("region_id: %ld init sst partitions fail, err: %s",
+                region_id, iter->status().ToString().c_str());
+        return -1;
+    }
+    return 0;
+}
+
+// 每个文件不超过SST_FILE_LENGTH, 生成完一个即可发送
+void build_sst_files(SnapshotContextPtr sc, SstFilesContextPtr context, size_t partition_idx,
+                     int64_t region_id, int64_t build_id) {
+    TimeCost cost;
+    const auto& partition = context->partitions[partition_idx];
+    rocksdb::Slice upper_bound_slice = partition.upper_bound;
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = sc->snapshot;
+    read_options.total_order_seek = true;
+    read_options.fill_cache = false;
+    read_options.iterate_upper_bound = &upper_bound_slice;
+    RocksWrapper* db = RocksWrapper::get_instance();
+    std::unique_ptr<rocksdb::Iterator> iter(db->new_iterator(read_options, db->get_data_handle()));
+    SstFileWriter writer(db->get_options(db->get_data_handle()));
+    std::string path;
+    int file_idx = 0;
+    bool opened = false;
+    int64_t count = 0;
+    ScopeGuard fail_guard([&]() {
+        if (opened) {
+            butil::DeleteFile(butil::FilePath(path), false);
+        }
+        BAIDU_SCOPED_LOCK(context->mutex);
+        context->failed = true;
+        context->cv.notify_all();
+    });
+    auto finish_file = [&]() -> bool {
+        rocksdb::ExternalSstFileInfo file_info;
+        auto s = writer.finish(&file_info);
+        if (!s.ok()) {
+            DB_FATAL("finish sst file path: %s failed, err: %s, region_id: %ld",
+                    path.c_str(), s.ToString().c_str(), region_id);
+            return false;
+        }
+        opened = false;
+        SstFilesContext::SstFile file;
+        file.path = path;
+        file.size = file_info.file_size;
+        BAIDU_SCOPED_LOCK(context->mutex);
+        context->partitions[partition_idx].files.push_back(file);
+        publish_sst_files(context.get(), region_id);
+        context->cv.notify_all();
+        return true;
+    };
+    for (iter->Seek(partition.lower_bound); iter->Valid(); iter->Next()) {
+        if (++count % 1000 == 0 && context->cancel) {
+            DB_WARNING("region_id: %ld build sst files canceled", region_id);
+            return;
+        }
+        if (!opened) {
+            path = FLAGS_db_path + "/" + SNAPSHOT_SST_FILE_PREFIX + std::to_string(region_id) + "."
+                + std::to_string(build_id) + "." + std::to_string(partition_idx) + "."
+                + std::to_string(file_idx++);
+            auto s = writer.open(path);
+            if (!s.ok()) {
+                DB_FATAL("open sst file path: %s failed, err: %s, region_id: %ld",
+                        path.c_str(), s.ToString().c_str(), region_id);
+                return;
+            }
+            opened = true;
+        }
+        auto s = writer.put(iter->key(), iter->value());
+        if (!s.ok()) {
+            DB_FATAL("write sst file path: %s failed, err: %s, region_id: %ld",
+                    path.c_str(), s.ToString().c_str(), region_id);
+            return;
+        }
+        if (writer.file_size() >= SST_FILE_LENGTH && !finish_file()) {
+            return;
+        }
+    }
+    if (!iter->status().ok()) {
+        DB_FATAL("region_id: %ld iterate fail when build sst files, err: %s",
+                region_id, iter->status().ToString().c_str());
+        return;
+    }
+    if (opened && !finish_file()) {
+        return;
+    }
+    fail_guard.release();
+    BAIDU_SCOPED_LOCK(context->mutex);
+    context->partitions[partition_idx].done = true;
+    publish_sst_files(context.get(), region_id);
+    context->cv.notify_all();
+    DB_WARNING("region_id: %ld build sst files for partition: %lu, lines: %ld, file_num: %d, time_cost: %ld",
+            region_id, partition_idx, count, file_idx, cost.get_time());
+}
+
+void clear_snapshot_sst_files() {
+    butil::FileEnumerator sst_files(butil::FilePath(FLAGS_db_path), false,
+            butil::FileEnumerator::FILES, SNAPSHOT_SST_FILE_PREFIX + "*");
+    int count = 0;
+    for (butil::FilePath file = sst_files.Next(); !file.empty(); file = sst_files.Next()) {
+        butil::DeleteFile(file, false);
+        ++count;
+    }
+    DB_WARNING("clear snapshot sst files, db_path: %s, count: %d", FLAGS_db_path.c_str(), count);
+}
+
+braft::FileAdaptor* RocksdbFileSystemAdaptor::open_sst_files_reader_adaptor(const std::string& path,
+                                     butil::File::Error* e) {
+    TimeCost time_cost;
+    const std::string snapshot_path = path.substr(0, path.size() - SNAPSHOT_SST_FILES_WITH_SLASH.size());
+    BAIDU_SCOPED_LOCK(_open_reader_adaptor_mutex);
+    auto sc = get_snapshot(snapshot_path);
+    if (sc == nullptr) {
+        DB_FATAL("snapshot no found, path: %s, region_id: %ld", snapshot_path.c_str(), _region_id);
+        if (e != nullptr) {
+            *e = butil::File::FILE_ERROR_NOT_FOUND;
+        }
+        return nullptr;
+    }
+    SstFilesContextPtr context = sc->sst_files_context;
+    //first open snapshot file, 后台开始生成sst文件
+    if (context == nullptr) {
+        context.reset(new SstFilesContext);
+        context->need_copy_data = need_copy_data(sc->data_index);
+        if (context->need_copy_data
+                && init_sst_partitions(sc->snapshot, _region_id, context.get()) != 0) {
+            if (e != nullptr) {
+                *e = butil::File::FILE_ERROR_FAILED;
+            }
+            return nullptr;
+        }
+        sc->sst_files_context = context;
+        int64_t region_id = _region_id;
+        if (context->partitions.empty()) {
+            BAIDU_SCOPED_LOCK(context->mutex);
+            publish_sst_files(context.get(), region_id);
+        } else {
+            int64_t build_id = g_snapshot_sst_build_id.fetch_add(1);
+            Bthread bth;
+            bth.run([sc, context, region_id, build_id]() {
+                TimeCost cost;
+                ConcurrencyBthread build_bth(FLAGS_snapshot_sst_build_concurrency);
+                for (size_t i = 0; i < context->partitions.size(); ++i) {
+                    build_bth.run([sc, context, i, region_id, build_id]() {
+                        build_sst_files(sc, context, i, region_id, build_id);
+                    });
+                }
+                build_bth.join();
+                int64_t total_size = 0;
+                {
+                    BAIDU_SCOPED_LOCK(context->mutex);
+                    total_size = context->total_size;
+                }
+                DB_WARNING("region_id: %ld build sst files over, partition_num: %lu, "
+                        "total_size: %ld, failed: %d, time_cost: %ld", region_id,
+                        context->partitions.size(), total_size, context->failed, cost.get_time());
+            });
+        }
+        DB_WARNING("region_id: %ld open sst files reader, data_index:%ld, need_copy_data:%d, "
+                "partition_num: %lu, path: %s, time_cost: %ld", _region_id, sc->data_index,
+                context->need_copy_data, context->partitions.size(), path.c_str(), time_cost.get_time());
+    }
+    {
+        BAIDU_SCOPED_LOCK(context->mutex);
+        if (context->reading) {
+            DB_WARNING("snapshot reader is busy, path: %s, region_id: %ld", path.c_str(), _region_id);
+            if (e != nullptr) {
+                *e = butil::File::FILE_ERROR_IN_USE;
+            }
+            return nullptr;
+        }
+        context->reading = true;
+    }
+    auto reader = new SstFilesReaderAdaptor(_region_id, path, this, context);
+    reader->open();
+    DB_WARNING("region_id: %ld open sst files reader: path: %s, time_cost: %ld",
+                _region_id, path.c_str(), time_cost.get_time());
+    return reader;
+}
+
 bool RocksdbFileSystemAdaptor::delete_file(const std::string& path, bool recursive) {
     butil::FilePath file_path(path);
     return butil::DeleteFile(file_path, recursive);
@@ -734,7 +1338,9 @@ bool RocksdbFileSystemAdaptor::open_snapshot(const std::string& path) {
         if (iter->second.cost.get_time() > 3600 * 1000 * 1000LL
             && iter->second.count == 1
             && (iter->second.ptr->data_context == nullptr
-            || iter->second.ptr->data_context->offset == 0)) {
+            || iter->second.ptr->data_context->offset == 0)
+            && (iter->second.ptr->sst_files_context == nullptr
+            || iter->second.ptr->sst_files_context->read_offset == 0)) {
             _snapshots.erase(iter);
             DB_WARNING("region_id: %ld snapshot path: %s is hang over 1 hour, erase", _region_id, path.c_str());
         } else {
@@ -769,6 +1375,10 @@ void RocksdbFileSystemAdaptor::close_snapshot(const std::string& path) {
     if (iter != _snapshots.end()) {
         _snapshots[path].count--;
         if (_snapshots[path].count == 0) {
+            // 后台生成的线程退出后删除文件
+            if (iter->second.ptr->sst_files_context != nullptr) {
+                iter->second.ptr->sst_files_context->cancel = true;
+            }
             _snapshots.erase(iter);
             _mutil_snapshot_cond.decrease_broadcast();
             DB_WARNING("region_id: %ld close snapshot path: %s relase", _region_id, path.c_str());
@@ -789,6 +1399,8 @@ void RocksdbFileSystemAdaptor::close(const std::string& path) {
     size_t len = path.size();
     if (is_snapshot_data_file(path)) {
         len -= SNAPSHOT_DATA_FILE_WITH_SLASH.size();
+    } else if (is_snapshot_sst_files(path)) {
+        len -= SNAPSHOT_SST_FILES_WITH_SLASH.size();
     } else {
         len -= SNAPSHOT_META_FILE_WITH_SLASH.size();
     }
@@ -805,6 +1417,14 @@ void RocksdbFileSystemAdaptor::close(const std::string& path) {
     if (is_snapshot_data_file(path) && snapshot_ctx.ptr->data_context != nullptr) {
         DB_WARNING("read snapshot data file close, path: %s", path.c_str());
         snapshot_ctx.ptr->data_context.reset();
+    } else if (is_snapshot_sst_files(path)) {
+        auto context = snapshot_ctx.ptr->sst_files_context;
+        if (context != nullptr) {
+            // braft读失败重试会重新打开, 继续读已生成的文件, 快照关闭时才取消生成
+            DB_WARNING("read snapshot sst files close, path: %s", path.c_str());
+            BAIDU_SCOPED_LOCK(context->mutex);
+            context->reading = false;
+        }
     } else if (snapshot_ctx.ptr->meta_context != nullptr) {
         DB_WARNING("read snapshot meta data file close, path: %s", path.c_str());
         snapshot_ctx.ptr->meta_context.reset();
@@ -23,9 +23,22 @@ DEFINE_string(q2b_utf8_path, "./conf/q2b_utf8.dic", "q2b_utf8_path");
 DEFINE_string(q2b_gbk_path, "./conf/q2b_gbk.dic", "q2b_gbk_path");
 DEFINE_string(punctuation_path, "./conf/punctuation.dic", "punctuation_path");
 DEFINE_bool(reverse_print_log, false, "reverse_print_log");
+DEFINE_int64(reverse_cache_max_bytes, 1024 * 1024 * 1024LL,
+        "total bytes of all reverse list/segment caches, 0 means unlimited, default: 1G");
+DEFINE_int64(reverse_cache_min_bytes, 16 * 1024 * 1024LL,
+        "min bytes of each reverse list/segment cache when the total is split, default: 16M");
+DEFINE_int32(reverse_cache_shard_bits, 4, "reverse cache has 2^shard_bits shards, default: 16");
 
 std::atomic_long g_statistic_insert_key_num = {0};
 std::atomic_long g_statistic_delete_key_num = {0};
+
+CacheBudget* reverse_cache_budget() {
+    static CacheBudget budget("reverse_cache", FLAGS_reverse_cache_shard_bits);
+    // 新建索引时刷新, 修改flag后随后续的add生效
+    budget.capacity.store(FLAGS_reverse_cache_max_bytes, std::memory_order_relaxed);
+    budget.min_capacity.store(FLAGS_reverse_cache_min_bytes, std::memory_order_relaxed);
+    return &budget;
+}
 int Tokenizer::init() {
     {
         std::ifstream fp(FLAGS_punctuation_path);
@@ -0,0 +1,153 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "column_batch.h"
+#include "mem_row.h"
+
+namespace baikaldb {
+using google::protobuf::FieldDescriptor;
+using google::protobuf::Descriptor;
+using google::protobuf::Message;
+using google::protobuf::Reflection;
+
+int ColumnBatch::load_column(RowBatch* batch, int32_t tuple_id, int32_t slot_id,
+        pb::PrimitiveType type) {
+    ColumnVector* column = add_column(tuple_id, slot_id, type);
+    size_t num_rows = batch->size();
+    if (_num_rows != num_rows) {
+        set_num_rows(num_rows);
+    }
+    // 复用上一个batch的列时需要重置null标记
+    column->clear();
+    column->resize(num_rows);
+    if (num_rows == 0) {
+        return 0;
+    }
+    Message* first = batch->get_row(0)->get_tuple(tuple_id);
+    if (first == nullptr) {
+        // tuple不存在时整列为null
+        return 0;
+    }
+    const Descriptor* descriptor = first->GetDescriptor();
+    const FieldDescriptor* field = descriptor->field(slot_id - 1);
+    if (field == nullptr) {
+        DB_WARNING("invalid field, tuple_id:%d slot_id:%d", tuple_id, slot_id);
+        return -1;
+    }
+    const Reflection* reflection = first->GetReflection();
+    ColumnVector::PhysicalType pt = column->physical_type();
+    auto cpp_type = field->cpp_type();
+    for (size_t i = 0; i < num_rows; ++i) {
+        Message* tuple = batch->get_row(i)->get_tuple(tuple_id);
+        if (tuple == nullptr || !reflection->HasField(*tuple, field)) {
+            continue;
+        }
+        switch (cpp_type) {
+            case FieldDescriptor::CPPTYPE_INT32: {
+                int32_t v = reflection->GetInt32(*tuple, field);
+                if (pt == ColumnVector::PT_INT64) {
+                    column->int_data()[i] = v;
+                } else if (pt == ColumnVector::PT_UINT64) {
+                    column->uint_data()[i] = v;
+                } else if (pt == ColumnVector::PT_DOUBLE) {
+                    column->double_data()[i] = v;
+                } else {
+                    column->str_data()[i] = std::to_string(v);
+                }
+                break;
+            }
+            case FieldDescriptor::CPPTYPE_INT64: {
+                int64_t v = reflection->GetInt64(*tuple, field);
+                if (pt == ColumnVector::PT_INT64) {
+                    column->int_data()[i] = v;
+                } else if (pt == ColumnVector::PT_UINT64) {
+                    column->uint_data()[i] = v;
+                } else if (pt == ColumnVector::PT_DOUBLE) {
+                    column->double_data()[i] = v;
+                } else {
+                    column->str_data()[i] = std::to_string(v);
+                }
+                break;
+            }
+            case FieldDescriptor::CPPTYPE_UINT32:
+            case FieldDescriptor::CPPTYPE_UINT64:
+            case FieldDescriptor::CPPTYPE_BOOL: {
+                uint64_t v = 0;
+                if (cpp_type == FieldDescriptor::CPPTYPE_UINT32) {
+                    v = reflection->GetUInt32(*tuple, field);
+                } else if (cpp_type == FieldDescriptor::CPPTYPE_UINT64) {
+                    v = reflection->GetUInt64(*tuple, field);
+                } else {
+                    v = reflection->GetBool(*tuple, field);
+                }
+                if (pt == ColumnVector::PT_INT64) {
+                    column->int_data()[i] = v;
+                } else if (pt == ColumnVector::PT_UINT64) {
+                    column->uint_data()[i] = v;
+                } else if (pt == ColumnVector::PT_DOUBLE) {
+                    column->double_data()[i] = v;
+                } else {
+                    column->str_data()[i] = std::to_string(v);
+                }
+                break;
+            }
+            case FieldDescriptor::CPPTYPE_FLOAT:
+            case FieldDescriptor::CPPTYPE_DOUBLE: {
+                double v = cpp_type == FieldDescriptor::CPPTYPE_FLOAT ?
+                    reflection->GetFloat(*tuple, field) : reflection->GetDouble(*tuple, field);
+                if (pt == ColumnVector::PT_DOUBLE) {
+                    column->double_data()[i] = v;
+                } else {
+                    // 类型不一致时走ExprValue转换, 保持与行存一致的语义
+                    column->set_value(i, MessageHelper::get_value(field, tuple).cast_to(type));
+                    continue;
+                }
+                break;
+            }
+            case FieldDescriptor::CPPTYPE_STRING: {
+                if (pt == ColumnVector::PT_STRING) {
+                    column->str_data()[i] = reflection->GetString(*tuple, field);
+                } else {
+                    column->set_value(i, MessageHelper::get_value(field, tuple).cast_to(type));
+                    continue;
+                }
+                break;
+            }
+            default:
+                continue;
+        }
+        column->set_not_null(i);
+    }
+    return 0;
+}
+
+int ColumnBatch::from_row_batch(RowBatch* batch, const std::vector<pb::TupleDescriptor>& tuple_descs) {
+    clear();
+    set_num_rows(batch->size());
+    for (auto& tuple_desc : tuple_descs) {
+        if (!tuple_desc.has_tuple_id()) {
+            continue;
+        }
+        for (auto& slot : tuple_desc.slots()) {
+            int ret = load_column(batch, tuple_desc.tuple_id(), slot.slot_id(), slot.slot_type());
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+    return 0;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
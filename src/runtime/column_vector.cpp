@@ -0,0 +1,142 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "column_vector.h"
+
+namespace baikaldb {
+void ColumnVector::resize(size_t n) {
+    switch (_physical_type) {
+        case PT_INT64:
+            _int_vals.resize(n, 0);
+            break;
+        case PT_UINT64:
+            _uint_vals.resize(n, 0);
+            break;
+        case PT_DOUBLE:
+            _double_vals.resize(n, 0);
+            break;
+        case PT_STRING:
+            _str_vals.resize(n);
+            break;
+    }
+    size_t words = (n + 63) / 64;
+    if (n > _size) {
+        // 新增的行默认为null
+        _null_bitmap.resize(words, ~0ULL);
+        for (size_t i = _size; i < n && (i & 63) != 0; ++i) {
+            set_null(i);
+        }
+    } else {
+        _null_bitmap.resize(words);
+    }
+    _size = n;
+}
+
+void ColumnVector::reserve(size_t n) {
+    switch (_physical_type) {
+        case PT_INT64:
+            _int_vals.reserve(n);
+            break;
+        case PT_UINT64:
+            _uint_vals.reserve(n);
+            break;
+        case PT_DOUBLE:
+            _double_vals.reserve(n);
+            break;
+        case PT_STRING:
+            _str_vals.reserve(n);
+            break;
+    }
+    _null_bitmap.reserve((n + 63) / 64);
+}
+
+void ColumnVector::set_value(size_t idx, const ExprValue& value) {
+    if (value.is_null()) {
+        set_null(idx);
+        return;
+    }
+    switch (_physical_type) {
+        case PT_INT64:
+            _int_vals[idx] = value.get_numberic<int64_t>();
+            break;
+        case PT_UINT64:
+            _uint_vals[idx] = value.get_numberic<uint64_t>();
+            break;
+        case PT_DOUBLE:
+            _double_vals[idx] = value.get_numberic<double>();
+            break;
+        case PT_STRING:
+            _str_vals[idx] = value.get_string();
+            break;
+    }
+    set_not_null(idx);
+}
+
+ExprValue ColumnVector::get_value(size_t idx) const {
+    if (is_null(idx)) {
+        return ExprValue::Null();
+    }
+    if (_physical_type == PT_STRING) {
+        // 与MessageHelper::get_value保持一致, 字符串类统一返回STRING
+        ExprValue value(pb::STRING);
+        value.str_val = _str_vals[idx];
+        return value;
+    }
+    ExprValue value(_type);
+    switch (_type) {
+        case pb::BOOL:
+            value._u.bool_val = _uint_vals[idx];
+            break;
+        case pb::INT8:
+            value._u.int8_val = _int_vals[idx];
+            break;
+        case pb::INT16:
+            value._u.int16_val = _int_vals[idx];
+            break;
+        case pb::INT32:
+        case pb::TIME:
+            value._u.int32_val = _int_vals[idx];
+            break;
+        case pb::INT64:
+            value._u.int64_val = _int_vals[idx];
+            break;
+        case pb::UINT8:
+            value._u.uint8_val = _uint_vals[idx];
+            break;
+        case pb::UINT16:
+            value._u.uint16_val = _uint_vals[idx];
+            break;
+        case pb::UINT32:
+        case pb::DATE:
+        case pb::TIMESTAMP:
+            value._u.uint32_val = _uint_vals[idx];
+            break;
+        case pb::UINT64:
+        case pb::DATETIME:
+            value._u.uint64_val = _uint_vals[idx];
+            break;
+        case pb::FLOAT:
+            value._u.float_val = _double_vals[idx];
+            break;
+        case pb::DOUBLE:
+            value._u.double_val = _double_vals[idx];
+            break;
+        default:
+            return ExprValue::Null();
+    }
+    return value;
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -24,6 +24,31 @@ DECLARE_int32(single_store_concurrency);
 DECLARE_int64(baikaldb_alive_time_s);
 DEFINE_int32(time_length_to_delete_message, 1, "hours length to delete mem_row_descriptor of sql : default one hour");
 DEFINE_bool(limit_unappropriate_sql, false, "limit concurrency as one when select sql is unappropriate");
+DEFINE_bool(mem_row_use_arena, true, "allocate tuples of MemRow from per request arena, default: true");
+DEFINE_int64(mem_row_arena_max_bytes, 16 * 1024 * 1024LL, "fallback to heap when arena of one request exceeds #, default: 16M");
+DEFINE_int64(mem_row_arena_block_size, 8 * 1024LL, "initial block size of mem row arena, default: 8K");
+DEFINE_int64(sort_spill_budget, 1024 * 1024 * 1024LL, "sorted runs spill to disk when sort uses more than # bytes, <=0 means disable, default: 1G");
+DEFINE_int64(store_sort_spill_budget, 128 * 1024 * 1024LL, "sort_spill_budget of requests on store, <=0 means disable, default: 128M");
+
+static google::protobuf::Arena* new_mem_row_arena() {
+    if (!FLAGS_mem_row_use_arena) {
+        return nullptr;
+    }
+    google::protobuf::ArenaOptions options;
+    options.start_block_size = FLAGS_mem_row_arena_block_size;
+    options.max_block_size = std::max(FLAGS_mem_row_arena_block_size, 1024 * 1024LL);
+    return new google::protobuf::Arena(options);
+}
+
+google::protobuf::Arena* RuntimeState::mem_row_arena() {
+    if (_mem_row_arena == nullptr) {
+        return nullptr;
+    }
+    if ((int64_t)_mem_row_arena->SpaceAllocated() > FLAGS_mem_row_arena_max_bytes) {
+        return nullptr;
+    }
+    return _mem_row_arena.get();
+}
 int RuntimeState::init(const pb::StoreReq& req,
         const pb::Plan& plan, 
         const RepeatedPtrField<pb::TupleDescriptor>& tuples,
@@ -38,6 +63,8 @@ int RuntimeState::init(const pb::StoreReq& req,
         _tuple_descs[tuple.tuple_id()] = tuple;
     }
     sign = req.sql_sign();
+    // store上并发请求多, 单个请求排序的内存预算更小
+    _sort_spill_budget = FLAGS_store_sort_spill_budget;
     uint64_t tuple_sign = tuple_descs_to_sign();
 
     //取出缓存的动态编译结果(按照签名)
@@ -64,6 +91,7 @@ int RuntimeState::init(const pb::StoreReq& req,
         }
     }
     clear_mem_row_descriptor(sql_sign_to_mem_row_descriptor);//定期清理过期sql的mem_row_descriptor
+    _mem_row_arena.reset(new_mem_row_arena());
 
     _region_id = req.region_id();
     _region_version = req.region_version();
@@ -158,6 +186,10 @@ int RuntimeState::init(QueryContext* ctx, DataBuffer* send_buf) {
         }
     }
     clear_mem_row_descriptor(sql_sign_to_mem_row_descriptor);//定期清理过期sql的mem_row_descriptor
+    // prepare语句的runtime会被复用, arena无法按请求释放, 不使用arena
+    if (!ctx->is_prepared && !ctx->exec_prepared) {
+        _mem_row_arena.reset(new_mem_row_arena());
+    }
 
     if (ctx->open_binlog) {
         _open_binlog = true;
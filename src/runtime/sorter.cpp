@@ -13,19 +13,34 @@
 // limitations under the License.
 
 #include "sorter.h"
+#include "runtime_state.h"
 
 namespace baikaldb {
 int Sorter::get_next(RowBatch* batch, bool* eos) {
+    if (!_runs.empty()) {
+        return get_next_from_runs(batch, eos);
+    }
+    return get_next_in_memory(batch, eos);
+}
+
+int Sorter::get_next_in_memory(RowBatch* batch, bool* eos) {
     if (_min_heap.size() == 0) {
         *eos = true;
         return 0;
     }
     if (_comp->need_not_compare()) {
-        if (_idx == _min_heap.size() - 1) {
-            *eos = true;
-        }
         batch->swap(*_min_heap[_idx]);
-        ++_idx;
+        // 还有下一页时留在原位, 保证按batch的顺序输出
+        int ret = refill(_min_heap[_idx]);
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret == 0) {
+            if (_idx == _min_heap.size() - 1) {
+                *eos = true;
+            }
+            ++_idx;
+        }
         return 0;
     }
     while (1) {
@@ -38,8 +53,16 @@ int Sorter::get_next(RowBatch* batch, bool* eos) {
         }
         batch->move_row(std::move(_min_heap[0]->get_row()));
         _min_heap[0]->next();
-        //堆顶batch遍历完后，pop出去
+        //堆顶batch遍历完后，有下一页则换成下一页, 否则pop出去
         if (_min_heap[0]->is_traverse_over()) {
+            int ret = refill(_min_heap[0]);
+            if (ret < 0) {
+                return ret;
+            }
+            if (ret > 0) {
+                shiftdown(0);
+                continue;
+            }
             std::iter_swap(_min_heap.begin(), _min_heap.end() - 1);
             _min_heap.pop_back();
             if (!_min_heap.empty()) {
@@ -51,7 +74,176 @@ int Sorter::get_next(RowBatch* batch, bool* eos) {
     }
     return 0;
 }
+int Sorter::spill() {
+    if (_min_heap.empty()) {
+        return 0;
+    }
+    if (_spill_row_desc == nullptr) {
+        DB_WARNING("spill row desc not set");
+        return -1;
+    }
+    TimeCost cost;
+    int64_t spill_bytes = 0;
+    if (_state != nullptr) {
+        for (auto& batch : _min_heap) {
+            spill_bytes += batch->used_bytes_size();
+        }
+    }
+    sort();
+    std::unique_ptr<SpillFile> run(new SpillFile);
+    if (run->open() != 0) {
+        return -1;
+    }
+    bool eos = false;
+    do {
+        RowBatch batch;
+        int ret = get_next_in_memory(&batch, &eos);
+        if (ret < 0) {
+            DB_WARNING("get next in memory fail, ret:%d", ret);
+            return ret;
+        }
+        for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+            if (run->write_row(batch.get_row().get()) != 0) {
+                return -1;
+            }
+        }
+    } while (!eos);
+    if (run->finish_write() != 0) {
+        return -1;
+    }
+    DB_WARNING("spill run:%lu rows:%ld bytes:%ld time:%ld", _runs.size(),
+            run->row_count(), run->byte_size(), cost.get_time());
+    _runs.emplace_back(std::move(run));
+    _min_heap.clear();
+    _idx = 0;
+    if (_state != nullptr) {
+        _state->memory_limit_release(_added_rows, spill_bytes);
+    }
+    return 0;
+}
+
+int Sorter::prepare_merge_runs() {
+    int ret = spill();
+    if (ret < 0) {
+        return ret;
+    }
+    int run_count = _runs.size();
+    _run_rows.clear();
+    _run_rows.resize(run_count);
+    for (int i = 0; i < run_count; ++i) {
+        ret = read_run(i);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    // -1作为哨兵, 比任何run都小
+    _loser_tree.assign(run_count, -1);
+    for (int i = run_count - 1; i >= 0; --i) {
+        adjust_loser_tree(i);
+    }
+    return 0;
+}
+
+int Sorter::read_run(int idx) {
+    bool eof = false;
+    std::unique_ptr<MemRow> row;
+    if (_runs[idx]->read_row(_spill_row_desc, &row, &eof) != 0) {
+        DB_WARNING("read run:%d fail", idx);
+        return -1;
+    }
+    if (eof) {
+        row.reset();
+    }
+    _run_rows[idx] = std::move(row);
+    return 0;
+}
+
+bool Sorter::run_less(int left, int right) {
+    if (left == -1) {
+        return true;
+    }
+    if (right == -1) {
+        return false;
+    }
+    // 读完的run视为无穷大
+    if (_run_rows[left] == nullptr) {
+        return false;
+    }
+    if (_run_rows[right] == nullptr) {
+        return true;
+    }
+    return _comp->less(_run_rows[left].get(), _run_rows[right].get());
+}
+
+void Sorter::adjust_loser_tree(int idx) {
+    int winner = idx;
+    for (int t = (idx + _loser_tree.size()) / 2; t > 0; t /= 2) {
+        if (run_less(_loser_tree[t], winner)) {
+            std::swap(winner, _loser_tree[t]);
+        }
+    }
+    _loser_tree[0] = winner;
+}
+
+int Sorter::get_next_from_runs(RowBatch* batch, bool* eos) {
+    while (1) {
+        if (batch->is_full()) {
+            return 0;
+        }
+        int winner = _loser_tree[0];
+        if (winner < 0 || _run_rows[winner] == nullptr) {
+            *eos = true;
+            return 0;
+        }
+        batch->move_row(std::move(_run_rows[winner]));
+        if (read_run(winner) < 0) {
+            return -1;
+        }
+        adjust_loser_tree(winner);
+    }
+    return 0;
+}
+
+void Sorter::add_top_n_batch(RowBatch& batch) {
+    auto less_func = _comp->get_less_func();
+    _added_rows += batch.size();
+    // 被挤出堆和直接丢弃的行随后释放, 从内存统计中扣除
+    int64_t release_bytes = 0;
+    for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+        std::unique_ptr<MemRow>& row = batch.get_row();
+        if ((int64_t)_top_n_heap.size() < _top_n) {
+            _top_n_heap.emplace_back(std::move(row));
+            std::push_heap(_top_n_heap.begin(), _top_n_heap.end(), less_func);
+        } else if (_comp->less(row.get(), _top_n_heap.front().get())) {
+            std::pop_heap(_top_n_heap.begin(), _top_n_heap.end(), less_func);
+            if (_state != nullptr) {
+                release_bytes += _top_n_heap.back()->used_size();
+            }
+            _top_n_heap.back() = std::move(row);
+            std::push_heap(_top_n_heap.begin(), _top_n_heap.end(), less_func);
+        } else if (_state != nullptr) {
+            release_bytes += row->used_size();
+        }
+    }
+    if (_state != nullptr && release_bytes > 0) {
+        _state->memory_limit_release(_added_rows, release_bytes);
+    }
+}
+
 void Sorter::sort() {
+    if (_top_n > 0) {
+        if (_top_n_heap.empty()) {
+            return;
+        }
+        std::sort_heap(_top_n_heap.begin(), _top_n_heap.end(), _comp->get_less_func());
+        std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+        for (auto& row : _top_n_heap) {
+            batch->move_row(std::move(row));
+        }
+        _top_n_heap.clear();
+        add_batch(batch);
+        return;
+    }
     if (_comp->need_not_compare()) {
         return;
     }
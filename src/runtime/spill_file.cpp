@@ -0,0 +1,104 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "spill_file.h"
+#include <stdlib.h>
+#include <unistd.h>
+#ifdef BAIDU_INTERNAL
+#include <base/file_util.h>
+#else
+#include <butil/file_util.h>
+#endif
+
+namespace baikaldb {
+DEFINE_string(spill_dir, "./spill", "dir of temp files when agg/sort spill to disk");
+DEFINE_int32(spill_file_buffer_size, 1024 * 1024, "io buffer size of spill file, default: 1M");
+
+int SpillFile::open() {
+    butil::File::Error err;
+    if (!butil::CreateDirectoryAndGetError(butil::FilePath(FLAGS_spill_dir), &err)) {
+        DB_WARNING("create spill dir:%s fail, err:%d", FLAGS_spill_dir.c_str(), err);
+        return -1;
+    }
+    std::string path = FLAGS_spill_dir + "/spill_XXXXXX";
+    int fd = mkstemp(&path[0]);
+    if (fd < 0) {
+        DB_WARNING("mkstemp fail, path:%s, errno:%d", path.c_str(), errno);
+        return -1;
+    }
+    unlink(path.c_str());
+    _fp = fdopen(fd, "w+");
+    if (_fp == nullptr) {
+        DB_WARNING("fdopen fail, path:%s, errno:%d", path.c_str(), errno);
+        ::close(fd);
+        return -1;
+    }
+    setvbuf(_fp, nullptr, _IOFBF, FLAGS_spill_file_buffer_size);
+    return 0;
+}
+
+int SpillFile::write_row(MemRow* row) {
+    if (_fp == nullptr) {
+        return -1;
+    }
+    _buf.resize(sizeof(uint32_t));
+    row->serialize(&_buf);
+    uint32_t len = _buf.size() - sizeof(uint32_t);
+    memcpy(&_buf[0], &len, sizeof(len));
+    if (fwrite(_buf.data(), 1, _buf.size(), _fp) != _buf.size()) {
+        DB_WARNING("write spill file fail, errno:%d", errno);
+        return -1;
+    }
+    ++_row_count;
+    _byte_size += _buf.size();
+    return 0;
+}
+
+int SpillFile::finish_write() {
+    if (_fp == nullptr) {
+        return -1;
+    }
+    if (fflush(_fp) != 0 || fseek(_fp, 0, SEEK_SET) != 0) {
+        DB_WARNING("rewind spill file fail, errno:%d", errno);
+        return -1;
+    }
+    return 0;
+}
+
+int SpillFile::read_row(MemRowDescriptor* desc, std::unique_ptr<MemRow>* row, bool* eof) {
+    *eof = false;
+    if (_fp == nullptr) {
+        return -1;
+    }
+    uint32_t len = 0;
+    size_t n = fread(&len, 1, sizeof(len), _fp);
+    if (n == 0 && feof(_fp)) {
+        *eof = true;
+        return 0;
+    }
+    if (n != sizeof(len)) {
+        DB_WARNING("read spill file fail, errno:%d", errno);
+        return -1;
+    }
+    _buf.resize(len);
+    if (len > 0 && fread(&_buf[0], 1, len, _fp) != len) {
+        DB_WARNING("read spill file fail, len:%u errno:%d", len, errno);
+        return -1;
+    }
+    *row = desc->fetch_mem_row();
+    return (*row)->deserialize(_buf.data(), _buf.size());
+}
+}
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
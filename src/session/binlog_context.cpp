@@ -14,13 +14,21 @@
 
 #include "binlog_context.h"
 #include "meta_server_interact.hpp"
+#include "tso_client.h"
 
 namespace baikaldb {
 
 int64_t TsoFetcher::get_tso() {
+    if (FLAGS_tso_client_batch) {
+        return TsoClient::get_instance()->get_tso();
+    }
+    return gen_tso(1);
+}
+
+int64_t TsoFetcher::gen_tso(int64_t count) {
     pb::TsoRequest request;
     request.set_op_type(pb::OP_GEN_TSO);
-    request.set_count(1);
+    request.set_count(count);
     pb::TsoResponse response;
     int retry_time = 0;
     int ret = 0;
@@ -0,0 +1,69 @@
+// Copyright (c) 2020-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "tso_client.h"
+#include "binlog_context.h"
+
+namespace baikaldb {
+DEFINE_bool(tso_client_batch, false, "merge concurrent tso requests into one rpc, "
+        "no timestamp is prefetched or cached, default: false");
+
+bvar::LatencyRecorder TsoClient::tso_rpc_time {"tso_client_rpc_time"};
+bvar::IntRecorder TsoClient::tso_batch_count {"tso_client_batch_count"};
+
+int64_t TsoClient::get_tso() {
+    std::unique_lock<bthread::Mutex> lock(_mutex);
+    if (_pending_batch == nullptr) {
+        _pending_batch = std::make_shared<TsoBatch>();
+    } else if (_pending_batch->count >= tso::max_logical / 16) {
+        // 合并的请求过多, 单独取
+        lock.unlock();
+        return TsoFetcher::gen_tso(1);
+    }
+    SmartTsoBatch batch = _pending_batch;
+    int64_t idx = batch->count++;
+    while (!batch->done) {
+        // 正在进行的rpc在本请求到达前已发出, 等它返回后由本batch的请求发下一次rpc
+        if (!_fetching && _pending_batch == batch) {
+            fetch(lock);
+        } else {
+            _cv.wait(lock);
+        }
+    }
+    if (batch->start < 0) {
+        return batch->start;
+    }
+    return batch->start + idx;
+}
+
+void TsoClient::fetch(std::unique_lock<bthread::Mutex>& lock) {
+    SmartTsoBatch batch = _pending_batch;
+    _pending_batch.reset();
+    _fetching = true;
+    lock.unlock();
+    int64_t begin_us = butil::gettimeofday_us();
+    int64_t start = TsoFetcher::gen_tso(batch->count);
+    if (start >= 0) {
+        tso_rpc_time << butil::gettimeofday_us() - begin_us;
+        tso_batch_count << batch->count;
+    }
+    lock.lock();
+    batch->start = start;
+    batch->done = true;
+    _fetching = false;
+    _cv.notify_all();
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
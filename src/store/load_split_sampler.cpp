@@ -0,0 +1,130 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "load_split_sampler.h"
+#include <algorithm>
+#include <cstdlib>
+
+namespace baikaldb {
+DEFINE_bool(load_split, false, "split hot region by access load");
+DEFINE_int64(load_split_qps_threshold, 3000, "region weighted qps threshold for load split");
+DEFINE_int32(load_split_sustain_times, 3, "load split after region is hot for continuous check cycles");
+DEFINE_int32(load_split_sample_num, 1000, "max sampled keys per region for load split");
+DEFINE_int32(load_split_sample_rate, 10, "sample one key every load_split_sample_rate accesses");
+DEFINE_int32(load_split_write_weight, 4, "load weight of a write compared to a point read");
+DEFINE_int32(load_split_min_ratio, 20, "min load percent of each side after load split");
+
+bool LoadSplitSampler::need_sample() const {
+    if (FLAGS_load_split_sample_rate <= 1) {
+        return true;
+    }
+    return butil::fast_rand_less_than(FLAGS_load_split_sample_rate) == 0;
+}
+
+void LoadSplitSampler::sample(const std::string& key, int64_t weight) {
+    if (key.empty() || FLAGS_load_split_sample_num <= 0) {
+        return;
+    }
+    BAIDU_SCOPED_LOCK(_mutex);
+    ++_sample_count;
+    if (_samples.size() < (size_t)FLAGS_load_split_sample_num) {
+        _samples.push_back({key, weight});
+        return;
+    }
+    uint64_t pos = butil::fast_rand_less_than(_sample_count);
+    if (pos < _samples.size()) {
+        _samples[pos].key = key;
+        _samples[pos].weight = weight;
+    }
+}
+
+bool LoadSplitSampler::check_hot() {
+    int64_t cost = std::max(_last_check.get_time(), (int64_t)1);
+    _last_check.reset();
+    int64_t qps = _load.exchange(0) * 1000000 / cost;
+    if (qps < FLAGS_load_split_qps_threshold) {
+        if (_hot_times > 0) {
+            reset();
+        }
+        return false;
+    }
+    ++_hot_times;
+    return _hot_times >= FLAGS_load_split_sustain_times;
+}
+
+int LoadSplitSampler::get_split_key(const std::string& start_key, const std::string& end_key,
+                                    std::string& split_key) {
+    std::vector<Sample> samples;
+    {
+        BAIDU_SCOPED_LOCK(_mutex);
+        samples = _samples;
+    }
+    // 采样太少时分布不可信
+    size_t min_samples = std::max(FLAGS_load_split_sample_num / 10, 10);
+    int64_t total = 0;
+    std::vector<Sample*> in_range;
+    in_range.reserve(samples.size());
+    for (auto& sample : samples) {
+        if (!end_key.empty() && sample.key.compare(end_key) >= 0) {
+            continue;
+        }
+        // 范围扫描的左边界可能在region之前, 负载算在start_key上
+        if (sample.key.compare(start_key) < 0) {
+            sample.key = start_key;
+        }
+        total += sample.weight;
+        in_range.push_back(&sample);
+    }
+    if (in_range.size() < min_samples || total <= 0) {
+        return -1;
+    }
+    std::sort(in_range.begin(), in_range.end(), [](const Sample* l, const Sample* r) {
+        return l->key < r->key;
+    });
+    // 在每个不同key处切分, left为小于该key的负载, 选两边最接近的
+    int64_t left = 0;
+    int64_t min_diff = INT64_MAX;
+    int64_t best_left = 0;
+    const std::string* best_key = nullptr;
+    for (size_t i = 0; i < in_range.size(); ++i) {
+        if (i > 0 && in_range[i]->key != in_range[i - 1]->key) {
+            int64_t diff = std::abs(total - 2 * left);
+            if (diff < min_diff) {
+                min_diff = diff;
+                best_left = left;
+                best_key = &in_range[i]->key;
+            }
+        }
+        left += in_range[i]->weight;
+    }
+    if (best_key == nullptr) {
+        return -1;
+    }
+    int64_t min_load = total * FLAGS_load_split_min_ratio / 100;
+    if (best_left < min_load || total - best_left < min_load) {
+        return -1;
+    }
+    split_key = *best_key;
+    return 0;
+}
+
+void LoadSplitSampler::reset() {
+    _hot_times = 0;
+    BAIDU_SCOPED_LOCK(_mutex);
+    _samples.clear();
+    _sample_count = 0;
+}
+} // namespace baikaldb
+
+/* vim: set ts=4 sw=4 sts=4 tw=100 */
@@ -20,6 +20,8 @@
 #include "table_key.h"
 #include "runtime_state.h"
 #include "mem_row_descriptor.h"
+#include "column_block.h"
+#include "store_plan_cache.h"
 #include "exec_node.h"
 #include "table_record.h"
 #include "my_raft_log_storage.h"
@@ -115,16 +117,7 @@ ScopeMergeStatus::~ScopeMergeStatus() {
     }
 }
 
-int Region::init(bool new_region, int32_t snapshot_times) {
-    _shutdown = false;
-    if (_init_success) {
-        DB_WARNING("region_id: %ld has inited before", _region_id);
-        return 0;
-    }
-    // 对于没有table info的region init_success一直false，导致心跳不上报，无法gc
-    ON_SCOPE_EXIT([this]() {
-        _can_heartbeat = true;
-    });
+int Region::init_resource(bool new_region) {
     MutTableKey start;
     MutTableKey end;
     start.append_i64(_region_id);
@@ -137,7 +130,6 @@ int Region::init(bool new_region, int32_t snapshot_times) {
     _data_cf = _rocksdb->get_data_handle();
     _meta_cf = _rocksdb->get_meta_info_handle();
     _meta_writer = MetaWriter::get_instance();
-    TimeCost time_cost;
     _resource.reset(new RegionResource);
     //如果是新建region需要
     if (new_region) {
@@ -253,6 +245,25 @@ int Region::init(bool new_region, int32_t snapshot_times) {
         } 
     }
     _storage_compute_separate = _factory->get_separate_switch(get_table_id());
+    _txn_pool.init(_region_id, _use_ttl, _online_ttl_base_expire_time_us);
+    copy_region(&_resource->region_info);
+    return 0;
+}
+
+int Region::init(bool new_region, int32_t snapshot_times) {
+    _shutdown = false;
+    if (_init_success) {
+        DB_WARNING("region_id: %ld has inited before", _region_id);
+        return 0;
+    }
+    // 对于没有table info的region init_success一直false，导致心跳不上报，无法gc
+    ON_SCOPE_EXIT([this]() {
+        _can_heartbeat = true;
+    });
+    TimeCost time_cost;
+    if (init_resource(new_region) != 0) {
+        return -1;
+    }
 
     braft::NodeOptions options;
     //construct init peer
@@ -289,7 +300,6 @@ int Region::init(bool new_region, int32_t snapshot_times) {
                                 boost::lexical_cast<std::string>(_region_id);
     options.snapshot_file_system_adaptor = &_snapshot_adaptor;
 
-    _txn_pool.init(_region_id, _use_ttl, _online_ttl_base_expire_time_us);
     bool is_restart = _restart;
     if (_is_learner) {
         DB_DEBUG("init learner.");
@@ -1223,6 +1233,10 @@ void Region::exec_kv_out_txn(const pb::StoreReq* request,
 }
 
 DEFINE_int32(not_leader_alarm_print_interval_s, 60, "not leader alarm print interval(s)");
+DEFINE_bool(enable_apply_group_commit, false, "merge consecutive leader 1pc dml log entries into one rocksdb commit");
+DEFINE_int32(apply_group_commit_max_entries, 64, "max log entries of one group commit, default: 64");
+DEFINE_int32(apply_lanes, 0, "parallel apply lanes for single row 1pc dml in follower, 0 or 1 means serial apply");
+DEFINE_int32(apply_lane_max_entries, 256, "max log entries of one parallel apply round, default: 256");
 // 处理not leader 报警
 // 每个region单独聚合打印报警日志，noah聚合所有region可能会误报
 void Region::NotLeaderAlarm::not_leader_alarm(const braft::PeerId& leader_id) {
@@ -1441,6 +1455,33 @@ void Region::query(google::protobuf::RpcController* controller,
         }
 
     }
+    // 分页select续读, 版本在创建游标时已校验, 分裂后仍读创建时的数据视图
+    if (request->op_type() == pb::OP_SELECT && request->cursor_id() != 0) {
+        if (request->close_cursor()) {
+            close_select_cursor(*request, *response);
+            return;
+        }
+        select_cursor_next(*request, *response);
+        if (response->affected_rows() > 1024) {
+            cntl->set_response_compress_type(brpc::COMPRESS_TYPE_SNAPPY);
+        }
+        return;
+    }
+    // 只带计划模板签名的select, 用store缓存的模板补全plan
+    // 空plan建出的执行树为空, 签名缺失或未命中都不能执行, 让baikaldb带完整plan重发
+    pb::StoreReq filled_request;
+    // select同步执行, filled_request在本函数返回前不会被释放
+    if (request->op_type() == pb::OP_SELECT && request->plan().nodes_size() == 0) {
+        if (StorePlanCache::get_instance()->fill_request(*request, &filled_request) != 0) {
+            response->set_errcode(pb::PLAN_NOT_CACHED);
+            response->set_errmsg("plan template not cached");
+            return;
+        }
+        request = &filled_request;
+    } else if (request->op_type() == pb::OP_SELECT && request->plan_sign() != 0
+            && (request->txn_infos_size() == 0 || request->txn_infos(0).txn_id() == 0)) {
+        response->set_plan_cached(StorePlanCache::get_instance()->add_template(*request));
+    }
     if (validate_version(request, response) == false) {
         //add_version的第二次或者打三次重试，需要把num_table_line返回回去
         if (request->op_type() == pb::OP_ADD_VERSION_FOR_SPLIT_REGION) {
@@ -1573,6 +1614,22 @@ void Region::dml(const pb::StoreReq& request, pb::StoreRes& response,
                optimize_1pc,
                seq_id,
                request.DebugString().c_str());
+    if (FLAGS_load_split) {
+        _load_split_sampler.add_load(FLAGS_load_split_write_weight);
+        if (_load_split_sampler.need_sample()) {
+            // insert没有scan node, 只采样update/delete的主键范围
+            for (const auto& node : request.plan().nodes()) {
+                if (node.node_type() == pb::SCAN_NODE) {
+                    pb::PossibleIndex pos_index;
+                    pos_index.ParseFromString(node.derive_node().scan_node().indexes(0));
+                    if (pos_index.index_id() == get_global_index_id()) {
+                        sample_access_key(pos_index, FLAGS_load_split_write_weight);
+                    }
+                    break;
+                }
+            }
+        }
+    }
     if ((request.op_type() == pb::OP_PREPARE) && optimize_1pc) {
         dml_1pc(request, request.op_type(), request.plan(), request.tuples(), 
             response, applied_index, term, nullptr);
@@ -2285,10 +2342,10 @@ int Region::select(const pb::StoreReq& request, pb::StoreRes& response) {
         sign = request.sql_sign();
     } 
     int64_t index_id = 0;
+    pb::PossibleIndex pos_index;
     for (const auto& node : request.plan().nodes()) {
         if (node.node_type() == pb::SCAN_NODE) {
             // todo 兼容代码
-            pb::PossibleIndex pos_index;
             pos_index.ParseFromString(node.derive_node().scan_node().indexes(0));
             index_id = pos_index.index_id();
             //index_id = node.derive_node().scan_node().use_indexes(0);
@@ -2317,6 +2374,26 @@ int Region::select(const pb::StoreReq& request, pb::StoreRes& response) {
         ret = select(request, request.plan(), request.tuples(), response);
     }
     StoreQos::get_instance()->destroy_bthread_local();
+    _load_stat.read_count.fetch_add(1, std::memory_order_relaxed);
+    _load_stat.scan_rows.fetch_add(response.scan_rows(), std::memory_order_relaxed);
+    int64_t read_bytes = 0;
+    if (response.has_column_block()) {
+        read_bytes = response.column_block().ByteSizeLong();
+    }
+    for (auto& row : response.row_values()) {
+        for (auto& value : row.tuple_values()) {
+            read_bytes += value.size();
+        }
+    }
+    _load_stat.read_bytes.fetch_add(read_bytes, std::memory_order_relaxed);
+    if (FLAGS_load_split) {
+        // 每扫描1000行折算为一次点查
+        int64_t weight = 1 + response.scan_rows() / 1000;
+        _load_split_sampler.add_load(weight);
+        if (index_id == get_global_index_id() && _load_split_sampler.need_sample()) {
+            sample_access_key(pos_index, weight);
+        }
+    }
     return ret;
 }
 
@@ -2463,10 +2540,18 @@ int Region::select(const pb::StoreReq& request,
         }
     }
     
+    // 非事务select可以分页返回, 剩余数据保留游标等待续读
+    bool use_cursor = request.page_rows() > 0 && is_new_txn && !is_trace
+        && request.op_type() == pb::OP_SELECT && !request.has_analyze_info();
+    if (use_cursor) {
+        use_cursor = _select_cursors.can_add();
+    }
+    bool eos = true;
     if (request.has_analyze_info()) {
         rows = select_sample(state, root, request.analyze_info(), response);
     } else {
-        rows = select_normal(state, root, response);
+        rows = select_normal(state, root, response, use_cursor ? request.page_rows() : 0,
+                request.use_column_block(), &eos);
     }
     if (rows < 0) {
         root->close(&state);
@@ -2490,6 +2575,29 @@ int Region::select(const pb::StoreReq& request,
     response.set_affected_rows(rows);
     response.set_scan_rows(state.num_scan_rows());
     response.set_filter_rows(state.num_filter_rows());
+    if (!eos) {
+        SmartSelectCursor cursor = std::make_shared<SelectCursor>();
+        cursor->state = state_ptr;
+        cursor->root = root;
+        cursor->db_conn_id = request.db_conn_id();
+        cursor->column_block = request.use_column_block();
+        cursor->scan_rows = state.num_scan_rows();
+        cursor->filter_rows = state.num_filter_rows();
+        cursor->rows = rows;
+        uint64_t cursor_id = _select_cursors.add(request.new_cursor_id(), cursor);
+        auto_rollback.release();
+        if (cursor_id == 0) {
+            // baikaldb在首页返回前已关闭该游标(backup request另一端先返回)
+            DB_WARNING("select cursor closed before created, region_id: %ld, cursor_id: %lu, log_id: %lu",
+                    _region_id, request.new_cursor_id(), request.log_id());
+            close_select_cursor(cursor);
+            return 0;
+        }
+        response.set_cursor_id(cursor_id);
+        response.set_has_more(true);
+        desc += " rows:" + std::to_string(rows) + " cursor:" + std::to_string(cursor_id);
+        return 0;
+    }
     if (!is_new_txn && txn != nullptr && request.op_type() == pb::OP_SELECT_FOR_UPDATE) {
         auto seq_id = txn_info.seq_id();
         pb::CachePlan plan_item;
@@ -2513,14 +2621,27 @@ int Region::select(const pb::StoreReq& request,
 
 int Region::select_normal(RuntimeState& state, ExecNode* root, pb::StoreRes& response) {
     bool eos = false;
+    return select_normal(state, root, response, 0, false, &eos);
+}
+
+int Region::select_normal(RuntimeState& state, ExecNode* root, pb::StoreRes& response,
+        int64_t max_rows, bool column_block, bool* eos) {
+    *eos = false;
     int rows = 0;
     int ret = 0;
     MemRowDescriptor* mem_row_desc = state.mem_row_desc();
+    ColumnBlockEncoder encoder;
+    if (column_block) {
+        encoder.init(mem_row_desc);
+    }
 
-    while (!eos) {
+    while (!*eos) {
+        if (max_rows > 0 && rows >= max_rows) {
+            break;
+        }
         RowBatch batch;
         batch.set_capacity(state.row_batch_capacity());
-        ret = root->get_next(&state, &batch, &eos);
+        ret = root->get_next(&state, &batch, eos);
         if (ret < 0) {
             DB_FATAL("plan get_next fail, region_id: %ld", _region_id);
             return -1;
@@ -2544,10 +2665,14 @@ int Region::select_normal(RuntimeState& state, ExecNode* root, pb::StoreRes& res
                 DB_FATAL("row is null; region_id: %ld, rows:%d", _region_id, rows);
                 continue;
             }
-            pb::RowValue* row_value = response.add_row_values();
-            for (const auto& iter : mem_row_desc->id_tuple_mapping()) {
-                std::string* tuple_value = row_value->add_tuple_values();
-                row->to_string(iter.first, tuple_value);
+            if (column_block) {
+                encoder.add_row(row);
+            } else {
+                pb::RowValue* row_value = response.add_row_values();
+                for (const auto& iter : mem_row_desc->id_tuple_mapping()) {
+                    std::string* tuple_value = row_value->add_tuple_values();
+                    row->to_string(iter.first, tuple_value);
+                }
             }
 
             if (global_ddl_with_ttl) {
@@ -2555,10 +2680,88 @@ int Region::select_normal(RuntimeState& state, ExecNode* root, pb::StoreRes& res
             }
         }
     }
-
+    if (column_block) {
+        encoder.finish(response.mutable_column_block());
+    }
     return rows;
 }
 
+int Region::select_cursor_next(const pb::StoreReq& request, pb::StoreRes& response) {
+    SmartSelectCursor cursor = _select_cursors.take(request.cursor_id(), request.db_conn_id());
+    if (cursor == nullptr) {
+        response.set_errcode(pb::CURSOR_NOT_EXIST);
+        response.set_errmsg("select cursor not exist");
+        DB_WARNING("select cursor not exist, region_id: %ld, cursor_id: %lu, log_id: %lu",
+                _region_id, request.cursor_id(), request.log_id());
+        return -1;
+    }
+    RuntimeState& state = *cursor->state;
+    for (auto& tuple : state.tuple_descs()) {
+        if (tuple.has_tuple_id()) {
+            response.add_tuple_ids(tuple.tuple_id());
+        }
+    }
+    bool eos = false;
+    int64_t page_rows = request.page_rows() > 0 ? request.page_rows() : state.row_batch_capacity();
+    int rows = select_normal(state, cursor->root, response, page_rows, cursor->column_block, &eos);
+    if (rows < 0) {
+        response.set_errcode(pb::EXEC_FAIL);
+        if (state.error_code != ER_ERROR_FIRST) {
+            response.set_mysql_errcode(state.error_code);
+            response.set_errmsg(state.error_msg.str());
+        } else {
+            response.set_errmsg("plan exec failed");
+        }
+        DB_FATAL("plan exec fail, region_id: %ld, cursor_id: %lu", _region_id, request.cursor_id());
+        close_select_cursor(cursor);
+        return -1;
+    }
+    response.set_errcode(pb::SUCCESS);
+    response.set_affected_rows(rows);
+    response.set_scan_rows(state.num_scan_rows() - cursor->scan_rows);
+    response.set_filter_rows(state.num_filter_rows() - cursor->filter_rows);
+    cursor->scan_rows = state.num_scan_rows();
+    cursor->filter_rows = state.num_filter_rows();
+    cursor->rows += rows;
+    if (eos) {
+        close_select_cursor(cursor);
+        return 0;
+    }
+    _select_cursors.put_back(request.cursor_id(), cursor);
+    response.set_cursor_id(request.cursor_id());
+    response.set_has_more(true);
+    return 0;
+}
+
+void Region::close_select_cursor(const pb::StoreReq& request, pb::StoreRes& response) {
+    SmartSelectCursor cursor = _select_cursors.close(request.cursor_id(), request.db_conn_id());
+    if (cursor != nullptr) {
+        close_select_cursor(cursor);
+    }
+    response.set_errcode(pb::SUCCESS);
+}
+
+void Region::close_select_cursor(SmartSelectCursor cursor) {
+    RuntimeState& state = *cursor->state;
+    cursor->root->close(&state);
+    ExecNode::destroy_tree(cursor->root);
+    cursor->root = nullptr;
+    auto txn = state.txn();
+    if (txn != nullptr) {
+        txn->rollback();
+    }
+}
+
+void Region::clear_select_cursors(bool only_expired) {
+    std::vector<SmartSelectCursor> cursors;
+    _select_cursors.clear(only_expired, &cursors);
+    for (auto& cursor : cursors) {
+        DB_WARNING("close select cursor, region_id: %ld, rows: %ld, idle_time: %ld",
+                _region_id, cursor->rows, cursor->last_access.get_time());
+        close_select_cursor(cursor);
+    }
+}
+
 //抽样采集
 int Region::select_sample(RuntimeState& state, ExecNode* root, const pb::AnalyzeInfo& analyze_info, pb::StoreRes& response) {
     bool eos = false;
@@ -2693,6 +2896,8 @@ void Region::construct_heart_beat_request(pb::StoreHeartBeatRequest& request, bo
         return;
     }
     _region_info.set_num_table_lines(_num_table_lines.load());
+    pb::RegionLoad load;
+    _load_stat.collect(&load);
     //增加peer心跳信息
     if ((need_peer_balance || is_merged()) 
         // addpeer过程中，还没走到on_configuration_committed，此时删表，会导致peer清理不掉
@@ -2705,6 +2910,7 @@ void Region::construct_heart_beat_request(pb::StoreHeartBeatRequest& request, bo
         peer_info->set_start_key(copy_region_info.start_key());
         peer_info->set_end_key(copy_region_info.end_key());
         peer_info->set_is_learner(is_learner());
+        *peer_info->mutable_load() = load;
         if (get_leader().ip != butil::IP_ANY) {
             peer_info->set_exist_leader(true);    
         } else {
@@ -2735,6 +2941,7 @@ void Region::construct_heart_beat_request(pb::StoreHeartBeatRequest& request, bo
             //_region_info.add_peers(butil::endpoint2str(peer.addr).c_str());
         }
         construct_peers_status(leader_heart);
+        *leader_heart->mutable_load() = load;
     }
 
     if (is_learner()) {
@@ -2760,6 +2967,354 @@ void Region::set_can_add_peer() {
     }
 }
 
+void Region::commit_leader_1pc(DMLClosure* done, int64_t applied_index) {
+    bool commit_succ = false;
+    int64_t tmp_num_table_lines = _num_table_lines + done->txn_num_increase_rows;
+    _meta_writer->write_meta_index_and_num_table_lines(_region_id, applied_index, applied_index,
+                    tmp_num_table_lines, done->transaction);
+    auto res = done->transaction->commit();
+    if (res.ok()) {
+        commit_succ = true;
+    } else if (res.IsExpired()) {
+        DB_WARNING("txn expired, region_id: %ld, applied_index: %ld", 
+                   _region_id, applied_index);
+        commit_succ = false;
+    } else {
+        DB_WARNING("unknown error: region_id: %ld, errcode:%d, msg:%s", 
+                _region_id, res.code(), res.ToString().c_str());
+        commit_succ = false;
+    }
+    if (commit_succ) {
+        if (done->txn_num_increase_rows < 0) {
+            _num_delete_lines -= done->txn_num_increase_rows;
+        }
+        _num_table_lines = tmp_num_table_lines;
+    } else {
+        done->response->set_errcode(pb::EXEC_FAIL);
+        done->response->set_errmsg("txn commit failed.");
+        DB_FATAL("txn commit failed, region_id: %ld, applied_index: %ld", 
+                 _region_id, applied_index);
+    }
+    done->applied_index = applied_index;
+}
+
+bool Region::can_group_commit(const pb::StoreReq& request, braft::Closure* done, int64_t index) {
+    if (!FLAGS_enable_apply_group_commit || done == nullptr || index <= _applied_index) {
+        return false;
+    }
+    // 分裂过程中走异步apply
+    if (get_version() == 0) {
+        return false;
+    }
+    // 只合并leader端已执行完的1pc dml, 这些事务的行锁同时持有, 相互不冲突
+    // follower的1pc需要在状态机内执行, 后一条要读到前一条的结果, 不能合并
+    uint64_t txn_id = request.txn_infos_size() > 0 ? request.txn_infos(0).txn_id() : 0;
+    return txn_id == 0 && is_dml_op_type(request.op_type())
+        && ((DMLClosure*)done)->transaction != nullptr;
+}
+
+void Region::group_commit_1pc() {
+    static bvar::IntRecorder group_commit_entries("group_commit_entries");
+    if (_group_commit_dones.empty()) {
+        return;
+    }
+    std::vector<DMLClosure*> dones;
+    dones.swap(_group_commit_dones);
+    ON_SCOPE_EXIT(([&dones]() {
+        for (auto done : dones) {
+            braft::run_closure_in_bthread(done);
+        }
+    }));
+    DMLClosure* last = dones.back();
+    std::vector<SmartTransaction> txns;
+    int64_t increase_rows = 0;
+    for (auto done : dones) {
+        increase_rows += done->txn_num_increase_rows;
+        if (done != last) {
+            txns.emplace_back(done->transaction);
+        }
+    }
+    // 合并失败时逐条提交
+    if (txns.empty() || last->transaction->merge_untracked(txns) != 0) {
+        for (auto done : dones) {
+            commit_leader_1pc(done, done->applied_index);
+        }
+        return;
+    }
+    // applied_index和行数随最后一条一起写入
+    int64_t applied_index = last->applied_index;
+    int64_t tmp_num_table_lines = _num_table_lines + increase_rows;
+    _meta_writer->write_meta_index_and_num_table_lines(_region_id, applied_index, applied_index,
+                    tmp_num_table_lines, last->transaction);
+    auto res = last->transaction->commit();
+    if (!res.ok()) {
+        // 与合并失败一样逐条提交, 其他事务的写入仍在各自事务中, 不能因最后一条失败一起失败
+        DB_FATAL("group commit failed, commit one by one, region_id: %ld, applied_index: %ld, "
+                "entries: %lu, errcode:%d, msg:%s", _region_id, applied_index, dones.size(),
+                res.code(), res.ToString().c_str());
+        // 去掉合并进来的写入和meta, 只保留最后一条自己的写入
+        last->transaction->get_txn()->RollbackToSavePoint();
+        for (auto done : dones) {
+            commit_leader_1pc(done, done->applied_index);
+        }
+        return;
+    }
+    for (auto done : dones) {
+        if (done != last) {
+            done->transaction->finish_merged(true);
+        }
+        if (done->txn_num_increase_rows < 0) {
+            _num_delete_lines -= done->txn_num_increase_rows;
+        }
+    }
+    _num_table_lines = tmp_num_table_lines;
+    group_commit_entries << dones.size();
+}
+
+bool Region::can_apply_in_lane(const pb::StoreReq& request, braft::Closure* done, int64_t index,
+        std::string* key) {
+    if (FLAGS_apply_lanes <= 1 || done != nullptr || index <= _applied_index) {
+        return false;
+    }
+    if (get_version() == 0 || _is_global_index || _is_binlog_region) {
+        return false;
+    }
+    return get_apply_lane_key(request, key);
+}
+
+bool Region::get_apply_lane_key(const pb::StoreReq& request, std::string* key) {
+    pb::OpType op_type = request.op_type();
+    uint64_t txn_id = request.txn_infos_size() > 0 ? request.txn_infos(0).txn_id() : 0;
+    if (txn_id != 0 || (op_type != pb::OP_INSERT && op_type != pb::OP_DELETE && op_type != pb::OP_UPDATE)) {
+        return false;
+    }
+    SchemaFactory* factory = SchemaFactory::get_instance();
+    int64_t table_id = get_table_id();
+    SmartTable table_info = factory->get_table_info_ptr(table_id);
+    SmartIndex pk_info = factory->get_index_info_ptr(table_id);
+    if (table_info == nullptr || pk_info == nullptr) {
+        return false;
+    }
+    // 唯一索引和全文索引在不同主键间也会冲突
+    for (int64_t index_id : table_info->indices) {
+        SmartIndex index_info = factory->get_index_info_ptr(index_id);
+        if (index_info == nullptr || index_info->type == pb::I_UNIQ
+                || index_info->type == pb::I_FULLTEXT || index_info->is_global) {
+            return false;
+        }
+    }
+    const pb::PlanNode* dml_node = nullptr;
+    const pb::PlanNode* scan_node = nullptr;
+    for (auto& node : request.plan().nodes()) {
+        switch (node.node_type()) {
+            case pb::INSERT_NODE:
+            case pb::DELETE_NODE:
+            case pb::UPDATE_NODE:
+                if (dml_node != nullptr) {
+                    return false;
+                }
+                dml_node = &node;
+                break;
+            case pb::SCAN_NODE:
+                if (scan_node != nullptr) {
+                    return false;
+                }
+                scan_node = &node;
+                break;
+            case pb::TABLE_FILTER_NODE:
+            case pb::WHERE_FILTER_NODE:
+                break;
+            default:
+                return false;
+        }
+    }
+    if (dml_node == nullptr) {
+        return false;
+    }
+    if (dml_node->node_type() == pb::INSERT_NODE) {
+        const pb::InsertNode& insert_node = dml_node->derive_node().insert_node();
+        if (scan_node != nullptr || insert_node.table_id() != table_id || insert_node.records_size() != 1) {
+            return false;
+        }
+        // ddl补写的索引数据与ddl状态相关, 串行apply
+        if (insert_node.ddl_need_write()) {
+            return false;
+        }
+        SmartRecord record = factory->new_record(table_id);
+        if (record == nullptr || record->decode(insert_node.records(0)) != 0) {
+            return false;
+        }
+        MutTableKey pk_key;
+        if (record->encode_key(*pk_info, pk_key, -1, false) != 0) {
+            return false;
+        }
+        *key = pk_key.data();
+        return true;
+    }
+    if (scan_node == nullptr) {
+        return false;
+    }
+    if (dml_node->node_type() == pb::UPDATE_NODE) {
+        // 修改主键会写入新的主键
+        for (auto& slot : dml_node->derive_node().update_node().update_slots()) {
+            for (auto& field : pk_info->fields) {
+                if (slot.field_id() == field.id) {
+                    return false;
+                }
+            }
+        }
+    }
+    // 只支持主键等值的单行更新
+    const pb::ScanNode& scan = scan_node->derive_node().scan_node();
+    if (scan.table_id() != table_id || scan.indexes_size() != 1) {
+        return false;
+    }
+    pb::PossibleIndex pos_index;
+    if (!pos_index.ParseFromString(scan.indexes(0))) {
+        return false;
+    }
+    if (pos_index.index_id() != table_id || pos_index.ranges_size() != 1) {
+        return false;
+    }
+    const pb::PossibleIndex::Range& range = pos_index.ranges(0);
+    if (!range.has_left_key() || range.left_key() != range.right_key()
+            || range.left_open() || range.right_open() || range.like_prefix()
+            || range.left_field_cnt() != (int)pk_info->fields.size()) {
+        return false;
+    }
+    *key = range.left_key();
+    return true;
+}
+
+int Region::dml_1pc_in_lane(const pb::StoreReq& request, int64_t applied_index, SmartTransaction txn) {
+    int64_t index_id = 0;
+    StoreQos::get_instance()->create_bthread_local(QOS_DML, request.sql_sign(), index_id);
+    ON_SCOPE_EXIT(([]() {
+        StoreQos::get_instance()->destroy_bthread_local();
+    }));
+    SmartState state_ptr = std::make_shared<RuntimeState>();
+    RuntimeState& state = *state_ptr;
+    state.set_resource(get_resource());
+    int ret = state.init(request, request.plan(), request.tuples(), &_txn_pool, false);
+    if (ret < 0) {
+        DB_FATAL("RuntimeState init fail, region_id: %ld, applied_index: %ld", 
+                    _region_id, applied_index);
+        return -1;
+    }
+    state.need_condition_again = false;
+    state.set_txn(txn);
+    {
+        BAIDU_SCOPED_LOCK(_reverse_index_map_lock);
+        state.set_reverse_index_map(_reverse_index_map);
+    }
+    // 同一lane的日志共用一个事务, 单条失败只回滚到该条之前
+    int64_t num_increase_rows = txn->num_increase_rows;
+    txn->get_txn()->SetSavePoint();
+    ExecNode* root = nullptr;
+    ret = ExecNode::create_tree(request.plan(), &root);
+    if (ret == 0) {
+        ret = root->open(&state);
+        root->close(&state);
+    }
+    ExecNode::destroy_tree(root);
+    if (ret < 0) {
+        txn->get_txn()->RollbackToSavePoint();
+        txn->num_increase_rows = num_increase_rows;
+        DB_WARNING("dml_1pc in lane fail, region_id: %ld, applied_index: %ld, error_code: %d",
+                _region_id, applied_index, state.error_code);
+        return -1;
+    }
+    txn->num_increase_rows += state.num_increase_rows();
+    return 0;
+}
+
+void Region::apply_in_lanes() {
+    static bvar::IntRecorder apply_lane_entries("apply_lane_entries");
+    if (_apply_lane_entries.empty()) {
+        return;
+    }
+    std::vector<ApplyLaneEntry> entries;
+    entries.swap(_apply_lane_entries);
+    if (entries.size() == 1) {
+        do_apply(entries[0].term, entries[0].index, *entries[0].request, nullptr);
+        return;
+    }
+    TimeCost cost;
+    int lane_cnt = std::min((size_t)FLAGS_apply_lanes, entries.size());
+    std::vector<std::vector<ApplyLaneEntry*>> lanes(lane_cnt);
+    std::hash<std::string> hash_fn;
+    for (auto& entry : entries) {
+        lanes[hash_fn(entry.key) % lane_cnt].emplace_back(&entry);
+    }
+    std::vector<SmartTransaction> txns;
+    ConcurrencyBthread lane_bth(lane_cnt);
+    for (auto& lane : lanes) {
+        if (lane.empty()) {
+            continue;
+        }
+        SmartTransaction txn(new Transaction(0, &_txn_pool));
+        txn->set_resource(get_resource());
+        Transaction::TxnOptions txn_opt;
+        txn_opt.dml_1pc = true;
+        txn_opt.in_fsm = true;
+        txn->begin(txn_opt);
+        txns.emplace_back(txn);
+        lane_bth.run([this, &lane, txn]() {
+            for (auto entry : lane) {
+                dml_1pc_in_lane(*entry->request, entry->index, txn);
+            }
+        });
+    }
+    lane_bth.join();
+
+    // 所有lane的写入和applied_index一起原子提交, 保证重放时不会重复apply
+    int64_t applied_index = entries.back().index;
+    int64_t num_increase_rows = 0;
+    for (auto& txn : txns) {
+        num_increase_rows += txn->num_increase_rows;
+    }
+    SmartTransaction main_txn = txns[0];
+    std::vector<SmartTransaction> merged_txns(txns.begin() + 1, txns.end());
+    if (main_txn->merge_untracked(merged_txns) != 0) {
+        // lane事务不能脱离applied_index单独提交, 否则重启后会重复apply
+        // 全部回滚, 按日志顺序逐条走普通apply流程
+        DB_FATAL("merge lane txn fail, apply serially, region_id: %ld, applied_index: %ld",
+                _region_id, applied_index);
+        for (auto& txn : txns) {
+            txn->rollback();
+        }
+        for (auto& entry : entries) {
+            do_apply(entry.term, entry.index, *entry.request, nullptr);
+        }
+        return;
+    }
+    int64_t tmp_num_table_lines = _num_table_lines + num_increase_rows;
+    _meta_writer->write_meta_index_and_num_table_lines(_region_id, applied_index, applied_index,
+            tmp_num_table_lines, main_txn);
+    auto res = main_txn->commit();
+    bool commit_succ = res.ok();
+    for (auto& txn : merged_txns) {
+        txn->finish_merged(commit_succ);
+    }
+    if (!commit_succ) {
+        DB_FATAL("lane txn commit failed, region_id: %ld, applied_index: %ld, errcode:%d, msg:%s",
+                _region_id, applied_index, res.code(), res.ToString().c_str());
+    } else {
+        if (num_increase_rows < 0) {
+            _num_delete_lines -= num_increase_rows;
+        }
+        _num_table_lines = tmp_num_table_lines;
+    }
+    _region_info.set_log_index(applied_index);
+    _applied_index = applied_index;
+    _data_index = applied_index;
+    apply_lane_entries << entries.size();
+    if (cost.get_time() > FLAGS_print_time_us) {
+        DB_WARNING("region_id: %ld apply %lu entries in %d lanes, applied_index: %ld, cost: %ld",
+                _region_id, entries.size(), lane_cnt, applied_index, cost.get_time());
+    }
+}
+
 void Region::do_apply(int64_t term, int64_t index, const pb::StoreReq& request, braft::Closure* done) {
     if (index <= _applied_index) {
         if (get_version() == 0) {
@@ -2827,34 +3382,7 @@ void Region::do_apply(int64_t term, int64_t index, const pb::StoreReq& request,
                 break;
             }
             if (done != nullptr && ((DMLClosure*)done)->transaction != nullptr && (is_dml_op_type(op_type))) {
-                bool commit_succ = false;
-                int64_t tmp_num_table_lines = _num_table_lines + ((DMLClosure*)done)->txn_num_increase_rows;
-                _meta_writer->write_meta_index_and_num_table_lines(_region_id, _applied_index, _data_index,
-                                tmp_num_table_lines, ((DMLClosure*)done)->transaction);
-                auto res = ((DMLClosure*)done)->transaction->commit();
-                if (res.ok()) {
-                    commit_succ = true;
-                } else if (res.IsExpired()) {
-                    DB_WARNING("txn expired, region_id: %ld, applied_index: %ld", 
-                               _region_id, _applied_index);
-                    commit_succ = false;
-                } else {
-                    DB_WARNING("unknown error: region_id: %ld, errcode:%d, msg:%s", 
-                            _region_id, res.code(), res.ToString().c_str());
-                    commit_succ = false;
-                }
-                if (commit_succ) {
-                    if (((DMLClosure*)done)->txn_num_increase_rows < 0) {
-                        _num_delete_lines -= ((DMLClosure*)done)->txn_num_increase_rows;
-                    }
-                    _num_table_lines = tmp_num_table_lines;
-                } else {
-                    ((DMLClosure*)done)->response->set_errcode(pb::EXEC_FAIL);
-                    ((DMLClosure*)done)->response->set_errmsg("txn commit failed.");
-                    DB_FATAL("txn commit failed, region_id: %ld, applied_index: %ld", 
-                             _region_id, _applied_index);
-                }
-                ((DMLClosure*)done)->applied_index = _applied_index;
+                commit_leader_1pc((DMLClosure*)done, _applied_index);
                 break;
             } else {
                 dml_1pc(request, request.op_type(), request.plan(), request.tuples(), 
@@ -2978,67 +3506,115 @@ void Region::on_apply(braft::Iterator& iter) {
             }
             continue;
         }
-        reset_timecost();
         auto term = iter.term();
         auto index = iter.index();
-        _braft_apply_index = index;
-
-        DB_WARNING("Huzx=> onApply index:%ld, request:%s", index, request->DebugString().c_str());
-
-        if (request->op_type() == pb::OP_ADD_VERSION_FOR_SPLIT_REGION ||
-                (get_version() == 0 && request->op_type() == pb::OP_CLEAR_APPLYING_TXN)) {
-            // 异步队列排空
-            DB_WARNING("braft_apply_index: %lu, applied_index: %lu, region_id: %lu",
-                       _braft_apply_index, _applied_index, _region_id);
-            wait_async_apply_log_queue_empty();
-            DB_WARNING("wait async finish, region_id: %lu", _region_id);
-        }
-        // 分裂的情况下，region version为0，都走异步的逻辑;
-        // OP_ADD_VERSION_FOR_SPLIT_REGION及分裂结束后，走正常同步的逻辑
-        // version为0时，on_leader_start会提交一条pb::OP_CLEAR_APPLYING_TXN日志，这个同步
-        if (get_version() == 0
-            && request->op_type() != pb::OP_CLEAR_APPLYING_TXN
-            && request->op_type() != pb::OP_ADD_VERSION_FOR_SPLIT_REGION) {
-            auto func = [this, term, index, request]() mutable {
-                pb::StoreReq& store_req = *request;
-                if (store_req.op_type() != pb::OP_INSERT
-                    && store_req.op_type() != pb::OP_DELETE
-                    && store_req.op_type() != pb::OP_UPDATE
-                    && store_req.op_type() != pb::OP_PREPARE
-                    && store_req.op_type() != pb::OP_ROLLBACK
-                    && store_req.op_type() != pb::OP_COMMIT
-                    && store_req.op_type() != pb::OP_NONE
-                    && store_req.op_type() != pb::OP_KV_BATCH
-                    && store_req.op_type() != pb::OP_SELECT_FOR_UPDATE
-                    && store_req.op_type() != pb::OP_UPDATE_PRIMARY_TIMESTAMP) {
-                    DB_WARNING("unexpected store_req:%s, region_id: %ld",
-                               pb2json(store_req).c_str(), _region_id);
-                    _async_apply_param.apply_log_failed = true;
-                    return;
-                }
-                store_req.set_region_id(_region_id);
-                store_req.set_region_version(0);
-                // for tail splitting new region replay txn
-                if (store_req.has_start_key() && !store_req.start_key().empty()) {
-                    pb::RegionInfo region_info_mem;
-                    copy_region(&region_info_mem);
-                    region_info_mem.set_start_key(store_req.start_key());
-                    set_region_with_update_range(region_info_mem);
-                }
-                do_apply(term, index, store_req, nullptr);
-            };
-            _async_apply_log_queue.run(func);
-            if (done != nullptr && ((DMLClosure*)done)->response != nullptr) {
-                ((DMLClosure*)done)->response->set_errcode(pb::SUCCESS);
-                ((DMLClosure*)done)->response->set_errmsg("success");
-            }
-        } else {
-            do_apply(term, index, *request, done);
+        apply_entry(term, index, request, done_guard.release());
+    }
+    finish_apply_entries();
+}
+
+void Region::apply_entry(int64_t term, int64_t index, std::shared_ptr<pb::StoreReq> request,
+        braft::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    reset_timecost();
+    _braft_apply_index = index;
+    // 写负载在apply时统计, follower的apply开销也计入
+    if (is_dml_op_type(request->op_type())
+            || request->op_type() == pb::OP_PREPARE
+            || request->op_type() == pb::OP_KV_BATCH) {
+        _load_stat.write_count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    DB_WARNING("Huzx=> onApply index:%ld, request:%s", index, request->DebugString().c_str());
+
+    std::string lane_key;
+    if (can_group_commit(*request, done, index)) {
+        apply_in_lanes();
+        // 先推进applied_index, 数据和meta在group_commit_1pc中一起提交
+        _region_info.set_log_index(index);
+        _applied_index = index;
+        _data_index = index;
+        DMLClosure* dml_done = (DMLClosure*)done_guard.release();
+        dml_done->applied_index = index;
+        _group_commit_dones.emplace_back(dml_done);
+        if ((int)_group_commit_dones.size() >= FLAGS_apply_group_commit_max_entries) {
+            group_commit_1pc();
         }
-        if (done != nullptr) {
-            braft::run_closure_in_bthread(done_guard.release());
+        return;
+    }
+    group_commit_1pc();
+    if (can_apply_in_lane(*request, done, index, &lane_key)) {
+        ApplyLaneEntry entry;
+        entry.request = request;
+        entry.index = index;
+        entry.term = term;
+        entry.key.swap(lane_key);
+        _apply_lane_entries.emplace_back(entry);
+        if ((int)_apply_lane_entries.size() >= FLAGS_apply_lane_max_entries) {
+            apply_in_lanes();
         }
+        return;
     }
+    apply_in_lanes();
+
+    if (request->op_type() == pb::OP_ADD_VERSION_FOR_SPLIT_REGION ||
+            (get_version() == 0 && request->op_type() == pb::OP_CLEAR_APPLYING_TXN)) {
+        // 异步队列排空
+        DB_WARNING("braft_apply_index: %lu, applied_index: %lu, region_id: %lu",
+                   _braft_apply_index, _applied_index, _region_id);
+        wait_async_apply_log_queue_empty();
+        DB_WARNING("wait async finish, region_id: %lu", _region_id);
+    }
+    // 分裂的情况下，region version为0，都走异步的逻辑;
+    // OP_ADD_VERSION_FOR_SPLIT_REGION及分裂结束后，走正常同步的逻辑
+    // version为0时，on_leader_start会提交一条pb::OP_CLEAR_APPLYING_TXN日志，这个同步
+    if (get_version() == 0
+        && request->op_type() != pb::OP_CLEAR_APPLYING_TXN
+        && request->op_type() != pb::OP_ADD_VERSION_FOR_SPLIT_REGION) {
+        auto func = [this, term, index, request]() mutable {
+            pb::StoreReq& store_req = *request;
+            if (store_req.op_type() != pb::OP_INSERT
+                && store_req.op_type() != pb::OP_DELETE
+                && store_req.op_type() != pb::OP_UPDATE
+                && store_req.op_type() != pb::OP_PREPARE
+                && store_req.op_type() != pb::OP_ROLLBACK
+                && store_req.op_type() != pb::OP_COMMIT
+                && store_req.op_type() != pb::OP_NONE
+                && store_req.op_type() != pb::OP_KV_BATCH
+                && store_req.op_type() != pb::OP_SELECT_FOR_UPDATE
+                && store_req.op_type() != pb::OP_UPDATE_PRIMARY_TIMESTAMP) {
+                DB_WARNING("unexpected store_req:%s, region_id: %ld",
+                           pb2json(store_req).c_str(), _region_id);
+                _async_apply_param.apply_log_failed = true;
+                return;
+            }
+            store_req.set_region_id(_region_id);
+            store_req.set_region_version(0);
+            // for tail splitting new region replay txn
+            if (store_req.has_start_key() && !store_req.start_key().empty()) {
+                pb::RegionInfo region_info_mem;
+                copy_region(&region_info_mem);
+                region_info_mem.set_start_key(store_req.start_key());
+                set_region_with_update_range(region_info_mem);
+            }
+            do_apply(term, index, store_req, nullptr);
+        };
+        _async_apply_log_queue.run(func);
+        if (done != nullptr && ((DMLClosure*)done)->response != nullptr) {
+            ((DMLClosure*)done)->response->set_errcode(pb::SUCCESS);
+            ((DMLClosure*)done)->response->set_errmsg("success");
+        }
+    } else {
+        do_apply(term, index, *request, done);
+    }
+    if (done != nullptr) {
+        braft::run_closure_in_bthread(done_guard.release());
+    }
+}
+
+void Region::finish_apply_entries() {
+    group_commit_1pc();
+    apply_in_lanes();
 }
 
 bool Region::check_key_fits_region_range(SmartIndex pk_info, SmartTransaction txn,
@@ -4032,8 +4608,10 @@ void Region::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* don
     if (get_version() == 0) {
         wait_async_apply_log_queue_empty();
     }
+    // 数据文件是虚拟文件, 安装快照时才从rocksdb读取; 按文件名区分逐key发送还是直接发送sst
+    const std::string& data_file = FLAGS_snapshot_ship_sst ? SNAPSHOT_SST_FILES : SNAPSHOT_DATA_FILE;
     if (writer->add_file(SNAPSHOT_META_FILE) != 0 
-            || writer->add_file(SNAPSHOT_DATA_FILE) != 0) {
+            || writer->add_file(data_file) != 0) {
         done->status().set_error(EINVAL, "Fail to add snapshot");
         DB_WARNING("Error while adding extra_fs to writer, region_id: %ld", _region_id);
         return;
@@ -4912,7 +5490,7 @@ void Region::start_process_split(const pb::RegionSplitResponse& split_response,
         baikaldb::Store::get_instance()->sub_split_num();
         return;
     }
-    if (!tail_split && split_key.compare(get_end_key()) > 0) {
+    if (!tail_split && end_key_compare(split_key, get_end_key()) > 0) {
         baikaldb::Store::get_instance()->sub_split_num();
         return;
     }
@@ -5318,9 +5896,8 @@ void Region::write_local_rocksdb_for_split() {
                 rocksdb::Slice key_slice(iter->key());
                 key_slice.remove_prefix(2 * sizeof(int64_t));
                 if (index_info.type == pb::I_PRIMARY || _is_global_index) {
-                    // check end_key
-                    // tail split need not send rocksdb
-                    if (key_slice.compare(end_key) >= 0) {
+                    // check end_key, 按负载分裂的尾region end_key为空
+                    if (end_key_compare(key_slice, end_key) >= 0) {
                         break;
                     }
                 } else if (index_info.type == pb::I_UNIQ || index_info.type == pb::I_KEY) {
@@ -5450,9 +6027,8 @@ void Region::write_local_rocksdb_for_split() {
                     //int ret1 = 0;
                     rocksdb::Slice key_slice(iter->key());
                     key_slice.remove_prefix(2 * sizeof(int64_t));
-                    // check end_key
-                    // tail split need not send rocksdb
-                    if (key_slice.compare(end_key) >= 0) {
+                    // check end_key, 按负载分裂的尾region end_key为空
+                    if (end_key_compare(key_slice, end_key) >= 0) {
                         break;
                     }
                     MutTableKey key(iter->key());
@@ -6367,6 +6943,37 @@ void Region::adjust_num_table_lines() {
     return;
 }
 
+void Region::sample_access_key(const pb::PossibleIndex& pos_index, int64_t weight) {
+    if (pos_index.ranges_size() == 0) {
+        return;
+    }
+    // in条件有多个range时随机取一个
+    const auto& range = pos_index.ranges(butil::fast_rand_less_than(pos_index.ranges_size()));
+    if (range.has_left_key()) {
+        _load_split_sampler.sample(range.left_key(), weight);
+    }
+}
+
+int Region::get_load_split_key(std::string& split_key, int64_t& split_key_term) {
+    // 拿到term,之后开始分裂会校验term
+    braft::NodeStatus s;
+    _node.get_status(&s);
+    split_key_term = s.term;
+    int ret = _load_split_sampler.get_split_key(get_start_key(), get_end_key(), split_key);
+    size_t sample_size = _load_split_sampler.sample_size();
+    // 不论是否选到分裂点都重新累计, 单key热点无法拆分时避免每个周期重试
+    _load_split_sampler.reset();
+    if (ret != 0) {
+        DB_WARNING("region_id: %ld hot but no balanced split key, sample_size: %lu",
+                _region_id, sample_size);
+        return -1;
+    }
+    DB_WARNING("table_id:%ld, load split_key:%s, region_id: %ld, sample_size: %lu",
+            get_global_index_id(), rocksdb::Slice(split_key).ToString(true).c_str(),
+            _region_id, sample_size);
+    return 0;
+}
+
 int Region::get_split_key(std::string& split_key, int64_t& split_key_term) {
     int64_t tableid = get_global_index_id();
     if (tableid < 0) {
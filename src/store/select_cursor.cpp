@@ -0,0 +1,92 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "select_cursor.h"
+
+namespace baikaldb {
+DEFINE_int64(select_cursor_timeout_s, 60, "paged select cursor idle timeout(s)");
+DEFINE_int32(select_cursor_max_per_region, 16, "max paged select cursors per region, exceed will return all rows");
+
+bool SelectCursorMap::can_add() {
+    BAIDU_SCOPED_LOCK(_lock);
+    return (int)_cursors.size() < FLAGS_select_cursor_max_per_region;
+}
+
+uint64_t SelectCursorMap::add(uint64_t cursor_id, SmartSelectCursor cursor) {
+    BAIDU_SCOPED_LOCK(_lock);
+    if (cursor_id != 0 && _closed_ids.erase(cursor_id) != 0) {
+        return 0;
+    }
+    // 随机id, 避免store重启后旧id命中其他请求的游标
+    while (cursor_id == 0 || _cursors.count(cursor_id) != 0) {
+        cursor_id = butil::fast_rand();
+    }
+    _cursors[cursor_id] = cursor;
+    return cursor_id;
+}
+
+SmartSelectCursor SelectCursorMap::take(uint64_t cursor_id, uint64_t db_conn_id) {
+    BAIDU_SCOPED_LOCK(_lock);
+    auto iter = _cursors.find(cursor_id);
+    if (iter == _cursors.end() || iter->second->db_conn_id != db_conn_id) {
+        return nullptr;
+    }
+    // 取出后独占使用, 重复的续读请求会拿不到游标
+    SmartSelectCursor cursor = iter->second;
+    _cursors.erase(iter);
+    return cursor;
+}
+
+void SelectCursorMap::put_back(uint64_t cursor_id, SmartSelectCursor cursor) {
+    cursor->last_access.reset();
+    BAIDU_SCOPED_LOCK(_lock);
+    _cursors[cursor_id] = cursor;
+}
+
+SmartSelectCursor SelectCursorMap::close(uint64_t cursor_id, uint64_t db_conn_id) {
+    BAIDU_SCOPED_LOCK(_lock);
+    auto iter = _cursors.find(cursor_id);
+    if (iter == _cursors.end()) {
+        // 首页可能还在执行
+        _closed_ids[cursor_id].reset();
+        return nullptr;
+    }
+    if (iter->second->db_conn_id != db_conn_id) {
+        return nullptr;
+    }
+    SmartSelectCursor cursor = iter->second;
+    _cursors.erase(iter);
+    return cursor;
+}
+
+void SelectCursorMap::clear(bool only_expired, std::vector<SmartSelectCursor>* cursors) {
+    int64_t timeout_us = FLAGS_select_cursor_timeout_s * 1000 * 1000LL;
+    BAIDU_SCOPED_LOCK(_lock);
+    for (auto iter = _cursors.begin(); iter != _cursors.end();) {
+        if (!only_expired || iter->second->last_access.get_time() > timeout_us) {
+            cursors->emplace_back(iter->second);
+            iter = _cursors.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    for (auto iter = _closed_ids.begin(); iter != _closed_ids.end();) {
+        if (!only_expired || iter->second.get_time() > timeout_us) {
+            iter = _closed_ids.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+}
+}  // namespace baikaldb
@@ -34,6 +34,7 @@
 #include "my_raft_log_storage.h"
 //#include <jemalloc/jemalloc.h>
 #include "qos.h"
+#include "store_plan_cache.h"
 
 namespace baikaldb {
 DECLARE_int64(store_heart_beat_interval_us);
@@ -79,6 +80,7 @@ DEFINE_string(network_segment, "", "network segment of store set by user");
 DEFINE_string(container_id, "", "container_id for zoombie instance");
 DEFINE_int32(rocksdb_perf_level, rocksdb::kDisable, "rocksdb_perf_level");
 DEFINE_bool(stop_ttl_data, false, "stop ttl data");
+DEFINE_int32(multi_query_concurrency, 8, "region query concurrency of one multi_query, default: 8");
 DECLARE_bool(store_rocks_hang_check);
 DECLARE_int32(store_rocks_hang_check_timeout_s);
 DECLARE_int32(store_rocks_hang_cnt_limit);
@@ -123,6 +125,8 @@ int Store::init_before_listen(std::vector<std::int64_t>& init_region_ids) {
         DB_FATAL("rocksdb init failed: code:%d", res);
         return -1;
     }
+    // 进程退出前未清理的快照sst文件
+    clear_snapshot_sst_files();
     // init val 
     _factory = SchemaFactory::get_instance();
     std::vector<rocksdb::Transaction*> recovered_txns;
@@ -563,6 +567,80 @@ void Store::query(google::protobuf::RpcController* controller,
                   done_guard.release());
 }
 
+void Store::multi_query(google::protobuf::RpcController* controller,
+                  const pb::MultiStoreReq* request,
+                  pb::MultiStoreRes* response,
+                  google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    brpc::Controller* cntl =
+            static_cast<brpc::Controller*>(controller);
+    uint64_t log_id = 0;
+    if (cntl->has_log_id()) {
+        log_id = cntl->log_id();
+    }
+    const pb::StoreReq& common = request->common();
+    for (int i = 0; i < request->regions_size(); ++i) {
+        response->add_responses();
+    }
+    // 事务和dml会修改region状态, 只合并非事务select
+    bool in_txn = common.txn_infos_size() > 0 && common.txn_infos(0).txn_id() != 0;
+    if (common.op_type() != pb::OP_SELECT || in_txn) {
+        for (auto& res : *response->mutable_responses()) {
+            res.set_errcode(pb::INPUT_PARAM_ERROR);
+            res.set_errmsg("multi_query only support select without txn");
+        }
+        DB_WARNING("multi_query not support, op_type: %s, logid: %lu",
+                pb::OpType_Name(common.op_type()).c_str(), log_id);
+        return;
+    }
+    std::atomic<bool> need_compress(false);
+    // 限制整个响应的行数, 超过后剩余region由baikaldb重新请求
+    std::atomic<int64_t> total_rows(0);
+    ConcurrencyBthread query_bth(FLAGS_multi_query_concurrency);
+    for (int i = 0; i < request->regions_size(); ++i) {
+        query_bth.run([this, request, response, &common, &need_compress, &total_rows, log_id, i]() {
+            const pb::MultiRegionReq& region_req = request->regions(i);
+            pb::StoreRes* res = response->mutable_responses(i);
+            if (request->max_rows() > 0 && total_rows.load() >= request->max_rows()) {
+                res->set_errcode(pb::REGION_SKIPPED);
+                res->set_errmsg("multi_query rows exceed max_rows");
+                return;
+            }
+            SmartRegion region = get_region(region_req.region_id());
+            if (region == nullptr || region->removed()) {
+                res->set_errcode(pb::REGION_NOT_EXIST);
+                res->set_errmsg("region_id not exist in store");
+                DB_WARNING("region_id: %ld not exist in store, logid:%lu", region_req.region_id(), log_id);
+                return;
+            }
+            pb::StoreReq sub_request;
+            sub_request.CopyFrom(common);
+            sub_request.set_region_id(region_req.region_id());
+            sub_request.set_region_version(region_req.region_version());
+            sub_request.mutable_scan_indexes()->CopyFrom(region_req.scan_indexes());
+            // 带完整模板时补回本region的索引范围, 只带签名时由region从计划缓存补全
+            if (sub_request.has_plan()) {
+                StorePlanCache::restore_scan_indexes(sub_request.mutable_plan(),
+                        sub_request.mutable_scan_indexes());
+            }
+            brpc::Controller sub_cntl;
+            sub_cntl.set_log_id(log_id);
+            BthreadCond cond(1);
+            MultiQueryClosure sub_done(cond);
+            region->query(&sub_cntl, &sub_request, res, &sub_done);
+            cond.wait();
+            total_rows += res->has_column_block() ? res->column_block().num_rows() : res->row_values_size();
+            if (sub_cntl.response_compress_type() == brpc::COMPRESS_TYPE_SNAPPY) {
+                need_compress = true;
+            }
+        });
+    }
+    query_bth.join();
+    if (need_compress) {
+        cntl->set_response_compress_type(brpc::COMPRESS_TYPE_SNAPPY);
+    }
+}
+
 void Store::query_binlog(google::protobuf::RpcController* controller,
                   const pb::StoreReq* request,
                   pb::StoreRes* response,
@@ -1407,6 +1485,8 @@ void Store::whether_split_thread() {
             //DB_WARNING("region_id: %ld, split_capacity: %ld", region_ids[i], region_capacity);
             std::string split_key;
             int64_t split_key_term = 0;
+            // 每个周期都检查, 负载按两次检查的间隔折算qps
+            bool load_hot = FLAGS_load_split && ptr_region->check_load_hot();
             //如果是尾部分
             if (ptr_region->is_leader() 
                     && ptr_region->get_status() == pb::IDLE
@@ -1440,6 +1520,15 @@ void Store::whether_split_thread() {
                         process_split_request(ptr_region->get_global_index_id(), region_ids[i], false, split_key, split_key_term);
                         continue;
                     }
+                } else if (load_hot) {
+                    // 数据量小但访问集中的region按采样key的负载分布分裂, 尾region也不走尾分裂
+                    if (0 != ptr_region->get_load_split_key(split_key, split_key_term)) {
+                        continue;
+                    }
+                    DB_WARNING("start split by load, region_id: %ld num_table_lines:%ld",
+                            region_ids[i], ptr_region->get_num_table_lines());
+                    process_split_request(ptr_region->get_global_index_id(), region_ids[i], false, split_key, split_key_term);
+                    continue;
                 }
             }
             
@@ -0,0 +1,331 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <map>
+#include <random>
+#include <set>
+#ifdef BAIDU_INTERNAL
+#include <base/file_util.h>
+#else
+#include <butil/file_util.h>
+#endif
+#include "agg_node.h"
+#include "runtime_state.h"
+#include "transaction_pool.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_int32(agg_parallel_round_rows);
+DECLARE_int32(agg_parallel_min_rows);
+DECLARE_int64(row_number_to_check_memory);
+
+static const std::string TEST_SPILL_DIR = "./test_agg_spill";
+
+// 与agg_fn_call.cpp中avg的中间结果布局一致
+struct TestAvgIntermediate {
+    double sum;
+    int64_t count;
+};
+
+// 模拟store返回的中间结果
+class BatchSourceNode : public ExecNode {
+public:
+    explicit BatchSourceNode(std::vector<std::unique_ptr<RowBatch>>* batches) {
+        _batches.swap(*batches);
+    }
+    virtual int open(RuntimeState* state) {
+        return 0;
+    }
+    virtual int get_next(RuntimeState* state, RowBatch* batch, bool* eos) {
+        if (_idx < _batches.size()) {
+            batch->swap(*_batches[_idx++]);
+        }
+        *eos = _idx >= _batches.size();
+        return 0;
+    }
+private:
+    std::vector<std::unique_ptr<RowBatch>> _batches;
+    size_t _idx = 0;
+};
+
+struct AggExpect {
+    int64_t count = 0;
+    bool has_sum = false;
+    int64_t sum = 0;
+    bool has_min_max = false;
+    int64_t min = 0;
+    int64_t max = 0;
+    double avg_sum = 0;
+    int64_t avg_count = 0;
+};
+
+// tuple 0: slot 1 INT64分组列, slot 2 STRING分组列, slot 3 INT64聚合输入
+// tuple 1: count(1) sum(2) min(3) max(4), avg中间结果slot 5, 最终结果slot 6
+class AggSpillTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_spill_dir = TEST_SPILL_DIR;
+        // 不走mem tracker
+        FLAGS_row_number_to_check_memory = INT64_MAX;
+        pb::TupleDescriptor* tuple0 = _tuples.Add();
+        tuple0->set_tuple_id(0);
+        tuple0->set_table_id(1);
+        pb::PrimitiveType types0[] = {pb::INT64, pb::STRING, pb::INT64};
+        for (int slot_id = 1; slot_id <= 3; ++slot_id) {
+            pb::SlotDescriptor* slot = tuple0->add_slots();
+            slot->set_slot_id(slot_id);
+            slot->set_tuple_id(0);
+            slot->set_slot_type(types0[slot_id - 1]);
+        }
+        pb::TupleDescriptor* tuple1 = _tuples.Add();
+        tuple1->set_tuple_id(1);
+        pb::PrimitiveType types1[] = {pb::INT64, pb::INT64, pb::INT64, pb::INT64, pb::STRING, pb::DOUBLE};
+        for (int slot_id = 1; slot_id <= 6; ++slot_id) {
+            pb::SlotDescriptor* slot = tuple1->add_slots();
+            slot->set_slot_id(slot_id);
+            slot->set_tuple_id(1);
+            slot->set_slot_type(types1[slot_id - 1]);
+        }
+        pb::PlanNode* plan_node = _plan.add_nodes();
+        plan_node->set_node_type(pb::MERGE_AGG_NODE);
+        plan_node->set_limit(-1);
+        plan_node->set_num_children(1);
+        pb::AggNode* agg = plan_node->mutable_derive_node()->mutable_agg_node();
+        agg->set_agg_tuple_id(1);
+        add_slot_ref(agg->add_group_exprs(), 0, 1, pb::INT64);
+        add_slot_ref(agg->add_group_exprs(), 0, 2, pb::STRING);
+        add_agg(agg->add_agg_funcs(), "count", 1, 1);
+        add_agg(agg->add_agg_funcs(), "sum", 2, 2);
+        add_agg(agg->add_agg_funcs(), "min", 3, 3);
+        add_agg(agg->add_agg_funcs(), "max", 4, 4);
+        add_agg(agg->add_agg_funcs(), "avg", 6, 5);
+    }
+    void TearDown() override {
+        FLAGS_agg_parallel_partitions = 8;
+        FLAGS_agg_parallel_round_rows = 16384;
+        FLAGS_agg_parallel_min_rows = 2048;
+        FLAGS_agg_spill_memory_quota = 0;
+        FLAGS_row_number_to_check_memory = 4096;
+        butil::DeleteFile(butil::FilePath(TEST_SPILL_DIR), true);
+    }
+
+    static void add_slot_ref(pb::Expr* expr, int32_t tuple_id, int32_t slot_id, pb::PrimitiveType type) {
+        pb::ExprNode* node = expr->add_nodes();
+        node->set_node_type(pb::SLOT_REF);
+        node->set_col_type(type);
+        node->set_num_children(0);
+        node->mutable_derive_node()->set_tuple_id(tuple_id);
+        node->mutable_derive_node()->set_slot_id(slot_id);
+    }
+    static void add_agg(pb::Expr* expr, const std::string& name, int32_t final_slot_id,
+            int32_t intermediate_slot_id) {
+        pb::ExprNode* node = expr->add_nodes();
+        node->set_node_type(pb::AGG_EXPR);
+        node->set_col_type(pb::INVALID_TYPE);
+        node->set_num_children(1);
+        node->mutable_fn()->set_name(name);
+        node->mutable_derive_node()->set_tuple_id(1);
+        node->mutable_derive_node()->set_slot_id(final_slot_id);
+        node->mutable_derive_node()->set_intermediate_slot_id(intermediate_slot_id);
+        add_slot_ref(expr, 0, 3, pb::INT64);
+    }
+
+    static std::string group_key(const ExprValue& g1, const ExprValue& g2) {
+        std::string key;
+        key += g1.is_null() ? "N" : "V" + g1.get_string();
+        key += "|";
+        key += g2.is_null() ? "N" : "V" + g2.get_string();
+        return key;
+    }
+
+    // 各store的部分聚合结果, 同一分组在多个batch中重复出现
+    std::vector<std::unique_ptr<RowBatch>> make_batches(MemRowDescriptor* desc, int num_batches,
+            std::map<std::string, AggExpect>* expect) {
+        std::mt19937 rand(num_batches);
+        std::vector<std::unique_ptr<RowBatch>> batches;
+        for (int i = 0; i < num_batches; ++i) {
+            std::unique_ptr<RowBatch> batch(new RowBatch);
+            int rows = i % 7 == 6 ? 0 : 300;
+            for (int j = 0; j < rows; ++j) {
+                std::unique_ptr<MemRow> row = desc->fetch_mem_row();
+                ExprValue g1(pb::INT64);
+                if (rand() % 10 != 0) {
+                    g1._u.int64_val = (int64_t)(rand() % 50) - 25;
+                    row->set_value(0, 1, g1);
+                } else {
+                    g1 = ExprValue::Null();
+                }
+                ExprValue g2(pb::STRING);
+                if (rand() % 8 != 0) {
+                    g2.str_val = std::string(rand() % 5, 'k');
+                    row->set_value(0, 2, g2);
+                } else {
+                    g2 = ExprValue::Null();
+                }
+                AggExpect& e = (*expect)[group_key(g1, g2)];
+                ExprValue count(pb::INT64);
+                count._u.int64_val = rand() % 5;
+                row->set_value(1, 1, count);
+                e.count += count._u.int64_val;
+                if (rand() % 6 != 0) {
+                    ExprValue sum(pb::INT64);
+                    sum._u.int64_val = (int64_t)(rand() % 100) - 50;
+                    row->set_value(1, 2, sum);
+                    e.sum += sum._u.int64_val;
+                    e.has_sum = true;
+                }
+                if (rand() % 6 != 0) {
+                    ExprValue min(pb::INT64);
+                    min._u.int64_val = (int64_t)(rand() % 1000) - 500;
+                    ExprValue max(pb::INT64);
+                    max._u.int64_val = min._u.int64_val + rand() % 100;
+                    row->set_value(1, 3, min);
+                    row->set_value(1, 4, max);
+                    if (!e.has_min_max || min._u.int64_val < e.min) {
+                        e.min = min._u.int64_val;
+                    }
+                    if (!e.has_min_max || max._u.int64_val > e.max) {
+                        e.max = max._u.int64_val;
+                    }
+                    e.has_min_max = true;
+                }
+                TestAvgIntermediate avg;
+                avg.sum = (double)(rand() % 100);
+                avg.count = rand() % 3;
+                ExprValue avg_value(pb::STRING);
+                avg_value.str_val.assign((char*)&avg, sizeof(avg));
+                row->set_value(1, 5, avg_value);
+                e.avg_sum += avg.sum;
+                e.avg_count += avg.count;
+                batch->move_row(std::move(row));
+            }
+            batches.push_back(std::move(batch));
+        }
+        return batches;
+    }
+
+    // 返回open的结果, 成功时与逐行计算的结果比较
+    int run_and_check(int num_batches) {
+        RuntimeState state;
+        TransactionPool pool;
+        pb::StoreReq req;
+        EXPECT_EQ(0, state.init(req, _plan, _tuples, &pool, false));
+        std::map<std::string, AggExpect> expect;
+        auto batches = make_batches(state.mem_row_desc(), num_batches, &expect);
+        AggNode agg;
+        EXPECT_EQ(0, agg.init(_plan.nodes(0)));
+        agg.add_child(new BatchSourceNode(&batches));
+        int ret = agg.open(&state);
+        if (ret < 0) {
+            agg.close(&state);
+            return ret;
+        }
+        std::set<std::string> keys;
+        bool eos = false;
+        while (!eos) {
+            RowBatch batch;
+            EXPECT_EQ(0, agg.get_next(&state, &batch, &eos));
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                MemRow* row = batch.get_row().get();
+                std::string key = group_key(row->get_value(0, 1), row->get_value(0, 2));
+                // 各分区的key不相交, 每个分组只输出一次
+                EXPECT_TRUE(keys.insert(key).second) << key;
+                auto iter = expect.find(key);
+                if (iter == expect.end()) {
+                    ADD_FAILURE() << "unexpected group:" << key;
+                    continue;
+                }
+                const AggExpect& e = iter->second;
+                EXPECT_EQ(e.count, row->get_value(1, 1).get_numberic<int64_t>()) << key;
+                ExprValue sum = row->get_value(1, 2);
+                EXPECT_EQ(!e.has_sum, sum.is_null()) << key;
+                if (e.has_sum && !sum.is_null()) {
+                    EXPECT_EQ(e.sum, sum.get_numberic<int64_t>()) << key;
+                }
+                ExprValue min = row->get_value(1, 3);
+                ExprValue max = row->get_value(1, 4);
+                EXPECT_EQ(!e.has_min_max, min.is_null()) << key;
+                EXPECT_EQ(!e.has_min_max, max.is_null()) << key;
+                if (e.has_min_max && !min.is_null() && !max.is_null()) {
+                    EXPECT_EQ(e.min, min.get_numberic<int64_t>()) << key;
+                    EXPECT_EQ(e.max, max.get_numberic<int64_t>()) << key;
+                }
+                ExprValue avg = row->get_value(1, 6);
+                EXPECT_EQ(e.avg_count == 0, avg.is_null()) << key;
+                if (e.avg_count != 0 && !avg.is_null()) {
+                    EXPECT_DOUBLE_EQ(e.avg_sum / e.avg_count, avg.get_numberic<double>()) << key;
+                }
+            }
+        }
+        EXPECT_EQ(expect.size(), keys.size());
+        agg.close(&state);
+        return 0;
+    }
+
+    RepeatedPtrField<pb::TupleDescriptor> _tuples;
+    pb::Plan _plan;
+};
+
+// 不分区, 分区不落盘, 每轮都落盘, 偶尔落盘, 结果都与逐行计算一致
+TEST_F(AggSpillTest, partition_spill) {
+    struct Case {
+        int32_t partitions;
+        int32_t round_rows;
+        int32_t min_rows;
+        int64_t quota;
+    };
+    std::vector<Case> cases = {
+        {1, 16384, 2048, 0},
+        {4, 16384, 2048, 0},
+        // 单bthread聚合, 每轮结束都整体落盘
+        {4, 500, 100000, 1},
+        // 多bthread聚合
+        {8, 700, 1, 1},
+        {3, 1000, 2048, 20000},
+    };
+    for (auto& c : cases) {
+        FLAGS_agg_parallel_partitions = c.partitions;
+        FLAGS_agg_parallel_round_rows = c.round_rows;
+        FLAGS_agg_parallel_min_rows = c.min_rows;
+        FLAGS_agg_spill_memory_quota = c.quota;
+        EXPECT_EQ(0, run_and_check(23)) << c.partitions << " " << c.quota;
+    }
+    // 没有输入
+    FLAGS_agg_parallel_partitions = 4;
+    FLAGS_agg_spill_memory_quota = 1;
+    EXPECT_EQ(0, run_and_check(0));
+}
+
+// 落盘失败时open返回错误, 不输出部分结果
+TEST_F(AggSpillTest, spill_fail) {
+    // spill_dir的父路径是普通文件, 无法创建
+    std::string file = TEST_SPILL_DIR + "_file";
+    ASSERT_EQ(1, butil::WriteFile(butil::FilePath(file), "x", 1));
+    FLAGS_spill_dir = file + "/spill";
+    FLAGS_agg_parallel_partitions = 4;
+    FLAGS_agg_parallel_round_rows = 500;
+    FLAGS_agg_spill_memory_quota = 1;
+    EXPECT_EQ(-1, run_and_check(5));
+    // 不超过配额时不落盘
+    FLAGS_agg_spill_memory_quota = 0;
+    EXPECT_EQ(0, run_and_check(5));
+    butil::DeleteFile(butil::FilePath(file), false);
+}
+}  // namespace baikaldb
@@ -0,0 +1,192 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <brpc/server.h>
+#include "async_commit_resolver.h"
+#include "schema_factory.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    baikaldb::SchemaFactory::get_instance()->init();
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_int64(retry_interval_us);
+DECLARE_int64(async_commit_max_pending);
+DECLARE_int32(async_commit_max_retry);
+static const int64_t TEST_TABLE_ID = 3003;
+
+// 一个store: 按持有的region版本回复commit, 或者回复NOT_LEADER
+class FakeStoreService : public pb::StoreService {
+public:
+    virtual void query(google::protobuf::RpcController* controller,
+            const pb::StoreReq* request,
+            pb::StoreRes* response,
+            google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        BAIDU_SCOPED_LOCK(mutex);
+        requests.push_back(*request);
+        if (!not_leader.empty()) {
+            response->set_errcode(pb::NOT_LEADER);
+            response->set_leader(not_leader);
+            return;
+        }
+        auto iter = regions.find(request->region_id());
+        if (iter == regions.end()) {
+            response->set_errcode(pb::REGION_NOT_EXIST);
+            return;
+        }
+        if (request->region_version() < iter->second.version()) {
+            // 分裂后返回本store上的新region
+            response->set_errcode(pb::VERSION_OLD);
+            response->set_leader(addr);
+            for (auto& pair : regions) {
+                *response->add_regions() = pair.second;
+            }
+            return;
+        }
+        response->set_errcode(pb::SUCCESS);
+        committed.push_back(request->region_id());
+    }
+
+    bthread::Mutex mutex;
+    std::string addr;
+    // 非空时回复NOT_LEADER, 指向该地址
+    std::string not_leader;
+    std::map<int64_t, pb::RegionInfo> regions;
+    std::vector<pb::StoreReq> requests;
+    std::vector<int64_t> committed;
+};
+
+class AsyncCommitResolverTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_retry_interval_us = 1000;
+        for (int i = 0; i < 2; ++i) {
+            ASSERT_EQ(0, _servers[i].AddService(&_services[i], brpc::SERVER_DOESNT_OWN_SERVICE));
+            ASSERT_EQ(0, _servers[i].Start(butil::PortRange(18000, 19000), nullptr));
+            _services[i].addr = "127.0.0.1:" + std::to_string(_servers[i].listen_address().port);
+        }
+    }
+    void TearDown() override {
+        FLAGS_retry_interval_us = 500 * 1000;
+        FLAGS_async_commit_max_retry = 20;
+        FLAGS_async_commit_max_pending = 10000;
+        for (int i = 0; i < 2; ++i) {
+            _servers[i].Stop(0);
+            _servers[i].Join();
+        }
+    }
+
+    // 两个store上都有的region, 版本为version
+    pb::RegionInfo region_info(int64_t region_id, int64_t version,
+            const std::string& start_key, const std::string& end_key) {
+        pb::RegionInfo info;
+        info.set_region_id(region_id);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_version(version);
+        info.set_start_key(start_key);
+        info.set_end_key(end_key);
+        info.set_leader(_services[0].addr);
+        info.add_peers(_services[0].addr);
+        info.add_peers(_services[1].addr);
+        return info;
+    }
+    SmartAsyncCommitTask commit_task(const pb::RegionInfo& info) {
+        SmartAsyncCommitTask task = std::make_shared<AsyncCommitTask>();
+        task->request.set_op_type(pb::OP_COMMIT);
+        task->request.set_region_id(info.region_id());
+        task->request.set_region_version(info.version());
+        task->request.add_txn_infos()->set_txn_id(123);
+        task->info = info;
+        return task;
+    }
+    // 等待后台commit全部结束
+    bool wait_resolved() {
+        for (int i = 0; i < 500; ++i) {
+            if (AsyncCommitResolver::get_instance()->pending() == 0) {
+                return true;
+            }
+            bthread_usleep(10 * 1000);
+        }
+        return false;
+    }
+
+    FakeStoreService _services[2];
+    brpc::Server _servers[2];
+};
+
+// NOT_LEADER时跟随返回的新leader重试
+TEST_F(AsyncCommitResolverTest, not_leader) {
+    pb::RegionInfo info = region_info(1, 1, "", "");
+    _services[0].not_leader = _services[1].addr;
+    _services[1].regions[1] = info;
+    ASSERT_TRUE(AsyncCommitResolver::get_instance()->add_tasks({commit_task(info)}));
+    ASSERT_TRUE(wait_resolved());
+
+    BAIDU_SCOPED_LOCK(_services[0].mutex);
+    BAIDU_SCOPED_LOCK(_services[1].mutex);
+    EXPECT_EQ(1u, _services[0].requests.size());
+    EXPECT_TRUE(_services[0].committed.empty());
+    EXPECT_EQ(std::vector<int64_t>({1}), _services[1].committed);
+    ASSERT_EQ(1u, _services[1].requests.size());
+    EXPECT_EQ(123u, _services[1].requests[0].txn_infos(0).txn_id());
+}
+
+// region分裂后VERSION_OLD: 按新版本重试自身, 分裂出的region也要commit
+TEST_F(AsyncCommitResolverTest, region_split) {
+    pb::RegionInfo old_info = region_info(1, 1, "", "");
+    _services[0].regions[1] = region_info(1, 2, "", "m");
+    _services[0].regions[5] = region_info(5, 1, "m", "");
+    ASSERT_TRUE(AsyncCommitResolver::get_instance()->add_tasks({commit_task(old_info)}));
+    ASSERT_TRUE(wait_resolved());
+
+    BAIDU_SCOPED_LOCK(_services[0].mutex);
+    std::vector<int64_t> committed = _services[0].committed;
+    std::sort(committed.begin(), committed.end());
+    EXPECT_EQ(std::vector<int64_t>({1, 5}), committed);
+    ASSERT_EQ(3u, _services[0].requests.size());
+    EXPECT_EQ(1, _services[0].requests[0].region_version());
+    for (size_t i = 1; i < _services[0].requests.size(); ++i) {
+        auto& request = _services[0].requests[i];
+        EXPECT_EQ(request.region_id() == 1 ? 2 : 1, request.region_version());
+        EXPECT_EQ(123u, request.txn_infos(0).txn_id());
+    }
+}
+
+// 超过重试次数后放弃, 交给store端通过primary region处理
+TEST_F(AsyncCommitResolverTest, give_up) {
+    FLAGS_async_commit_max_retry = 3;
+    pb::RegionInfo info = region_info(1, 1, "", "");
+    _services[0].not_leader = _services[0].addr;
+    int64_t fail_count = AsyncCommitResolver::async_commit_fail_count.get_value();
+    ASSERT_TRUE(AsyncCommitResolver::get_instance()->add_tasks({commit_task(info)}));
+    ASSERT_TRUE(wait_resolved());
+    EXPECT_EQ(fail_count + 1, AsyncCommitResolver::async_commit_fail_count.get_value());
+    BAIDU_SCOPED_LOCK(_services[0].mutex);
+    EXPECT_EQ(3u, _services[0].requests.size());
+}
+
+// 积压过多时不接收, 由调用方同步commit
+TEST_F(AsyncCommitResolverTest, max_pending) {
+    FLAGS_async_commit_max_pending = 1;
+    pb::RegionInfo info = region_info(1, 1, "", "");
+    EXPECT_FALSE(AsyncCommitResolver::get_instance()->add_tasks({commit_task(info), commit_task(info)}));
+    EXPECT_EQ(0, AsyncCommitResolver::get_instance()->pending());
+}
+}  // namespace baikaldb
@@ -0,0 +1,349 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "mem_row_descriptor.h"
+#include "row_batch.h"
+#include "column_batch.h"
+#include "expr_node.h"
+#include "scalar_fn_call.h"
+#include "fn_manager.h"
+#include "rocksdb_scan_node.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    baikaldb::FunctionManager::instance()->init();
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// slot_id从1开始, 依次为 a:INT32 b:INT64 c:UINT64 d:DOUBLE e:UINT8 f:FLOAT s:STRING
+static const pb::PrimitiveType SLOT_TYPES[] = {
+    pb::INT32, pb::INT64, pb::UINT64, pb::DOUBLE, pb::UINT8, pb::FLOAT, pb::STRING};
+static const int SLOT_NUM = 7;
+static const int ROW_NUM = 300;
+
+// 按先根序构造pb::Expr
+class ExprBuilder {
+public:
+    ExprBuilder& fn(const std::string& name, int fn_op, int num_children) {
+        pb::ExprNode* node = _expr.add_nodes();
+        node->set_node_type(pb::FUNCTION_CALL);
+        node->set_col_type(pb::INVALID_TYPE);
+        node->set_num_children(num_children);
+        node->mutable_fn()->set_name(name);
+        node->mutable_fn()->set_fn_op(fn_op);
+        return *this;
+    }
+    ExprBuilder& slot(int slot_id) {
+        pb::ExprNode* node = _expr.add_nodes();
+        node->set_node_type(pb::SLOT_REF);
+        node->set_col_type(SLOT_TYPES[slot_id - 1]);
+        node->set_num_children(0);
+        node->mutable_derive_node()->set_tuple_id(0);
+        node->mutable_derive_node()->set_slot_id(slot_id);
+        return *this;
+    }
+    ExprBuilder& int_val(int64_t val) {
+        pb::ExprNode* node = literal(pb::INT_LITERAL, pb::INT64);
+        node->mutable_derive_node()->set_int_val(val);
+        return *this;
+    }
+    ExprBuilder& double_val(double val) {
+        pb::ExprNode* node = literal(pb::DOUBLE_LITERAL, pb::DOUBLE);
+        node->mutable_derive_node()->set_double_val(val);
+        return *this;
+    }
+    ExprBuilder& string_val(const std::string& val) {
+        pb::ExprNode* node = literal(pb::STRING_LITERAL, pb::STRING);
+        node->mutable_derive_node()->set_string_val(val);
+        return *this;
+    }
+    ExprBuilder& null_val() {
+        literal(pb::NULL_LITERAL, pb::NULL_TYPE);
+        return *this;
+    }
+    const pb::Expr& expr() const {
+        return _expr;
+    }
+
+private:
+    pb::ExprNode* literal(pb::ExprNodeType node_type, pb::PrimitiveType col_type) {
+        pb::ExprNode* node = _expr.add_nodes();
+        node->set_node_type(node_type);
+        node->set_col_type(col_type);
+        node->set_num_children(0);
+        return node;
+    }
+    pb::Expr _expr;
+};
+
+class BatchFilterTest : public testing::Test {
+protected:
+    void SetUp() override {
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(0);
+        tuple.set_table_id(1);
+        for (int slot_id = 1; slot_id <= SLOT_NUM; ++slot_id) {
+            pb::SlotDescriptor* slot = tuple.add_slots();
+            slot->set_slot_id(slot_id);
+            slot->set_tuple_id(0);
+            slot->set_slot_type(SLOT_TYPES[slot_id - 1]);
+        }
+        _tuple_descs.push_back(tuple);
+        ASSERT_EQ(0, _desc.init(_tuple_descs));
+        for (int i = 0; i < ROW_NUM; ++i) {
+            std::unique_ptr<MemRow> row = _desc.fetch_mem_row();
+            // 每列按不同间隔置null
+            if (i % 5 != 0) {
+                ExprValue v(pb::INT32);
+                v._u.int32_val = i % 41 - 20;
+                row->set_value(0, 1, v);
+            }
+            if (i % 7 != 1) {
+                ExprValue v(pb::INT64);
+                v._u.int64_val = (i % 2 == 0 ? -1 : 1) * (int64_t)i * 100003;
+                row->set_value(0, 2, v);
+            }
+            if (i % 11 != 2) {
+                // 包含超过INT64_MAX的值
+                ExprValue v(pb::UINT64);
+                v._u.uint64_val = i % 3 == 0 ? UINT64_MAX - i : (uint64_t)i;
+                row->set_value(0, 3, v);
+            }
+            if (i % 13 != 3) {
+                ExprValue v(pb::DOUBLE);
+                v._u.double_val = (i % 29) * 0.5 - 7;
+                row->set_value(0, 4, v);
+            }
+            if (i % 17 != 4) {
+                ExprValue v(pb::UINT8);
+                v._u.uint8_val = (uint8_t)(i * 7);
+                row->set_value(0, 5, v);
+            }
+            if (i % 19 != 5) {
+                ExprValue v(pb::FLOAT);
+                v._u.float_val = (i % 23) * 0.25f - 2;
+                row->set_value(0, 6, v);
+            }
+            if (i % 4 != 0) {
+                ExprValue v(pb::STRING);
+                v.str_val = std::to_string(i % 37 - 10);
+                row->set_value(0, 7, v);
+            }
+            _rows.move_row(std::move(row));
+        }
+    }
+
+    ExprNode* create(const ExprBuilder& builder) {
+        ExprNode* expr = nullptr;
+        EXPECT_EQ(0, ExprNode::create_tree(builder.expr(), &expr));
+        if (expr == nullptr) {
+            return nullptr;
+        }
+        EXPECT_EQ(0, expr->type_inferer());
+        EXPECT_EQ(0, expr->open());
+        _exprs.emplace_back(expr);
+        return expr;
+    }
+
+    // 与FilterNode::need_copy相同的逐行语义
+    SelectVector filter_by_row(const std::vector<ExprNode*>& conjuncts) {
+        SelectVector sel;
+        for (size_t i = 0; i < _rows.size(); ++i) {
+            bool selected = true;
+            for (auto conjunct : conjuncts) {
+                ExprValue value = conjunct->get_value(_rows.get_row(i).get());
+                if (value.is_null() || value.get_numberic<bool>() == false) {
+                    selected = false;
+                    break;
+                }
+            }
+            if (selected) {
+                sel.push_back(i);
+            }
+        }
+        return sel;
+    }
+
+    // 与FilterNode::batch_filter相同, 多个条件共用一个ColumnBatch
+    SelectVector filter_by_batch(const std::vector<ExprNode*>& conjuncts, ColumnBatch* columns) {
+        SelectVector sel(_rows.size());
+        for (size_t i = 0; i < _rows.size(); ++i) {
+            sel[i] = i;
+        }
+        columns->reset();
+        for (auto conjunct : conjuncts) {
+            if (sel.empty()) {
+                break;
+            }
+            EXPECT_EQ(0, conjunct->filter_batch(&_rows, columns, &sel));
+        }
+        return sel;
+    }
+
+    void check(const std::vector<ExprNode*>& conjuncts) {
+        SelectVector expect = filter_by_row(conjuncts);
+        ColumnBatch columns;
+        SelectVector result = filter_by_batch(conjuncts, &columns);
+        EXPECT_EQ(expect, result);
+        // 复用ColumnBatch和表达式的结果缓冲区, 第二个batch结果不变
+        EXPECT_EQ(expect, filter_by_batch(conjuncts, &columns));
+    }
+
+    void check(const ExprBuilder& builder, bool batch) {
+        ExprNode* expr = create(builder);
+        ASSERT_TRUE(expr != nullptr);
+        EXPECT_EQ(batch, expr->support_eval_batch()) << builder.expr().ShortDebugString();
+        check(std::vector<ExprNode*>{expr});
+    }
+
+    void TearDown() override {
+        for (auto& expr : _exprs) {
+            expr->close();
+        }
+    }
+
+    std::vector<pb::TupleDescriptor> _tuple_descs;
+    MemRowDescriptor _desc;
+    RowBatch _rows;
+    std::vector<std::unique_ptr<ExprNode>> _exprs;
+};
+
+TEST_F(BatchFilterTest, compare_with_null) {
+    const int ops[] = {parser::FT_EQ, parser::FT_NE, parser::FT_GT,
+        parser::FT_GE, parser::FT_LT, parser::FT_LE};
+    const char* names[] = {"eq", "ne", "gt", "ge", "lt", "le"};
+    for (int i = 0; i < 6; ++i) {
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(1).int_val(3), true);
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(2).slot(1), true);
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(3).int_val(100), true);
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(4).double_val(-1.5), true);
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(6).slot(4), true);
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(5).slot(3), true);
+        // 与null常量比较全部过滤, null常量没有列类型, 走逐行
+        check(ExprBuilder().fn(names[i], ops[i], 2).slot(1).null_val(), false);
+    }
+}
+
+TEST_F(BatchFilterTest, mixed_type) {
+    // int与uint比较统一成uint64, 负数不能直接按位比较, 走逐行
+    check(ExprBuilder().fn("gt", parser::FT_GT, 2).slot(1).slot(3), false);
+    check(ExprBuilder().fn("lt", parser::FT_LT, 2).slot(2).slot(3), false);
+    check(ExprBuilder().fn("eq", parser::FT_EQ, 2).slot(2).slot(5), false);
+    // int与double
+    check(ExprBuilder().fn("ge", parser::FT_GE, 2).slot(1).slot(4), false);
+    check(ExprBuilder().fn("lt", parser::FT_LT, 2).slot(2).double_val(2.5), true);
+    check(ExprBuilder().fn("eq", parser::FT_EQ, 2).slot(4).int_val(-7), true);
+    // uint列与负数常量
+    check(ExprBuilder().fn("gt", parser::FT_GT, 2).slot(3).int_val(-1), true);
+    // 算术结果再比较
+    check(ExprBuilder().fn("gt", parser::FT_GT, 2)
+            .fn("add", parser::FT_ADD, 2).slot(1).slot(2).int_val(0), true);
+    check(ExprBuilder().fn("le", parser::FT_LE, 2)
+            .fn("multiplies", parser::FT_MULTIPLIES, 2).slot(4).slot(6).double_val(3), true);
+    check(ExprBuilder().fn("ne", parser::FT_NE, 2)
+            .fn("minus", parser::FT_MINUS, 2).slot(3).slot(5).int_val(0), true);
+    check(ExprBuilder().fn("ge", parser::FT_GE, 2)
+            .fn("minus", parser::FT_MINUS, 2).slot(1).slot(4).slot(2), false);
+}
+
+TEST_F(BatchFilterTest, row_fallback) {
+    // 字符串和逻辑运算没有列式实现
+    check(ExprBuilder().fn("eq", parser::FT_EQ, 2).slot(7).string_val("5"), false);
+    check(ExprBuilder().fn("gt", parser::FT_GT, 2).slot(7).slot(1), false);
+    check(ExprBuilder().fn("logic_and", parser::FT_LOGIC_AND, 2)
+            .fn("gt", parser::FT_GT, 2).slot(1).int_val(0)
+            .fn("lt", parser::FT_LT, 2).slot(4).double_val(3), false);
+    check(ExprBuilder().fn("logic_or", parser::FT_LOGIC_OR, 2)
+            .fn("eq", parser::FT_EQ, 2).slot(1).null_val()
+            .fn("ne", parser::FT_NE, 2).slot(3).int_val(5), false);
+    check(ExprBuilder().fn("logic_not", parser::FT_LOGIC_NOT, 1)
+            .fn("le", parser::FT_LE, 2).slot(2).int_val(0), false);
+    // 没有列式实现的算术结果直接作为条件
+    check(ExprBuilder().fn("divides", parser::FT_DIVIDES, 2).slot(2).slot(1), false);
+    // 逐行计算的子表达式结果参与列式比较
+    check(ExprBuilder().fn("gt", parser::FT_GT, 2)
+            .fn("divides", parser::FT_DIVIDES, 2).slot(2).slot(1).double_val(1), true);
+}
+
+TEST_F(BatchFilterTest, conjuncts) {
+    // 同一列被多个条件引用, 列只转置一次; 列式与逐行条件交替
+    std::vector<ExprNode*> conjuncts;
+    conjuncts.push_back(create(ExprBuilder().fn("gt", parser::FT_GT, 2).slot(1).int_val(-15)));
+    conjuncts.push_back(create(ExprBuilder().fn("eq", parser::FT_EQ, 2).slot(7).string_val("3")));
+    conjuncts.push_back(create(ExprBuilder().fn("lt", parser::FT_LT, 2).slot(1).int_val(15)));
+    conjuncts.push_back(create(ExprBuilder().fn("ne", parser::FT_NE, 2).slot(4).slot(6)));
+    for (auto conjunct : conjuncts) {
+        ASSERT_TRUE(conjunct != nullptr);
+    }
+    check(conjuncts);
+    std::vector<ExprNode*> reversed(conjuncts.rbegin(), conjuncts.rend());
+    check(reversed);
+    // 第一个条件过滤掉全部行
+    conjuncts.insert(conjuncts.begin(),
+            create(ExprBuilder().fn("gt", parser::FT_GT, 2).slot(5).int_val(1000)));
+    check(conjuncts);
+    EXPECT_TRUE(filter_by_row(conjuncts).empty());
+}
+
+// 列存扫描: 过滤列由TableIterator按列产出, 条件直接使用产出的列, 结果记入FiltBitSet
+TEST_F(BatchFilterTest, scan_produced_columns) {
+    std::vector<ExprNode*> conjuncts;
+    conjuncts.push_back(create(ExprBuilder().fn("gt", parser::FT_GT, 2).slot(2).int_val(0)));
+    conjuncts.push_back(create(ExprBuilder().fn("lt", parser::FT_LT, 2).slot(1).int_val(15)));
+    conjuncts.push_back(create(ExprBuilder().fn("ne", parser::FT_NE, 2).slot(7).string_val("3")));
+    for (auto conjunct : conjuncts) {
+        ASSERT_TRUE(conjunct != nullptr);
+    }
+    // 与TableIterator::get_column一致, 按行号写入刚解码的字段
+    auto produce = [this](ColumnBatch* columns, int32_t slot_id) {
+        ColumnVector* column = columns->add_column(0, slot_id, SLOT_TYPES[slot_id - 1]);
+        for (size_t i = 0; i < _rows.size(); ++i) {
+            column->set_value(i, _rows.get_row(i)->get_value(0, slot_id));
+        }
+        return column;
+    };
+    SelectVector expect = filter_by_row(conjuncts);
+    ColumnBatch columns;
+    for (int round = 0; round < 2; ++round) {
+        // 复用上一个batch的列
+        columns.reset();
+        columns.set_num_rows(_rows.size());
+        ColumnVector* b = produce(&columns, 2);
+        produce(&columns, 1);
+        FiltBitSet filter;
+        ASSERT_EQ(0, RocksdbScanNode::batch_need_copy(&_rows, &columns, conjuncts, &filter));
+        SelectVector result;
+        for (size_t i = 0; i < _rows.size(); ++i) {
+            if (!filter.test(i)) {
+                result.push_back(i);
+            }
+        }
+        EXPECT_EQ(expect, result) << round;
+        // 产出的列没有被重新转置
+        EXPECT_EQ(b, columns.get_column(0, 2));
+    }
+
+    // 条件用的是产出的列而不是行: b列全部为null时全部过滤
+    columns.reset();
+    columns.set_num_rows(_rows.size());
+    columns.add_column(0, 2, pb::INT64);
+    FiltBitSet filter;
+    ASSERT_EQ(0, RocksdbScanNode::batch_need_copy(&_rows, &columns, conjuncts, &filter));
+    EXPECT_EQ(_rows.size(), filter.count());
+}
+}  // namespace baikaldb
@@ -0,0 +1,53 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <random>
+#include "bloom_filter.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+TEST(test_bloom_filter, add_and_check) {
+    BloomFilter bloom_filter;
+    bloom_filter.init(100000, 0.01);
+    std::mt19937_64 gen(1);
+    std::vector<uint64_t> hashes;
+    for (int i = 0; i < 100000; ++i) {
+        hashes.emplace_back(gen());
+        bloom_filter.add(hashes.back());
+    }
+    // 不能漏判
+    for (auto hash : hashes) {
+        EXPECT_TRUE(bloom_filter.may_contain(hash));
+    }
+    int false_positive = 0;
+    for (int i = 0; i < 100000; ++i) {
+        false_positive += bloom_filter.may_contain(gen());
+    }
+    EXPECT_LT(false_positive, 2000);
+
+    // 序列化后结果一致
+    BloomFilter copy;
+    ASSERT_EQ(copy.init_from_string(bloom_filter.bits(), bloom_filter.num_hashes()), 0);
+    for (auto hash : hashes) {
+        EXPECT_TRUE(copy.may_contain(hash));
+    }
+    EXPECT_EQ(copy.init_from_string("", 3), -1);
+}
+}  // namespace baikaldb
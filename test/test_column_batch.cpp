@@ -0,0 +1,107 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <vector>
+#include "mem_row.h"
+#include "mem_row_descriptor.h"
+#include "row_batch.h"
+#include "column_batch.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+TEST(test_column_batch, null_bitmap) {
+    ColumnVector column(pb::INT64);
+    column.resize(130);
+    for (size_t i = 0; i < 130; ++i) {
+        EXPECT_TRUE(column.is_null(i));
+    }
+    ExprValue value(pb::INT64);
+    value._u.int64_val = -7;
+    column.set_value(64, value);
+    EXPECT_FALSE(column.is_null(64));
+    EXPECT_EQ(column.get_value(64).get_numberic<int64_t>(), -7);
+    column.resize(10);
+    column.resize(70);
+    for (size_t i = 10; i < 70; ++i) {
+        EXPECT_TRUE(column.is_null(i));
+    }
+}
+
+TEST(test_column_batch, from_row_batch) {
+    std::vector<pb::TupleDescriptor> tuple_descs;
+    pb::TupleDescriptor tuple;
+    tuple.set_tuple_id(0);
+    tuple.set_table_id(1);
+    pb::PrimitiveType types[] = {pb::INT32, pb::UINT64, pb::DOUBLE, pb::STRING};
+    for (int slot_id = 1; slot_id <= 4; ++slot_id) {
+        pb::SlotDescriptor* slot = tuple.add_slots();
+        slot->set_slot_id(slot_id);
+        slot->set_tuple_id(0);
+        slot->set_slot_type(types[slot_id - 1]);
+    }
+    tuple_descs.push_back(tuple);
+    MemRowDescriptor desc;
+    ASSERT_EQ(desc.init(tuple_descs), 0);
+
+    RowBatch batch;
+    for (int i = 0; i < 100; ++i) {
+        std::unique_ptr<MemRow> row = desc.fetch_mem_row();
+        ExprValue v1(pb::INT32);
+        v1._u.int32_val = i - 50;
+        row->set_value(0, 1, v1);
+        ExprValue v2(pb::UINT64);
+        v2._u.uint64_val = i * 1000;
+        row->set_value(0, 2, v2);
+        if (i % 3 != 0) {
+            ExprValue v3(pb::DOUBLE);
+            v3._u.double_val = i * 0.5;
+            row->set_value(0, 3, v3);
+        }
+        ExprValue v4(pb::STRING);
+        v4.str_val = "row_" + std::to_string(i);
+        row->set_value(0, 4, v4);
+        batch.move_row(std::move(row));
+    }
+
+    ColumnBatch columns;
+    ASSERT_EQ(columns.from_row_batch(&batch, tuple_descs), 0);
+    EXPECT_EQ(columns.size(), 100u);
+    ColumnVector* c1 = columns.get_column(0, 1);
+    ColumnVector* c3 = columns.get_column(0, 3);
+    ColumnVector* c4 = columns.get_column(0, 4);
+    ASSERT_TRUE(c1 != nullptr && c3 != nullptr && c4 != nullptr);
+    EXPECT_EQ(c1->int_data()[7], -43);
+    EXPECT_TRUE(c3->is_null(3));
+    EXPECT_DOUBLE_EQ(c3->double_data()[4], 2.0);
+    EXPECT_EQ(c4->str_data()[99], "row_99");
+
+    ColumnVector* c2 = columns.get_column(0, 2);
+    ASSERT_TRUE(c2 != nullptr);
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(c1->int_data()[i], i - 50);
+        EXPECT_EQ(c2->uint_data()[i], (uint64_t)i * 1000);
+        EXPECT_EQ(c3->is_null(i), i % 3 == 0);
+        EXPECT_EQ(c4->str_data()[i], "row_" + std::to_string(i));
+    }
+    // 重复load复用同一个列
+    EXPECT_EQ(columns.load_column(&batch, 0, 1, pb::INT32), 0);
+    EXPECT_EQ(columns.get_column(0, 1), c1);
+}
+}  // namespace baikaldb
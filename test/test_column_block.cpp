@@ -0,0 +1,138 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "column_block.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// tuple 0: slot 1 int64, slot 2 string, slot 3 double, slot 4 uint32, slot 5 bool
+static int init_desc(MemRowDescriptor* desc) {
+    std::vector<pb::TupleDescriptor> tuple_desc;
+    pb::TupleDescriptor tuple;
+    tuple.set_tuple_id(0);
+    tuple.set_table_id(1);
+    pb::PrimitiveType types[] = {pb::INT64, pb::STRING, pb::DOUBLE, pb::UINT32, pb::BOOL};
+    for (int i = 0; i < 5; ++i) {
+        pb::SlotDescriptor* slot = tuple.add_slots();
+        slot->set_slot_id(i + 1);
+        slot->set_slot_type(types[i]);
+        slot->set_tuple_id(0);
+    }
+    tuple_desc.push_back(tuple);
+    return desc->init(tuple_desc);
+}
+
+static std::unique_ptr<MemRow> make_row(MemRowDescriptor* desc, int i) {
+    std::unique_ptr<MemRow> row = desc->fetch_mem_row();
+    google::protobuf::Message* tuple = row->get_tuple(0);
+    auto reflection = tuple->GetReflection();
+    auto descriptor = tuple->GetDescriptor();
+    // 每7行一个null
+    if (i % 7 != 0) {
+        reflection->SetInt64(tuple, descriptor->FindFieldByNumber(1), i / 10);
+    }
+    reflection->SetString(tuple, descriptor->FindFieldByNumber(2), "city_" + std::to_string(i % 3));
+    reflection->SetDouble(tuple, descriptor->FindFieldByNumber(3), i * 1.5);
+    reflection->SetUInt32(tuple, descriptor->FindFieldByNumber(4), i);
+    reflection->SetBool(tuple, descriptor->FindFieldByNumber(5), i % 2);
+    return row;
+}
+
+TEST(test_column_block, encode_decode) {
+    MemRowDescriptor desc;
+    ASSERT_EQ(init_desc(&desc), 0);
+    std::vector<std::unique_ptr<MemRow>> src_rows;
+    ColumnBlockEncoder encoder;
+    ASSERT_EQ(encoder.init(&desc), 0);
+    for (int i = 0; i < 100; ++i) {
+        src_rows.emplace_back(make_row(&desc, i));
+        encoder.add_row(src_rows.back().get());
+    }
+    pb::ColumnBlock block;
+    encoder.finish(&block);
+    EXPECT_EQ(block.num_rows(), 100);
+    EXPECT_EQ(encoder.num_rows(), 0);
+    ASSERT_EQ(block.columns_size(), 5);
+    // int列按i/10分段, 使用游程编码
+    EXPECT_GT(block.columns(0).run_lengths_size(), 0);
+    EXPECT_TRUE(block.columns(0).has_null_bitmap());
+    // 字符串列只有3个不同值, 使用字典编码
+    EXPECT_EQ(block.columns(1).dict_size(), 3);
+    EXPECT_EQ(block.columns(1).str_values_size(), 0);
+    // double列全不同, 原样输出
+    EXPECT_EQ(block.columns(2).double_values_size(), 100);
+    EXPECT_EQ(block.columns(2).run_lengths_size(), 0);
+
+    std::string wire;
+    ASSERT_TRUE(block.SerializeToString(&wire));
+    pb::ColumnBlock parsed;
+    ASSERT_TRUE(parsed.ParseFromString(wire));
+    std::vector<std::unique_ptr<MemRow>> rows;
+    ASSERT_EQ(ColumnBlockDecoder::decode(&desc, parsed, nullptr, &rows), 0);
+    ASSERT_EQ(rows.size(), 100);
+    for (int i = 0; i < 100; ++i) {
+        std::string expect;
+        std::string actual;
+        src_rows[i]->to_string(0, &expect);
+        rows[i]->to_string(0, &actual);
+        EXPECT_EQ(expect, actual) << "row " << i;
+    }
+}
+
+TEST(test_column_block, reject_merged_block) {
+    MemRowDescriptor desc;
+    ASSERT_EQ(init_desc(&desc), 0);
+    ColumnBlockEncoder encoder;
+    ASSERT_EQ(encoder.init(&desc), 0);
+    std::vector<std::unique_ptr<MemRow>> src_rows;
+    for (int i = 0; i < 10; ++i) {
+        src_rows.emplace_back(make_row(&desc, i));
+        encoder.add_row(src_rows.back().get());
+    }
+    pb::ColumnBlock block;
+    encoder.finish(&block);
+    // 模拟backup_request把两个response merge到一起
+    pb::ColumnBlock merged = block;
+    merged.MergeFrom(block);
+    std::vector<std::unique_ptr<MemRow>> rows;
+    EXPECT_EQ(ColumnBlockDecoder::decode(&desc, merged, nullptr, &rows), -1);
+    EXPECT_EQ(rows.size(), 0);
+    // 值个数与行数不符
+    pb::ColumnBlock broken = block;
+    broken.set_num_rows(11);
+    EXPECT_EQ(ColumnBlockDecoder::decode(&desc, broken, nullptr, &rows), -1);
+    EXPECT_EQ(rows.size(), 0);
+}
+
+TEST(test_column_block, empty_block) {
+    MemRowDescriptor desc;
+    ASSERT_EQ(init_desc(&desc), 0);
+    ColumnBlockEncoder encoder;
+    ASSERT_EQ(encoder.init(&desc), 0);
+    pb::ColumnBlock block;
+    encoder.finish(&block);
+    EXPECT_EQ(block.num_rows(), 0);
+    std::vector<std::unique_ptr<MemRow>> rows;
+    EXPECT_EQ(ColumnBlockDecoder::decode(&desc, block, nullptr, &rows), 0);
+    EXPECT_EQ(rows.size(), 0);
+}
+}  // namespace baikaldb
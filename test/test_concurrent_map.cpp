@@ -0,0 +1,217 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+#include "common.h"
+#include "concurrent_map.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+TEST(test_concurrent_map, basic) {
+    ConcurrentMap<int64_t, std::shared_ptr<int64_t>> map;
+    EXPECT_EQ(map.get(1), nullptr);
+    EXPECT_FALSE(map.exist(1));
+    map.set(1, std::make_shared<int64_t>(10));
+    EXPECT_EQ(*map.get(1), 10);
+    EXPECT_EQ(map.count(1), 1);
+    bool ret = map.insert_init_if_not_exist(1, [](std::shared_ptr<int64_t>& value) {
+        value = std::make_shared<int64_t>(11);
+        return 0;
+    });
+    EXPECT_FALSE(ret);
+    EXPECT_EQ(*map.get(1), 10);
+    // init失败不插入
+    ret = map.insert_init_if_not_exist(2, [](std::shared_ptr<int64_t>& value) {
+        return -1;
+    });
+    EXPECT_FALSE(ret);
+    EXPECT_FALSE(map.exist(2));
+    ret = map.insert_init_if_not_exist(2, [](std::shared_ptr<int64_t>& value) {
+        value = std::make_shared<int64_t>(20);
+        return 0;
+    });
+    EXPECT_TRUE(ret);
+    EXPECT_EQ(map.size(), 2);
+
+    auto value = map.get_or_put_call(3, [](std::shared_ptr<int64_t>& value) {
+        value = std::make_shared<int64_t>(30);
+        return value;
+    });
+    EXPECT_EQ(*value, 30);
+    value = map.get_or_put_call(3, [](std::shared_ptr<int64_t>& value) {
+        value = std::make_shared<int64_t>(31);
+        return value;
+    });
+    EXPECT_EQ(*value, 30);
+
+    // value为shared_ptr, 回调修改的是同一个对象
+    EXPECT_TRUE(map.call_and_get(1, [](std::shared_ptr<int64_t>& value) {
+        *value += 1;
+    }));
+    EXPECT_EQ(*map.get(1), 11);
+    EXPECT_FALSE(map.call_and_get(4, [](std::shared_ptr<int64_t>& value) {}));
+
+    int64_t sum = 0;
+    map.traverse([&sum](std::shared_ptr<int64_t>& value) {
+        sum += *value;
+    });
+    EXPECT_EQ(sum, 61);
+    int64_t key_sum = 0;
+    map.traverse_with_key_value([&key_sum](const int64_t& key, std::shared_ptr<int64_t>& value) {
+        key_sum += key;
+    });
+    EXPECT_EQ(key_sum, 6);
+
+    int64_t erased_value = 0;
+    EXPECT_TRUE(map.call_and_erase(2, [&erased_value](std::shared_ptr<int64_t>& value) {
+        erased_value = *value;
+    }));
+    EXPECT_EQ(erased_value, 20);
+    EXPECT_FALSE(map.exist(2));
+    EXPECT_EQ(map.erase(3), 1);
+    EXPECT_EQ(map.erase(3), 0);
+    EXPECT_EQ(map.size(), 1);
+    map.clear();
+    EXPECT_EQ(map.size(), 0);
+}
+
+TEST(test_concurrent_map, concurrent_read_write) {
+    ConcurrentMap<int64_t, std::shared_ptr<int64_t>> map;
+    const int64_t key_count = 1000;
+    for (int64_t i = 0; i < key_count; ++i) {
+        map.set(i, std::make_shared<int64_t>(i));
+    }
+    std::atomic<int64_t> wrong_count(0);
+    ConcurrencyBthread con_bth(64);
+    for (int t = 0; t < 64; ++t) {
+        con_bth.run([&map, &wrong_count, t, key_count]() {
+            for (int64_t i = 0; i < 5000; ++i) {
+                int64_t key = (i * 64 + t) % key_count;
+                if (t % 8 == 0) {
+                    // 写者反复删除再插入不在读者范围内的key
+                    int64_t write_key = key_count + t * 5000 + i;
+                    map.set(write_key, std::make_shared<int64_t>(write_key));
+                    map.erase(write_key);
+                    continue;
+                }
+                auto value = map.get(key);
+                if (value == nullptr || *value != key) {
+                    wrong_count++;
+                }
+            }
+        });
+    }
+    con_bth.join();
+    EXPECT_EQ(wrong_count.load(), 0);
+    EXPECT_EQ(map.size(), key_count);
+}
+
+// 64个bthread下ThreadSafeMap与ConcurrentMap的get/insert/traverse耗时对比
+template <typename MAP>
+static void bench_map(const char* name, MAP& map, int bthread_num, int64_t key_count) {
+    typedef std::shared_ptr<int64_t> Value;
+    auto init_call = [](Value& value) {
+        value = std::make_shared<int64_t>(0);
+        return 0;
+    };
+    TimeCost cost;
+    {
+        ConcurrencyBthread con_bth(bthread_num);
+        for (int t = 0; t < bthread_num; ++t) {
+            con_bth.run([&map, &init_call, t, bthread_num, key_count]() {
+                for (int64_t i = t; i < key_count; i += bthread_num) {
+                    map.insert_init_if_not_exist(i, init_call);
+                }
+            });
+        }
+        con_bth.join();
+    }
+    int64_t insert_cost = cost.get_time();
+    cost.reset();
+    {
+        ConcurrencyBthread con_bth(bthread_num);
+        for (int t = 0; t < bthread_num; ++t) {
+            con_bth.run([&map, t, key_count]() {
+                for (int64_t i = 0; i < key_count * 10; ++i) {
+                    map.get((i + t) % key_count);
+                }
+            });
+        }
+        con_bth.join();
+    }
+    int64_t get_cost = cost.get_time();
+    cost.reset();
+    std::atomic<int64_t> traverse_count(0);
+    {
+        ConcurrencyBthread con_bth(bthread_num);
+        for (int t = 0; t < bthread_num; ++t) {
+            con_bth.run([&map, &traverse_count]() {
+                for (int i = 0; i < 10; ++i) {
+                    map.traverse([&traverse_count](Value& value) {
+                        traverse_count++;
+                    });
+                }
+            });
+        }
+        con_bth.join();
+    }
+    int64_t traverse_cost = cost.get_time();
+    EXPECT_EQ(traverse_count.load(), key_count * 10 * bthread_num);
+    DB_NOTICE("%s bthread_num: %d, key_count: %ld, insert_cost: %ld, get_cost: %ld, traverse_cost: %ld",
+            name, bthread_num, key_count, insert_cost, get_cost, traverse_cost);
+}
+
+TEST(test_concurrent_map, release_on_erase) {
+    ConcurrentMap<int64_t, std::shared_ptr<int64_t>> map;
+    std::weak_ptr<int64_t> erased;
+    std::weak_ptr<int64_t> cleared;
+    std::weak_ptr<int64_t> replaced;
+    {
+        auto value = std::make_shared<int64_t>(1);
+        erased = value;
+        map.set(1, value);
+        value = std::make_shared<int64_t>(2);
+        cleared = value;
+        map.set(2, value);
+        value = std::make_shared<int64_t>(3);
+        replaced = value;
+        map.set(3, value);
+    }
+    // 删除/覆盖返回时value已析构, 不依赖后续写操作触发释放
+    map.erase(1);
+    EXPECT_TRUE(erased.expired());
+    map.set(3, std::make_shared<int64_t>(4));
+    EXPECT_TRUE(replaced.expired());
+    map.clear();
+    EXPECT_TRUE(cleared.expired());
+    EXPECT_EQ(map.size(), 0);
+}
+
+TEST(test_concurrent_map, bench) {
+    const int64_t key_count = 10000;
+    for (int bthread_num : {64, 128}) {
+        ThreadSafeMap<int64_t, std::shared_ptr<int64_t>> thread_safe_map;
+        bench_map("ThreadSafeMap", thread_safe_map, bthread_num, key_count);
+        ConcurrentMap<int64_t, std::shared_ptr<int64_t>> concurrent_map;
+        bench_map("ConcurrentMap", concurrent_map, bthread_num, key_count);
+    }
+}
+}  // namespace baikaldb
@@ -0,0 +1,60 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include "fetcher_store.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// prepare成功: commit使用预取的commit_ts, 且只用一次
+TEST(FetcherCommitTsTest, use_pipelined_commit_ts) {
+    FetcherStore fetcher;
+    fetcher.pipelined_commit_ts = 100;
+    fetcher.error = E_OK;
+    fetcher.discard_commit_ts_if_failed(pb::OP_PREPARE);
+    EXPECT_EQ(100, fetcher.pipelined_commit_ts.load());
+    EXPECT_EQ(100, fetcher.fetch_commit_ts());
+    EXPECT_EQ(-1, fetcher.pipelined_commit_ts.load());
+}
+
+// prepare失败时binlog bthread可能已经取到了commit_ts, 必须丢弃
+TEST(FetcherCommitTsTest, prepare_fail) {
+    for (ErrorType err : {E_FATAL, E_RETURN, E_RETRY, E_WARNING}) {
+        FetcherStore fetcher;
+        fetcher.pipelined_commit_ts = 100;
+        fetcher.error = err;
+        fetcher.discard_commit_ts_if_failed(pb::OP_PREPARE);
+        EXPECT_EQ(-1, fetcher.pipelined_commit_ts.load()) << err;
+    }
+}
+
+// 回滚的事务不会commit, 预取的commit_ts不能留给之后的commit
+TEST(FetcherCommitTsTest, rollback) {
+    FetcherStore fetcher;
+    fetcher.pipelined_commit_ts = 100;
+    fetcher.error = E_OK;
+    fetcher.discard_commit_ts_if_failed(pb::OP_ROLLBACK);
+    EXPECT_EQ(-1, fetcher.pipelined_commit_ts.load());
+    // 其他操作不影响
+    fetcher.pipelined_commit_ts = 200;
+    fetcher.error = E_FATAL;
+    fetcher.discard_commit_ts_if_failed(pb::OP_INSERT);
+    EXPECT_EQ(200, fetcher.pipelined_commit_ts.load());
+}
+}  // namespace baikaldb
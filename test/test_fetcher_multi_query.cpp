@@ -0,0 +1,267 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <set>
+#include <brpc/server.h>
+#include "fetcher_store.h"
+#include "store_plan_cache.h"
+#include "query_context.h"
+#include "network_socket.h"
+#include "schema_factory.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    baikaldb::SchemaFactory::get_instance()->init();
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_bool(fetcher_follower_read);
+DECLARE_bool(fetcher_multi_query);
+static const int64_t TEST_TABLE_ID = 3002;
+
+// 按region返回预置的结果, 记录收到的query和multi_query
+class FakeStoreService : public pb::StoreService {
+public:
+    virtual void query(google::protobuf::RpcController* controller,
+            const pb::StoreReq* request,
+            pb::StoreRes* response,
+            google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        BAIDU_SCOPED_LOCK(mutex);
+        requests.push_back(*request);
+        response->CopyFrom(results[request->region_id()]);
+    }
+    virtual void multi_query(google::protobuf::RpcController* controller,
+            const pb::MultiStoreReq* request,
+            pb::MultiStoreRes* response,
+            google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        BAIDU_SCOPED_LOCK(mutex);
+        multi_requests.push_back(*request);
+        int response_cnt = request->regions_size();
+        if (drop_response) {
+            drop_response = false;
+            --response_cnt;
+        }
+        for (int i = 0; i < response_cnt; ++i) {
+            int64_t region_id = request->regions(i).region_id();
+            pb::StoreRes* res = response->add_responses();
+            if (skip_regions.erase(region_id) > 0) {
+                res->set_errcode(pb::REGION_SKIPPED);
+                continue;
+            }
+            res->CopyFrom(results[region_id]);
+        }
+    }
+
+    bthread::Mutex mutex;
+    std::map<int64_t, pb::StoreRes> results;
+    // 下次multi_query中返回REGION_SKIPPED的region
+    std::set<int64_t> skip_regions;
+    // 下次multi_query少返回一个结果
+    bool drop_response = false;
+    std::vector<pb::StoreReq> requests;
+    std::vector<pb::MultiStoreReq> multi_requests;
+};
+
+// tuple 0: slot 1 INT64, 3个region都在同一个store上
+class FetcherMultiQueryTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_enable_store_plan_cache = true;
+        FLAGS_fetcher_follower_read = false;
+        FLAGS_fetcher_multi_query = true;
+        ASSERT_EQ(0, _server.AddService(&_service, brpc::SERVER_DOESNT_OWN_SERVICE));
+        ASSERT_EQ(0, _server.Start(butil::PortRange(18000, 19000), nullptr));
+        _addr = "127.0.0.1:" + std::to_string(_server.listen_address().port);
+
+        pb::SchemaInfo info;
+        info.set_namespace_name("test_namespace");
+        info.set_database("test_db");
+        info.set_table_name("fetcher_multi_query_t");
+        info.set_partition_num(1);
+        info.set_namespace_id(111);
+        info.set_database_id(222);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_version(1);
+        pb::FieldInfo* field = info.add_fields();
+        field->set_field_name("id");
+        field->set_field_id(1);
+        field->set_mysql_type(pb::INT64);
+        pb::IndexInfo* index_pk = info.add_indexs();
+        index_pk->set_index_type(pb::I_PRIMARY);
+        index_pk->set_index_name("pk_index");
+        index_pk->add_field_ids(1);
+        index_pk->set_index_id(TEST_TABLE_ID);
+        SchemaFactory::get_instance()->update_table(info);
+
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(0);
+        tuple.set_table_id(TEST_TABLE_ID);
+        pb::SlotDescriptor* slot = tuple.add_slots();
+        slot->set_slot_id(1);
+        slot->set_tuple_id(0);
+        slot->set_slot_type(pb::INT64);
+        slot->set_field_id(1);
+        _ctx.mutable_tuple_descs()->push_back(tuple);
+        _ctx.client_conn = &_conn;
+        ASSERT_EQ(0, _state.init(&_ctx, nullptr));
+
+        pb::Plan plan;
+        pb::PlanNode* node = plan.add_nodes();
+        node->set_node_type(pb::SCAN_NODE);
+        node->set_num_children(0);
+        node->set_limit(-1);
+        pb::ScanNode* scan_node = node->mutable_derive_node()->mutable_scan_node();
+        scan_node->set_tuple_id(0);
+        scan_node->set_table_id(TEST_TABLE_ID);
+        scan_node->set_engine(pb::ROCKSDB);
+        ASSERT_EQ(0, ExecNode::create_tree(plan, &_store_request));
+
+        // region i返回i * 100开始的i行
+        for (int64_t region_id = 1; region_id <= 3; ++region_id) {
+            add_result(region_id, region_id * 100, region_id);
+        }
+    }
+    void TearDown() override {
+        FLAGS_enable_store_plan_cache = false;
+        FLAGS_fetcher_follower_read = true;
+        FLAGS_fetcher_multi_query = false;
+        _server.Stop(0);
+        _server.Join();
+        ExecNode::destroy_tree(_store_request);
+    }
+
+    void add_result(int64_t region_id, int64_t start, int rows) {
+        pb::StoreRes res;
+        res.set_errcode(pb::SUCCESS);
+        res.add_tuple_ids(0);
+        for (int64_t i = start; i < start + rows; ++i) {
+            std::unique_ptr<MemRow> row = _state.mem_row_desc()->fetch_mem_row();
+            ExprValue v(pb::INT64);
+            v._u.int64_val = i;
+            row->set_value(0, 1, v);
+            row->to_string(0, res.add_row_values()->add_tuple_values());
+        }
+        BAIDU_SCOPED_LOCK(_service.mutex);
+        _service.results[region_id] = res;
+    }
+
+    std::map<int64_t, pb::RegionInfo> region_infos() {
+        std::map<int64_t, pb::RegionInfo> infos;
+        std::string start_key;
+        for (int64_t region_id = 1; region_id <= 3; ++region_id) {
+            pb::RegionInfo& info = infos[region_id];
+            info.set_region_id(region_id);
+            info.set_table_id(TEST_TABLE_ID);
+            info.set_version(region_id + 10);
+            info.set_start_key(start_key);
+            start_key = std::string(1, 'a' + region_id);
+            info.set_end_key(region_id == 3 ? "" : start_key);
+            info.set_leader(_addr);
+            info.add_peers(_addr);
+        }
+        return infos;
+    }
+
+    // 每个region的结果只进入自己的batch
+    void expect_region_batches(FetcherStore& fetcher) {
+        ASSERT_EQ(3u, fetcher.region_batch.size());
+        for (int64_t region_id = 1; region_id <= 3; ++region_id) {
+            ASSERT_EQ(1u, fetcher.region_batch.count(region_id)) << region_id;
+            std::shared_ptr<RowBatch> batch = fetcher.region_batch[region_id];
+            ASSERT_NE(nullptr, batch);
+            ASSERT_EQ((size_t)region_id, batch->size()) << region_id;
+            int64_t expect = region_id * 100;
+            for (batch->reset(); !batch->is_traverse_over(); batch->next()) {
+                EXPECT_EQ(expect++, batch->get_row()->get_value(0, 1).get_numberic<int64_t>());
+            }
+        }
+    }
+
+    FakeStoreService _service;
+    brpc::Server _server;
+    std::string _addr;
+    NetworkSocket _conn;
+    QueryContext _ctx;
+    RuntimeState _state;
+    ExecNode* _store_request = nullptr;
+};
+
+// 同store的region合并成一个multi_query, 结果按regions的顺序拆回各region
+TEST_F(FetcherMultiQueryTest, split_response) {
+    FetcherStore fetcher;
+    ASSERT_EQ(0, fetcher.run(&_state, region_infos(), _store_request, 0, 0, pb::OP_SELECT));
+    EXPECT_EQ(E_OK, fetcher.error.load());
+    expect_region_batches(fetcher);
+    EXPECT_EQ(6, fetcher.row_cnt.load());
+
+    BAIDU_SCOPED_LOCK(_service.mutex);
+    EXPECT_TRUE(_service.requests.empty());
+    ASSERT_EQ(1u, _service.multi_requests.size());
+    const pb::MultiStoreReq& request = _service.multi_requests[0];
+    EXPECT_TRUE(request.common().has_plan());
+    EXPECT_NE(0u, request.common().plan_sign());
+    EXPECT_GT(request.max_rows(), 0);
+    ASSERT_EQ(3, request.regions_size());
+    std::set<int64_t> region_ids;
+    for (auto& region : request.regions()) {
+        region_ids.insert(region.region_id());
+        EXPECT_EQ(region.region_id() + 10, region.region_version());
+    }
+    EXPECT_EQ(std::set<int64_t>({1, 2, 3}), region_ids);
+}
+
+// 行数达到上限后store跳过的region, 重新排队后单独发送
+TEST_F(FetcherMultiQueryTest, region_skipped) {
+    {
+        BAIDU_SCOPED_LOCK(_service.mutex);
+        _service.skip_regions.insert(2);
+    }
+    FetcherStore fetcher;
+    ASSERT_EQ(0, fetcher.run(&_state, region_infos(), _store_request, 0, 0, pb::OP_SELECT));
+    EXPECT_EQ(E_OK, fetcher.error.load());
+    expect_region_batches(fetcher);
+
+    BAIDU_SCOPED_LOCK(_service.mutex);
+    ASSERT_EQ(1u, _service.multi_requests.size());
+    EXPECT_EQ(3, _service.multi_requests[0].regions_size());
+    ASSERT_EQ(1u, _service.requests.size());
+    EXPECT_EQ(2, _service.requests[0].region_id());
+    EXPECT_EQ(12, _service.requests[0].region_version());
+    EXPECT_TRUE(_service.requests[0].has_plan());
+}
+
+// 结果个数与region个数不一致时整批失败, 不能把结果错位到别的region
+TEST_F(FetcherMultiQueryTest, response_size_diff) {
+    {
+        BAIDU_SCOPED_LOCK(_service.mutex);
+        _service.drop_response = true;
+    }
+    FetcherStore fetcher;
+    EXPECT_EQ(-1, fetcher.run(&_state, region_infos(), _store_request, 0, 0, pb::OP_SELECT));
+    EXPECT_EQ(E_FATAL, fetcher.error.load());
+    for (auto& pair : fetcher.region_batch) {
+        EXPECT_EQ(nullptr, pair.second) << pair.first;
+    }
+
+    BAIDU_SCOPED_LOCK(_service.mutex);
+    ASSERT_EQ(1u, _service.multi_requests.size());
+    EXPECT_EQ(3, _service.multi_requests[0].regions_size());
+    EXPECT_TRUE(_service.requests.empty());
+}
+}  // namespace baikaldb
@@ -0,0 +1,228 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <deque>
+#include <brpc/server.h>
+#include "fetcher_store.h"
+#include "query_context.h"
+#include "network_socket.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// 按脚本返回续读结果, 记录收到的请求
+class FakeStoreService : public pb::StoreService {
+public:
+    virtual void query(google::protobuf::RpcController* controller,
+            const pb::StoreReq* request,
+            pb::StoreRes* response,
+            google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        BAIDU_SCOPED_LOCK(mutex);
+        if (request->close_cursor()) {
+            closed.push_back(request->cursor_id());
+            response->set_errcode(pb::SUCCESS);
+            return;
+        }
+        requests.push_back(*request);
+        if (pages.empty()) {
+            response->set_errcode(pb::CURSOR_NOT_EXIST);
+            return;
+        }
+        response->CopyFrom(pages.front());
+        pages.pop_front();
+    }
+
+    bthread::Mutex mutex;
+    std::deque<pb::StoreRes> pages;
+    std::vector<pb::StoreReq> requests;
+    std::vector<uint64_t> closed;
+};
+
+// tuple 0: slot 1 INT64
+class FetcherStorePageTest : public testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_EQ(0, _server.AddService(&_service, brpc::SERVER_DOESNT_OWN_SERVICE));
+        ASSERT_EQ(0, _server.Start(butil::PortRange(18000, 19000), nullptr));
+        _addr = "127.0.0.1:" + std::to_string(_server.listen_address().port);
+
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(0);
+        tuple.set_table_id(1);
+        pb::SlotDescriptor* slot = tuple.add_slots();
+        slot->set_slot_id(1);
+        slot->set_tuple_id(0);
+        slot->set_slot_type(pb::INT64);
+        _ctx.mutable_tuple_descs()->push_back(tuple);
+        _ctx.client_conn = &_conn;
+        ASSERT_EQ(0, _state.init(&_ctx, nullptr));
+    }
+    void TearDown() override {
+        _server.Stop(0);
+        _server.Join();
+    }
+
+    PageCursor make_cursor(int64_t region_id, uint64_t cursor_id) {
+        PageCursor cursor;
+        cursor.cursor_id = cursor_id;
+        cursor.addr = _addr;
+        cursor.request.set_op_type(pb::OP_SELECT);
+        cursor.request.set_region_id(region_id);
+        cursor.request.set_region_version(1);
+        cursor.request.set_cursor_id(cursor_id);
+        cursor.info.set_region_id(region_id);
+        cursor.info.set_version(1);
+        cursor.info.set_leader(_addr);
+        return cursor;
+    }
+    // 一页数据, cursor_id非0时还有下一页
+    void add_page(int64_t start, int rows, uint64_t cursor_id) {
+        pb::StoreRes res;
+        res.set_errcode(pb::SUCCESS);
+        res.add_tuple_ids(0);
+        for (int64_t i = start; i < start + rows; ++i) {
+            std::unique_ptr<MemRow> row = _state.mem_row_desc()->fetch_mem_row();
+            ExprValue v(pb::INT64);
+            v._u.int64_val = i;
+            row->set_value(0, 1, v);
+            row->to_string(0, res.add_row_values()->add_tuple_values());
+        }
+        res.set_affected_rows(rows);
+        if (cursor_id != 0) {
+            res.set_has_more(true);
+            res.set_cursor_id(cursor_id);
+        }
+        BAIDU_SCOPED_LOCK(_service.mutex);
+        _service.pages.push_back(res);
+    }
+    // 关闭游标是异步的, 等待store收到
+    std::vector<uint64_t> wait_closed(size_t num) {
+        for (int i = 0; i < 200; ++i) {
+            {
+                BAIDU_SCOPED_LOCK(_service.mutex);
+                if (_service.closed.size() >= num) {
+                    return _service.closed;
+                }
+            }
+            bthread_usleep(10 * 1000);
+        }
+        BAIDU_SCOPED_LOCK(_service.mutex);
+        return _service.closed;
+    }
+
+    FakeStoreService _service;
+    brpc::Server _server;
+    std::string _addr;
+    NetworkSocket _conn;
+    QueryContext _ctx;
+    RuntimeState _state;
+    ExecNode _store_request;
+};
+
+// 按页续读直到最后一页, 续读请求只带游标id
+TEST_F(FetcherStorePageTest, fetch_next_page) {
+    FetcherStore fetcher;
+    fetcher.page_stream = true;
+    fetcher.add_page_cursor(1, make_cursor(1, 42));
+    add_page(100, 3, 42);
+    // 空页被跳过
+    add_page(103, 0, 42);
+    add_page(103, 2, 0);
+    std::shared_ptr<RowBatch> batch;
+    ASSERT_EQ(1, fetcher.fetch_next_page(&_state, &_store_request, 1, &batch));
+    ASSERT_EQ(3u, batch->size());
+    EXPECT_TRUE(fetcher.has_page_cursor(1));
+    ASSERT_EQ(1, fetcher.fetch_next_page(&_state, &_store_request, 1, &batch));
+    ASSERT_EQ(2u, batch->size());
+    int64_t expect = 103;
+    for (batch->reset(); !batch->is_traverse_over(); batch->next()) {
+        EXPECT_EQ(expect++, batch->get_row()->get_value(0, 1).get_numberic<int64_t>());
+    }
+    EXPECT_FALSE(fetcher.has_page_cursor(1));
+    EXPECT_EQ(0, fetcher.fetch_next_page(&_state, &_store_request, 1, &batch));
+    EXPECT_EQ(E_OK, fetcher.error.load());
+
+    BAIDU_SCOPED_LOCK(_service.mutex);
+    ASSERT_EQ(3u, _service.requests.size());
+    for (auto& req : _service.requests) {
+        EXPECT_EQ(42u, req.cursor_id());
+        EXPECT_FALSE(req.has_plan());
+        EXPECT_EQ(0u, req.new_cursor_id());
+    }
+    EXPECT_TRUE(_service.closed.empty());
+}
+
+// 游标过期(超时/切主/重启): 已有页交给上层, 不能从头重读, 整个查询失败
+TEST_F(FetcherStorePageTest, cursor_expired) {
+    FetcherStore fetcher;
+    fetcher.page_stream = true;
+    fetcher.add_page_cursor(1, make_cursor(1, 42));
+    std::shared_ptr<RowBatch> batch;
+    EXPECT_EQ(-1, fetcher.fetch_next_page(&_state, &_store_request, 1, &batch));
+    EXPECT_EQ(E_FATAL, fetcher.error.load());
+    EXPECT_FALSE(fetcher.has_page_cursor(1));
+    BAIDU_SCOPED_LOCK(_service.mutex);
+    // 没有重新请求首页
+    ASSERT_EQ(1u, _service.requests.size());
+    EXPECT_EQ(42u, _service.requests[0].cursor_id());
+}
+
+// 首页还没交给上层时可以从头重试, 交出过页后不行
+TEST_F(FetcherStorePageTest, restart_paged_select) {
+    FetcherStore fetcher;
+    pb::RegionInfo info = make_cursor(1, 42).info;
+    OnRPCDone* task = new OnRPCDone(&fetcher, &_state, &_store_request, &info,
+            1, 1, 0, 0, pb::OP_SELECT);
+    EXPECT_EQ(E_RETRY, task->restart_paged_select());
+    task->set_page_cursor(make_cursor(1, 42));
+    EXPECT_EQ(E_FATAL, task->restart_paged_select());
+    // 失败的task释放时关闭游标
+    delete task;
+    std::vector<uint64_t> closed = wait_closed(1);
+    ASSERT_EQ(1u, closed.size());
+    EXPECT_EQ(42u, closed[0]);
+}
+
+// 上层没读完的region, 查询结束时关闭store端游标
+TEST_F(FetcherStorePageTest, close_page_cursors) {
+    {
+        FetcherStore fetcher;
+        fetcher.add_page_cursor(1, make_cursor(1, 42));
+        fetcher.add_page_cursor(2, make_cursor(2, 43));
+        fetcher.close_page_cursors();
+        EXPECT_FALSE(fetcher.has_page_cursor(1));
+        EXPECT_FALSE(fetcher.has_page_cursor(2));
+        std::vector<uint64_t> closed = wait_closed(2);
+        std::sort(closed.begin(), closed.end());
+        EXPECT_EQ(std::vector<uint64_t>({42, 43}), closed);
+    }
+    {
+        // 析构时也会关闭
+        FetcherStore fetcher;
+        fetcher.add_page_cursor(3, make_cursor(3, 44));
+    }
+    std::vector<uint64_t> closed = wait_closed(3);
+    ASSERT_EQ(3u, closed.size());
+    EXPECT_EQ(1, std::count(closed.begin(), closed.end(), 44));
+    BAIDU_SCOPED_LOCK(_service.mutex);
+    EXPECT_TRUE(_service.requests.empty());
+}
+}  // namespace baikaldb
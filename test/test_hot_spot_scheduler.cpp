@@ -0,0 +1,98 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include "hot_spot_scheduler.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_int32(region_load_read_weight);
+DECLARE_int32(region_load_write_weight);
+DECLARE_int64(region_load_scan_rows_unit);
+DECLARE_int64(region_load_read_bytes_unit);
+
+static pb::RegionLoad make_load(int64_t read_qps, int64_t write_qps) {
+    pb::RegionLoad load;
+    load.set_read_qps(read_qps);
+    load.set_write_qps(write_qps);
+    return load;
+}
+
+// 每个region的read_qps为leader_load/follower_load, 所有region都有follower
+static void heartbeat(const std::string& instance, int64_t leader_load, int64_t follower_load) {
+    pb::StoreHeartBeatRequest request;
+    request.mutable_instance_info()->set_address(instance);
+    request.mutable_instance_info()->set_resource_tag("test_hot_spot");
+    request.set_need_peer_balance(true);
+    auto leader_region = request.add_leader_regions();
+    leader_region->mutable_region()->set_region_id(1);
+    *leader_region->mutable_load() = make_load(leader_load, 0);
+    // peer_infos里的leader region不重复计入总负载
+    auto peer_info = request.add_peer_infos();
+    peer_info->set_region_id(1);
+    *peer_info->mutable_load() = make_load(leader_load, 0);
+    peer_info = request.add_peer_infos();
+    peer_info->set_region_id(2);
+    *peer_info->mutable_load() = make_load(follower_load, 0);
+    HotSpotScheduler::get_instance()->update_instance_load(&request);
+}
+
+TEST(test_hot_spot_scheduler, weighted_load) {
+    EXPECT_EQ(0, HotSpotScheduler::weighted_load(pb::RegionLoad()));
+    pb::RegionLoad load = make_load(10, 5);
+    EXPECT_EQ(10 * FLAGS_region_load_read_weight + 5 * FLAGS_region_load_write_weight,
+              HotSpotScheduler::weighted_load(load));
+    load.set_scan_rows(FLAGS_region_load_scan_rows_unit * 3);
+    load.set_read_bytes(FLAGS_region_load_read_bytes_unit * 2);
+    EXPECT_EQ(10 * FLAGS_region_load_read_weight + 5 * FLAGS_region_load_write_weight + 3 + 2,
+              HotSpotScheduler::weighted_load(load));
+    // 只有follower apply的负载也不为0
+    EXPECT_EQ(FLAGS_region_load_write_weight, HotSpotScheduler::weighted_load(make_load(0, 1)));
+
+    int64_t scan_rows_unit = FLAGS_region_load_scan_rows_unit;
+    FLAGS_region_load_scan_rows_unit = 0;
+    EXPECT_EQ(10 * FLAGS_region_load_read_weight + 5 * FLAGS_region_load_write_weight + 2,
+              HotSpotScheduler::weighted_load(load));
+    FLAGS_region_load_scan_rows_unit = scan_rows_unit;
+}
+
+TEST(test_hot_spot_scheduler, move_load) {
+    int32_t read_weight = FLAGS_region_load_read_weight;
+    FLAGS_region_load_read_weight = 1;
+    HotSpotScheduler* scheduler = HotSpotScheduler::get_instance();
+    // 总负载: hot 1000, a 300, b 500
+    heartbeat("hot:8010", 400, 600);
+    heartbeat("a:8010", 100, 200);
+    heartbeat("b:8010", 500, 0);
+    std::vector<std::string> candidates = {"a:8010", "b:8010", "unknown:8010"};
+
+    // 按leader负载, a最低
+    EXPECT_EQ("a:8010", scheduler->move_load("hot:8010", candidates, 100, 600, true));
+    // a的leader负载变成200, 加上350超过阈值, b也超过, 没有候选
+    EXPECT_EQ("", scheduler->move_load("hot:8010", candidates, 450, 600, true));
+    // 转leader不改变总负载, 按总负载a(300)仍然最低
+    EXPECT_EQ("a:8010", scheduler->move_load("hot:8010", candidates, 200, 600, false));
+    // a的总负载变成500, 和b相同时选先遍历到的
+    EXPECT_EQ("a:8010", scheduler->move_load("hot:8010", candidates, 100, 600, false));
+    // a的总负载600, 只剩b满足
+    EXPECT_EQ("b:8010", scheduler->move_load("hot:8010", candidates, 100, 600, false));
+    EXPECT_EQ("", scheduler->move_load("hot:8010", candidates, 100, 550, false));
+    FLAGS_region_load_read_weight = read_weight;
+}
+} // namespace baikaldb
@@ -0,0 +1,92 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include "load_split_sampler.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_int64(load_split_qps_threshold);
+DECLARE_int32(load_split_sustain_times);
+DECLARE_int32(load_split_sample_num);
+
+static std::string make_key(int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "k%05d", i);
+    return buf;
+}
+
+TEST(test_load_split_sampler, split_key) {
+    LoadSplitSampler sampler;
+    // 采样太少
+    for (int i = 0; i < 10; ++i) {
+        sampler.sample(make_key(i), 1);
+    }
+    std::string split_key;
+    EXPECT_EQ(-1, sampler.get_split_key("", "", split_key));
+
+    // key 0-99均匀访问, 90-99的写权重为10, 负载中点在key 90
+    sampler.reset();
+    for (int i = 0; i < 200; ++i) {
+        sampler.sample(make_key(i % 100), i % 100 >= 90 ? 10 : 1);
+    }
+    ASSERT_EQ(0, sampler.get_split_key("", "", split_key));
+    EXPECT_EQ(make_key(90), split_key);
+    // 分裂点在region范围内, region之前的key负载算在start_key上
+    ASSERT_EQ(0, sampler.get_split_key(make_key(50), make_key(95), split_key));
+    EXPECT_LT(make_key(50), split_key);
+    EXPECT_GT(make_key(95), split_key);
+    EXPECT_EQ(make_key(70), split_key);
+}
+
+TEST(test_load_split_sampler, single_hot_key) {
+    LoadSplitSampler sampler;
+    for (int i = 0; i < 1000; ++i) {
+        sampler.sample(make_key(7), 1);
+    }
+    std::string split_key;
+    EXPECT_EQ(-1, sampler.get_split_key("", "", split_key));
+    // 一个key占了95%的负载, 切在哪边都不均衡
+    for (int i = 0; i < 50; ++i) {
+        sampler.sample(make_key(100 + i), 1);
+    }
+    EXPECT_EQ(-1, sampler.get_split_key("", "", split_key));
+}
+
+TEST(test_load_split_sampler, reservoir_and_hot) {
+    LoadSplitSampler sampler;
+    for (int i = 0; i < FLAGS_load_split_sample_num * 10; ++i) {
+        sampler.sample(make_key(i % 100), 1);
+    }
+    EXPECT_EQ((size_t)FLAGS_load_split_sample_num, sampler.sample_size());
+
+    int64_t threshold = FLAGS_load_split_qps_threshold;
+    FLAGS_load_split_qps_threshold = 1;
+    for (int i = 0; i < FLAGS_load_split_sustain_times; ++i) {
+        sampler.add_load(1000000);
+        EXPECT_EQ(i == FLAGS_load_split_sustain_times - 1, sampler.check_hot());
+    }
+    // 负载降下来后重新累计
+    FLAGS_load_split_qps_threshold = INT64_MAX;
+    EXPECT_FALSE(sampler.check_hot());
+    EXPECT_EQ(0, sampler.sample_size());
+    FLAGS_load_split_qps_threshold = threshold;
+}
+
+}  // namespace baikaldb
@@ -0,0 +1,173 @@
+// Copyright (c) 2018 Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "lru_cache.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+TEST(test_sharded_cache, find_add_del) {
+    ShardedCache<std::string, int> cache;
+    int value = 0;
+    EXPECT_EQ(cache.find("a", &value), -1);
+    ASSERT_EQ(cache.init(100, 0, 2), 0);
+    EXPECT_EQ(cache.find("a", &value), -1);
+    cache.add("a", 1);
+    cache.add("b", 2);
+    EXPECT_EQ(cache.find("a", &value), 0);
+    EXPECT_EQ(value, 1);
+    cache.add("a", 3);
+    EXPECT_EQ(cache.find("a", &value), 0);
+    EXPECT_EQ(value, 3);
+    EXPECT_EQ(cache.size(), 2);
+    cache.del("a");
+    EXPECT_EQ(cache.check("a"), -1);
+    EXPECT_EQ(cache.check("b"), 0);
+    EXPECT_EQ(cache.size(), 1);
+    std::cout << cache.get_info() << std::endl;
+}
+
+TEST(test_sharded_cache, evict_by_bytes) {
+    // 单分片便于验证LRU顺序
+    ShardedCache<int, std::string> cache;
+    ASSERT_EQ(cache.init(1000, 100, 0), 0);
+    for (int i = 0; i < 10; ++i) {
+        cache.add(i, std::string(10, 'x'), 10);
+    }
+    EXPECT_EQ(cache.size(), 10);
+    EXPECT_EQ(cache.used_bytes(), 100);
+    std::string value;
+    // 访问0后, 淘汰顺序变为1,2,...
+    EXPECT_EQ(cache.find(0, &value), 0);
+    cache.add(10, std::string(30, 'y'), 30);
+    EXPECT_EQ(cache.used_bytes(), 100);
+    EXPECT_EQ(cache.check(0), 0);
+    EXPECT_EQ(cache.check(1), -1);
+    EXPECT_EQ(cache.check(2), -1);
+    EXPECT_EQ(cache.check(3), -1);
+    EXPECT_EQ(cache.check(4), 0);
+    // 单个超过容量的条目不缓存
+    cache.add(11, std::string(200, 'z'), 200);
+    EXPECT_EQ(cache.check(11), -1);
+    EXPECT_EQ(cache.check(4), 0);
+    EXPECT_EQ(cache.used_bytes(), 100);
+    // 调小容量时立即淘汰
+    cache.init(2, 0);
+    EXPECT_EQ(cache.size(), 2);
+}
+
+TEST(test_sharded_cache, budget) {
+    CacheBudget budget("test_sharded_cache_budget", 0);
+    budget.capacity = 100;
+    ShardedCache<int, std::string> cache1;
+    ASSERT_EQ(cache1.init(1000, 0, 0, &budget), 0);
+    for (int i = 0; i < 10; ++i) {
+        cache1.add(i, std::string(10, 'x'), 10);
+    }
+    EXPECT_EQ(cache1.used_bytes(), 100);
+    std::string value;
+    EXPECT_EQ(cache1.find(0, &value), 0);
+    EXPECT_EQ(cache1.find(100, &value), -1);
+    EXPECT_EQ(budget.hit_counts[0].get_value(), 1);
+    EXPECT_EQ(budget.miss_counts[0].get_value(), 1);
+    {
+        // 两个cache均分预算, cache1在下次add时淘汰到50
+        ShardedCache<int, std::string> cache2;
+        ASSERT_EQ(cache2.init(1000, 0, 0, &budget), 0);
+        EXPECT_EQ(budget.cache_count.load(), 2);
+        cache2.add(0, std::string(60, 'y'), 60);
+        EXPECT_EQ(cache2.check(0), -1);
+        cache1.add(10, std::string(10, 'x'), 10);
+        EXPECT_EQ(cache1.used_bytes(), 50);
+        EXPECT_EQ(cache1.check(10), 0);
+        EXPECT_EQ(cache1.check(0), 0);
+        EXPECT_EQ(cache1.check(1), -1);
+    }
+    EXPECT_EQ(budget.cache_count.load(), 1);
+    cache1.add(11, std::string(60, 'z'), 60);
+    EXPECT_EQ(cache1.check(11), 0);
+    EXPECT_LE(cache1.used_bytes(), 100);
+}
+
+TEST(test_sharded_cache, budget_min_capacity) {
+    CacheBudget budget("test_sharded_cache_min_capacity", 2);
+    budget.capacity = 400;
+    budget.min_capacity = 200;
+    std::vector<std::unique_ptr<ShardedCache<int, std::string>>> caches;
+    for (int i = 0; i < 10; ++i) {
+        caches.emplace_back(new ShardedCache<int, std::string>);
+        ASSERT_EQ(caches.back()->init(1000, 0, 2, &budget), 0);
+    }
+    // 均分只有40, 按最小容量200算, 每个分片50
+    EXPECT_EQ(budget.cache_capacity(), 200);
+    caches[0]->add(1, std::string(50, 'x'), 50);
+    EXPECT_EQ(caches[0]->check(1), 0);
+    caches[0]->add(2, std::string(51, 'x'), 51);
+    EXPECT_EQ(caches[0]->check(2), -1);
+
+    // 同一分片下标的命中在所有cache上累加
+    std::string value;
+    for (auto& cache : caches) {
+        cache->add(1, "v", 1);
+        EXPECT_EQ(cache->find(1, &value), 0);
+    }
+    int64_t hit = 0;
+    int shard_hit = 0;
+    for (int i = 0; i < 4; ++i) {
+        hit += budget.hit_counts[i].get_value();
+        if (budget.hit_counts[i].get_value() > 0) {
+            ++shard_hit;
+        }
+    }
+    EXPECT_EQ(hit, 10);
+    EXPECT_EQ(shard_hit, 1);
+}
+
+TEST(test_sharded_cache, concurrent) {
+    ShardedCache<int, int> cache;
+    ASSERT_EQ(cache.init(512, 0, 4), 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&cache, t]() {
+            for (int i = 0; i < 10000; ++i) {
+                int key = (i * 7 + t) % 1024;
+                int value = 0;
+                if (cache.find(key, &value) == 0) {
+                    EXPECT_EQ(value, key);
+                } else {
+                    cache.add(key, key, 1);
+                }
+                if (i % 97 == 0) {
+                    cache.del(key);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    // 每个分片条数上限为512/16
+    EXPECT_LE(cache.size(), 512);
+}
+}  // namespace baikaldb
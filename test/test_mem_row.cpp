@@ -12,12 +12,20 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <gtest/gtest.h>
 #include "mem_row_descriptor.h"
 #include "mem_row.h"
 #include "table_iterator.h"
 #include <vector>
 
 int main(int argc, char* argv[]) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// 观察大量tuple message的内存占用, 耗时较长, 需要--gtest_also_run_disabled_tests
+TEST(test_mem_row, DISABLED_new_tuple_message) {
     baikaldb::MemRowDescriptor* desc = new baikaldb::MemRowDescriptor;
 
     std::vector<baikaldb::pb::TupleDescriptor> tuple_desc;
@@ -30,15 +38,12 @@ int main(int argc, char* argv[]) {
             baikaldb::pb::SlotDescriptor* slot = tuple.add_slots();
             slot->set_slot_id(jdx);
             slot->set_slot_type(baikaldb::pb::UINT16);
-            slot->set_tuple_id(idx);         
+            slot->set_tuple_id(idx);
         }
         tuple_desc.push_back(tuple);
     }
 
-    if (0 != desc->init(tuple_desc)) {
-        DB_WARNING("init failed");
-        return -1;
-    }
+    ASSERT_EQ(0, desc->init(tuple_desc));
 
     std::vector<google::protobuf::Message*> messages;
     for (int idx = 0; idx < 10000000; ++idx) {
@@ -58,6 +63,117 @@ int main(int argc, char* argv[]) {
     DB_WARNING("delete message success");
 
     sleep(30);
+}
+
+static const pb::PrimitiveType SLOT_TYPES[] = {
+    pb::INT32, pb::UINT64, pb::DOUBLE, pb::STRING, pb::BOOL, pb::INT64};
+
+// tuple 0和tuple 2有slot, tuple 1不在descriptor中
+static void init_desc(MemRowDescriptor* desc) {
+    std::vector<pb::TupleDescriptor> tuple_descs;
+    for (int tuple_id : {0, 2}) {
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(tuple_id);
+        tuple.set_table_id(tuple_id + 1);
+        for (int slot_id = 1; slot_id <= 6; ++slot_id) {
+            pb::SlotDescriptor* slot = tuple.add_slots();
+            slot->set_slot_id(slot_id);
+            slot->set_tuple_id(tuple_id);
+            slot->set_slot_type(SLOT_TYPES[slot_id - 1]);
+        }
+        tuple_descs.push_back(tuple);
+    }
+    ASSERT_EQ(0, desc->init(tuple_descs));
+}
+
+static void fill_row(MemRow* row, int32_t tuple_id, int i) {
+    ExprValue v1(pb::INT32);
+    v1._u.int32_val = -i;
+    row->set_value(tuple_id, 1, v1);
+    if (i % 2 == 0) {
+        ExprValue v2(pb::UINT64);
+        v2._u.uint64_val = UINT64_MAX - i;
+        row->set_value(tuple_id, 2, v2);
+    }
+    ExprValue v3(pb::DOUBLE);
+    v3._u.double_val = i * -0.125;
+    row->set_value(tuple_id, 3, v3);
+    if (i % 3 != 0) {
+        // 含\0和非ascii字节
+        ExprValue v4(pb::STRING);
+        v4.str_val = std::string("a\0b", 3) + std::string(i, '\xff');
+        row->set_value(tuple_id, 4, v4);
+    }
+    ExprValue v5(pb::BOOL);
+    v5._u.bool_val = i % 2;
+    row->set_value(tuple_id, 5, v5);
+}
+
+static void expect_row_eq(MemRow* expect, MemRow* row) {
+    for (int32_t tuple_id : {0, 2}) {
+        for (int32_t slot_id = 1; slot_id <= 6; ++slot_id) {
+            ExprValue v1 = expect->get_value(tuple_id, slot_id);
+            ExprValue v2 = row->get_value(tuple_id, slot_id);
+            EXPECT_EQ(v1.is_null(), v2.is_null()) << tuple_id << ":" << slot_id;
+            if (!v1.is_null() && !v2.is_null()) {
+                EXPECT_EQ(v1.type, v2.type);
+                EXPECT_EQ(v1.get_string(), v2.get_string()) << tuple_id << ":" << slot_id;
+            }
+        }
+    }
+}
 
-    return 0;
+TEST(test_mem_row, serialize_round_trip) {
+    MemRowDescriptor desc;
+    init_desc(&desc);
+    for (int i = 0; i < 20; ++i) {
+        std::unique_ptr<MemRow> row = desc.fetch_mem_row();
+        fill_row(row.get(), 0, i);
+        // 一半的行第二个tuple全为null
+        if (i % 2 == 1) {
+            fill_row(row.get(), 2, i * 7);
+        }
+        std::string buf;
+        row->serialize(&buf);
+        std::unique_ptr<MemRow> out = desc.fetch_mem_row();
+        ASSERT_EQ(0, out->deserialize(buf.data(), buf.size()));
+        expect_row_eq(row.get(), out.get());
+        // 追加写入不影响已有内容
+        std::string prefix = "xyz";
+        row->serialize(&prefix);
+        EXPECT_EQ("xyz" + buf, prefix);
+    }
+    // 全为null的行序列化为空
+    std::unique_ptr<MemRow> empty = desc.fetch_mem_row();
+    std::string buf;
+    empty->serialize(&buf);
+    EXPECT_TRUE(buf.empty());
+    std::unique_ptr<MemRow> out = desc.fetch_mem_row();
+    ASSERT_EQ(0, out->deserialize(buf.data(), buf.size()));
+    expect_row_eq(empty.get(), out.get());
+}
+
+TEST(test_mem_row, deserialize_invalid) {
+    MemRowDescriptor desc;
+    init_desc(&desc);
+    std::unique_ptr<MemRow> row = desc.fetch_mem_row();
+    fill_row(row.get(), 2, 5);
+    std::string buf;
+    row->serialize(&buf);
+    // 截断
+    for (size_t size : {(size_t)3, sizeof(uint32_t) * 2 - 1, buf.size() - 1}) {
+        std::unique_ptr<MemRow> out = desc.fetch_mem_row();
+        EXPECT_EQ(-1, out->deserialize(buf.data(), size)) << size;
+    }
+    // 不存在的tuple
+    std::string bad = buf;
+    uint32_t tuple_id = 1;
+    memcpy(&bad[0], &tuple_id, sizeof(tuple_id));
+    std::unique_ptr<MemRow> out = desc.fetch_mem_row();
+    EXPECT_EQ(-1, out->deserialize(bad.data(), bad.size()));
+    tuple_id = 100;
+    memcpy(&bad[0], &tuple_id, sizeof(tuple_id));
+    out = desc.fetch_mem_row();
+    EXPECT_EQ(-1, out->deserialize(bad.data(), bad.size()));
 }
+} // namespace baikaldb
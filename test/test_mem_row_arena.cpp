@@ -0,0 +1,187 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include "runtime_state.h"
+#include "query_context.h"
+#include "network_socket.h"
+#include "sorter.h"
+#include "expr_node.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+// tuple 0: slot 1 INT64, slot 2 STRING
+class MemRowArenaTest : public testing::Test {
+protected:
+    void SetUp() override {
+        pb::TupleDescriptor* tuple = _tuples.Add();
+        tuple->set_tuple_id(0);
+        tuple->set_table_id(1);
+        pb::PrimitiveType types[] = {pb::INT64, pb::STRING};
+        for (int slot_id = 1; slot_id <= 2; ++slot_id) {
+            pb::SlotDescriptor* slot = tuple->add_slots();
+            slot->set_slot_id(slot_id);
+            slot->set_tuple_id(0);
+            slot->set_slot_type(types[slot_id - 1]);
+        }
+        pb::PlanNode* node = _plan.add_nodes();
+        node->set_node_type(pb::SCAN_NODE);
+        node->set_limit(-1);
+        node->set_num_children(0);
+    }
+    void TearDown() override {
+        FLAGS_mem_row_use_arena = true;
+        FLAGS_mem_row_arena_max_bytes = 16 * 1024 * 1024LL;
+    }
+
+    // store侧的RuntimeState
+    std::unique_ptr<RuntimeState> new_state() {
+        std::unique_ptr<RuntimeState> state(new RuntimeState);
+        pb::StoreReq req;
+        EXPECT_EQ(0, state->init(req, _plan, _tuples, &_pool, false));
+        return state;
+    }
+
+    static std::unique_ptr<MemRow> make_row(RuntimeState* state, int64_t i) {
+        std::unique_ptr<MemRow> row = state->mem_row_desc()->fetch_mem_row(state->mem_row_arena());
+        ExprValue v1(pb::INT64);
+        v1._u.int64_val = i;
+        row->set_value(0, 1, v1);
+        ExprValue v2(pb::STRING);
+        v2.str_val = std::string(i % 100, 'x');
+        row->set_value(0, 2, v2);
+        return row;
+    }
+    static void expect_row(MemRow* row, int64_t i) {
+        EXPECT_EQ(i, row->get_value(0, 1).get_numberic<int64_t>());
+        EXPECT_EQ(std::string(i % 100, 'x'), row->get_value(0, 2).get_string());
+    }
+
+    RepeatedPtrField<pb::TupleDescriptor> _tuples;
+    pb::Plan _plan;
+    TransactionPool _pool;
+};
+
+// arena上的行经过RowBatch和Sorter(与SelectManagerNode一致)后仍在请求内使用和释放
+TEST_F(MemRowArenaTest, row_lifetime) {
+    std::unique_ptr<RuntimeState> state = new_state();
+    google::protobuf::Arena* arena = state->mem_row_arena();
+    ASSERT_NE(nullptr, arena);
+
+    pb::Expr expr;
+    pb::ExprNode* node = expr.add_nodes();
+    node->set_node_type(pb::SLOT_REF);
+    node->set_col_type(pb::INT64);
+    node->set_num_children(0);
+    node->mutable_derive_node()->set_tuple_id(0);
+    node->mutable_derive_node()->set_slot_id(1);
+    ExprNode* slot_ref = nullptr;
+    ASSERT_EQ(0, ExprNode::create_tree(expr, &slot_ref));
+    ASSERT_EQ(0, slot_ref->open());
+    std::vector<ExprNode*> order_exprs = {slot_ref};
+    std::vector<bool> is_asc = {false};
+    std::vector<bool> is_null_first = {false};
+    MemRowCompare comp(order_exprs, is_asc, is_null_first);
+    {
+        Sorter sorter(&comp);
+        for (int b = 0; b < 10; ++b) {
+            std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+            for (int j = 0; j < 100; ++j) {
+                std::unique_ptr<MemRow> row = make_row(state.get(), b * 100 + j);
+                ASSERT_EQ(arena, row->get_tuple(0)->GetArena());
+                batch->move_row(std::move(row));
+            }
+            sorter.add_batch(batch);
+        }
+        sorter.sort();
+        int64_t expect = 999;
+        bool eos = false;
+        while (!eos) {
+            RowBatch batch;
+            ASSERT_EQ(0, sorter.get_next(&batch, &eos));
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                expect_row(batch.get_row().get(), expect--);
+            }
+        }
+        EXPECT_EQ(-1, expect);
+    }
+    // 行先于RuntimeState释放, 释放MemRow不会触碰arena上的tuple
+    std::unique_ptr<MemRow> row = make_row(state.get(), 7);
+    row.reset();
+    slot_ref->close();
+    delete slot_ref;
+}
+
+// 需要比请求活得久的行, 拷贝到堆上后不依赖arena
+TEST_F(MemRowArenaTest, copy_out) {
+    std::unique_ptr<RuntimeState> state = new_state();
+    ASSERT_NE(nullptr, state->mem_row_arena());
+    MemRowDescriptor* desc = state->mem_row_desc();
+    std::vector<std::unique_ptr<MemRow>> copies;
+    for (int64_t i = 0; i < 50; ++i) {
+        std::unique_ptr<MemRow> row = make_row(state.get(), i);
+        std::string buf;
+        row->serialize(&buf);
+        std::unique_ptr<MemRow> copy = desc->fetch_mem_row();
+        ASSERT_EQ(0, copy->deserialize(buf.data(), buf.size()));
+        EXPECT_EQ(nullptr, copy->get_tuple(0)->GetArena());
+        copies.push_back(std::move(copy));
+    }
+    state.reset();
+    for (int64_t i = 0; i < 50; ++i) {
+        expect_row(copies[i].get(), i);
+    }
+}
+
+// 超过配额或关闭时退回堆上分配
+TEST_F(MemRowArenaTest, fallback) {
+    FLAGS_mem_row_arena_max_bytes = 1024;
+    std::unique_ptr<RuntimeState> state = new_state();
+    ASSERT_NE(nullptr, state->mem_row_arena());
+    std::vector<std::unique_ptr<MemRow>> rows;
+    for (int64_t i = 0; i < 10000 && state->mem_row_arena() != nullptr; ++i) {
+        rows.push_back(make_row(state.get(), i));
+    }
+    ASSERT_EQ(nullptr, state->mem_row_arena());
+    std::unique_ptr<MemRow> heap_row = make_row(state.get(), 3);
+    EXPECT_EQ(nullptr, heap_row->get_tuple(0)->GetArena());
+    rows.clear();
+    state.reset();
+    expect_row(heap_row.get(), 3);
+
+    FLAGS_mem_row_arena_max_bytes = 16 * 1024 * 1024LL;
+    FLAGS_mem_row_use_arena = false;
+    state = new_state();
+    EXPECT_EQ(nullptr, state->mem_row_arena());
+}
+
+// prepare语句复用RuntimeState, 不使用arena
+TEST_F(MemRowArenaTest, prepared) {
+    NetworkSocket conn;
+    for (int i = 0; i < 3; ++i) {
+        QueryContext ctx;
+        ctx.client_conn = &conn;
+        ctx.is_prepared = i == 1;
+        ctx.exec_prepared = i == 2;
+        RuntimeState state;
+        ASSERT_EQ(0, state.init(&ctx, nullptr));
+        EXPECT_EQ(i == 0, state.mem_row_arena() != nullptr) << i;
+    }
+}
+}  // namespace baikaldb
@@ -0,0 +1,240 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include "plan_cache.h"
+#include "parser.h"
+#include "network_socket.h"
+#include "schema_factory.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+static const int64_t TEST_DB_ID = 222;
+static const int64_t TEST_TABLE_ID = 1001;
+
+class PlanCacheTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_enable_plan_cache = true;
+        _user.reset(new UserInfo);
+        _user->namespace_ = "test_namespace";
+        _user->database[TEST_DB_ID] = pb::READ;
+    }
+    void TearDown() override {
+        FLAGS_enable_plan_cache = false;
+    }
+
+    // 解析并参数化, 不走计划缓存时返回-1
+    int normalize(const std::string& sql, QueryContext* ctx) {
+        ctx->sql = sql;
+        ctx->cur_db = "test_db";
+        ctx->charset = "utf8";
+        ctx->mysql_cmd = COM_QUERY;
+        ctx->user_info = _user;
+        ctx->client_conn = &_conn;
+        _parser.reset(new parser::SqlParser);
+        _parser->parse(sql);
+        if (_parser->error != parser::SUCC || _parser->result.size() != 1) {
+            return -2;
+        }
+        ctx->stmt = _parser->result[0];
+        ctx->stmt_type = ctx->stmt->node_type;
+        ctx->is_complex = ctx->stmt->is_complex_node();
+        return PlanCache::get_instance()->normalize(ctx, _parser->arena);
+    }
+    std::string key(const std::string& sql) {
+        QueryContext ctx;
+        if (normalize(sql, &ctx) != 0) {
+            return "";
+        }
+        return ctx.normalized_sql;
+    }
+
+    void update_table(int64_t version) {
+        pb::SchemaInfo info;
+        info.set_namespace_name("test_namespace");
+        info.set_database("test_db");
+        info.set_table_name("plan_cache_t");
+        info.set_partition_num(1);
+        info.set_namespace_id(111);
+        info.set_database_id(TEST_DB_ID);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_version(version);
+        pb::FieldInfo* field = info.add_fields();
+        field->set_field_name("id");
+        field->set_field_id(1);
+        field->set_mysql_type(pb::INT64);
+        pb::IndexInfo* index_pk = info.add_indexs();
+        index_pk->set_index_type(pb::I_PRIMARY);
+        index_pk->set_index_name("pk_index");
+        index_pk->add_field_ids(1);
+        index_pk->set_index_id(TEST_TABLE_ID);
+        SchemaFactory::get_instance()->update_table(info);
+    }
+
+    // 模拟逻辑计划完成后的ctx: 一个占位符对应一个参数
+    void fill_plan(QueryContext* ctx) {
+        pb::PlanNode* node = ctx->plan.add_nodes();
+        node->set_node_type(pb::TABLE_FILTER_NODE);
+        node->set_limit(-1);
+        node->set_num_children(0);
+        pb::Expr* conjunct = node->mutable_derive_node()->mutable_filter_node()->add_conjuncts();
+        for (size_t i = 0; i < ctx->plan_cache_params.size(); ++i) {
+            pb::ExprNode* place_holder = conjunct->add_nodes();
+            place_holder->set_node_type(pb::PLACE_HOLDER_LITERAL);
+            place_holder->set_num_children(0);
+            place_holder->mutable_derive_node()->set_int_val(i);
+        }
+        pb::TupleDescriptor tuple_desc;
+        tuple_desc.set_tuple_id(0);
+        tuple_desc.set_table_id(TEST_TABLE_ID);
+        ctx->add_tuple(tuple_desc);
+        ctx->stat_info.sign = 12345;
+    }
+
+    std::shared_ptr<UserInfo> _user;
+    NetworkSocket _conn;
+    std::unique_ptr<parser::SqlParser> _parser;
+};
+
+TEST_F(PlanCacheTest, literal_type) {
+    std::string int_key = key("select id from plan_cache_t where id = 1");
+    std::string str_key = key("select id from plan_cache_t where id = '1'");
+    std::string double_key = key("select id from plan_cache_t where id = 1.0");
+    ASSERT_FALSE(int_key.empty());
+    ASSERT_FALSE(str_key.empty());
+    EXPECT_NE(int_key, str_key);
+    EXPECT_NE(int_key, double_key);
+    // 同类型不同值共用
+    EXPECT_EQ(int_key, key("select id from plan_cache_t where id = 2"));
+    EXPECT_EQ(str_key, key("select id from plan_cache_t where id = 'abc'"));
+
+    QueryContext ctx;
+    ASSERT_EQ(0, normalize("select id from plan_cache_t where id = '7'", &ctx));
+    ASSERT_EQ(1u, ctx.plan_cache_params.size());
+    EXPECT_EQ(pb::STRING_LITERAL, ctx.plan_cache_params[0].node_type());
+    EXPECT_EQ("7", ctx.plan_cache_params[0].derive_node().string_val());
+}
+
+TEST_F(PlanCacheTest, in_list) {
+    std::string key2 = key("select id from plan_cache_t where id in (1, 2)");
+    std::string key3 = key("select id from plan_cache_t where id in (1, 2, 3)");
+    ASSERT_FALSE(key2.empty());
+    EXPECT_NE(key2, key3);
+    EXPECT_EQ(key2, key("select id from plan_cache_t where id in (5, 6)"));
+    // 类型不同的in列表
+    EXPECT_NE(key2, key("select id from plan_cache_t where id in (5, '6')"));
+
+    QueryContext ctx;
+    ASSERT_EQ(0, normalize("select id from plan_cache_t where id in (4, 5, 6) and id > 1", &ctx));
+    ASSERT_EQ(4u, ctx.plan_cache_params.size());
+    EXPECT_EQ(4, ctx.plan_cache_params[0].derive_node().int_val());
+    EXPECT_EQ(1, ctx.plan_cache_params[3].derive_node().int_val());
+}
+
+TEST_F(PlanCacheTest, limit_and_lock) {
+    std::string key1 = key("select id from plan_cache_t where id > 1 limit 1");
+    std::string key10 = key("select id from plan_cache_t where id > 1 limit 10");
+    ASSERT_FALSE(key1.empty());
+    // limit不参数化, 不同limit不共用计划
+    EXPECT_NE(key1, key10);
+    EXPECT_EQ(key1, key("select id from plan_cache_t where id > 2 limit 1"));
+
+    std::string plain = key("select id from plan_cache_t where id = 1");
+    std::string for_update = key("select id from plan_cache_t where id = 1 for update");
+    ASSERT_FALSE(for_update.empty());
+    EXPECT_NE(plain, for_update);
+}
+
+TEST_F(PlanCacheTest, reject) {
+    QueryContext ctx;
+    // 会话变量和会话函数
+    EXPECT_EQ(-1, normalize("select id from plan_cache_t where id = @a", &ctx));
+    QueryContext ctx2;
+    EXPECT_EQ(-1, normalize("select id from plan_cache_t where id = @@session.autocommit", &ctx2));
+    QueryContext ctx3;
+    EXPECT_EQ(-1, normalize("select last_insert_id() from plan_cache_t where id = 1", &ctx3));
+    QueryContext ctx4;
+    EXPECT_EQ(-1, normalize("select database() from plan_cache_t where id = 1", &ctx4));
+    // join
+    QueryContext ctx5;
+    EXPECT_EQ(-1, normalize("select a.id from plan_cache_t a join plan_cache_t b on a.id = b.id "
+                "where a.id = 1", &ctx5));
+    // 字符串含转义
+    QueryContext ctx6;
+    EXPECT_EQ(-1, normalize("select id from plan_cache_t where id = 'a\\'b'", &ctx6));
+    // 没有被参数化, parse tree保持原样
+    EXPECT_TRUE(ctx5.plan_cache_params.empty());
+    EXPECT_TRUE(ctx5.normalized_sql.empty());
+
+    FLAGS_enable_plan_cache = false;
+    QueryContext ctx7;
+    EXPECT_EQ(-1, normalize("select id from plan_cache_t where id = 1", &ctx7));
+}
+
+TEST_F(PlanCacheTest, schema_version) {
+    SchemaFactory::get_instance()->init();
+    update_table(1);
+    const std::string sql = "select id from plan_cache_t where id = 1";
+    {
+        QueryContext ctx;
+        ASSERT_EQ(0, normalize(sql, &ctx));
+        EXPECT_EQ(-1, PlanCache::get_instance()->fill_from_cache(&ctx));
+        fill_plan(&ctx);
+        PlanCache::get_instance()->add_to_cache(&ctx);
+    }
+    {
+        QueryContext ctx;
+        ASSERT_EQ(0, normalize("select id from plan_cache_t where id = 2", &ctx));
+        ASSERT_EQ(0, PlanCache::get_instance()->fill_from_cache(&ctx));
+        EXPECT_EQ(12345u, ctx.stat_info.sign);
+        EXPECT_EQ(1, ctx.plan.nodes_size());
+        // 本次的常量在create_plan_tree时绑定
+        EXPECT_EQ(2, ctx.plan_cache_params[0].derive_node().int_val());
+    }
+    {
+        // 无权限时按未命中处理
+        _user->database.clear();
+        QueryContext ctx;
+        ASSERT_EQ(0, normalize(sql, &ctx));
+        EXPECT_EQ(-1, PlanCache::get_instance()->fill_from_cache(&ctx));
+        _user->database[TEST_DB_ID] = pb::READ;
+    }
+    // schema version变化后失效并从缓存删除
+    update_table(2);
+    {
+        QueryContext ctx;
+        ASSERT_EQ(0, normalize(sql, &ctx));
+        EXPECT_EQ(-1, PlanCache::get_instance()->fill_from_cache(&ctx));
+    }
+    {
+        QueryContext ctx;
+        ASSERT_EQ(0, normalize(sql, &ctx));
+        EXPECT_EQ(-1, PlanCache::get_instance()->fill_from_cache(&ctx));
+        // 重新加入后可以命中
+        fill_plan(&ctx);
+        PlanCache::get_instance()->add_to_cache(&ctx);
+    }
+    {
+        QueryContext ctx;
+        ASSERT_EQ(0, normalize(sql, &ctx));
+        EXPECT_EQ(0, PlanCache::get_instance()->fill_from_cache(&ctx));
+    }
+}
+} // namespace baikaldb
@@ -0,0 +1,491 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <deque>
+#include <map>
+#include <random>
+#ifdef BAIDU_INTERNAL
+#include <base/file_util.h>
+#else
+#include <butil/file_util.h>
+#endif
+#include "region.h"
+#include "closure.h"
+#include "meta_writer.h"
+#include "rocks_wrapper.h"
+#include "schema_factory.h"
+#include "mut_table_key.h"
+
+static const std::string TEST_DB_PATH = "./test_region_apply_db";
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    butil::DeleteFile(butil::FilePath(TEST_DB_PATH), true);
+    baikaldb::RocksWrapper* rocksdb = baikaldb::RocksWrapper::get_instance();
+    if (rocksdb->init(TEST_DB_PATH) != 0) {
+        DB_FATAL("rocksdb init failed");
+        return -1;
+    }
+    baikaldb::MetaWriter::get_instance()->init(rocksdb, rocksdb->get_meta_info_handle());
+    baikaldb::SchemaFactory::get_instance()->init();
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+static const int64_t TEST_TABLE_ID = 2001;
+
+// leader端的closure, 只记录结果不回复rpc
+struct TestDMLClosure : public DMLClosure {
+    explicit TestDMLClosure(BthreadCond* cond) : DMLClosure(cond) {}
+    virtual void Run() {
+        cond->decrease_signal();
+        delete this;
+    }
+};
+
+// 一条leader端已执行完的1pc dml: put/delete的key(不含region前缀)
+struct LeaderEntry {
+    std::map<std::string, std::string> puts;
+    std::vector<std::string> deletes;
+    // 大于0时事务在提交前过期, 提交返回Expired
+    int64_t expiration_ms = -1;
+};
+
+// 不初始化raft的region, 直接调用apply_entry模拟on_apply
+class RegionApplyTest : public testing::Test {
+protected:
+    static void SetUpTestCase() {
+        pb::SchemaInfo info;
+        info.set_namespace_name("test_namespace");
+        info.set_database("test_db");
+        info.set_table_name("region_apply_t");
+        info.set_partition_num(1);
+        info.set_namespace_id(111);
+        info.set_database_id(222);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_version(1);
+        pb::FieldInfo* field = info.add_fields();
+        field->set_field_name("id");
+        field->set_field_id(1);
+        field->set_mysql_type(pb::INT64);
+        field = info.add_fields();
+        field->set_field_name("v");
+        field->set_field_id(2);
+        field->set_mysql_type(pb::INT64);
+        pb::IndexInfo* index_pk = info.add_indexs();
+        index_pk->set_index_type(pb::I_PRIMARY);
+        index_pk->set_index_name("pk_index");
+        index_pk->add_field_ids(1);
+        index_pk->set_index_id(TEST_TABLE_ID);
+        SchemaFactory::get_instance()->update_table(info);
+    }
+    void TearDown() override {
+        FLAGS_enable_apply_group_commit = false;
+        FLAGS_apply_lanes = 0;
+    }
+
+    SmartRegion new_region(int64_t version = 1) {
+        static int64_t region_id = 0;
+        ++region_id;
+        pb::RegionInfo info;
+        info.set_region_id(region_id);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_table_name("test_namespace.test_db.region_apply_t");
+        info.set_partition_id(0);
+        info.set_replica_num(1);
+        info.set_version(version);
+        info.set_conf_version(1);
+        info.set_start_key("");
+        info.set_end_key("");
+        butil::EndPoint addr;
+        butil::str2endpoint("127.0.0.1:8110", &addr);
+        braft::GroupId group_id("region_" + std::to_string(region_id));
+        SmartRegion region(new Region(RocksWrapper::get_instance(), SchemaFactory::get_instance(),
+                "127.0.0.1:8110", group_id, braft::PeerId(addr, 0), info, region_id));
+        EXPECT_EQ(0, region->init_resource(false));
+        return region;
+    }
+
+    static std::string data_key(Region* region, const std::string& key) {
+        MutTableKey mut_key;
+        mut_key.append_i64(region->get_region_id()).append_string(key);
+        return mut_key.data();
+    }
+
+    // leader端执行dml: 事务持有行锁, 写入还在事务中
+    SmartTransaction leader_txn(Region* region, const LeaderEntry& entry) {
+        SmartTransaction txn(new Transaction(0, &region->get_txn_pool()));
+        rocksdb::TransactionOptions txn_opt;
+        // 合并时如果等待这些行锁, 会等到超时
+        txn_opt.lock_timeout = 10 * 1000;
+        txn_opt.expiration = entry.expiration_ms;
+        EXPECT_EQ(0, txn->begin(txn_opt));
+        auto data_cf = RocksWrapper::get_instance()->get_data_handle();
+        for (auto& kv : entry.puts) {
+            EXPECT_TRUE(txn->get_txn()->Put(data_cf, data_key(region, kv.first), kv.second).ok());
+        }
+        for (auto& key : entry.deletes) {
+            EXPECT_TRUE(txn->get_txn()->Delete(data_cf, data_key(region, key)).ok());
+        }
+        return txn;
+    }
+
+    // 按日志顺序apply一批leader端日志, 返回每条的errcode
+    std::vector<pb::ErrCode> apply_leader(Region* region, const std::vector<LeaderEntry>& entries) {
+        std::deque<pb::StoreRes> responses;
+        std::vector<SmartTransaction> txns;
+        for (auto& entry : entries) {
+            txns.emplace_back(leader_txn(region, entry));
+        }
+        if (!entries.empty() && entries.back().expiration_ms > 0) {
+            bthread_usleep((entries.back().expiration_ms + 10) * 1000LL);
+        }
+        BthreadCond cond;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            responses.emplace_back();
+            responses.back().set_errcode(pb::SUCCESS);
+            TestDMLClosure* done = new TestDMLClosure(&cond);
+            done->op_type = pb::OP_INSERT;
+            done->response = &responses.back();
+            done->transaction = txns[i];
+            done->txn_num_increase_rows = (int64_t)entries[i].puts.size() - (int64_t)entries[i].deletes.size();
+            std::shared_ptr<pb::StoreReq> request = std::make_shared<pb::StoreReq>();
+            request->set_op_type(pb::OP_INSERT);
+            request->set_region_id(region->get_region_id());
+            request->set_region_version(1);
+            cond.increase();
+            region->apply_entry(1, region->get_log_index() + 1, request, done);
+        }
+        region->finish_apply_entries();
+        cond.wait();
+        std::vector<pb::ErrCode> errcodes;
+        for (auto& res : responses) {
+            errcodes.push_back(res.errcode());
+        }
+        return errcodes;
+    }
+
+    // follower端的单行replace
+    static std::shared_ptr<pb::StoreReq> replace_request(Region* region, int64_t id, int64_t v) {
+        SmartRecord record = SchemaFactory::get_instance()->new_record(TEST_TABLE_ID);
+        ExprValue id_value(pb::INT64);
+        id_value._u.int64_val = id;
+        record->set_value(record->get_field_by_tag(1), id_value);
+        ExprValue v_value(pb::INT64);
+        v_value._u.int64_val = v;
+        record->set_value(record->get_field_by_tag(2), v_value);
+        std::shared_ptr<pb::StoreReq> request = std::make_shared<pb::StoreReq>();
+        request->set_op_type(pb::OP_INSERT);
+        request->set_region_id(region->get_region_id());
+        request->set_region_version(region->get_version());
+        pb::PlanNode* node = request->mutable_plan()->add_nodes();
+        node->set_node_type(pb::INSERT_NODE);
+        node->set_num_children(0);
+        node->set_limit(-1);
+        pb::InsertNode* insert_node = node->mutable_derive_node()->mutable_insert_node();
+        insert_node->set_table_id(TEST_TABLE_ID);
+        insert_node->set_is_replace(true);
+        record->encode(*insert_node->add_records());
+        return request;
+    }
+
+    static std::shared_ptr<pb::StoreReq> truncate_request(Region* region) {
+        std::shared_ptr<pb::StoreReq> request = std::make_shared<pb::StoreReq>();
+        request->set_op_type(pb::OP_TRUNCATE_TABLE);
+        request->set_region_id(region->get_region_id());
+        request->set_region_version(region->get_version());
+        pb::PlanNode* node = request->mutable_plan()->add_nodes();
+        node->set_node_type(pb::TRUNCATE_NODE);
+        node->set_num_children(0);
+        node->set_limit(-1);
+        node->mutable_derive_node()->mutable_truncate_node()->set_table_id(TEST_TABLE_ID);
+        return request;
+    }
+
+    // follower端按日志顺序apply
+    static void apply_follower(Region* region, const std::vector<std::shared_ptr<pb::StoreReq>>& requests) {
+        for (auto& request : requests) {
+            region->apply_entry(1, region->get_log_index() + 1, request, nullptr);
+        }
+        region->finish_apply_entries();
+    }
+
+    // region的全部数据, key去掉region前缀
+    static std::map<std::string, std::string> dump(Region* region) {
+        std::map<std::string, std::string> rows;
+        MutTableKey prefix;
+        prefix.append_i64(region->get_region_id());
+        rocksdb::ReadOptions read_opt;
+        read_opt.total_order_seek = true;
+        std::unique_ptr<rocksdb::Iterator> iter(RocksWrapper::get_instance()->new_iterator(
+                read_opt, RocksWrapper::DATA_CF));
+        for (iter->Seek(prefix.data()); iter->Valid() && iter->key().starts_with(prefix.data()); iter->Next()) {
+            rows[iter->key().ToString().substr(sizeof(int64_t))] = iter->value().ToString();
+        }
+        return rows;
+    }
+
+    static int64_t persisted_applied_index(Region* region) {
+        int64_t applied_index = 0;
+        int64_t data_index = 0;
+        MetaWriter::get_instance()->read_applied_index(region->get_region_id(), &applied_index, &data_index);
+        return applied_index;
+    }
+
+    static void expect_same_state(Region* expect, Region* region) {
+        EXPECT_EQ(dump(expect), dump(region));
+        EXPECT_EQ(expect->get_log_index(), region->get_log_index());
+        EXPECT_EQ(persisted_applied_index(expect), persisted_applied_index(region));
+        EXPECT_EQ(expect->get_num_table_lines(), region->get_num_table_lines());
+        EXPECT_EQ(MetaWriter::get_instance()->read_num_table_lines(expect->get_region_id()),
+                MetaWriter::get_instance()->read_num_table_lines(region->get_region_id()));
+    }
+
+    // 先写入一批, 再覆盖和删除其中一部分
+    static std::vector<std::vector<LeaderEntry>> make_rounds() {
+        std::vector<std::vector<LeaderEntry>> rounds(2);
+        for (int i = 0; i < 20; ++i) {
+            LeaderEntry entry;
+            entry.puts["k" + std::to_string(i)] = "v" + std::to_string(i);
+            entry.puts["k" + std::to_string(i) + "_idx"] = "";
+            rounds[0].push_back(entry);
+        }
+        for (int i = 0; i < 20; i += 2) {
+            LeaderEntry entry;
+            entry.puts["k" + std::to_string(i)] = "u" + std::to_string(i);
+            entry.deletes.push_back("k" + std::to_string(i + 1));
+            entry.deletes.push_back("k" + std::to_string(i + 1) + "_idx");
+            rounds[1].push_back(entry);
+        }
+        return rounds;
+    }
+};
+
+// 合并时直接写入目标事务的WriteBatch, 不等待被合并事务持有的行锁
+TEST_F(RegionApplyTest, merge_without_row_locks) {
+    SmartRegion region = new_region();
+    LeaderEntry entry1;
+    entry1.puts["a"] = "1";
+    entry1.deletes.push_back("b");
+    LeaderEntry entry2;
+    entry2.puts["c"] = "2";
+    SmartTransaction txn1 = leader_txn(region.get(), entry1);
+    SmartTransaction txn2 = leader_txn(region.get(), entry2);
+    TimeCost cost;
+    ASSERT_EQ(0, txn2->merge_untracked({txn1}));
+    EXPECT_LT(cost.get_time(), 1000 * 1000LL);
+    ASSERT_TRUE(txn2->commit().ok());
+    txn1->finish_merged(true);
+    std::map<std::string, std::string> expect = {{"a", "1"}, {"c", "2"}};
+    EXPECT_EQ(expect, dump(region.get()));
+}
+
+// 组提交与逐条提交的数据, applied_index和行数一致
+TEST_F(RegionApplyTest, group_commit) {
+    SmartRegion serial = new_region();
+    SmartRegion grouped = new_region();
+    for (auto& entries : make_rounds()) {
+        FLAGS_enable_apply_group_commit = false;
+        std::vector<pb::ErrCode> expect = apply_leader(serial.get(), entries);
+        FLAGS_enable_apply_group_commit = true;
+        TimeCost cost;
+        std::vector<pb::ErrCode> errcodes = apply_leader(grouped.get(), entries);
+        // 合并失败逐条提交时结果也一致, 用耗时区分是否等了行锁
+        EXPECT_LT(cost.get_time(), 5 * 1000 * 1000LL);
+        EXPECT_EQ(expect, errcodes);
+        EXPECT_EQ(std::vector<pb::ErrCode>(entries.size(), pb::SUCCESS), errcodes);
+        expect_same_state(serial.get(), grouped.get());
+    }
+    EXPECT_EQ(30, grouped->get_log_index());
+    EXPECT_EQ(30, persisted_applied_index(grouped.get()));
+    EXPECT_EQ(30, grouped->get_num_table_lines());
+}
+
+// 攒批的日志在flush前不提交, 超过apply_group_commit_max_entries时提前提交
+TEST_F(RegionApplyTest, group_commit_flush) {
+    FLAGS_enable_apply_group_commit = true;
+    SmartRegion region = new_region();
+    int32_t max_entries = FLAGS_apply_group_commit_max_entries;
+    FLAGS_apply_group_commit_max_entries = 3;
+    BthreadCond cond;
+    std::deque<pb::StoreRes> responses;
+    for (int i = 0; i < 4; ++i) {
+        LeaderEntry entry;
+        entry.puts["k" + std::to_string(i)] = "v";
+        TestDMLClosure* done = new TestDMLClosure(&cond);
+        responses.emplace_back();
+        done->response = &responses.back();
+        done->transaction = leader_txn(region.get(), entry);
+        done->txn_num_increase_rows = 1;
+        std::shared_ptr<pb::StoreReq> request = std::make_shared<pb::StoreReq>();
+        request->set_op_type(pb::OP_INSERT);
+        cond.increase();
+        region->apply_entry(1, i + 1, request, done);
+    }
+    FLAGS_apply_group_commit_max_entries = max_entries;
+    // 前3条已提交, 第4条等待flush
+    EXPECT_EQ(3u, dump(region.get()).size());
+    EXPECT_EQ(3, persisted_applied_index(region.get()));
+    EXPECT_EQ(4, region->get_log_index());
+    region->finish_apply_entries();
+    cond.wait();
+    EXPECT_EQ(4u, dump(region.get()).size());
+    EXPECT_EQ(4, persisted_applied_index(region.get()));
+}
+
+// 最后一条提交失败时回滚到合并前的savepoint逐条提交: 失败那条的写入不残留, 其他条正常提交
+TEST_F(RegionApplyTest, group_commit_fallback) {
+    SmartRegion serial = new_region();
+    SmartRegion grouped = new_region();
+    std::vector<std::vector<LeaderEntry>> rounds = make_rounds();
+    rounds[0].back().expiration_ms = 10;
+    rounds[1].back().expiration_ms = 10;
+    for (auto& entries : rounds) {
+        FLAGS_enable_apply_group_commit = false;
+        std::vector<pb::ErrCode> expect = apply_leader(serial.get(), entries);
+        FLAGS_enable_apply_group_commit = true;
+        std::vector<pb::ErrCode> errcodes = apply_leader(grouped.get(), entries);
+        EXPECT_EQ(expect, errcodes);
+        EXPECT_EQ(pb::EXEC_FAIL, errcodes.back());
+        for (size_t i = 0; i + 1 < errcodes.size(); ++i) {
+            EXPECT_EQ(pb::SUCCESS, errcodes[i]) << i;
+        }
+        expect_same_state(serial.get(), grouped.get());
+    }
+    std::map<std::string, std::string> rows = dump(grouped.get());
+    // 第一轮最后一条k19没有写入, 第二轮最后一条没有覆盖k18, 也没有删除k19
+    EXPECT_EQ(0u, rows.count("k19"));
+    EXPECT_EQ(0u, rows.count("k19_idx"));
+    EXPECT_EQ("v18", rows["k18"]);
+    EXPECT_EQ("u16", rows["k16"]);
+    EXPECT_EQ(0u, rows.count("k17"));
+    // 失败的那条不推进持久化的applied_index
+    EXPECT_EQ(29, persisted_applied_index(grouped.get()));
+}
+
+// 只有单行主键dml可以进lane, 事务, 分裂, ddl和truncate等日志都是屏障
+TEST_F(RegionApplyTest, lane_key) {
+    SmartRegion region = new_region();
+    std::string key1;
+    std::string key2;
+    ASSERT_TRUE(region->get_apply_lane_key(*replace_request(region.get(), 1, 10), &key1));
+    ASSERT_TRUE(region->get_apply_lane_key(*replace_request(region.get(), 1, 11), &key2));
+    EXPECT_EQ(key1, key2);
+    ASSERT_TRUE(region->get_apply_lane_key(*replace_request(region.get(), 2, 10), &key2));
+    EXPECT_NE(key1, key2);
+
+    std::string key;
+    std::shared_ptr<pb::StoreReq> request = replace_request(region.get(), 1, 10);
+    FLAGS_apply_lanes = 1;
+    EXPECT_FALSE(region->can_apply_in_lane(*request, nullptr, 1, &key));
+    FLAGS_apply_lanes = 4;
+    EXPECT_TRUE(region->can_apply_in_lane(*request, nullptr, 1, &key));
+    // leader端的日志有done
+    TestDMLClosure done(nullptr);
+    EXPECT_FALSE(region->can_apply_in_lane(*request, &done, 1, &key));
+    // 已apply的日志
+    EXPECT_FALSE(region->can_apply_in_lane(*request, nullptr, 0, &key));
+
+    std::shared_ptr<pb::StoreReq> txn_request = replace_request(region.get(), 1, 10);
+    txn_request->add_txn_infos()->set_txn_id(123);
+    EXPECT_FALSE(region->can_apply_in_lane(*txn_request, nullptr, 1, &key));
+    EXPECT_FALSE(region->can_apply_in_lane(*truncate_request(region.get()), nullptr, 1, &key));
+    for (pb::OpType op_type : {pb::OP_NONE, pb::OP_PREPARE, pb::OP_COMMIT, pb::OP_ROLLBACK,
+            pb::OP_START_SPLIT, pb::OP_VALIDATE_AND_ADD_VERSION, pb::OP_ADD_VERSION_FOR_SPLIT_REGION,
+            pb::OP_START_DDL, pb::OP_UPDATE_STORE_DDLWORK, pb::OP_KV_BATCH, pb::OP_CLEAR_APPLYING_TXN}) {
+        std::shared_ptr<pb::StoreReq> other = replace_request(region.get(), 1, 10);
+        other->set_op_type(op_type);
+        EXPECT_FALSE(region->can_apply_in_lane(*other, nullptr, 1, &key)) << pb::OpType_Name(op_type);
+    }
+    std::shared_ptr<pb::StoreReq> ddl_request = replace_request(region.get(), 1, 10);
+    ddl_request->mutable_plan()->mutable_nodes(0)->mutable_derive_node()
+            ->mutable_insert_node()->set_ddl_need_write(true);
+    EXPECT_FALSE(region->can_apply_in_lane(*ddl_request, nullptr, 1, &key));
+    std::shared_ptr<pb::StoreReq> multi_request = replace_request(region.get(), 1, 10);
+    pb::InsertNode* insert_node = multi_request->mutable_plan()->mutable_nodes(0)
+            ->mutable_derive_node()->mutable_insert_node();
+    insert_node->add_records(insert_node->records(0));
+    EXPECT_FALSE(region->can_apply_in_lane(*multi_request, nullptr, 1, &key));
+
+    // 分裂中的region走异步apply
+    SmartRegion splitting = new_region(0);
+    EXPECT_FALSE(splitting->can_apply_in_lane(*replace_request(splitting.get(), 1, 10), nullptr, 1, &key));
+}
+
+// 并行apply与串行apply结果一致: 同主键的多次写入保持日志顺序
+TEST_F(RegionApplyTest, lanes_equal_serial) {
+    SmartRegion serial = new_region();
+    SmartRegion laned = new_region();
+    int32_t max_entries = FLAGS_apply_lane_max_entries;
+    // 多轮并行apply
+    FLAGS_apply_lane_max_entries = 37;
+    std::mt19937 rand(12345);
+    std::vector<std::shared_ptr<pb::StoreReq>> serial_requests;
+    std::vector<std::shared_ptr<pb::StoreReq>> laned_requests;
+    std::map<int64_t, int64_t> last_value;
+    for (int64_t i = 0; i < 500; ++i) {
+        int64_t id = rand() % 20;
+        serial_requests.emplace_back(replace_request(serial.get(), id, i));
+        laned_requests.emplace_back(replace_request(laned.get(), id, i));
+        last_value[id] = i;
+    }
+    FLAGS_apply_lanes = 0;
+    apply_follower(serial.get(), serial_requests);
+    FLAGS_apply_lanes = 4;
+    apply_follower(laned.get(), laned_requests);
+    FLAGS_apply_lane_max_entries = max_entries;
+
+    expect_same_state(serial.get(), laned.get());
+    EXPECT_EQ(500, laned->get_log_index());
+    EXPECT_EQ(500, persisted_applied_index(laned.get()));
+    EXPECT_EQ(last_value.size(), dump(laned.get()).size());
+    EXPECT_EQ((int64_t)last_value.size(), laned->get_num_table_lines());
+}
+
+// 不能进lane的日志先把攒着的lane日志apply完: truncate前的写入不能出现在truncate之后
+TEST_F(RegionApplyTest, lane_barrier) {
+    SmartRegion serial = new_region();
+    SmartRegion laned = new_region();
+    auto make_requests = [](Region* region) {
+        std::vector<std::shared_ptr<pb::StoreReq>> requests;
+        for (int64_t id = 0; id < 10; ++id) {
+            requests.emplace_back(replace_request(region, id, id));
+        }
+        requests.emplace_back(truncate_request(region));
+        for (int64_t id = 5; id < 15; ++id) {
+            requests.emplace_back(replace_request(region, id, 100 + id));
+        }
+        std::shared_ptr<pb::StoreReq> none_request = std::make_shared<pb::StoreReq>();
+        none_request->set_op_type(pb::OP_NONE);
+        none_request->set_region_id(region->get_region_id());
+        requests.emplace_back(none_request);
+        for (int64_t id = 0; id < 3; ++id) {
+            requests.emplace_back(replace_request(region, id, 200 + id));
+        }
+        return requests;
+    };
+    FLAGS_apply_lanes = 0;
+    apply_follower(serial.get(), make_requests(serial.get()));
+    FLAGS_apply_lanes = 4;
+    apply_follower(laned.get(), make_requests(laned.get()));
+
+    expect_same_state(serial.get(), laned.get());
+    // truncate之前的0~4不残留
+    EXPECT_EQ(13u, dump(laned.get()).size());
+    EXPECT_EQ(25, laned->get_log_index());
+    EXPECT_EQ(25, persisted_applied_index(laned.get()));
+}
+}  // namespace baikaldb
@@ -0,0 +1,136 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <memory>
+#include "proto/test_decode.pb.h"
+#include "row_codec.h"
+#include <google/protobuf/dynamic_message.h>
+
+using google::protobuf::DynamicMessageFactory;
+using google::protobuf::Message;
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+
+static void fill(TestTupleRecord* pb_data, int i) {
+    pb_data->set_col1(-1 - i);
+    pb_data->set_col2(-10000000000LL * i);
+    pb_data->set_col3(i);
+    pb_data->set_col4(1ULL << 40);
+    pb_data->set_col5(-2);
+    pb_data->set_col6(-12);
+    pb_data->set_col7(13);
+    pb_data->set_col8(14);
+    pb_data->set_col9(-14);
+    pb_data->set_col10(-15);
+    pb_data->set_col11(-15.13);
+    pb_data->set_col12(15.1333);
+    pb_data->set_col13(i % 2 == 0);
+    pb_data->set_col14("abcdefghijklmn" + std::to_string(i));
+}
+
+TEST(test_row_codec, wire_compatible) {
+    std::unique_ptr<RowCodec> codec(RowCodec::create(TestTupleRecord::descriptor()));
+    ASSERT_TRUE(codec != nullptr);
+    ASSERT_EQ(14, codec->entries().size());
+    for (int i = 0; i < 3; ++i) {
+        TestTupleRecord pb_data;
+        fill(&pb_data, i);
+        if (i == 1) {
+            // 部分字段为空, 以及0值
+            pb_data.clear_col3();
+            pb_data.clear_col14();
+            pb_data.set_col5(0);
+        }
+        std::string expect;
+        pb_data.SerializeToString(&expect);
+        std::string data;
+        ASSERT_EQ(0, codec->encode(pb_data, &data));
+        EXPECT_EQ(expect, data);
+
+        TestTupleRecord pb_decode;
+        ASSERT_EQ(0, codec->decode(data.data(), data.size(), &pb_decode));
+        EXPECT_EQ(pb_data.ShortDebugString(), pb_decode.ShortDebugString());
+        EXPECT_EQ(pb_data.has_col3(), pb_decode.has_col3());
+        EXPECT_EQ(pb_data.has_col14(), pb_decode.has_col14());
+    }
+}
+
+TEST(test_row_codec, unknown_and_invalid) {
+    std::unique_ptr<RowCodec> codec(RowCodec::create(TestTupleRecord::descriptor()));
+    TestTupleRecord pb_data;
+    fill(&pb_data, 5);
+    std::string data;
+    pb_data.SerializeToString(&data);
+    // 字段20(已删除的列)不在schema里, 退化为protobuf解析并保留
+    data.append("\xa0\x01\x07", 3);
+    TestTupleRecord pb_decode;
+    ASSERT_EQ(0, codec->decode(data.data(), data.size(), &pb_decode));
+    EXPECT_EQ(pb_data.col14(), pb_decode.col14());
+    std::string encoded;
+    ASSERT_EQ(0, codec->encode(pb_decode, &encoded));
+    EXPECT_EQ(data, encoded);
+
+    // 截断的数据
+    std::string truncated = data.substr(0, data.size() - 5);
+    EXPECT_NE(0, codec->decode(truncated.data(), truncated.size(), &pb_decode));
+}
+
+TEST(test_row_codec, benchmark) {
+    DynamicMessageFactory factory;
+    const Message* prototype = factory.GetPrototype(TestTupleRecord::descriptor());
+    std::unique_ptr<RowCodec> codec(RowCodec::create(TestTupleRecord::descriptor()));
+    const int count = 200000;
+    TestTupleRecord pb_data;
+    fill(&pb_data, 7);
+    std::string data;
+    pb_data.SerializeToString(&data);
+    std::unique_ptr<Message> message(prototype->New());
+    message->ParseFromString(data);
+
+    std::string out;
+    TimeCost cost;
+    for (int i = 0; i < count; ++i) {
+        message->SerializeToString(&out);
+    }
+    int64_t pb_encode = cost.get_time();
+    cost.reset();
+    for (int i = 0; i < count; ++i) {
+        codec->encode(*message, &out);
+    }
+    int64_t codec_encode = cost.get_time();
+    EXPECT_EQ(data, out);
+
+    cost.reset();
+    for (int i = 0; i < count; ++i) {
+        message->ParseFromString(data);
+    }
+    int64_t pb_decode = cost.get_time();
+    cost.reset();
+    for (int i = 0; i < count; ++i) {
+        codec->decode(data.data(), data.size(), message.get());
+    }
+    int64_t codec_decode = cost.get_time();
+    EXPECT_EQ(pb_data.ShortDebugString(), message->ShortDebugString());
+    DB_NOTICE("rows:%d encode pb:%ld codec:%ld, decode pb:%ld codec:%ld",
+            count, pb_encode, codec_encode, pb_decode, codec_decode);
+}
+
+}  // namespace baikaldb
@@ -0,0 +1,123 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <unistd.h>
+#include "select_cursor.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+static SmartSelectCursor make_cursor(uint64_t db_conn_id) {
+    SmartSelectCursor cursor = std::make_shared<SelectCursor>();
+    cursor->db_conn_id = db_conn_id;
+    return cursor;
+}
+
+class SelectCursorTest : public testing::Test {
+protected:
+    void TearDown() override {
+        FLAGS_select_cursor_timeout_s = 60;
+        FLAGS_select_cursor_max_per_region = 16;
+    }
+};
+
+// 续读独占取出游标, 重复的续读和其他连接的请求都拿不到
+TEST_F(SelectCursorTest, take) {
+    SelectCursorMap cursors;
+    SmartSelectCursor cursor = make_cursor(100);
+    ASSERT_EQ(12345u, cursors.add(12345, cursor));
+    EXPECT_EQ(nullptr, cursors.take(12345, 101));
+    EXPECT_EQ(nullptr, cursors.take(54321, 100));
+    EXPECT_EQ(cursor, cursors.take(12345, 100));
+    EXPECT_EQ(nullptr, cursors.take(12345, 100));
+    cursors.put_back(12345, cursor);
+    EXPECT_EQ(cursor, cursors.take(12345, 100));
+
+    // 未指定id或id冲突时随机生成
+    uint64_t id1 = cursors.add(0, make_cursor(100));
+    EXPECT_NE(0u, id1);
+    uint64_t id2 = cursors.add(id1, make_cursor(100));
+    EXPECT_NE(0u, id2);
+    EXPECT_NE(id1, id2);
+    EXPECT_EQ(2u, cursors.size());
+}
+
+// backup request落败的一端: 关闭先于首页建立游标到达
+TEST_F(SelectCursorTest, close_before_add) {
+    SelectCursorMap cursors;
+    EXPECT_EQ(nullptr, cursors.close(777, 100));
+    EXPECT_EQ(0u, cursors.add(777, make_cursor(100)));
+    EXPECT_EQ(0u, cursors.size());
+    // 已关闭的id只拦截一次
+    EXPECT_EQ(777u, cursors.add(777, make_cursor(100)));
+
+    // 建立后关闭, 其他连接不能关闭
+    EXPECT_EQ(nullptr, cursors.close(777, 101));
+    EXPECT_EQ(1u, cursors.size());
+    EXPECT_NE(nullptr, cursors.close(777, 100));
+    EXPECT_EQ(0u, cursors.size());
+    // 续读中的游标不在表里, 关闭只记下id
+    SmartSelectCursor cursor = make_cursor(100);
+    ASSERT_EQ(888u, cursors.add(888, cursor));
+    ASSERT_EQ(cursor, cursors.take(888, 100));
+    EXPECT_EQ(nullptr, cursors.close(888, 100));
+}
+
+// 空闲超时的游标和已关闭id被清理, 之后的续读拿不到游标
+TEST_F(SelectCursorTest, expire) {
+    SelectCursorMap cursors;
+    SmartSelectCursor idle = make_cursor(100);
+    ASSERT_EQ(1u, cursors.add(1, idle));
+    cursors.close(3, 100);
+    std::vector<SmartSelectCursor> expired;
+    cursors.clear(true, &expired);
+    EXPECT_TRUE(expired.empty());
+
+    FLAGS_select_cursor_timeout_s = 1;
+    SmartSelectCursor active = make_cursor(100);
+    ASSERT_EQ(2u, cursors.add(2, active));
+    usleep(1100 * 1000);
+    // 刚续读过的游标不超时
+    cursors.put_back(2, cursors.take(2, 100));
+    cursors.clear(true, &expired);
+    ASSERT_EQ(1u, expired.size());
+    EXPECT_EQ(idle, expired[0]);
+    EXPECT_EQ(nullptr, cursors.take(1, 100));
+    // 已关闭id过期后不再拦截
+    EXPECT_EQ(3u, cursors.add(3, make_cursor(100)));
+
+    expired.clear();
+    cursors.clear(false, &expired);
+    EXPECT_EQ(2u, expired.size());
+    EXPECT_EQ(0u, cursors.size());
+}
+
+// 超过上限不再分页
+TEST_F(SelectCursorTest, max_per_region) {
+    FLAGS_select_cursor_max_per_region = 2;
+    SelectCursorMap cursors;
+    EXPECT_TRUE(cursors.can_add());
+    cursors.add(1, make_cursor(100));
+    EXPECT_TRUE(cursors.can_add());
+    cursors.add(2, make_cursor(100));
+    EXPECT_FALSE(cursors.can_add());
+    cursors.take(1, 100);
+    EXPECT_TRUE(cursors.can_add());
+}
+}  // namespace baikaldb
@@ -0,0 +1,265 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <random>
+#include <set>
+#include <algorithm>
+#include <vector>
+#ifdef BAIDU_INTERNAL
+#include <base/file_util.h>
+#else
+#include <butil/file_util.h>
+#endif
+#include "sorter.h"
+#include "expr_node.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+static const std::string TEST_SPILL_DIR = "./test_sorter_spill";
+
+// tuple 0: slot 1 INT64排序列, slot 2 STRING排序列, slot 3 INT64行号
+// 两个排序列都有大量重复值和null
+class SorterTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_spill_dir = TEST_SPILL_DIR;
+        pb::TupleDescriptor tuple;
+        tuple.set_tuple_id(0);
+        tuple.set_table_id(1);
+        pb::PrimitiveType types[] = {pb::INT64, pb::STRING, pb::INT64};
+        for (int slot_id = 1; slot_id <= 3; ++slot_id) {
+            pb::SlotDescriptor* slot = tuple.add_slots();
+            slot->set_slot_id(slot_id);
+            slot->set_tuple_id(0);
+            slot->set_slot_type(types[slot_id - 1]);
+        }
+        std::vector<pb::TupleDescriptor> tuple_descs = {tuple};
+        ASSERT_EQ(0, _desc.init(tuple_descs));
+        for (int slot_id = 1; slot_id <= 2; ++slot_id) {
+            pb::Expr expr;
+            pb::ExprNode* node = expr.add_nodes();
+            node->set_node_type(pb::SLOT_REF);
+            node->set_col_type(types[slot_id - 1]);
+            node->set_num_children(0);
+            node->mutable_derive_node()->set_tuple_id(0);
+            node->mutable_derive_node()->set_slot_id(slot_id);
+            ExprNode* slot_ref = nullptr;
+            ASSERT_EQ(0, ExprNode::create_tree(expr, &slot_ref));
+            ASSERT_EQ(0, slot_ref->open());
+            _order_exprs.push_back(slot_ref);
+        }
+    }
+    void TearDown() override {
+        for (auto expr : _order_exprs) {
+            expr->close();
+            delete expr;
+        }
+        butil::DeleteFile(butil::FilePath(TEST_SPILL_DIR), true);
+    }
+
+    std::unique_ptr<MemRow> make_row(int64_t id, std::mt19937* rand) {
+        std::unique_ptr<MemRow> row = _desc.fetch_mem_row();
+        if ((*rand)() % 10 != 0) {
+            ExprValue v1(pb::INT64);
+            v1._u.int64_val = (int64_t)((*rand)() % 20) - 10;
+            row->set_value(0, 1, v1);
+        }
+        if ((*rand)() % 7 != 0) {
+            ExprValue v2(pb::STRING);
+            v2.str_val = std::string((*rand)() % 3, 'a' + (*rand)() % 3);
+            row->set_value(0, 2, v2);
+        }
+        ExprValue v3(pb::INT64);
+        v3._u.int64_val = id;
+        row->set_value(0, 3, v3);
+        return row;
+    }
+
+    // 生成num_batches个batch, 同时在expect中保留一份拷贝
+    std::vector<std::shared_ptr<RowBatch>> make_batches(int num_batches, int batch_rows,
+            std::vector<std::unique_ptr<MemRow>>* expect) {
+        std::mt19937 rand(num_batches * 1000 + batch_rows);
+        std::vector<std::shared_ptr<RowBatch>> batches;
+        int64_t id = 0;
+        for (int i = 0; i < num_batches; ++i) {
+            std::shared_ptr<RowBatch> batch = std::make_shared<RowBatch>();
+            // 行数不同的batch, 包括空batch
+            int rows = i % 5 == 4 ? 0 : batch_rows - i % 3;
+            for (int j = 0; j < rows; ++j) {
+                std::unique_ptr<MemRow> row = make_row(id++, &rand);
+                std::string buf;
+                row->serialize(&buf);
+                std::unique_ptr<MemRow> copy = _desc.fetch_mem_row();
+                EXPECT_EQ(0, copy->deserialize(buf.data(), buf.size()));
+                expect->push_back(std::move(copy));
+                batch->move_row(std::move(row));
+            }
+            batches.push_back(batch);
+        }
+        return batches;
+    }
+
+    std::vector<std::unique_ptr<MemRow>> read_all(Sorter* sorter) {
+        std::vector<std::unique_ptr<MemRow>> rows;
+        bool eos = false;
+        while (!eos) {
+            RowBatch batch;
+            EXPECT_EQ(0, sorter->get_next(&batch, &eos));
+            for (batch.reset(); !batch.is_traverse_over(); batch.next()) {
+                rows.push_back(std::move(batch.get_row()));
+            }
+        }
+        return rows;
+    }
+
+    // 排序不稳定, 相等的行顺序不定: 逐行比较排序列, 再比较行号集合
+    void expect_sorted_eq(MemRowCompare* comp, std::vector<std::unique_ptr<MemRow>>& expect,
+            std::vector<std::unique_ptr<MemRow>>& rows, size_t limit) {
+        std::stable_sort(expect.begin(), expect.end(), comp->get_less_func());
+        size_t num = std::min(limit, expect.size());
+        ASSERT_EQ(num, rows.size());
+        for (size_t i = 0; i < num; ++i) {
+            EXPECT_EQ(0, comp->compare(expect[i].get(), rows[i].get())) << i;
+            if (i > 0) {
+                EXPECT_LE(comp->compare(rows[i - 1].get(), rows[i].get()), 0) << i;
+            }
+        }
+        // 最后一组相等的行可能被limit截断, 只比较截断前的完整分组
+        size_t full = num;
+        while (full > 0 && num < expect.size()
+                && comp->compare(expect[full - 1].get(), expect[num].get()) == 0) {
+            --full;
+        }
+        std::set<int64_t> expect_ids;
+        std::set<int64_t> ids;
+        for (size_t i = 0; i < full; ++i) {
+            expect_ids.insert(expect[i]->get_value(0, 3).get_numberic<int64_t>());
+            ids.insert(rows[i]->get_value(0, 3).get_numberic<int64_t>());
+        }
+        EXPECT_EQ(expect_ids, ids);
+    }
+
+    MemRowDescriptor _desc;
+    std::vector<ExprNode*> _order_exprs;
+};
+
+// 多个有序run落盘后归并, 与内存排序结果一致
+TEST_F(SorterTest, spill_merge) {
+    for (bool asc : {true, false}) {
+        for (bool null_first : {true, false}) {
+            for (int spill_every : {1, 3, 100}) {
+                std::vector<bool> is_asc = {asc, !asc};
+                std::vector<bool> is_null_first = {null_first, !null_first};
+                MemRowCompare comp(_order_exprs, is_asc, is_null_first);
+                std::vector<std::unique_ptr<MemRow>> expect;
+                auto batches = make_batches(17, 300, &expect);
+                Sorter sorter(&comp);
+                sorter.set_spill_row_desc(&_desc);
+                for (size_t i = 0; i < batches.size(); ++i) {
+                    if (batches[i]->size() > 0) {
+                        sorter.add_batch(batches[i]);
+                    }
+                    if ((i + 1) % spill_every == 0) {
+                        ASSERT_EQ(0, sorter.spill());
+                    }
+                }
+                if (spill_every < 100) {
+                    ASSERT_TRUE(sorter.is_spilled());
+                    ASSERT_EQ(0, sorter.prepare_merge_runs());
+                } else {
+                    // 未落盘时走内存归并
+                    ASSERT_FALSE(sorter.is_spilled());
+                    sorter.sort();
+                }
+                auto rows = read_all(&sorter);
+                expect_sorted_eq(&comp, expect, rows, expect.size());
+            }
+        }
+    }
+}
+
+// 落盘后只剩一个run或空run
+TEST_F(SorterTest, spill_edge) {
+    std::vector<bool> is_asc = {true, true};
+    std::vector<bool> is_null_first = {true, true};
+    MemRowCompare comp(_order_exprs, is_asc, is_null_first);
+    {
+        std::vector<std::unique_ptr<MemRow>> expect;
+        auto batches = make_batches(1, 500, &expect);
+        Sorter sorter(&comp);
+        sorter.set_spill_row_desc(&_desc);
+        sorter.add_batch(batches[0]);
+        ASSERT_EQ(0, sorter.spill());
+        // 没有新的batch, 不产生空run
+        ASSERT_EQ(0, sorter.spill());
+        ASSERT_EQ(0, sorter.prepare_merge_runs());
+        auto rows = read_all(&sorter);
+        expect_sorted_eq(&comp, expect, rows, expect.size());
+    }
+    {
+        Sorter sorter(&comp);
+        sorter.set_spill_row_desc(&_desc);
+        ASSERT_EQ(0, sorter.prepare_merge_runs());
+        EXPECT_FALSE(sorter.is_spilled());
+        EXPECT_TRUE(read_all(&sorter).empty());
+    }
+    {
+        // 没有设置row desc时不能落盘
+        std::vector<std::unique_ptr<MemRow>> expect;
+        auto batches = make_batches(1, 10, &expect);
+        Sorter sorter(&comp);
+        sorter.add_batch(batches[0]);
+        EXPECT_EQ(-1, sorter.spill());
+    }
+}
+
+// Top-N只保留前n行, 与全量排序后取前n行一致, 包括n落在一组相等行中间的情况
+TEST_F(SorterTest, top_n) {
+    for (bool asc : {true, false}) {
+        for (bool null_first : {true, false}) {
+            for (int64_t limit : {1, 2, 37, 300, 4000, 10000}) {
+                std::vector<bool> is_asc = {asc, asc};
+                std::vector<bool> is_null_first = {null_first, null_first};
+                MemRowCompare comp(_order_exprs, is_asc, is_null_first);
+                std::vector<std::unique_ptr<MemRow>> expect;
+                auto batches = make_batches(17, 300, &expect);
+                Sorter sorter(&comp);
+                sorter.set_top_n(limit);
+                for (auto& batch : batches) {
+                    sorter.add_top_n_batch(*batch);
+                }
+                sorter.sort();
+                auto rows = read_all(&sorter);
+                expect_sorted_eq(&comp, expect, rows, limit);
+            }
+        }
+    }
+    // 没有输入
+    std::vector<bool> is_asc = {true, true};
+    std::vector<bool> is_null_first = {true, true};
+    MemRowCompare comp(_order_exprs, is_asc, is_null_first);
+    Sorter sorter(&comp);
+    sorter.set_top_n(10);
+    RowBatch empty;
+    sorter.add_top_n_batch(empty);
+    sorter.sort();
+    EXPECT_TRUE(read_all(&sorter).empty());
+}
+}  // namespace baikaldb
@@ -0,0 +1,263 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include "rocksdb_file_system_adaptor.h"
+#include "mut_table_key.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_string(db_path);
+static const std::string TEST_DIR = "./test_sst_files_stream";
+
+static std::string make_content(size_t size, char seed) {
+    std::string content;
+    content.reserve(size);
+    for (size_t i = 0; i < size; ++i) {
+        content.push_back(seed + i % 23);
+    }
+    return content;
+}
+
+static void write_file(const std::string& path, const std::string& content) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(content.data(), content.size());
+}
+
+static std::string read_file(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// 两个分区共3个文件, 按不同的包大小读出再写入, 接收端文件与发送端一致
+TEST(test_sst_files_stream, round_trip) {
+    butil::DeleteFile(butil::FilePath(TEST_DIR), true);
+    butil::CreateDirectory(butil::FilePath(TEST_DIR));
+    std::vector<std::string> contents = {
+        make_content(1000, 'a'), make_content(1, 'b'), make_content(4097, 'c')};
+    for (size_t packet_size : {1, 7, 8, 100, 10000}) {
+        SstFilesContext context;
+        context.partitions.resize(2);
+        for (size_t i = 0; i < contents.size(); ++i) {
+            SstFilesContext::SstFile file;
+            file.path = TEST_DIR + "/send" + std::to_string(i);
+            file.size = contents[i].size();
+            write_file(file.path, contents[i]);
+            context.partitions[i == 0 ? 0 : 1].files.push_back(file);
+        }
+        // 生成完的文件按key序可读, 第一个分区未生成完时读不到后面分区的文件
+        context.partitions[1].done = true;
+        context.publish();
+        EXPECT_FALSE(context.done);
+        EXPECT_EQ(1U, context.files.size());
+        context.partitions[0].done = true;
+        context.publish();
+        ASSERT_TRUE(context.done);
+        ASSERT_EQ(contents.size(), context.files.size());
+        int64_t total_size = 0;
+        for (auto& content : contents) {
+            total_size += sizeof(uint64_t) + content.size();
+        }
+        EXPECT_EQ(total_size, context.total_size);
+
+        SstFilesStreamReader reader;
+        SstFilesStreamWriter writer(0, TEST_DIR + "/recv");
+        int64_t offset = 0;
+        while (offset < context.total_size) {
+            butil::IOPortal portal;
+            ssize_t count = reader.read(context.files, &portal, offset, packet_size);
+            ASSERT_GT(count, 0);
+            ASSERT_EQ(count, (ssize_t)portal.size());
+            ASSERT_EQ(0, writer.write(portal));
+            offset += count;
+        }
+        EXPECT_EQ(context.total_size, offset);
+        // 流结尾之后读不到数据
+        butil::IOPortal portal;
+        EXPECT_EQ(0, reader.read(context.files, &portal, offset, packet_size));
+        EXPECT_TRUE(writer.close());
+        ASSERT_EQ((int)contents.size(), writer.file_num());
+        for (size_t i = 0; i < contents.size(); ++i) {
+            EXPECT_EQ(contents[i], read_file(TEST_DIR + "/recv" + std::to_string(i)));
+        }
+    }
+    butil::DeleteFile(butil::FilePath(TEST_DIR), true);
+}
+
+// 流在文件中间断开时删除不完整的文件
+TEST(test_sst_files_stream, incomplete) {
+    butil::DeleteFile(butil::FilePath(TEST_DIR), true);
+    butil::CreateDirectory(butil::FilePath(TEST_DIR));
+    std::string content = make_content(100, 'x');
+    SstFilesContext context;
+    context.partitions.resize(1);
+    SstFilesContext::SstFile file;
+    file.path = TEST_DIR + "/send0";
+    file.size = content.size();
+    write_file(file.path, content);
+    context.partitions[0].files.push_back(file);
+    context.partitions[0].done = true;
+    context.publish();
+
+    SstFilesStreamReader reader;
+    SstFilesStreamWriter writer(0, TEST_DIR + "/recv");
+    butil::IOPortal portal;
+    ASSERT_EQ(50, reader.read(context.files, &portal, 0, 50));
+    ASSERT_EQ(0, writer.write(portal));
+    EXPECT_FALSE(writer.close());
+    EXPECT_EQ(0, writer.file_num());
+    EXPECT_FALSE(butil::PathExists(butil::FilePath(TEST_DIR + "/recv0")));
+    butil::DeleteFile(butil::FilePath(TEST_DIR), true);
+}
+
+static std::string make_key(int64_t region_id, int64_t index_id, int64_t pk) {
+    MutTableKey key;
+    key.append_i64(region_id).append_i64(index_id).append_i64(pk);
+    return key.data();
+}
+
+typedef std::map<std::string, std::string> KVMap;
+
+static KVMap scan_region(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* handle,
+                         const rocksdb::Snapshot* snapshot, int64_t region_id) {
+    MutTableKey lower;
+    lower.append_i64(region_id);
+    MutTableKey upper;
+    upper.append_i64(region_id + 1);
+    rocksdb::Slice upper_slice = upper.data();
+    rocksdb::ReadOptions read_options;
+    read_options.snapshot = snapshot;
+    read_options.total_order_seek = true;
+    read_options.iterate_upper_bound = &upper_slice;
+    std::unique_ptr<rocksdb::Iterator> iter(db->NewIterator(read_options, handle));
+    KVMap kvs;
+    for (iter->Seek(lower.data()); iter->Valid(); iter->Next()) {
+        kvs[iter->key().ToString()] = iter->value().ToString();
+    }
+    EXPECT_TRUE(iter->status().ok());
+    return kvs;
+}
+
+// leader按index生成sst, 经流发送到新peer的快照目录并ingest, 新peer的数据与leader快照一致
+TEST(test_sst_files_stream, install_on_new_peer) {
+    const int64_t region_id = 10;
+    const std::string leader_path = TEST_DIR + "/leader";
+    const std::string peer_path = TEST_DIR + "/peer";
+    const std::string peer_snapshot_path = TEST_DIR + "/peer_snapshot";
+    butil::DeleteFile(butil::FilePath(TEST_DIR), true);
+    butil::CreateDirectory(butil::FilePath(peer_snapshot_path), true);
+    FLAGS_db_path = leader_path;
+    RocksWrapper* leader = RocksWrapper::get_instance();
+    ASSERT_EQ(0, leader->init(leader_path));
+    rocksdb::ColumnFamilyHandle* data_cf = leader->get_data_handle();
+
+    rocksdb::WriteOptions write_options;
+    // 相邻region的数据不能发送
+    for (int64_t neighbor : {region_id - 1, region_id + 1}) {
+        for (int64_t pk = 0; pk < 10; ++pk) {
+            ASSERT_TRUE(leader->put(write_options, data_cf, make_key(neighbor, 1, pk), "x").ok());
+        }
+    }
+    // 3个index, 主键和二级索引的值大小不同
+    for (int64_t index_id : {1, 2, 5}) {
+        for (int64_t pk = 0; pk < 2000; ++pk) {
+            std::string value = make_content(index_id == 1 ? 200 + pk % 50 : 0, 'a' + pk % 20);
+            ASSERT_TRUE(leader->put(write_options, data_cf, make_key(region_id, index_id, pk),
+                        value).ok());
+        }
+    }
+    // 删除的数据不能出现在新peer上
+    for (int64_t pk = 0; pk < 2000; pk += 7) {
+        ASSERT_TRUE(leader->remove(write_options, data_cf, make_key(region_id, 2, pk)).ok());
+    }
+    ASSERT_TRUE(leader->flush(rocksdb::FlushOptions(), data_cf).ok());
+    for (int64_t pk = 2000; pk < 2100; ++pk) {
+        ASSERT_TRUE(leader->put(write_options, data_cf, make_key(region_id, 5, pk), "memtable").ok());
+    }
+
+    SnapshotContextPtr sc(new SnapshotContext);
+    KVMap leader_kvs = scan_region(leader->get_db(), data_cf, sc->snapshot, region_id);
+    ASSERT_EQ(3 * 2000 + 100 - 286, (int)leader_kvs.size());
+    // 快照之后的写入不属于这个快照
+    ASSERT_TRUE(leader->put(write_options, data_cf, make_key(region_id, 1, 0), "after").ok());
+    ASSERT_TRUE(leader->put(write_options, data_cf, make_key(region_id, 3, 0), "after").ok());
+    ASSERT_TRUE(leader->remove(write_options, data_cf, make_key(region_id, 5, 1)).ok());
+
+    SstFilesContextPtr context(new SstFilesContext);
+    sc->sst_files_context = context;
+    ASSERT_EQ(0, init_sst_partitions(sc->snapshot, region_id, context.get()));
+    ASSERT_EQ(3U, context->partitions.size());
+    for (size_t i = 0; i < context->partitions.size(); ++i) {
+        build_sst_files(sc, context, i, region_id, 0);
+    }
+    std::vector<std::string> built_files;
+    {
+        BAIDU_SCOPED_LOCK(context->mutex);
+        ASSERT_FALSE(context->failed);
+        ASSERT_TRUE(context->done);
+        ASSERT_EQ(3U, context->files.size());
+        for (auto& file : context->files) {
+            built_files.push_back(file.path);
+        }
+    }
+
+    // 新peer接收流, 文件名与SstFilesWriterAdaptor一致
+    SstFilesStreamReader reader;
+    SstFilesStreamWriter writer(region_id, peer_snapshot_path + "/" + SNAPSHOT_DATA_FILE);
+    int64_t offset = 0;
+    while (offset < context->total_size) {
+        butil::IOPortal portal;
+        ssize_t count = reader.read(context->files, &portal, offset, 4096);
+        ASSERT_GT(count, 0);
+        ASSERT_EQ(0, writer.write(portal));
+        offset += count;
+    }
+    ASSERT_TRUE(writer.close());
+    ASSERT_EQ(3, writer.file_num());
+
+    rocksdb::Options peer_options = leader->get_options(data_cf);
+    peer_options.create_if_missing = true;
+    rocksdb::DB* peer_db = nullptr;
+    ASSERT_TRUE(rocksdb::DB::Open(peer_options, peer_path, &peer_db).ok());
+    std::unique_ptr<rocksdb::DB> peer(peer_db);
+    for (int i = 0; i < writer.file_num(); ++i) {
+        rocksdb::IngestExternalFileOptions ingest_options;
+        std::string file = peer_snapshot_path + "/" + SNAPSHOT_DATA_FILE + std::to_string(i);
+        auto s = peer->IngestExternalFile(peer->DefaultColumnFamily(), {file}, ingest_options);
+        ASSERT_TRUE(s.ok()) << s.ToString();
+    }
+    EXPECT_EQ(leader_kvs, scan_region(peer.get(), peer->DefaultColumnFamily(), nullptr, region_id));
+    EXPECT_TRUE(scan_region(peer.get(), peer->DefaultColumnFamily(), nullptr, region_id - 1).empty());
+    EXPECT_TRUE(scan_region(peer.get(), peer->DefaultColumnFamily(), nullptr, region_id + 1).empty());
+
+    // 快照关闭后删除leader上生成的文件
+    sc.reset();
+    context.reset();
+    for (auto& path : built_files) {
+        EXPECT_FALSE(butil::PathExists(butil::FilePath(path)));
+    }
+    peer.reset();
+    butil::DeleteFile(butil::FilePath(TEST_DIR), true);
+}
+}  // namespace baikaldb
@@ -0,0 +1,227 @@
+// Copyright (c) 2018-present Baidu, Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <set>
+#include <brpc/server.h>
+#include "store_plan_cache.h"
+#include "fetcher_store.h"
+#include "query_context.h"
+#include "network_socket.h"
+#include "schema_factory.h"
+
+int main(int argc, char* argv[])
+{
+    testing::InitGoogleTest(&argc, argv);
+    baikaldb::SchemaFactory::get_instance()->init();
+    return RUN_ALL_TESTS();
+}
+
+namespace baikaldb {
+DECLARE_bool(fetcher_follower_read);
+static const int64_t TEST_TABLE_ID = 3001;
+
+// 模拟带计划模板缓存的store, 记录收到的请求
+class FakeStoreService : public pb::StoreService {
+public:
+    virtual void query(google::protobuf::RpcController* controller,
+            const pb::StoreReq* request,
+            pb::StoreRes* response,
+            google::protobuf::Closure* done) {
+        brpc::ClosureGuard done_guard(done);
+        BAIDU_SCOPED_LOCK(mutex);
+        requests.push_back(*request);
+        if (!request->has_plan()) {
+            if (request->plan_sign() == 0 || cached_signs.count(request->plan_sign()) == 0) {
+                response->set_errcode(pb::PLAN_NOT_CACHED);
+                return;
+            }
+        } else if (request->plan_sign() != 0) {
+            cached_signs.insert(request->plan_sign());
+            response->set_plan_cached(true);
+        }
+        response->set_errcode(pb::SUCCESS);
+    }
+
+    bthread::Mutex mutex;
+    std::set<uint64_t> cached_signs;
+    std::vector<pb::StoreReq> requests;
+};
+
+class StorePlanCacheTest : public testing::Test {
+protected:
+    void SetUp() override {
+        FLAGS_enable_store_plan_cache = true;
+        FLAGS_fetcher_follower_read = false;
+        pb::SchemaInfo info;
+        info.set_namespace_name("test_namespace");
+        info.set_database("test_db");
+        info.set_table_name("store_plan_cache_t");
+        info.set_partition_num(1);
+        info.set_namespace_id(111);
+        info.set_database_id(222);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_version(1);
+        pb::FieldInfo* field = info.add_fields();
+        field->set_field_name("id");
+        field->set_field_id(1);
+        field->set_mysql_type(pb::INT64);
+        pb::IndexInfo* index_pk = info.add_indexs();
+        index_pk->set_index_type(pb::I_PRIMARY);
+        index_pk->set_index_name("pk_index");
+        index_pk->add_field_ids(1);
+        index_pk->set_index_id(TEST_TABLE_ID);
+        SchemaFactory::get_instance()->update_table(info);
+
+        _tuple.set_tuple_id(0);
+        _tuple.set_table_id(TEST_TABLE_ID);
+        pb::SlotDescriptor* slot = _tuple.add_slots();
+        slot->set_slot_id(1);
+        slot->set_tuple_id(0);
+        slot->set_slot_type(pb::INT64);
+        slot->set_field_id(1);
+    }
+    void TearDown() override {
+        FLAGS_enable_store_plan_cache = false;
+        FLAGS_fetcher_follower_read = true;
+    }
+
+    // 单个scan node的plan, indexes为该region的索引范围
+    pb::Plan scan_plan(const std::vector<std::string>& indexes) {
+        pb::Plan plan;
+        pb::PlanNode* node = plan.add_nodes();
+        node->set_node_type(pb::SCAN_NODE);
+        node->set_num_children(0);
+        node->set_limit(-1);
+        pb::ScanNode* scan_node = node->mutable_derive_node()->mutable_scan_node();
+        scan_node->set_tuple_id(0);
+        scan_node->set_table_id(TEST_TABLE_ID);
+        scan_node->set_engine(pb::ROCKSDB);
+        for (auto& index : indexes) {
+            scan_node->add_indexes(index);
+        }
+        return plan;
+    }
+
+    pb::TupleDescriptor _tuple;
+};
+
+// store端: 模板加入缓存后, 只带签名和索引范围的请求可以补全为完整请求
+TEST_F(StorePlanCacheTest, template_round_trip) {
+    StorePlanCache* cache = StorePlanCache::get_instance();
+    pb::StoreReq full;
+    full.set_op_type(pb::OP_SELECT);
+    full.set_region_id(1);
+    full.mutable_plan()->CopyFrom(scan_plan({"a", "b"}));
+    full.add_tuples()->CopyFrom(_tuple);
+
+    pb::Plan plan = full.plan();
+    google::protobuf::RepeatedPtrField<std::string> scan_indexes;
+    uint64_t sign = StorePlanCache::make_template_sign(&plan, full.tuples(), &scan_indexes);
+    ASSERT_NE(0u, sign);
+    ASSERT_EQ(2, scan_indexes.size());
+    EXPECT_EQ(0, plan.nodes(0).derive_node().scan_node().indexes_size());
+    // 索引范围不同的plan模板相同
+    pb::Plan other_plan = scan_plan({"c"});
+    google::protobuf::RepeatedPtrField<std::string> other_indexes;
+    EXPECT_EQ(sign, StorePlanCache::make_template_sign(&other_plan, full.tuples(), &other_indexes));
+    StorePlanCache::restore_scan_indexes(&plan, &scan_indexes);
+    EXPECT_EQ(full.plan().SerializeAsString(), plan.SerializeAsString());
+
+    // 签名不一致不缓存
+    full.set_plan_sign(sign + 1);
+    EXPECT_FALSE(cache->add_template(full));
+    full.set_plan_sign(sign);
+    ASSERT_TRUE(cache->add_template(full));
+
+    pb::StoreReq stripped;
+    stripped.set_op_type(pb::OP_SELECT);
+    stripped.set_region_id(2);
+    stripped.set_plan_sign(sign);
+    stripped.add_scan_indexes("c");
+    pb::StoreReq filled;
+    ASSERT_EQ(0, cache->fill_request(stripped, &filled));
+    EXPECT_EQ(2, filled.region_id());
+    EXPECT_EQ(scan_plan({"c"}).SerializeAsString(), filled.plan().SerializeAsString());
+    ASSERT_EQ(1, filled.tuples_size());
+    EXPECT_EQ(_tuple.SerializeAsString(), filled.tuples(0).SerializeAsString());
+    EXPECT_EQ(0, filled.scan_indexes_size());
+
+    stripped.set_plan_sign(sign + 1);
+    EXPECT_EQ(-1, cache->fill_request(stripped, &filled));
+    stripped.set_plan_sign(0);
+    EXPECT_EQ(-1, cache->fill_request(stripped, &filled));
+    // 没有scan node的plan不走缓存
+    pb::Plan empty_plan;
+    EXPECT_EQ(0u, StorePlanCache::make_template_sign(&empty_plan, full.tuples(), &scan_indexes));
+}
+
+// baikaldb端: store确认缓存后只发签名, store返回PLAN_NOT_CACHED时立即带完整plan重发
+TEST_F(StorePlanCacheTest, plan_not_cached_resend) {
+    FakeStoreService service;
+    brpc::Server server;
+    ASSERT_EQ(0, server.AddService(&service, brpc::SERVER_DOESNT_OWN_SERVICE));
+    ASSERT_EQ(0, server.Start(butil::PortRange(18000, 19000), nullptr));
+    std::string addr = "127.0.0.1:" + std::to_string(server.listen_address().port);
+
+    NetworkSocket conn;
+    QueryContext ctx;
+    ctx.mutable_tuple_descs()->push_back(_tuple);
+    ctx.client_conn = &conn;
+    RuntimeState state;
+    ASSERT_EQ(0, state.init(&ctx, nullptr));
+    ExecNode* store_request = nullptr;
+    ASSERT_EQ(0, ExecNode::create_tree(scan_plan({}), &store_request));
+
+    auto run_select = [&]() {
+        std::map<int64_t, pb::RegionInfo> region_infos;
+        pb::RegionInfo& info = region_infos[1];
+        info.set_region_id(1);
+        info.set_table_id(TEST_TABLE_ID);
+        info.set_version(1);
+        info.set_leader(addr);
+        info.add_peers(addr);
+        FetcherStore fetcher;
+        EXPECT_EQ(0, fetcher.run(&state, region_infos, store_request, 0, 0, pb::OP_SELECT));
+        EXPECT_EQ(E_OK, fetcher.error.load());
+    };
+    // 第一次带完整plan, store确认缓存
+    run_select();
+    // 之后只发签名
+    run_select();
+    // store淘汰了模板(或重启), 只发签名被拒绝后带完整plan重发
+    {
+        BAIDU_SCOPED_LOCK(service.mutex);
+        service.cached_signs.clear();
+    }
+    run_select();
+    run_select();
+
+    BAIDU_SCOPED_LOCK(service.mutex);
+    ASSERT_EQ(5u, service.requests.size());
+    std::vector<bool> has_plan = {true, false, false, true, false};
+    uint64_t sign = service.requests[0].plan_sign();
+    ASSERT_NE(0u, sign);
+    for (size_t i = 0; i < service.requests.size(); ++i) {
+        auto& request = service.requests[i];
+        EXPECT_EQ(sign, request.plan_sign()) << i;
+        EXPECT_EQ(has_plan[i], request.has_plan()) << i;
+        EXPECT_EQ(has_plan[i], request.tuples_size() > 0) << i;
+        EXPECT_EQ(1, request.region_id()) << i;
+    }
+    server.Stop(0);
+    server.Join();
+    ExecNode::destroy_tree(store_request);
+}
+}  // namespace baikaldb
@@ -87,4 +87,41 @@ TEST(test_compare, case_all) {
     }
 }
 
+TEST(test_decode_plan, projection) {
+    TestTupleRecord pb_data;
+    pb_data.set_col1(-1);
+    pb_data.set_col2(-10);
+    pb_data.set_col9(-14);
+    pb_data.set_col12(15.1333);
+    pb_data.set_col14("abcd");
+    std::string data;
+    pb_data.SerializeToString(&data);
+    // 只取col2/col5/col12, col5不在行里填默认值
+    std::map<int32_t, FieldInfo*> fields;
+    for (int i : {2, 5, 12}) {
+        fields[i] = new FieldInfo;
+        fields[i]->pb_idx = i - 1;
+    }
+    fields[5]->default_expr_value = ExprValue(pb::INT32, "7");
+    TupleDecodePlan plan;
+    for (int row = 0; row < 2; ++row) {
+        TestTupleRecord* pb_decode = new TestTupleRecord;
+        SmartRecord record = SmartRecord(new TableRecord(pb_decode));
+        if (!plan.match(pb_decode)) {
+            ASSERT_EQ(0, plan.init(fields, nullptr, &record, 0, nullptr));
+        }
+        ASSERT_EQ(3, plan.items.size());
+        TupleRecord tuple(data);
+        ASSERT_EQ(0, tuple.decode_fields(plan, pb_decode, nullptr));
+        EXPECT_EQ(pb_data.col2(), pb_decode->col2());
+        EXPECT_EQ(7, pb_decode->col5());
+        EXPECT_EQ(pb_data.col12(), pb_decode->col12());
+        EXPECT_FALSE(pb_decode->has_col1());
+        EXPECT_FALSE(pb_decode->has_col14());
+    }
+    for (auto& pair : fields) {
+        delete pair.second;
+    }
+}
+
 }  // namespace baikal